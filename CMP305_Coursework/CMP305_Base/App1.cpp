@@ -3,6 +3,7 @@
 App1::App1()
 {
 	m_Terrain = nullptr;
+	terrainStreamer = nullptr;
 	light = nullptr;
 	tessellationShader = nullptr;
 }
@@ -26,6 +27,7 @@ void App1::init(HINSTANCE hinstance, HWND hwnd, int screenWidth, int screenHeigh
 	// Create Mesh object and shader object
 	m_Terrain = new TerrainMesh(renderer->getDevice(), renderer->getDeviceContext(), XMINT2(128, 128));
 	tessellationShader = new TessellationShader(renderer->getDevice(), hwnd);
+	terrainStreamer = new TerrainStreamer(renderer->getDevice());
 	
 	// Initialise light
 	light = new Light();
@@ -36,10 +38,61 @@ void App1::init(HINSTANCE hinstance, HWND hwnd, int screenWidth, int screenHeigh
 	// get current terrain Resolution
 	provisionalResolution[0] = m_Terrain->GetResolution().x;
 	provisionalResolution[1] = m_Terrain->GetResolution().y;
+	resampleFilter = kResampleBicubic;
+	quantisedHeightsToggle = false;
+	quantisedMaxError = 0.001f;
 
 	// set the default height offset for diamond-square algorithm
 	diamondSquareHeightOffsetRange.min = -30.0f;
 	diamondSquareHeightOffsetRange.max = 40.0f;
+
+	// scale and clamp of the heights
+	heightScale = 1.5f;
+	graphLiveUpdate = false;
+	graphNewNodeType = kNodeNoise;
+	graphCacheBudgetMB = (int)(TerrainGraph::kDefaultCacheBudget / (1024 * 1024));
+	layersToggle = false;
+	layerNewBlendMode = kLayerAdd;
+	selectedLayer = 0;
+	layerStrokePosition[0] = layerStrokePosition[1] = 64.0f;
+	layerStrokeRadius = 16.0f;
+	layerStrokeHeight = 10.0f;
+	layerStrokeStrength = 0.5f;
+	historyBudgetMB = 256;
+	historyCompressionToggle = true;
+	undoKeyHeld = false;
+	redoKeyHeld = false;
+	sculptToggle = false;
+	sculptMilliseconds = 0.0f;
+	heightClampRange.min = -10.0f;
+	heightClampRange.max = 30.0f;
+
+	// set the default river parameters
+	riverAccumulationThreshold = 200.0f;
+	riverMaxDepth = 2.0f;
+
+	// same level as the fake water of the domain shader
+	waterLevel = 0.0f;
+	beachWidth = 6.0f;
+
+	meanSlope = 0.0f;
+	steepestSlope = 0.0f;
+
+	frustumCullingToggle = true;
+	horizonCullingToggle = true;
+
+	// tessellation by default, the finest CDLOD level up to 64 units
+	terrainRenderMode = kRenderTessellation;
+	cdlodSettings.lodDistance = 64.0f;
+	cdlodSettings.morphStartRatio = 0.66f;
+
+	// infinite terrain, off by default
+	streamingToggle = false;
+	streamingViewDistance = 400.0f;
+	streamingMemoryBudget = 256;
+	terrainStreamer->SetSettings(streamingSettings);
+	terrainStreamer->SetViewDistance(streamingViewDistance);
+	terrainStreamer->SetMemoryBudget((size_t)streamingMemoryBudget * 1024 * 1024);
 }
 
 
@@ -55,6 +108,12 @@ App1::~App1()
 		m_Terrain = 0;
 	}
 
+	if (terrainStreamer)
+	{
+		delete terrainStreamer;
+		terrainStreamer = 0;
+	}
+
 	if (light)
 	{
 		delete light;
@@ -107,7 +166,65 @@ bool App1::update()
 	if (renderFrameWaves)
 	{
 		m_Terrain->BuildSinCosWavesHeightMap(&wavesData, dt);
-		m_Terrain->Regenerate(renderer->getDevice(), renderer->getDeviceContext());
+	}
+
+	// Swap in the result of the finished terrain job and start the operations recorded since, as a single job
+	m_Terrain->UpdateJobs();
+
+	// Swap in the full resolution terrain once the progressive generation has refined it
+	m_Terrain->UpdateProgressive();
+
+	// Composite the tiles of the height layers edited by the GUI of the last frame
+	m_Terrain->UpdateLayers();
+
+	// Undo with Ctrl+Z and redo with Ctrl+Y, once per key press
+	const bool control = input->isKeyDown(VK_CONTROL);
+	const bool undoKey = control && input->isKeyDown('Z');
+	const bool redoKey = control && input->isKeyDown('Y');
+	if (undoKey && !undoKeyHeld)
+	{
+		m_Terrain->Undo();
+	}
+	if (redoKey && !redoKeyHeld)
+	{
+		m_Terrain->Redo();
+	}
+	undoKeyHeld = undoKey;
+	redoKeyHeld = redoKey;
+
+	// Sculpt while the left button is held over the terrain (not over the GUI): the stroke queues the stamps of the drag
+	// and they are written once per frame, with only the rows of the tiles under them uploaded
+	const std::chrono::high_resolution_clock::time_point sculptStart = std::chrono::high_resolution_clock::now();
+	TerrainBrush& brush = m_Terrain->GetBrush();
+	XMFLOAT3 brushPoint;
+	if (sculptToggle && !streamingToggle && input->isLeftMouseDown() && !ImGui::GetIO().WantCaptureMouse && PickTerrain(brushPoint))
+	{
+		if (!brush.IsStroking())
+		{
+			brush.BeginStroke(brushSettings, m_Terrain->GetHeightField(), brushPoint.z, brushPoint.x);
+		}
+		else
+		{
+			brush.MoveStroke(brushPoint.z, brushPoint.x, dt);
+		}
+	}
+	else if (!input->isLeftMouseDown())
+	{
+		brush.EndStroke();
+	}
+	const bool sculpted = m_Terrain->ApplyBrush();
+
+	// Rebuild the tiles changed by all the above and by the GUI of the last frame, once per frame
+	m_Terrain->Regenerate(renderer->getDevice(), renderer->getDeviceContext());
+	if (sculpted)
+	{
+		sculptMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - sculptStart).count();
+	}
+
+	// Request and upload the tiles of the infinite terrain around the camera
+	if (streamingToggle)
+	{
+		terrainStreamer->Update(renderer->getDeviceContext(), camera->getPosition(), dt);
 	}
 
 	return true;
@@ -134,11 +251,84 @@ bool App1::render()
 	// Clear the scene. (default blue colour)
 	renderer->beginScene(0.39f, 0.58f, 0.92f, 1.0f);
 	{
-		// Send geometry data, set shader parameters, render object with shader
-		m_Terrain->sendData(renderer->getDeviceContext());
+		// Send geometry data, set shader parameters, render every tile of the terrain with shader
 		tessellationShader->setShaderParameters(renderer->getDeviceContext(), worldMatrix, viewMatrix, projectionMatrix,
 			textures, maxTextureHeight, fakeWaterLvlToggle, light, dMinMax, lvlOfDetail, camera);
-		tessellationShader->render(renderer->getDeviceContext(), m_Terrain->getIndexCount());
+		if (streamingToggle)
+		{
+			terrainStreamer->SendIndexData(renderer->getDeviceContext());
+			for (int tile = 0; tile < terrainStreamer->GetVisibleTileCount(); tile++)
+			{
+				terrainStreamer->SendTileData(renderer->getDeviceContext(), tile);
+				tessellationShader->render(renderer->getDeviceContext(), terrainStreamer->GetTileIndexCount());
+			}
+		}
+		else
+		{
+			// only the parts of the terrain inside the view frustum (the fake water raises the bounds to 0)
+			// and not hidden behind nearer terrain, seen from the camera in the space of the height map
+			Frustum frustum;
+			frustum.Build(worldMatrix * viewMatrix * projectionMatrix);
+			XMFLOAT3 eye = camera->getPosition();
+			XMStoreFloat3(&eye, XMVector3TransformCoord(XMLoadFloat3(&eye), XMMatrixInverse(nullptr, worldMatrix)));
+			const float heightFloor = fakeWaterLvlToggle ? 0.0f : -FLT_MAX;
+
+			if (terrainRenderMode == kRenderClipmap)
+			{
+				// rings of footprints around the camera, one instanced draw per footprint for all the levels
+				m_Terrain->UpdateClipmap(renderer->getDevice(), renderer->getDeviceContext(), eye, frustumCullingToggle ? &frustum : nullptr, heightFloor);
+				const ClipmapTerrain& clipmapTerrain = m_Terrain->GetClipmapTerrain();
+
+				m_Terrain->SendClipmapData(renderer->getDeviceContext());
+				tessellationShader->setClipmapPipeline(renderer->getDeviceContext(), clipmapTerrain.GetHeightTexture(), clipmapTerrain.GetInstances(),
+					clipmapTerrain.GetClipmap(), m_Terrain->GetResolution(), fakeWaterLvlToggle);
+				for (int footprint = 0; footprint < kFootprintCount; footprint++)
+				{
+					const ClipmapDraw& draw = clipmapTerrain.GetDraw(footprint);
+					tessellationShader->renderClipmapInstances(renderer->getDeviceContext(), draw.indexCount, draw.startIndex, draw.instanceCount, draw.firstInstance);
+				}
+			}
+			else if (terrainRenderMode == kRenderCdlod)
+			{
+				// nodes of the quadtree with a level of detail by distance, all drawn with the same grid in two instanced draws
+				m_Terrain->SelectLod(renderer->getDevice(), renderer->getDeviceContext(), eye, frustumCullingToggle ? &frustum : nullptr, heightFloor,
+					horizonCullingToggle, cdlodSettings);
+				const CdlodTerrain& lodTerrain = m_Terrain->GetLodTerrain();
+				const CdlodSelection& selection = lodTerrain.GetSelection();
+
+				m_Terrain->SendLodData(renderer->getDeviceContext());
+				tessellationShader->setCdlodPipeline(renderer->getDeviceContext(), lodTerrain.GetHeightTexture(), lodTerrain.GetInstances(),
+					eye, m_Terrain->GetResolution(), fakeWaterLvlToggle);
+				tessellationShader->renderInstances(renderer->getDeviceContext(), CdlodTerrain::GetGridIndexCount(), selection.GetNodeCount(), 0);
+				tessellationShader->renderInstances(renderer->getDeviceContext(), CdlodTerrain::GetQuadrantIndexCount(), selection.GetQuadrantCount(), selection.GetNodeCount());
+			}
+			else
+			{
+				m_Terrain->Cull(frustumCullingToggle ? &frustum : nullptr, heightFloor, horizonCullingToggle ? &eye : nullptr);
+
+				// the tessellation factors of the patches are computed on the cpu, the patches only have their 4 corners
+				TessellationSettings tessellationSettings;
+				tessellationSettings.dMin = dMinMax[0];
+				tessellationSettings.dMax = dMinMax[1];
+				tessellationSettings.lodMin = lvlOfDetail[0];
+				tessellationSettings.lodMax = lvlOfDetail[1];
+				m_Terrain->UpdateTessellation(renderer->getDeviceContext(), eye, tessellationSettings);
+
+				m_Terrain->sendData(renderer->getDeviceContext());
+				tessellationShader->setPipeline(renderer->getDeviceContext(), m_Terrain->GetTessellationFactors());
+				int boundTile = -1;
+				for (int i = 0; i < m_Terrain->GetDrawRangeCount(); i++)
+				{
+					const TerrainDrawRange& range = m_Terrain->GetDrawRange(i);
+					if (range.tile != boundTile)
+					{
+						m_Terrain->SendTileData(renderer->getDeviceContext(), range.tile);
+						boundTile = range.tile;
+					}
+					tessellationShader->renderRange(renderer->getDeviceContext(), range.indexCount, range.startIndex);
+				}
+			}
+		}
 
 		// Render GUI
 		gui();
@@ -149,6 +339,39 @@ bool App1::render()
 	return true;
 }
 
+void App1::FitTextureHeights()
+{
+	// fraction of the points under the maximum height of the water, sand, grass and concrete textures
+	const float percentiles[4] = { 0.15f, 0.25f, 0.6f, 0.85f };
+	const HeightStatistics& statistics = m_Terrain->GetStatistics();
+
+	for (int i = 0; i < 4; i++)
+	{
+		maxTextureHeight[i] = statistics.GetPercentile(percentiles[i]);
+
+		// keep the separation of 1 unit between textures required by the sliders
+		if (i > 0 && maxTextureHeight[i] < maxTextureHeight[i - 1] + 1.0f)
+		{
+			maxTextureHeight[i] = maxTextureHeight[i - 1] + 1.0f;
+		}
+	}
+}
+
+bool App1::PickTerrain(XMFLOAT3& point)
+{
+	// the cursor on the near and far planes, taken back to the space of the height map
+	const float x = 2.0f * input->getMouseX() / sWidth - 1.0f;
+	const float y = 1.0f - 2.0f * input->getMouseY() / sHeight;
+	const XMMATRIX inverse = XMMatrixInverse(nullptr, renderer->getWorldMatrix() * camera->getViewMatrix() * renderer->getProjectionMatrix());
+	const XMVECTOR nearPoint = XMVector3TransformCoord(XMVectorSet(x, y, 0.0f, 1.0f), inverse);
+	const XMVECTOR farPoint = XMVector3TransformCoord(XMVectorSet(x, y, 1.0f, 1.0f), inverse);
+
+	XMFLOAT3 origin, direction;
+	XMStoreFloat3(&origin, nearPoint);
+	XMStoreFloat3(&direction, XMVectorSubtract(farPoint, nearPoint));
+	return m_Terrain->Pick(origin, direction, point);
+}
+
 void App1::gui()
 {
 	// Force turn off unnecessary shader stages.
@@ -170,6 +393,89 @@ void App1::gui()
 	ImGui::Checkbox("Wireframe mode", &wireframeToggle);
 	// Fake Water Level toggle
 	ImGui::Checkbox("Fake Water Lvl mode", &fakeWaterLvlToggle);
+	// Frustum culling toggle
+	ImGui::Checkbox("Frustum culling", &frustumCullingToggle);
+	// Horizon occlusion culling toggle
+	ImGui::Checkbox("Horizon occlusion culling", &horizonCullingToggle);
+	if (horizonCullingToggle)
+	{
+		ImGui::Text("Blocks hidden by the terrain: %d / %d", m_Terrain->GetOccludedLeafCount(), m_Terrain->GetLeafCount());
+	}
+	ImGui::Text("Terrain rendering:");
+	ImGui::RadioButton("Tessellated tiles", &terrainRenderMode, kRenderTessellation);
+	ImGui::SameLine();
+	ImGui::RadioButton("Quadtree LOD", &terrainRenderMode, kRenderCdlod);
+	ImGui::SameLine();
+	ImGui::RadioButton("Clipmap", &terrainRenderMode, kRenderClipmap);
+	if (terrainRenderMode == kRenderTessellation)
+	{
+		ImGui::Text("Patches drawn: %d / %d (%d draw calls)", m_Terrain->GetDrawnPatchCount(), m_Terrain->GetPatchCount(), m_Terrain->GetDrawRangeCount());
+	}
+
+	//////////////////////////////  HISTORY ////////////////////////////////////////////////////////////////
+	if (ImGui::CollapsingHeader("Undo History"))
+	{
+		TerrainHistory& history = m_Terrain->GetHistory();
+		ImGui::Text("Ctrl+Z / Ctrl+Y. Only the tiles changed by every operation are kept.");
+		// greyed out with the layers on, the terrain does not undo then
+		if (m_Terrain->IsLayersEnabled())
+		{
+			ImGui::TextDisabled("Undo");
+			ImGui::TextDisabled("Redo");
+		}
+		else
+		{
+			if (ImGui::Button("Undo") && history.CanUndo())
+			{
+				m_Terrain->Undo();
+			}
+			ImGui::SameLine();
+			ImGui::Text("%s", history.CanUndo() ? history.GetUndoName().c_str() : "-");
+			if (ImGui::Button("Redo") && history.CanRedo())
+			{
+				m_Terrain->Redo();
+			}
+			ImGui::SameLine();
+			ImGui::Text("%s", history.CanRedo() ? history.GetRedoName().c_str() : "-");
+		}
+		if (ImGui::SliderInt("Budget (MB)", &historyBudgetMB, 16, 2048))
+		{
+			history.SetBudget((size_t)historyBudgetMB * 1024 * 1024);
+		}
+		if (ImGui::Checkbox("Compress old entries (16 bits)", &historyCompressionToggle))
+		{
+			history.SetCompression(historyCompressionToggle, quantisedMaxError);
+		}
+		ImGui::Text("Entries: %d (%d to undo), memory: %.1f MB", history.GetEntryCount(), history.GetPosition(), history.GetBytes() / (1024.0f * 1024.0f));
+		if (m_Terrain->IsLayersEnabled())
+		{
+			ImGui::TextDisabled("Not recorded while the height layers are on.");
+		}
+		ImGui::Text("\n");
+	}
+
+	//////////////////////////////  SCULPTING ////////////////////////////////////////////////////////////////
+	if (ImGui::CollapsingHeader("Sculpting"))
+	{
+		ImGui::Text("Hold the left mouse button over the terrain to sculpt. The stamps of a frame are written at once\nand only the rows of the tiles under them are rebuilt and uploaded. A stroke is one undo.");
+		ImGui::Checkbox("Sculpt with the mouse", &sculptToggle);
+		static const char* brushNames[kBrushTypeCount] = { "Raise", "Lower", "Smooth", "Flatten", "Noise" };
+		ImGui::Combo("Brush", &brushSettings.type, brushNames, kBrushTypeCount);
+		ImGui::SliderFloat("Radius (points)", &brushSettings.radius, 1.0f, 256.0f);
+		ImGui::SliderFloat("Strength", &brushSettings.strength, 0.01f, brushSettings.type == kBrushSmooth || brushSettings.type == kBrushFlatten ? 1.0f : 5.0f);
+		ImGui::SliderFloat("Spacing (radii)", &brushSettings.spacing, 0.05f, 1.0f);
+		if (brushSettings.type == kBrushNoise)
+		{
+			ImGui::SliderFloat("Noise scale", &brushSettings.noiseScale, 0.005f, 0.5f);
+		}
+		ImGui::Text("Last sculpted frame: %.3f ms, %d stamps, %d tiles, %.1f KB uploaded", sculptMilliseconds, m_Terrain->GetBrushStampsApplied(),
+			m_Terrain->GetTilesRebuilt(), m_Terrain->GetTileBytesUploaded() / 1024.0f);
+		if (m_Terrain->IsLayersEnabled())
+		{
+			ImGui::TextDisabled("The height layers are on: the strokes sculpt the base under them and cannot be undone.");
+		}
+		ImGui::Text("\n");
+	}
 
 	//////////////////////////////  RESOLUTION ////////////////////////////////////////////////////////////////
 	if (ImGui::CollapsingHeader("Terrain resolution"))
@@ -177,11 +483,133 @@ void App1::gui()
 		ImGui::Text("The resolution will be the number of quads used horizontally\nand vertically in the plane.");
 		ImGui::Text("The number of vertices will be (resolution + 1)");
 		ImGui::Text("Using tessellation will increase the number of vertices in gpu.");
-		ImGui::SliderInt2("Resolution (m*n)", provisionalResolution, 2, 1025);
+		ImGui::Text("The terrain is split in tiles of %dx%d quads, only the edited tiles are rebuilt.", TerrainTiles::kTileSize, TerrainTiles::kTileSize);
+		ImGui::SliderInt2("Resolution (m*n)", provisionalResolution, 2, 4097);
+		ImGui::Text("The terrain is resampled to the new resolution:");
+		ImGui::SameLine();
+		ImGui::RadioButton("Bilinear", &resampleFilter, kResampleBilinear);
+		ImGui::SameLine();
+		ImGui::RadioButton("Bicubic", &resampleFilter, kResampleBicubic);
 		if (ImGui::Button("Apply resolution") && (provisionalResolution[0] != m_Terrain->GetResolution().x || provisionalResolution[1] != m_Terrain->GetResolution().y))
 		{
-			m_Terrain->Resize(renderer->getDevice(), renderer->getDeviceContext(), XMINT2(provisionalResolution[0], provisionalResolution[1]));
+			m_Terrain->Resize(renderer->getDevice(), renderer->getDeviceContext(), XMINT2(provisionalResolution[0], provisionalResolution[1]), (ResampleFilter)resampleFilter);
+		}
+		ImGui::Text("Tiles: %d (rebuilt in the last update: %d)", m_Terrain->GetTileCount(), m_Terrain->GetTilesRebuilt());
+
+		// 16 bits per point, the tiles that would lose more than the maximum error stay in floats
+		bool storageChanged = ImGui::Checkbox("16-bit heights", &quantisedHeightsToggle);
+		storageChanged |= ImGui::SliderFloat("Max height error", &quantisedMaxError, 0.0001f, 0.01f, "%.4f");
+		if (storageChanged)
+		{
+			m_Terrain->SetQuantisedStorage(quantisedHeightsToggle, quantisedMaxError);
+		}
+		const XMINT2 resolution = m_Terrain->GetResolution();
+		ImGui::Text("Height map: %.2f MB (%.2f MB in floats)", m_Terrain->GetHeightMapBytes() / 1048576.0f, sizeof(float) * (resolution.x + 1) * (resolution.y + 1) / 1048576.0f);
+		if (m_Terrain->IsQuantisedStorage())
+		{
+			const QuantisedHeightMap& quantised = m_Terrain->GetQuantisedHeightMap();
+			ImGui::Text("Tiles kept in floats: %d / %d, largest step: %.5f", quantised.GetExactTileCount(), quantised.GetTileCount(), quantised.GetLargestStep());
 		}
+
+		// the layout is a compile time option, the benchmark times all of them
+		ImGui::Text("Float layout: %s (HEIGHT_MAP_LAYOUT_TILED or HEIGHT_MAP_LAYOUT_MORTON to change it)", HeightMapLayout::GetName());
+		// it runs in the background, the terrain keeps rendering meanwhile
+		if (layoutBenchmark.IsRunning())
+		{
+			ImGui::Text("Running the layout benchmark...");
+		}
+		else if (ImGui::Button("Run layout benchmark (a few seconds)"))
+		{
+			layoutBenchmark.Start();
+		}
+		if (layoutBenchmark.HasRun())
+		{
+			ImGui::Columns(HeightMapLayoutBenchmark::kOperationCount + 1, "LayoutBenchmark");
+			ImGui::Text("ms (speedup)");
+			ImGui::NextColumn();
+			for (int operation = 0; operation < HeightMapLayoutBenchmark::kOperationCount; operation++)
+			{
+				ImGui::Text("%s", HeightMapLayoutBenchmark::GetOperationName(operation));
+				ImGui::NextColumn();
+			}
+			for (int size = 0; size < HeightMapLayoutBenchmark::kSizeCount; size++)
+			{
+				for (int layout = 0; layout < HeightMapLayoutBenchmark::kLayoutCount; layout++)
+				{
+					ImGui::Text("%d^2 %s", HeightMapLayoutBenchmark::kSizes[size], HeightMapLayoutBenchmark::GetLayoutName(layout));
+					ImGui::NextColumn();
+					for (int operation = 0; operation < HeightMapLayoutBenchmark::kOperationCount; operation++)
+					{
+						ImGui::Text("%.1f (x%.2f)", layoutBenchmark.GetMilliseconds(size, layout, operation), layoutBenchmark.GetSpeedup(size, layout, operation));
+						ImGui::NextColumn();
+					}
+				}
+			}
+			ImGui::Columns(1);
+		}
+		ImGui::Text("\n");
+	}
+
+	//////////////////////////////  THREADS ////////////////////////////////////////////////////////////////
+	if (ImGui::CollapsingHeader("Threads"))
+	{
+		ImGui::Text("Task scheduler: %d threads (%d hardware threads)", TaskScheduler::Get().GetThreadCount(), (int)std::thread::hardware_concurrency());
+		if (ImGui::Button("Run scaling benchmark (a few seconds)"))
+		{
+			schedulerBenchmark.Run();
+		}
+		if (schedulerBenchmark.HasRun())
+		{
+			ImGui::Columns(TaskSchedulerBenchmark::kOperationCount + 1, "SchedulerBenchmark");
+			ImGui::Text("ms (speedup)");
+			ImGui::NextColumn();
+			for (int operation = 0; operation < TaskSchedulerBenchmark::kOperationCount; operation++)
+			{
+				ImGui::Text("%s", TaskSchedulerBenchmark::GetOperationName(operation));
+				ImGui::NextColumn();
+			}
+			for (int threadCount = 0; threadCount < TaskSchedulerBenchmark::kThreadCountCount; threadCount++)
+			{
+				ImGui::Text("%d threads", TaskSchedulerBenchmark::kThreadCounts[threadCount]);
+				ImGui::NextColumn();
+				for (int operation = 0; operation < TaskSchedulerBenchmark::kOperationCount; operation++)
+				{
+					ImGui::Text("%.1f (x%.2f)", schedulerBenchmark.GetMilliseconds(threadCount, operation), schedulerBenchmark.GetSpeedup(threadCount, operation));
+					ImGui::NextColumn();
+				}
+			}
+			ImGui::Columns(1);
+		}
+		ImGui::Text("\n");
+	}
+
+	//////////////////////////////  INFINITE TERRAIN ////////////////////////////////////////////////////////////////
+	if (ImGui::CollapsingHeader("Infinite Terrain (Streaming)"))
+	{
+		ImGui::Text("Replace the height map with a terrain generated around the camera.\nThe tiles are generated in the background and cached.");
+		ImGui::Checkbox("Stream infinite terrain", &streamingToggle);
+
+		ImGui::InputInt("Seed", &streamingSettings.seed);
+		ImGui::SliderInt("Octaves", &streamingSettings.octaves, 1, 10);
+		ImGui::SliderFloat("Frequency", &streamingSettings.frequency, 0.0005f, 0.02f, "%.4f");
+		ImGui::SliderFloat("Amplitude", &streamingSettings.amplitude, 1.0f, 150.0f);
+		ImGui::SliderFloat("Ridge weight", &streamingSettings.ridgeWeight, 0.0f, 1.0f);
+		if (ImGui::Button("Apply noise settings"))
+		{
+			terrainStreamer->SetSettings(streamingSettings);
+		}
+
+		if (ImGui::SliderFloat("View distance", &streamingViewDistance, 64.0f, 2000.0f, "%.0f"))
+		{
+			terrainStreamer->SetViewDistance(streamingViewDistance);
+		}
+		if (ImGui::SliderInt("Memory budget (MB)", &streamingMemoryBudget, 16, 2048))
+		{
+			terrainStreamer->SetMemoryBudget((size_t)streamingMemoryBudget * 1024 * 1024);
+		}
+		ImGui::Text("Tiles visible: %d  cached: %d  pending: %d  generated: %d", terrainStreamer->GetVisibleTileCount(),
+			terrainStreamer->GetCachedTileCount(), terrainStreamer->GetPendingTileCount(), terrainStreamer->GetGeneratedTileCount());
+		ImGui::Text("Memory: %.1f / %d MB", terrainStreamer->GetMemoryUsage() / (1024.0f * 1024.0f), streamingMemoryBudget);
 		ImGui::Text("\n");
 	}
 
@@ -190,6 +618,35 @@ void App1::gui()
 	{
 		ImGui::SliderFloat2("Min-Max distance", dMinMax, 0.0f, 100.0f, "%.0f"); //  "%.0f" to fake integer use 
 		ImGui::SliderFloat2("Lvl of detail", lvlOfDetail, 0.0f, 64.0f, "%.0f");
+		ImGui::Text("Factors computed per patch on the cpu, blocks uploaded in the last frame: %d", m_Terrain->GetTessellationBlocksUploaded());
+		ImGui::Text("\n");
+	}
+
+	//////////////////////////////  LEVEL OF DETAIL ////////////////////////////////////////////////////////////////
+	if (ImGui::CollapsingHeader("Level of Detail (CDLOD)"))
+	{
+		ImGui::Text("Draw the terrain with a grid of %dx%d quads per quadtree node, without tessellation.", CdlodSelection::kGridSize, CdlodSelection::kGridSize);
+		ImGui::Text("Every level doubles the distance and halves the density, the vertices morph between levels.");
+		ImGui::SliderFloat("Finest level distance", &cdlodSettings.lodDistance, 32.0f, 512.0f, "%.0f");
+		ImGui::SliderFloat("Morph start", &cdlodSettings.morphStartRatio, 0.5f, 0.95f);
+		if (terrainRenderMode == kRenderCdlod)
+		{
+			const CdlodSelection& selection = m_Terrain->GetLodTerrain().GetSelection();
+			ImGui::Text("Nodes drawn: %d whole, %d quadrants (%d nodes visited)", selection.GetNodeCount(), selection.GetQuadrantCount(), selection.GetVisitedNodeCount());
+		}
+		ImGui::Text("\n");
+	}
+
+	//////////////////////////////  CLIPMAP ////////////////////////////////////////////////////////////////
+	if (ImGui::CollapsingHeader("Geometry Clipmap"))
+	{
+		ImGui::Text("Draw the terrain as nested rings of %dx%d points around the camera, each level with half the density.", GeometryClipmap::kWindowSize, GeometryClipmap::kWindowSize);
+		ImGui::Text("Only the heights that enter the rings when the camera moves are uploaded.");
+		if (terrainRenderMode == kRenderClipmap)
+		{
+			const ClipmapTerrain& clipmapTerrain = m_Terrain->GetClipmapTerrain();
+			ImGui::Text("Levels: %d, texels uploaded in the last frame: %d", clipmapTerrain.GetClipmap().GetLevelCount(), clipmapTerrain.GetTexelsUploaded());
+		}
 		ImGui::Text("\n");
 	}
 
@@ -200,9 +657,33 @@ void App1::gui()
 		ImGui::SliderFloat("Sand Texture", &maxTextureHeight[1], maxTextureHeight[0] + 1, maxTextureHeight[2] - 1); // never lower than the water or higher than the grass
 		ImGui::SliderFloat("Grass Texture", &maxTextureHeight[2], maxTextureHeight[1] + 1, maxTextureHeight[3] - 1); // never lower than the sand or higher than the concrete
 		ImGui::SliderFloat("Concrete Texture", &maxTextureHeight[3], maxTextureHeight[2] + 1, 40); // never lower than the grass
+
+		// Height distribution of the terrain
+		const HeightStatistics& statistics = m_Terrain->GetStatistics();
+		ImGui::Text("Height min: %.2f  max: %.2f  mean: %.2f  std dev: %.2f", statistics.GetMin(), statistics.GetMax(), statistics.GetMean(), statistics.GetStdDev());
+		ImGui::PlotHistogram("Heights", [](void* data, int bin) { return (float)((const HeightStatistics*)data)->GetHistogram()[bin]; },
+			(void*)&statistics, HeightStatistics::kNumBins, 0, NULL, FLT_MAX, FLT_MAX, ImVec2(0, 60));
+		if (ImGui::Button("Fit textures to terrain"))
+		{
+			FitTextureHeights();
+		}
 		ImGui::Text("\n");
 	}
 
+	// The operations run in the background: the ones applied while a job runs wait for it and then run together as the next one
+	const TerrainJobQueue& jobs = m_Terrain->GetJobs();
+	const HeightPipeline& pipeline = m_Terrain->GetPipeline();
+	if (jobs.IsRunning() || !pipeline.IsEmpty())
+	{
+		ImGui::Text("\n%s", jobs.IsRunning() ? jobs.GetName().c_str() : "");
+		ImGui::ProgressBar(jobs.IsRunning() ? jobs.GetProgress() : 0.0f);
+		ImGui::Text("Next: %d operations in %d passes over the map", pipeline.GetPassCount(), pipeline.GetTraversalCount());
+		if (ImGui::Button("Cancel"))
+		{
+			m_Terrain->CancelJobs();
+		}
+	}
+
 	////////////////////// PROCEDURAL METHOD FUNCTIONS TO REBUILD HEIGHT MAP COMPLETELY ///////////////////////////////////////////////////////////////////
 	ImGui::Text("\n\nProcedural methods to modify height map from scratch:\n");
 
@@ -235,7 +716,6 @@ void App1::gui()
 		{
 			wavesData.offset = XMFLOAT3(0.0f, 0.0f, 0.0f);// reset offset
 			m_Terrain->BuildSinCosWavesHeightMap(&wavesData);
-			m_Terrain->Regenerate(renderer->getDevice(), renderer->getDeviceContext());
 		}
 		ImGui::Text("\n");
 	}
@@ -256,7 +736,6 @@ void App1::gui()
 		if (ImGui::Button("Apply Random Heights")) {
 			// build map height
 			m_Terrain->BuildRandomHeightMap(randomMinMaxHeight);
-			m_Terrain->Regenerate(renderer->getDevice(), renderer->getDeviceContext());
 		}
 		ImGui::Text("\n");
 	}
@@ -280,18 +759,269 @@ void App1::gui()
 		// Apply Diamond-Square algorithm
 		if (ImGui::Button("Apply Diamond-Square Algorithm")) {
 			m_Terrain->DiamondSquareAlgorithm(diamondSquareHeightOffsetRange);
-			m_Terrain->Regenerate(renderer->getDevice(), renderer->getDeviceContext());
 		}
 		ImGui::Text("\n");
 	}
 
+	//////////////////////////////  PROGRESSIVE GENERATION //////////////////////////////////////////////////////////////////////
+	if (ImGui::CollapsingHeader("Progressive Generation"))
+	{
+		ImGui::Text("Diamond-square, rivers and smoothing at any resolution. A preview at a lower resolution\nis shown at once and the full resolution terrain replaces it when it is ready.");
+		ImGui::InputInt("Generation seed", &generationSettings.seed);
+		float newOffsetRange[2] = { generationSettings.heightRange.min, generationSettings.heightRange.max };
+		if (ImGui::SliderFloat2("Generation offset Height", newOffsetRange, -40.0f, 40.0f))
+		{
+			generationSettings.heightRange.min = newOffsetRange[0];
+			generationSettings.heightRange.max = newOffsetRange[1];
+		}
+		ImGui::Checkbox("Carve rivers", &generationSettings.carveRivers);
+		ImGui::SliderFloat("Generation river threshold", &generationSettings.riverThreshold, 100.0f, 20000.0f, "%.0f");
+		ImGui::SliderFloat("Generation river depth", &generationSettings.riverDepth, 0.0f, 10.0f);
+		ImGui::SliderInt("Smooth passes", &generationSettings.smoothPasses, 0, 8);
+		ImGui::Text("Preview:");
+		ImGui::SameLine();
+		ImGui::RadioButton("1/4", &generationSettings.previewDivisor, 4);
+		ImGui::SameLine();
+		ImGui::RadioButton("1/8", &generationSettings.previewDivisor, 8);
+		if (ImGui::Button("Generate"))
+		{
+			m_Terrain->GenerateProgressive(generationSettings);
+		}
+
+		const ProgressiveGenerator& generator = m_Terrain->GetProgressiveGenerator();
+		ImGui::Text("Preview: %.1f ms", generator.GetPreviewMilliseconds());
+		if (generator.IsRefining())
+		{
+			ImGui::Text("Refining at full resolution...");
+		}
+		else
+		{
+			ImGui::Text("Refinement: %.1f ms, diamond-square levels reused: %d", generator.GetRefinementMilliseconds(), generator.GetReusedLevels());
+		}
+		ImGui::Text("\n");
+	}
+
+	//////////////////////////////  NODE GRAPH //////////////////////////////////////////////////////////////////////
+	if (ImGui::CollapsingHeader("Node Graph"))
+	{
+		ImGui::Text("Generators, modifiers and combiners of height maps. Every node keeps its result,\nso only the nodes after the one edited are computed again.");
+		bool graphChanged = false;
+
+		// names of the nodes to pick the inputs and the output, "none" first
+		std::vector<std::string> nodeLabels(1, "None");
+		for (int node = 0; node < terrainGraph.GetNodeCount(); node++)
+		{
+			nodeLabels.push_back(std::to_string(node) + ": " + TerrainGraph::GetTypeInfo(terrainGraph.GetNode(node).type).name);
+		}
+		std::vector<const char*> nodeNames;
+		for (const std::string& label : nodeLabels)
+		{
+			nodeNames.push_back(label.c_str());
+		}
+
+		// of the last evaluation that has ended, the nodes added since are not in it
+		const TerrainGraphEvaluation evaluation = terrainGraph.GetLastEvaluation();
+		for (int node = 0; node < terrainGraph.GetNodeCount(); node++)
+		{
+			TerrainNode& terrainNode = terrainGraph.GetNode(node);
+			const bool evaluated = node < (int)evaluation.evaluated.size() && evaluation.evaluated[node];
+			const float milliseconds = evaluated ? evaluation.milliseconds[node] : 0.0f;
+			ImGui::PushID(node);
+			if (ImGui::TreeNode("Node", "%s (%.1f ms%s)", nodeNames[node + 1], milliseconds, evaluated ? "" : ", cached"))
+			{
+				if (ImGui::Combo("Type", &terrainNode.type, TerrainGraph::GetTypeNames(), kNodeTypeCount))
+				{
+					terrainGraph.ResetParameters(node);
+					graphChanged = true;
+				}
+				const TerrainGraph::NodeTypeInfo& info = TerrainGraph::GetTypeInfo(terrainNode.type);
+				for (int input = 0; input < info.inputCount; input++)
+				{
+					// only the nodes before this one, so there are no cycles
+					static const char* inputLabels[TerrainNode::kMaxInputs] = { "Input A", "Input B", "Mask" };
+					int selected = terrainNode.inputs[input] + 1;
+					if (ImGui::Combo(inputLabels[input], &selected, nodeNames.data(), node + 1))
+					{
+						terrainNode.inputs[input] = selected - 1;
+						graphChanged = true;
+					}
+				}
+				if (info.usesSeed)
+				{
+					graphChanged |= ImGui::InputInt("Seed", &terrainNode.seed);
+				}
+				for (int parameter = 0; parameter < info.parameterCount; parameter++)
+				{
+					graphChanged |= ImGui::SliderFloat(info.parameterNames[parameter], &terrainNode.parameters[parameter], info.parameterMin[parameter], info.parameterMax[parameter]);
+				}
+				ImGui::TreePop();
+			}
+			ImGui::PopID();
+		}
+
+		int output = terrainGraph.GetOutput();
+		if (ImGui::Combo("Output", &output, nodeNames.data() + 1, terrainGraph.GetNodeCount()))
+		{
+			terrainGraph.SetOutput(output);
+			graphChanged = true;
+		}
+		ImGui::Combo("New node", &graphNewNodeType, TerrainGraph::GetTypeNames(), kNodeTypeCount);
+		if (ImGui::Button("Add node"))
+		{
+			terrainGraph.AddNode(graphNewNodeType);
+			graphChanged = true;
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Remove last node"))
+		{
+			terrainGraph.RemoveLastNode();
+			graphChanged = true;
+		}
+		ImGui::Checkbox("Live update", &graphLiveUpdate);
+		ImGui::SameLine();
+		if (ImGui::Button("Evaluate") || (graphChanged && graphLiveUpdate))
+		{
+			// evaluated by a terrain job, the heights are swapped in when it ends
+			m_Terrain->SetHeights(terrainGraph);
+		}
+		ImGui::Text("Last evaluation: %d nodes computed, %d cached", evaluation.evaluatedCount, evaluation.cachedCount);
+		// the results of the nodes used least recently are dropped over the budget
+		if (ImGui::SliderInt("Cache budget (MB)", &graphCacheBudgetMB, 16, 2048))
+		{
+			terrainGraph.GetCache().SetBudget((size_t)graphCacheBudgetMB * 1024 * 1024);
+		}
+		ImGui::Text("Cache: %d results, %.1f MB", terrainGraph.GetCache().GetEntryCount(), terrainGraph.GetCache().GetBytes() / (1024.0f * 1024.0f));
+		ImGui::Text("\n");
+	}
+
+	//////////////////////////////  HEIGHT LAYERS //////////////////////////////////////////////////////////////////////
+	if (ImGui::CollapsingHeader("Height Layers"))
+	{
+		ImGui::Text("Edits kept in layers over a base, blended with their mode and opacity. The other operations\nchange the base and the layers stay on top. Only the tiles changed are blended again.");
+		if (ImGui::Checkbox("Use layers", &layersToggle))
+		{
+			// turning them on clears the undo history, which is confirmed first if there is something to lose
+			if (layersToggle && m_Terrain->GetHistory().GetEntryCount() > 0)
+			{
+				layersToggle = false;
+				ImGui::OpenPopup("Clear the undo history?");
+			}
+			else
+			{
+				m_Terrain->SetLayersEnabled(layersToggle);
+			}
+		}
+		if (ImGui::BeginPopupModal("Clear the undo history?", nullptr, ImGuiWindowFlags_AlwaysAutoResize))
+		{
+			ImGui::Text("Turning the layers on clears the %d entries of the undo history,\nand nothing is recorded while they are on.", m_Terrain->GetHistory().GetEntryCount());
+			if (ImGui::Button("Use layers"))
+			{
+				layersToggle = true;
+				m_Terrain->SetLayersEnabled(true);
+				ImGui::CloseCurrentPopup();
+			}
+			ImGui::SameLine();
+			if (ImGui::Button("Cancel"))
+			{
+				ImGui::CloseCurrentPopup();
+			}
+			ImGui::EndPopup();
+		}
+
+		HeightLayerStack& layers = m_Terrain->GetLayers();
+		static const char* blendModeNames[kLayerBlendModeCount] = { "Add", "Max", "Min", "Replace" };
+		for (int layer = 0; layer < layers.GetLayerCount(); layer++)
+		{
+			const HeightLayer& heightLayer = layers.GetLayer(layer);
+			ImGui::PushID(layer);
+			ImGui::RadioButton("", &selectedLayer, layer);
+			ImGui::SameLine();
+			if (ImGui::TreeNode("Layer", "%s (%d tiles, %.1f KB)", heightLayer.name.c_str(), heightLayer.allocatedTiles, layers.GetLayerBytes(layer) / 1024.0f))
+			{
+				int blendMode = heightLayer.blendMode;
+				float opacity = heightLayer.opacity;
+				bool visible = heightLayer.visible;
+				ImGui::Combo("Blend", &blendMode, blendModeNames, kLayerBlendModeCount);
+				ImGui::SliderFloat("Opacity", &opacity, 0.0f, 1.0f);
+				ImGui::Checkbox("Visible", &visible);
+				layers.SetLayerBlend(layer, blendMode, opacity, visible);
+				if (ImGui::Button("Clear"))
+				{
+					layers.Clear(layer);
+				}
+				ImGui::SameLine();
+				const bool remove = ImGui::Button("Remove");
+				ImGui::TreePop();
+				if (remove)
+				{
+					layers.RemoveLayer(layer);
+					ImGui::PopID();
+					break;
+				}
+			}
+			ImGui::PopID();
+		}
+
+		ImGui::Combo("New layer blend", &layerNewBlendMode, blendModeNames, kLayerBlendModeCount);
+		if (ImGui::Button("Add layer"))
+		{
+			selectedLayer = layers.AddLayer("Layer " + std::to_string(layers.GetLayerCount()), (LayerBlendMode)layerNewBlendMode);
+		}
+
+		// strokes on the selected layer, once the stack has the resolution of the terrain
+		if (m_Terrain->IsLayersEnabled() && selectedLayer < layers.GetLayerCount())
+		{
+			const XMINT2 resolution = m_Terrain->GetResolution();
+			ImGui::SliderFloat("Stroke m", &layerStrokePosition[0], 0.0f, (float)resolution.x);
+			ImGui::SliderFloat("Stroke n", &layerStrokePosition[1], 0.0f, (float)resolution.y);
+			ImGui::SliderFloat("Stroke radius", &layerStrokeRadius, 1.0f, 128.0f);
+			ImGui::SliderFloat("Stroke height", &layerStrokeHeight, -40.0f, 40.0f);
+			ImGui::SliderFloat("Stroke strength", &layerStrokeStrength, 0.0f, 1.0f);
+			if (ImGui::Button("Paint"))
+			{
+				layers.Paint(selectedLayer, layerStrokePosition[0], layerStrokePosition[1], layerStrokeRadius, layerStrokeHeight, layerStrokeStrength);
+			}
+			ImGui::SameLine();
+			if (ImGui::Button("Erase"))
+			{
+				layers.Erase(selectedLayer, layerStrokePosition[0], layerStrokePosition[1], layerStrokeRadius, layerStrokeStrength);
+			}
+			ImGui::SameLine();
+			if (ImGui::Button("Fill from node graph"))
+			{
+				layers.Fill(selectedLayer, terrainGraph.Evaluate(m_Terrain->GetResolution()));
+			}
+		}
+		ImGui::Text("Memory: %.1f KB, tiles composited last time: %d of %d", layers.GetBytes() / 1024.0f, m_Terrain->GetLayerTilesComposited(), layers.GetTileCount());
+		ImGui::Text("\n");
+	}
+
 	//////////////////////////////  FLATTEN THE PLANE //////////////////////////////////////////////////////////////////////
 	if (ImGui::CollapsingHeader("Flatten"))
 	{
 		ImGui::Text("Set to 0 the height of every vertex.");
 		if (ImGui::Button("Apply Flatten")) {
 			m_Terrain->Flatten();
-			m_Terrain->Regenerate(renderer->getDevice(), renderer->getDeviceContext());
+		}
+		ImGui::Text("\n");
+	}
+
+	//////////////////////////////  SCALE AND CLAMP //////////////////////////////////////////////////////////////////////
+	if (ImGui::CollapsingHeader("Scale and Clamp"))
+	{
+		ImGui::Text("Multiply every height, or keep them in a range.\nApplied together they share a single pass over the map.");
+		ImGui::SliderFloat("Scale", &heightScale, 0.0f, 4.0f);
+		if (ImGui::Button("Apply Scale"))
+		{
+			m_Terrain->ScaleHeights(heightScale);
+		}
+		float clampRange[2] = { heightClampRange.min, heightClampRange.max };
+		ImGui::SliderFloat2("Clamp range", clampRange, -50.0f, 50.0f);
+		heightClampRange.min = (std::min)(clampRange[0], clampRange[1]);
+		heightClampRange.max = (std::max)(clampRange[0], clampRange[1]);
+		if (ImGui::Button("Apply Clamp"))
+		{
+			m_Terrain->ClampHeights(heightClampRange);
 		}
 		ImGui::Text("\n");
 	}
@@ -309,7 +1039,35 @@ void App1::gui()
 		if (ImGui::Button("Apply Smooth"))
 		{
 			m_Terrain->Smooth();
-			m_Terrain->Regenerate(renderer->getDevice(), renderer->getDeviceContext());
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Apply Gaussian Smooth"))
+		{
+			m_Terrain->GaussianSmooth();
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Apply Sharpen"))
+		{
+			m_Terrain->Sharpen();
+		}
+
+		// the filters against the loops with a bounds check per neighbour
+		if (ImGui::Button("Run filter benchmark (a few seconds)"))
+		{
+			stencilBenchmark.Run();
+		}
+		if (stencilBenchmark.HasRun())
+		{
+			for (int size = 0; size < StencilBenchmark::kSizeCount; size++)
+			{
+				for (int operation = 0; operation < StencilBenchmark::kOperationCount; operation++)
+				{
+					ImGui::Text("%d^2 %s: %.1f ms -> %.1f ms (x%.1f)", StencilBenchmark::kSizes[size], StencilBenchmark::GetOperationName(operation),
+						stencilBenchmark.GetMilliseconds(size, operation, StencilBenchmark::kReference), stencilBenchmark.GetMilliseconds(size, operation, StencilBenchmark::kStencil),
+						stencilBenchmark.GetSpeedup(size, operation));
+				}
+			}
+			ImGui::Text("Largest difference: %g", stencilBenchmark.GetMaxDifference());
 		}
 		ImGui::Text("\n");
 	}
@@ -328,7 +1086,6 @@ void App1::gui()
 		if (ImGui::Button("Apply Fault"))
 		{
 			m_Terrain->Fault(faultHeightRange);
-			m_Terrain->Regenerate(renderer->getDevice(), renderer->getDeviceContext());
 		}
 		ImGui::Text("\n");
 	}
@@ -348,17 +1105,78 @@ void App1::gui()
 		if (ImGui::Button("Apply Particle Deposition"))
 		{
 			m_Terrain->ParticleDeposition(particleDepoHeightRange);
-			m_Terrain->Regenerate(renderer->getDevice(), renderer->getDeviceContext());
 		}
 		// Anti-Particle Deposition
 		if (ImGui::Button("Apply Anti-Particle Deposition"))
 		{
 			m_Terrain->AntiParticleDeposition(particleDepoHeightRange);
-			m_Terrain->Regenerate(renderer->getDevice(), renderer->getDeviceContext());
 		}
 		ImGui::Text("\n");
 	}
 
+	// Rivers
+	if (ImGui::CollapsingHeader("Rivers (Hydrology)"))
+	{
+		ImGui::Text("Fill the depressions, compute the water flow\nand carve the points where enough water flows.");
+		ImGui::SliderFloat("Min flow accumulation", &riverAccumulationThreshold, 10.0f, 5000.0f, "%.0f");
+		ImGui::SliderFloat("Max river depth", &riverMaxDepth, 0.0f, 10.0f);
+		if (ImGui::Button("Carve Rivers"))
+		{
+			m_Terrain->CarveRivers(riverAccumulationThreshold, riverMaxDepth);
+		}
+		ImGui::Text("Points carved: %d", m_Terrain->GetRiverPointsCarved());
+		ImGui::Text("\n");
+	}
+
+	// Water bodies
+	if (ImGui::CollapsingHeader("Water Bodies"))
+	{
+		ImGui::Text("Find the seas (touching the border) and lakes\nformed by the points below the water level.");
+		ImGui::SliderFloat("Water level", &waterLevel, -30.0f, 30.0f);
+		if (ImGui::Button("Detect Water Bodies"))
+		{
+			WaterBodies::Label(m_Terrain->GetHeightField(), waterLevel, waterBodyMaps);
+		}
+		ImGui::Text("Seas: %d  Lakes: %d", WaterBodies::Count(waterBodyMaps, kSea), WaterBodies::Count(waterBodyMaps, kLake));
+		int largestLake = WaterBodies::GetLargest(waterBodyMaps, kLake);
+		if (largestLake != WaterBodies::kDryLand)
+		{
+			const WaterBody& lake = waterBodyMaps.bodies[largestLake];
+			ImGui::Text("Largest lake: %d points, (%d, %d) to (%d, %d)", lake.area, lake.boundsMin.x, lake.boundsMin.y, lake.boundsMax.x, lake.boundsMax.y);
+		}
+
+		// Beaches from the distance to the coast
+		ImGui::SliderFloat("Beach width", &beachWidth, 0.0f, 30.0f);
+		if (ImGui::Button("Build Beaches"))
+		{
+			m_Terrain->BuildBeaches(waterLevel, beachWidth);
+		}
+		ImGui::Text("\n");
+	}
+
+	// Terrain analysis
+	if (ImGui::CollapsingHeader("Terrain Analysis"))
+	{
+		ImGui::Text("Compute the slope, aspect, curvatures and normals\nof every point of the height map.");
+		if (ImGui::Button("Analyse Terrain"))
+		{
+			TerrainAnalysis::Compute(m_Terrain->GetHeightField(), kAnalysisAll, terrainAnalysisMaps);
+
+			// summary of the slope map
+			double slopeSum = 0.0;
+			float slopeMax = 0.0f;
+			for (float slope : terrainAnalysisMaps.slope)
+			{
+				slopeSum += slope;
+				slopeMax = max(slopeMax, slope);
+			}
+			meanSlope = XMConvertToDegrees((float)(slopeSum / terrainAnalysisMaps.slope.size()));
+			steepestSlope = XMConvertToDegrees(slopeMax);
+		}
+		ImGui::Text("Mean slope: %.1f deg  Steepest slope: %.1f deg", meanSlope, steepestSlope);
+		ImGui::Text("\n");
+	}
+
 	ImGui::Text("\nExample with diamond square and smooth:");
 	if (ImGui::Button("Make Example Terrain"))
 	{
@@ -377,11 +1195,10 @@ void App1::gui()
 		maxTextureHeight[2] = 15.0f;
 		maxTextureHeight[3] = 25.0f;
 
-		// apply procedural methods
+		// apply procedural methods, the operations after the resize run as a single job
 		m_Terrain->Resize(renderer->getDevice(), renderer->getDeviceContext(), XMINT2(provisionalResolution[0], provisionalResolution[1]));
 		m_Terrain->DiamondSquareAlgorithm(diamondSquareHeightOffsetRange);
 		m_Terrain->Smooth();
-		m_Terrain->Regenerate(renderer->getDevice(), renderer->getDeviceContext());
 	}
 	ImGui::Text("\n");
 
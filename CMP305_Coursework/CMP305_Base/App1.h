@@ -6,8 +6,24 @@
 #include "DXF.h"	// include dxframework
 #include "TessellationShader.h"
 #include "TerrainMesh.h"
+#include "TerrainStreamer.h"
+#include "WaterBodies.h"
+#include "TerrainAnalysis.h"
+#include "HeightMapLayoutBenchmark.h"
+#include "StencilBenchmark.h"
+#include "TaskSchedulerBenchmark.h"
+#include "TerrainGraph.h"
+#include <chrono>
+#include <string>
 #include <vector>
 
+// How the height map of m_Terrain is drawn
+enum TerrainRenderMode
+{
+	kRenderTessellation = 0, // tessellated tiles
+	kRenderCdlod, // quadtree level of detail
+	kRenderClipmap // geometry clipmap centred on the camera
+};
 
 class App1 : public BaseApplication
 {
@@ -24,9 +40,15 @@ protected:
 	bool render();
 	void gui();
 
+	// Set the maximum height of each texture from the height distribution of the terrain
+	void FitTextureHeights();
+	// Point of the terrain under the mouse cursor, in the space of the height map. False if the cursor is not over it
+	bool PickTerrain(XMFLOAT3& point);
+
 private:
 	TessellationShader* tessellationShader;
 	TerrainMesh* m_Terrain;
+	TerrainStreamer* terrainStreamer;
 
 	Light* light;
 
@@ -34,6 +56,13 @@ private:
 	float dMinMax[2] = { 1.0f, 47.0f };
 	float lvlOfDetail[2] = { 1.0f, 64.0f };
 	int provisionalResolution[2]; // resolution to show on IMGUI
+	int resampleFilter; // ResampleFilter used to carry the terrain to a new resolution
+	// 16-bit storage of the heights and its maximum error
+	bool quantisedHeightsToggle;
+	float quantisedMaxError;
+	HeightMapLayoutBenchmark layoutBenchmark; // times of the float layouts, started from the GUI and run in the background
+	StencilBenchmark stencilBenchmark; // times of the 3x3 filters, run from the GUI
+	TaskSchedulerBenchmark schedulerBenchmark; // times of the terrain work per number of threads, run from the GUI
 
 	// variable to create sin/cos waves in the terrain
 	WavesData wavesData;
@@ -46,8 +75,61 @@ private:
 	// Max and min values which will be used for getting a random height for the different procedural methods
 	Range randomMinMaxHeight;
 	Range diamondSquareHeightOffsetRange;
+	// Diamond-square, rivers and smoothing previewed at a lower resolution and refined in the background
+	GenerationSettings generationSettings;
+	// Procedural node graph, evaluated into the terrain when it changes if the live update is on
+	TerrainGraph terrainGraph;
+	bool graphLiveUpdate;
+	int graphNewNodeType; // TerrainNodeType of the next node added
+	int graphCacheBudgetMB;
+	// Height layers: blend mode of the next layer added and the stroke painted on the selected one
+	bool layersToggle;
+	int layerNewBlendMode;
+	int selectedLayer;
+	float layerStrokePosition[2]; // (m, n) in points
+	float layerStrokeRadius;
+	float layerStrokeHeight;
+	float layerStrokeStrength;
+	// Undo history: memory budget in MB and the keys held last frame (Ctrl+Z, Ctrl+Y)
+	int historyBudgetMB;
+	bool historyCompressionToggle;
+	bool undoKeyHeld, redoKeyHeld;
+	// Sculpting with the left mouse button over the terrain and the time of the last frame that sculpted (stamps and tiles)
+	bool sculptToggle;
+	BrushSettings brushSettings;
+	float sculptMilliseconds;
 	Range faultHeightRange;
+	float heightScale;
+	Range heightClampRange;
 	Range particleDepoHeightRange;
+
+	// Hydrology: minimum flow accumulation (number of points draining through) to be a river and depth of the channels
+	float riverAccumulationThreshold;
+	float riverMaxDepth;
+
+	// Water bodies (seas and lakes) below the water level
+	float waterLevel;
+	WaterBodyMaps waterBodyMaps;
+	float beachWidth;
+
+	// CPU culling of the terrain patches against the view frustum
+	bool frustumCullingToggle;
+	// CPU occlusion culling of the patches hidden behind nearer terrain (horizon sweep from the camera)
+	bool horizonCullingToggle;
+
+	// TerrainRenderMode, an int for the radio buttons
+	int terrainRenderMode;
+	CdlodSettings cdlodSettings;
+
+	// Infinite terrain streamed around the camera instead of the height map of m_Terrain
+	bool streamingToggle;
+	StreamingTerrainSettings streamingSettings;
+	float streamingViewDistance;
+	int streamingMemoryBudget; // MB
+
+	// Slope, aspect, curvature and normal maps of the current height map
+	TerrainAnalysisMaps terrainAnalysisMaps;
+	float meanSlope, steepestSlope; // degrees
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,139 @@
+#include "CdlodSelection.h"
+
+#include <algorithm>
+#include <cfloat>
+
+const int CdlodSelection::kGridSize;
+
+
+CdlodSelection::CdlodSelection()
+	: nodeCount(0), visitedNodes(0), quadtree(nullptr), frustum(nullptr), occlusion(nullptr), eye(0.0f, 0.0f, 0.0f), heightFloor(-FLT_MAX)
+{
+}
+
+void CdlodSelection::Select(const HeightQuadtree& iQuadtree, const XMFLOAT3& iEye, const Frustum* iFrustum, const HorizonOcclusion* iOcclusion,
+	float iHeightFloor, const CdlodSettings& settings)
+{
+	instances.clear();
+	quadrants.clear();
+	nodeCount = 0;
+	visitedNodes = 0;
+
+	const int levelCount = iQuadtree.GetLevelCount();
+	if (levelCount == 0)
+	{
+		return;
+	}
+
+	// The range of a level doubles the previous one, as its density halves. A node of level l is only split while it is
+	// nearer than the range of l - 1, so the nodes of level l - 1 next to one of level l reach about a node diagonal beyond
+	// that range. The limits keep it before the morph of level l starts, so a fully morphed edge never meets a morphing one
+	const float morphStartRatio = (std::min)((std::max)(settings.morphStartRatio, 0.5f), 0.95f);
+	const float lodDistance = (std::max)(settings.lodDistance, 4.0f * kGridSize);
+	lodRanges.resize(levelCount);
+	morphRanges.resize(levelCount);
+	float previousRange = 0.0f;
+	for (int level = 0; level < levelCount; level++)
+	{
+		// the root is drawn at any distance and never morphs
+		if (level == levelCount - 1)
+		{
+			lodRanges[level] = FLT_MAX;
+			morphRanges[level] = XMFLOAT2(FLT_MAX * 0.5f, FLT_MAX);
+			break;
+		}
+		lodRanges[level] = lodDistance * (float)(1 << level);
+		morphRanges[level] = XMFLOAT2(previousRange + (lodRanges[level] - previousRange) * morphStartRatio, lodRanges[level]);
+		previousRange = lodRanges[level];
+	}
+
+	quadtree = &iQuadtree;
+	frustum = iFrustum;
+	occlusion = iOcclusion;
+	eye = iEye;
+	heightFloor = iHeightFloor;
+
+	SelectNode(levelCount - 1, 0, 0, frustum == nullptr);
+
+	// the whole nodes and the quadrants are drawn with two instanced draws of the same buffer
+	nodeCount = (int)instances.size();
+	instances.insert(instances.end(), quadrants.begin(), quadrants.end());
+}
+
+bool CdlodSelection::SelectNode(int level, int i, int j, bool inside)
+{
+	const XMINT2 levelSize = quadtree->GetLevelSize(level);
+	if (i >= levelSize.x || j >= levelSize.y)
+	{
+		return true;
+	}
+	visitedNodes++;
+
+	// nothing to draw for the nodes outside the frustum or hidden, as if their parent had drawn them
+	if (occlusion && occlusion->GetState(level, i, j) == kOcclusionHidden)
+	{
+		return true;
+	}
+	const HeightFieldRect quads = quadtree->GetNodeQuads(level, i, j);
+	const XMFLOAT2 bounds = quadtree->GetBounds(level, i, j);
+	const XMFLOAT3 boxMin((float)quads.nMin, (std::max)(bounds.x, heightFloor), (float)quads.mMin);
+	const XMFLOAT3 boxMax((float)(quads.nMax + 1), (std::max)(bounds.y, heightFloor), (float)(quads.mMax + 1));
+	if (!inside)
+	{
+		const FrustumTestResult result = frustum->TestBox(boxMin, boxMax);
+		if (result == kFrustumOutside)
+		{
+			return true;
+		}
+		inside = (result == kFrustumInside);
+	}
+
+	// squared distance from the eye to the nearest point of the box
+	const float dx = (std::max)((std::max)(boxMin.x - eye.x, eye.x - boxMax.x), 0.0f);
+	const float dy = (std::max)((std::max)(boxMin.y - eye.y, eye.y - boxMax.y), 0.0f);
+	const float dz = (std::max)((std::max)(boxMin.z - eye.z, eye.z - boxMax.z), 0.0f);
+	const float distanceSq = dx * dx + dy * dy + dz * dz;
+
+	if (distanceSq > lodRanges[level] * lodRanges[level])
+	{
+		return false;
+	}
+	if (level == 0 || distanceSq > lodRanges[level - 1] * lodRanges[level - 1])
+	{
+		AddInstance(level, level, i, j, instances);
+		return true;
+	}
+
+	// Some part of the node needs the finer level. The children out of its range are drawn at this level, each one with a quarter of the grid
+	bool childSelected[4];
+	bool anySelected = false;
+	for (int child = 0; child < 4; child++)
+	{
+		childSelected[child] = SelectNode(level - 1, 2 * i + (child >> 1), 2 * j + (child & 1), inside);
+		anySelected |= childSelected[child];
+	}
+	if (!anySelected)
+	{
+		AddInstance(level, level, i, j, instances);
+		return true;
+	}
+	for (int child = 0; child < 4; child++)
+	{
+		if (!childSelected[child])
+		{
+			AddInstance(level - 1, level, 2 * i + (child >> 1), 2 * j + (child & 1), quadrants);
+		}
+	}
+	return true;
+}
+
+void CdlodSelection::AddInstance(int level, int lod, int i, int j, std::vector<CdlodInstance>& list)
+{
+	// the area of the node (i, j) of level, drawn with the density and morph of lod
+	CdlodInstance instance;
+	instance.origin = XMFLOAT2((float)(quadtree->GetNodeSize(level) * j), (float)(quadtree->GetNodeSize(level) * i));
+	instance.scale = (float)(1 << lod);
+	instance.lod = (float)lod;
+	instance.morphRange = morphRanges[lod];
+	list.push_back(instance);
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <vector>
+
+#include "HeightQuadtree.h"
+#include "Frustum.h"
+#include "HorizonOcclusion.h"
+
+// Distances of the levels of detail of the CDLOD selection
+struct CdlodSettings
+{
+	float lodDistance; // the finest level is used up to this distance from the eye, every level after it doubles it
+	float morphStartRatio; // fraction of the range of a level after which its vertices start morphing into the next one
+};
+
+// A node of the quadtree to draw with the shared grid mesh, the same layout as the instance buffer of terrain_cdlod_vs.hlsl
+struct CdlodInstance
+{
+	XMFLOAT2 origin; // first point (n, m) covered by the grid
+	float scale; // quads of the height map per quad of the grid, 2^lod
+	float lod;
+	XMFLOAT2 morphRange; // distances where the morph into the next level starts and ends
+};
+
+// Continuous distance-dependent level of detail (Strugar's CDLOD) over the min/max height quadtree.
+// Every level of the quadtree is a level of detail: a node of level l is drawn with the shared grid of
+// kGridSize^2 quads scaled by 2^l, so its density halves with every level. The quadtree is walked from the
+// root and a node is split while its children are in the range of the finer level, a child out of it is drawn
+// by its parent as a quadrant (a quarter of the grid). Near the end of the range of its level the vertices morph
+// into the positions of the next level, so there is no popping when a node changes level and no cracks between
+// neighbours. Everything is in the space of the height map: x = n, y = height, z = m
+class CdlodSelection
+{
+public:
+	static const int kGridSize = HeightQuadtree::kLeafSize; // quads per side of the shared grid
+
+	CdlodSelection();
+
+	// Select the nodes to draw for the eye. Only the ones inside the frustum and not hidden by the terrain if they are not null
+	// (occlusion computed from the same quadtree). Heights below heightFloor count as heightFloor (fake water level)
+	void Select(const HeightQuadtree& quadtree, const XMFLOAT3& eye, const Frustum* frustum, const HorizonOcclusion* occlusion,
+		float heightFloor, const CdlodSettings& settings);
+
+	// The whole nodes first (the full grid) and then the quadrants (the first quarter of the grid)
+	const std::vector<CdlodInstance>& GetInstances() const { return instances; }
+	int GetNodeCount() const { return nodeCount; }
+	int GetQuadrantCount() const { return (int)instances.size() - nodeCount; }
+	// Nodes of the quadtree tested by the last Select()
+	int GetVisitedNodeCount() const { return visitedNodes; }
+	float GetLodRange(int lod) const { return lodRanges[lod]; }
+
+private:
+	// Return false if the node is out of the range of its level, so its parent has to draw it
+	bool SelectNode(int level, int i, int j, bool inside);
+	void AddInstance(int level, int lod, int i, int j, std::vector<CdlodInstance>& list);
+
+	std::vector<float> lodRanges; // furthest distance of every level, the root has no limit
+	std::vector<XMFLOAT2> morphRanges;
+	std::vector<CdlodInstance> instances;
+	std::vector<CdlodInstance> quadrants;
+	int nodeCount;
+	int visitedNodes;
+
+	// state of the current Select()
+	const HeightQuadtree* quadtree;
+	const Frustum* frustum;
+	const HorizonOcclusion* occlusion;
+	XMFLOAT3 eye;
+	float heightFloor;
+};
@@ -0,0 +1,277 @@
+#include "CdlodTerrain.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "TerrainTiles.h"
+
+const int CdlodTerrain::kGridSize;
+
+
+CdlodTerrain::CdlodTerrain()
+	: resolution(0, 0), gridVertexBuffer(nullptr), gridIndexBuffer(nullptr), heightTexture(nullptr), heightView(nullptr),
+	instanceBuffer(nullptr), instanceView(nullptr), instanceCapacity(0)
+{
+}
+
+CdlodTerrain::~CdlodTerrain()
+{
+	ReleaseHeights();
+	ReleaseInstances();
+	if (gridVertexBuffer)
+	{
+		gridVertexBuffer->Release();
+		gridVertexBuffer = nullptr;
+	}
+	if (gridIndexBuffer)
+	{
+		gridIndexBuffer->Release();
+		gridIndexBuffer = nullptr;
+	}
+}
+
+void CdlodTerrain::Resize(ID3D11Device* device, XMINT2 newResolution)
+{
+	ReleaseHeights();
+	if (!gridVertexBuffer)
+	{
+		CreateGrid(device);
+	}
+
+	resolution = newResolution;
+	dirtyRect = HeightFieldRect(0, 0, resolution.x, resolution.y);
+
+	D3D11_TEXTURE2D_DESC textureDesc;
+	textureDesc.Width = resolution.y + 1;
+	textureDesc.Height = resolution.x + 1;
+	textureDesc.MipLevels = 1;
+	textureDesc.ArraySize = 1;
+	textureDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	textureDesc.SampleDesc.Count = 1;
+	textureDesc.SampleDesc.Quality = 0;
+	textureDesc.Usage = D3D11_USAGE_DEFAULT;
+	textureDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	textureDesc.CPUAccessFlags = 0;
+	textureDesc.MiscFlags = 0;
+	device->CreateTexture2D(&textureDesc, NULL, &heightTexture);
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc;
+	viewDesc.Format = textureDesc.Format;
+	viewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+	viewDesc.Texture2D.MostDetailedMip = 0;
+	viewDesc.Texture2D.MipLevels = 1;
+	if (heightTexture)
+	{
+		device->CreateShaderResourceView(heightTexture, &viewDesc, &heightView);
+	}
+}
+
+void CdlodTerrain::MarkAllDirty()
+{
+	dirtyRect = HeightFieldRect(0, 0, resolution.x, resolution.y);
+}
+
+void CdlodTerrain::MarkDirty(const HeightFieldRect& rect)
+{
+	if (rect.IsEmpty())
+	{
+		return;
+	}
+	if (dirtyRect.IsEmpty())
+	{
+		dirtyRect = rect;
+		return;
+	}
+	dirtyRect = HeightFieldRect((std::min)(dirtyRect.mMin, rect.mMin), (std::min)(dirtyRect.nMin, rect.nMin),
+		(std::max)(dirtyRect.mMax, rect.mMax), (std::max)(dirtyRect.nMax, rect.nMax));
+}
+
+void CdlodTerrain::Update(ID3D11Device* device, ID3D11DeviceContext* deviceContext, const HeightField& heightField, const HeightQuadtree& quadtree,
+	const XMFLOAT3& eye, const Frustum* frustum, const HorizonOcclusion* occlusion, float heightFloor, const CdlodSettings& settings)
+{
+	// the changed heights, in a single box
+	const HeightFieldRect upload = heightField.Clip(dirtyRect);
+	if (!upload.IsEmpty() && heightTexture)
+	{
+		D3D11_BOX box;
+		box.left = upload.nMin;
+		box.right = upload.nMax + 1;
+		box.top = upload.mMin;
+		box.bottom = upload.mMax + 1;
+		box.front = 0;
+		box.back = 1;
+		const float* heights = heightField.GetPointer(upload.mMin, upload.nMin);
+		if (!heights)
+		{
+			// decoded to floats or gathered out of the layout, the rows of the box one after the other
+			const int columns = upload.nMax - upload.nMin + 1;
+			uploadHeights.resize(columns * (upload.mMax - upload.mMin + 1));
+			for (int m = upload.mMin; m <= upload.mMax; m++)
+			{
+				heightField.ReadRow(m, upload.nMin, columns, &uploadHeights[(m - upload.mMin) * columns]);
+			}
+			deviceContext->UpdateSubresource(heightTexture, 0, &box, uploadHeights.data(), columns * sizeof(float), 0);
+		}
+		else
+		{
+			deviceContext->UpdateSubresource(heightTexture, 0, &box, heights, heightField.GetColumns() * sizeof(float), 0);
+		}
+	}
+	dirtyRect = HeightFieldRect();
+
+	selection.Select(quadtree, eye, frustum, occlusion, heightFloor, settings);
+
+	const std::vector<CdlodInstance>& instances = selection.GetInstances();
+	if (instances.empty())
+	{
+		return;
+	}
+	ReserveInstances(device, (int)instances.size());
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	if (instanceBuffer && SUCCEEDED(deviceContext->Map(instanceBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource)))
+	{
+		memcpy(mappedResource.pData, instances.data(), sizeof(CdlodInstance) * instances.size());
+		deviceContext->Unmap(instanceBuffer, 0);
+	}
+}
+
+void CdlodTerrain::SendData(ID3D11DeviceContext* deviceContext)
+{
+	unsigned int stride = sizeof(TerrainVertexType);
+	unsigned int offset = 0;
+
+	deviceContext->IASetVertexBuffers(0, 1, &gridVertexBuffer, &stride, &offset);
+	deviceContext->IASetIndexBuffer(gridIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
+	deviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+}
+
+void CdlodTerrain::CreateGrid(ID3D11Device* device)
+{
+	// The position of a vertex is its point (n, 0, m) in the grid, the vertex shader scales, moves and displaces it
+	const int gridVertices = kGridSize + 1;
+	std::vector<TerrainVertexType> vertices(gridVertices * gridVertices);
+	for (int m = 0; m < gridVertices; m++)
+	{
+		for (int n = 0; n < gridVertices; n++)
+		{
+			TerrainVertexType& vertex = vertices[n + m * gridVertices];
+			vertex.position = XMFLOAT3((float)n, 0.0f, (float)m);
+			vertex.texture = XMFLOAT2((float)m / kGridSize, (float)n / kGridSize);
+			vertex.normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+		}
+	}
+
+	// Two triangles per quad, clockwise seen from above. The quads are ordered by quadrants so the first quarter
+	// of the indices is the first quadrant, which the quadrant instances draw
+	const int half = kGridSize / 2;
+	std::vector<unsigned short> indices;
+	indices.reserve(GetGridIndexCount());
+	for (int quadrant = 0; quadrant < 4; quadrant++)
+	{
+		const int m0 = (quadrant >> 1) * half;
+		const int n0 = (quadrant & 1) * half;
+		for (int m = m0; m < m0 + half; m++)
+		{
+			for (int n = n0; n < n0 + half; n++)
+			{
+				const unsigned short corner = (unsigned short)(n + m * gridVertices);
+				indices.push_back(corner);
+				indices.push_back((unsigned short)(corner + gridVertices));
+				indices.push_back((unsigned short)(corner + 1));
+				indices.push_back((unsigned short)(corner + 1));
+				indices.push_back((unsigned short)(corner + gridVertices));
+				indices.push_back((unsigned short)(corner + gridVertices + 1));
+			}
+		}
+	}
+
+	D3D11_BUFFER_DESC vertexBufferDesc, indexBufferDesc;
+	D3D11_SUBRESOURCE_DATA vertexData, indexData;
+
+	vertexBufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	vertexBufferDesc.ByteWidth = (UINT)(sizeof(TerrainVertexType) * vertices.size());
+	vertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	vertexBufferDesc.CPUAccessFlags = 0;
+	vertexBufferDesc.MiscFlags = 0;
+	vertexBufferDesc.StructureByteStride = 0;
+	vertexData.pSysMem = vertices.data();
+	vertexData.SysMemPitch = 0;
+	vertexData.SysMemSlicePitch = 0;
+	device->CreateBuffer(&vertexBufferDesc, &vertexData, &gridVertexBuffer);
+
+	indexBufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	indexBufferDesc.ByteWidth = (UINT)(sizeof(unsigned short) * indices.size());
+	indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	indexBufferDesc.CPUAccessFlags = 0;
+	indexBufferDesc.MiscFlags = 0;
+	indexBufferDesc.StructureByteStride = 0;
+	indexData.pSysMem = indices.data();
+	indexData.SysMemPitch = 0;
+	indexData.SysMemSlicePitch = 0;
+	device->CreateBuffer(&indexBufferDesc, &indexData, &gridIndexBuffer);
+}
+
+void CdlodTerrain::ReserveInstances(ID3D11Device* device, int instanceCount)
+{
+	if (instanceCount <= instanceCapacity)
+	{
+		return;
+	}
+	ReleaseInstances();
+
+	// grow in powers of two so the buffer is rarely recreated while the camera moves
+	instanceCapacity = 256;
+	while (instanceCapacity < instanceCount)
+	{
+		instanceCapacity *= 2;
+	}
+
+	D3D11_BUFFER_DESC instanceBufferDesc;
+	instanceBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	instanceBufferDesc.ByteWidth = sizeof(CdlodInstance) * instanceCapacity;
+	instanceBufferDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	instanceBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	instanceBufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	instanceBufferDesc.StructureByteStride = sizeof(CdlodInstance);
+	device->CreateBuffer(&instanceBufferDesc, NULL, &instanceBuffer);
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc;
+	viewDesc.Format = DXGI_FORMAT_UNKNOWN;
+	viewDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	viewDesc.Buffer.FirstElement = 0;
+	viewDesc.Buffer.NumElements = instanceCapacity;
+	if (instanceBuffer)
+	{
+		device->CreateShaderResourceView(instanceBuffer, &viewDesc, &instanceView);
+	}
+}
+
+void CdlodTerrain::ReleaseHeights()
+{
+	if (heightView)
+	{
+		heightView->Release();
+		heightView = nullptr;
+	}
+	if (heightTexture)
+	{
+		heightTexture->Release();
+		heightTexture = nullptr;
+	}
+}
+
+void CdlodTerrain::ReleaseInstances()
+{
+	if (instanceView)
+	{
+		instanceView->Release();
+		instanceView = nullptr;
+	}
+	if (instanceBuffer)
+	{
+		instanceBuffer->Release();
+		instanceBuffer = nullptr;
+	}
+	instanceCapacity = 0;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <d3d11.h>
+#include <vector>
+
+#include "HeightField.h"
+#include "CdlodSelection.h"
+
+// GPU data to draw a height map with CDLOD: a single grid mesh of CdlodSelection::kGridSize^2 quads shared by every
+// node, the heights in a texture that terrain_cdlod_vs.hlsl samples to displace the grid and the nodes selected for the
+// eye in a structured buffer read with SV_InstanceID. The whole terrain is drawn with two instanced draws, one for
+// the whole nodes and one for the quadrants
+class CdlodTerrain
+{
+public:
+	CdlodTerrain();
+	~CdlodTerrain();
+
+	// Create the height texture for a height map of the given resolution, all of it dirty
+	void Resize(ID3D11Device* device, XMINT2 resolution);
+
+	// Flag the heights of rect (or everything) to be uploaded in the next Update()
+	void MarkAllDirty();
+	void MarkDirty(const HeightFieldRect& rect);
+
+	// Upload the dirty heights, select the nodes for the eye (in the space of the height map) and upload them
+	void Update(ID3D11Device* device, ID3D11DeviceContext* deviceContext, const HeightField& heightField, const HeightQuadtree& quadtree,
+		const XMFLOAT3& eye, const Frustum* frustum, const HorizonOcclusion* occlusion, float heightFloor, const CdlodSettings& settings);
+
+	// Bind the grid mesh as a triangle list
+	void SendData(ID3D11DeviceContext* deviceContext);
+
+	ID3D11ShaderResourceView* GetHeightTexture() const { return heightView; }
+	ID3D11ShaderResourceView* GetInstances() const { return instanceView; }
+	const CdlodSelection& GetSelection() const { return selection; }
+
+	// Indices of the whole grid and of its first quadrant (the first indices of the grid)
+	static int GetGridIndexCount() { return kGridSize * kGridSize * 6; }
+	static int GetQuadrantIndexCount() { return GetGridIndexCount() / 4; }
+
+private:
+	static const int kGridSize = CdlodSelection::kGridSize;
+
+	void CreateGrid(ID3D11Device* device);
+	// Make room in the instance buffer for instanceCount instances
+	void ReserveInstances(ID3D11Device* device, int instanceCount);
+	void ReleaseHeights();
+	void ReleaseInstances();
+
+	XMINT2 resolution;
+	CdlodSelection selection;
+
+	ID3D11Buffer* gridVertexBuffer;
+	ID3D11Buffer* gridIndexBuffer;
+
+	// one texel per point: the columns (n) are the width and the rows (m) the height
+	ID3D11Texture2D* heightTexture;
+	ID3D11ShaderResourceView* heightView;
+	HeightFieldRect dirtyRect; // points to upload, the union of the changes
+	std::vector<float> uploadHeights; // the points to upload, when the heights are quantised or not row-major
+
+	ID3D11Buffer* instanceBuffer;
+	ID3D11ShaderResourceView* instanceView;
+	int instanceCapacity;
+};
@@ -0,0 +1,328 @@
+#include "ClipmapTerrain.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "TerrainTiles.h"
+
+const int ClipmapTerrain::kBlockQuads;
+const int ClipmapTerrain::kWindowQuads;
+
+static_assert(4 * ClipmapTerrain::kBlockQuads + 2 == ClipmapTerrain::kWindowQuads, "A ring is 4 blocks and the fix-up along each side");
+
+
+ClipmapTerrain::ClipmapTerrain()
+	: resolution(0, 0), texelsUploaded(0), vertexBuffer(nullptr), indexBuffer(nullptr), heightTexture(nullptr), heightView(nullptr),
+	instanceBuffer(nullptr), instanceView(nullptr), instanceCapacity(0)
+{
+	// quads (columns along n, rows along m) of every footprint
+	const int b = kBlockQuads;
+	footprintSizes[kFootprintBlock] = XMINT2(b, b);
+	footprintSizes[kFootprintFixupColumn] = XMINT2(2, b);
+	footprintSizes[kFootprintFixupRow] = XMINT2(b, 2);
+	footprintSizes[kFootprintTrimColumn] = XMINT2(1, 2 * b + 2);
+	footprintSizes[kFootprintTrimRow] = XMINT2(2 * b + 1, 1);
+	footprintSizes[kFootprintInterior] = XMINT2(2 * b + 2, 2 * b + 2);
+	memset(draws, 0, sizeof(draws));
+}
+
+ClipmapTerrain::~ClipmapTerrain()
+{
+	ReleaseHeights();
+	ReleaseInstances();
+	if (vertexBuffer)
+	{
+		vertexBuffer->Release();
+		vertexBuffer = nullptr;
+	}
+	if (indexBuffer)
+	{
+		indexBuffer->Release();
+		indexBuffer = nullptr;
+	}
+}
+
+void ClipmapTerrain::Resize(ID3D11Device* device, XMINT2 newResolution)
+{
+	ReleaseHeights();
+	if (!vertexBuffer)
+	{
+		CreateFootprints(device);
+	}
+
+	resolution = newResolution;
+	clipmap.Resize(resolution);
+
+	// one slice per level, the point (m, n) of a level is in the texel (n & mask, m & mask) of its slice
+	D3D11_TEXTURE2D_DESC textureDesc;
+	textureDesc.Width = GeometryClipmap::kTextureSize;
+	textureDesc.Height = GeometryClipmap::kTextureSize;
+	textureDesc.MipLevels = 1;
+	textureDesc.ArraySize = clipmap.GetLevelCount();
+	textureDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	textureDesc.SampleDesc.Count = 1;
+	textureDesc.SampleDesc.Quality = 0;
+	textureDesc.Usage = D3D11_USAGE_DEFAULT;
+	textureDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	textureDesc.CPUAccessFlags = 0;
+	textureDesc.MiscFlags = 0;
+	device->CreateTexture2D(&textureDesc, NULL, &heightTexture);
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc;
+	viewDesc.Format = textureDesc.Format;
+	viewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+	viewDesc.Texture2DArray.MostDetailedMip = 0;
+	viewDesc.Texture2DArray.MipLevels = 1;
+	viewDesc.Texture2DArray.FirstArraySlice = 0;
+	viewDesc.Texture2DArray.ArraySize = textureDesc.ArraySize;
+	if (heightTexture)
+	{
+		device->CreateShaderResourceView(heightTexture, &viewDesc, &heightView);
+	}
+}
+
+void ClipmapTerrain::Update(ID3D11Device* device, ID3D11DeviceContext* deviceContext, const HeightField& heightField, const XMFLOAT3& eye,
+	const Frustum* frustum, XMFLOAT2 heightBounds)
+{
+	// only the rows and columns that have entered the windows (and the edited points)
+	texelsUploaded = clipmap.Update(heightField, eye);
+	if (heightTexture)
+	{
+		for (const ClipmapRegion& region : clipmap.GetUpdatedRegions())
+		{
+			D3D11_BOX box;
+			box.left = region.texelN;
+			box.right = region.texelN + region.columns;
+			box.top = region.texelM;
+			box.bottom = region.texelM + region.rows;
+			box.front = 0;
+			box.back = 1;
+			const float* heights = &clipmap.GetLevelHeights(region.level)[region.texelN + region.texelM * GeometryClipmap::kTextureSize];
+			deviceContext->UpdateSubresource(heightTexture, D3D11CalcSubresource(0, region.level, 1), &box, heights, GeometryClipmap::kTextureSize * sizeof(float), 0);
+		}
+	}
+
+	// The same ring in every level. The window of the finer level is one quad further from one side of the centre than from
+	// the other (delta), the trim covers that side
+	for (int footprint = 0; footprint < kFootprintCount; footprint++)
+	{
+		instances[footprint].clear();
+	}
+	const int b = kBlockQuads;
+	const int blocks[4] = { 0, b, 2 * b + 2, 3 * b + 2 };
+	for (int level = 0; level < clipmap.GetLevelCount(); level++)
+	{
+		for (int bm = 0; bm < 4; bm++)
+		{
+			for (int bn = 0; bn < 4; bn++)
+			{
+				if ((bm == 1 || bm == 2) && (bn == 1 || bn == 2))
+				{
+					continue;
+				}
+				AddInstance(kFootprintBlock, level, blocks[bm], blocks[bn], frustum, heightBounds);
+			}
+		}
+		AddInstance(kFootprintFixupColumn, level, 0, 2 * b, frustum, heightBounds);
+		AddInstance(kFootprintFixupColumn, level, 3 * b + 2, 2 * b, frustum, heightBounds);
+		AddInstance(kFootprintFixupRow, level, 2 * b, 0, frustum, heightBounds);
+		AddInstance(kFootprintFixupRow, level, 2 * b, 3 * b + 2, frustum, heightBounds);
+
+		if (level == 0)
+		{
+			AddInstance(kFootprintInterior, level, b, b, frustum, heightBounds);
+			continue;
+		}
+		const XMINT2 origin = clipmap.GetLevelOrigin(level);
+		const XMINT2 finerOrigin = clipmap.GetLevelOrigin(level - 1);
+		const int deltaM = finerOrigin.x / 2 - origin.x - b;
+		const int deltaN = finerOrigin.y / 2 - origin.y - b;
+		AddInstance(kFootprintTrimColumn, level, b, deltaN ? b : 3 * b + 1, frustum, heightBounds);
+		AddInstance(kFootprintTrimRow, level, deltaM ? b : 3 * b + 1, deltaN ? b + 1 : b, frustum, heightBounds);
+	}
+
+	// one buffer for all, every footprint is a range of it
+	allInstances.clear();
+	for (int footprint = 0; footprint < kFootprintCount; footprint++)
+	{
+		draws[footprint].firstInstance = (int)allInstances.size();
+		draws[footprint].instanceCount = (int)instances[footprint].size();
+		allInstances.insert(allInstances.end(), instances[footprint].begin(), instances[footprint].end());
+	}
+	if (allInstances.empty())
+	{
+		return;
+	}
+	ReserveInstances(device, (int)allInstances.size());
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	if (instanceBuffer && SUCCEEDED(deviceContext->Map(instanceBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource)))
+	{
+		memcpy(mappedResource.pData, allInstances.data(), sizeof(ClipmapInstance) * allInstances.size());
+		deviceContext->Unmap(instanceBuffer, 0);
+	}
+}
+
+void ClipmapTerrain::AddInstance(int footprint, int level, int m, int n, const Frustum* frustum, XMFLOAT2 heightBounds)
+{
+	// area of the height map under the footprint
+	const XMINT2 origin = clipmap.GetLevelOrigin(level);
+	const int scale = 1 << level;
+	const int mMin = (std::max)((origin.x + m) * scale, 0);
+	const int mMax = (std::min)((origin.x + m + footprintSizes[footprint].y) * scale, resolution.x);
+	const int nMin = (std::max)((origin.y + n) * scale, 0);
+	const int nMax = (std::min)((origin.y + n + footprintSizes[footprint].x) * scale, resolution.y);
+	if (mMin >= mMax || nMin >= nMax)
+	{
+		return;
+	}
+	if (frustum && frustum->TestBox(XMFLOAT3((float)nMin, heightBounds.x, (float)mMin), XMFLOAT3((float)nMax, heightBounds.y, (float)mMax)) == kFrustumOutside)
+	{
+		return;
+	}
+
+	ClipmapInstance instance;
+	instance.offset = XMFLOAT2((float)n, (float)m);
+	instance.level = (float)level;
+	instance.padding = 0.0f;
+	instances[footprint].push_back(instance);
+}
+
+void ClipmapTerrain::SendData(ID3D11DeviceContext* deviceContext)
+{
+	unsigned int stride = sizeof(TerrainVertexType);
+	unsigned int offset = 0;
+
+	deviceContext->IASetVertexBuffers(0, 1, &vertexBuffer, &stride, &offset);
+	deviceContext->IASetIndexBuffer(indexBuffer, DXGI_FORMAT_R16_UINT, 0);
+	deviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+}
+
+void ClipmapTerrain::CreateFootprints(ID3D11Device* device)
+{
+	// Every footprint is a grid of its quads with the vertex positions (n, 0, m) from its first quad, one after the other
+	std::vector<TerrainVertexType> vertices;
+	std::vector<unsigned short> indices;
+	for (int footprint = 0; footprint < kFootprintCount; footprint++)
+	{
+		const int columns = footprintSizes[footprint].x;
+		const int rows = footprintSizes[footprint].y;
+		const int firstVertex = (int)vertices.size();
+		for (int m = 0; m <= rows; m++)
+		{
+			for (int n = 0; n <= columns; n++)
+			{
+				TerrainVertexType vertex;
+				vertex.position = XMFLOAT3((float)n, 0.0f, (float)m);
+				vertex.texture = XMFLOAT2(0.0f, 0.0f);
+				vertex.normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+				vertices.push_back(vertex);
+			}
+		}
+
+		// two triangles per quad, clockwise seen from above
+		draws[footprint].startIndex = (int)indices.size();
+		for (int m = 0; m < rows; m++)
+		{
+			for (int n = 0; n < columns; n++)
+			{
+				const unsigned short corner = (unsigned short)(firstVertex + n + m * (columns + 1));
+				indices.push_back(corner);
+				indices.push_back((unsigned short)(corner + columns + 1));
+				indices.push_back((unsigned short)(corner + 1));
+				indices.push_back((unsigned short)(corner + 1));
+				indices.push_back((unsigned short)(corner + columns + 1));
+				indices.push_back((unsigned short)(corner + columns + 2));
+			}
+		}
+		draws[footprint].indexCount = (int)indices.size() - draws[footprint].startIndex;
+	}
+
+	D3D11_BUFFER_DESC vertexBufferDesc, indexBufferDesc;
+	D3D11_SUBRESOURCE_DATA vertexData, indexData;
+
+	vertexBufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	vertexBufferDesc.ByteWidth = (UINT)(sizeof(TerrainVertexType) * vertices.size());
+	vertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	vertexBufferDesc.CPUAccessFlags = 0;
+	vertexBufferDesc.MiscFlags = 0;
+	vertexBufferDesc.StructureByteStride = 0;
+	vertexData.pSysMem = vertices.data();
+	vertexData.SysMemPitch = 0;
+	vertexData.SysMemSlicePitch = 0;
+	device->CreateBuffer(&vertexBufferDesc, &vertexData, &vertexBuffer);
+
+	indexBufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	indexBufferDesc.ByteWidth = (UINT)(sizeof(unsigned short) * indices.size());
+	indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	indexBufferDesc.CPUAccessFlags = 0;
+	indexBufferDesc.MiscFlags = 0;
+	indexBufferDesc.StructureByteStride = 0;
+	indexData.pSysMem = indices.data();
+	indexData.SysMemPitch = 0;
+	indexData.SysMemSlicePitch = 0;
+	device->CreateBuffer(&indexBufferDesc, &indexData, &indexBuffer);
+}
+
+void ClipmapTerrain::ReserveInstances(ID3D11Device* device, int instanceCount)
+{
+	if (instanceCount <= instanceCapacity)
+	{
+		return;
+	}
+	ReleaseInstances();
+
+	// at most 20 footprints per level, the buffer is only created again if the number of levels grows
+	instanceCapacity = 20 * GeometryClipmap::kMaxLevels;
+	while (instanceCapacity < instanceCount)
+	{
+		instanceCapacity *= 2;
+	}
+
+	D3D11_BUFFER_DESC instanceBufferDesc;
+	instanceBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	instanceBufferDesc.ByteWidth = sizeof(ClipmapInstance) * instanceCapacity;
+	instanceBufferDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	instanceBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	instanceBufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	instanceBufferDesc.StructureByteStride = sizeof(ClipmapInstance);
+	device->CreateBuffer(&instanceBufferDesc, NULL, &instanceBuffer);
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc;
+	viewDesc.Format = DXGI_FORMAT_UNKNOWN;
+	viewDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	viewDesc.Buffer.FirstElement = 0;
+	viewDesc.Buffer.NumElements = instanceCapacity;
+	if (instanceBuffer)
+	{
+		device->CreateShaderResourceView(instanceBuffer, &viewDesc, &instanceView);
+	}
+}
+
+void ClipmapTerrain::ReleaseHeights()
+{
+	if (heightView)
+	{
+		heightView->Release();
+		heightView = nullptr;
+	}
+	if (heightTexture)
+	{
+		heightTexture->Release();
+		heightTexture = nullptr;
+	}
+}
+
+void ClipmapTerrain::ReleaseInstances()
+{
+	if (instanceView)
+	{
+		instanceView->Release();
+		instanceView = nullptr;
+	}
+	if (instanceBuffer)
+	{
+		instanceBuffer->Release();
+		instanceBuffer = nullptr;
+	}
+	instanceCapacity = 0;
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include <d3d11.h>
+#include <vector>
+
+#include "GeometryClipmap.h"
+#include "Frustum.h"
+
+// Pieces of the ring of a clipmap level, each one a mesh drawn for all the levels with a single instanced draw
+enum ClipmapFootprint
+{
+	kFootprintBlock = 0, // 12 per level around the centre
+	kFootprintFixupColumn, // the gap between the blocks in the middle of the ring
+	kFootprintFixupRow,
+	kFootprintTrimColumn, // L shaped strip between the ring and the next finer level, on the side the finer window leaves
+	kFootprintTrimRow,
+	kFootprintInterior, // centre of the finest level
+	kFootprintCount
+};
+
+// A footprint placed in the window of a level, the same layout as the instance buffer of terrain_clipmap_vs.hlsl
+struct ClipmapInstance
+{
+	XMFLOAT2 offset; // first quad (n, m) of the footprint inside the window
+	float level;
+	float padding;
+};
+
+// Instances of a footprint and its part of the shared index buffer
+struct ClipmapDraw
+{
+	int startIndex;
+	int indexCount;
+	int firstInstance;
+	int instanceCount;
+};
+
+// GPU data to draw a height map as a geometry clipmap: the windows of GeometryClipmap in a texture array (one slice per level,
+// only the refreshed regions are uploaded) and the footprints of the rings (Losasso & Hoppe) in one vertex and index buffer.
+// With windows of 255 points a ring is 4x4 blocks of 63 quads with 2 quads of fix-up in the middle; the centre of the ring is
+// the next finer level plus the trim, the finest level fills it with the interior
+class ClipmapTerrain
+{
+public:
+	static const int kBlockQuads = (GeometryClipmap::kWindowSize + 1) / 4 - 1;
+	static const int kWindowQuads = GeometryClipmap::kWindowSize - 1;
+
+	ClipmapTerrain();
+	~ClipmapTerrain();
+
+	// Create the texture array for a height map of the given resolution, all of it dirty
+	void Resize(ID3D11Device* device, XMINT2 resolution);
+
+	void MarkAllDirty() { clipmap.MarkAllDirty(); }
+	void MarkDirty(const HeightFieldRect& rect) { clipmap.MarkDirty(rect); }
+
+	// Move the windows to the eye (in the space of the height map), upload the refreshed texels and place the footprints of every
+	// level. Only the footprints over the height map and inside the frustum (if it is not null) with heights in heightBounds are drawn
+	void Update(ID3D11Device* device, ID3D11DeviceContext* deviceContext, const HeightField& heightField, const XMFLOAT3& eye,
+		const Frustum* frustum, XMFLOAT2 heightBounds);
+
+	// Bind the footprint meshes as a triangle list
+	void SendData(ID3D11DeviceContext* deviceContext);
+
+	ID3D11ShaderResourceView* GetHeightTexture() const { return heightView; }
+	ID3D11ShaderResourceView* GetInstances() const { return instanceView; }
+	const GeometryClipmap& GetClipmap() const { return clipmap; }
+	const ClipmapDraw& GetDraw(int footprint) const { return draws[footprint]; }
+	// Texels uploaded by the last Update()
+	int GetTexelsUploaded() const { return texelsUploaded; }
+
+private:
+	void CreateFootprints(ID3D11Device* device);
+	// Add an instance of the footprint at the quad (m, n) of the window of level if it is over the height map and visible
+	void AddInstance(int footprint, int level, int m, int n, const Frustum* frustum, XMFLOAT2 heightBounds);
+	void ReserveInstances(ID3D11Device* device, int instanceCount);
+	void ReleaseHeights();
+	void ReleaseInstances();
+
+	XMINT2 resolution;
+	GeometryClipmap clipmap;
+	int texelsUploaded;
+
+	ID3D11Buffer* vertexBuffer;
+	ID3D11Buffer* indexBuffer;
+	XMINT2 footprintSizes[kFootprintCount]; // quads (columns, rows)
+	ClipmapDraw draws[kFootprintCount];
+
+	ID3D11Texture2D* heightTexture;
+	ID3D11ShaderResourceView* heightView;
+
+	std::vector<ClipmapInstance> instances[kFootprintCount];
+	std::vector<ClipmapInstance> allInstances;
+	ID3D11Buffer* instanceBuffer;
+	ID3D11ShaderResourceView* instanceView;
+	int instanceCapacity;
+};
@@ -0,0 +1,200 @@
+#include "DistanceTransform.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "Parallel.h"
+
+// squared distance used for the points which have not reached the mask
+static const float kSquaredInfinity = 1e20f;
+// number of columns gathered together in the column pass, so every row read is a contiguous block
+static const int kColumnGroup = 16;
+
+
+void DistanceTransform::BuildMask(const HeightField& heightField, MaskType type, float threshold, std::vector<unsigned char>& mask)
+{
+	const int rows = heightField.GetRows();
+	const int columns = heightField.GetColumns();
+
+	mask.resize(heightField.GetSize());
+
+	Parallel::ForBlocks(0, rows, 16, [&](int mBegin, int mEnd)
+	{
+		// rows above, current and below for the slope
+		std::vector<float> above(columns), row(columns), below(columns);
+
+		for (int m = mBegin; m < mEnd; m++)
+		{
+			heightField.ReadRow(m, row.data());
+			unsigned char* maskRow = &mask[heightField.GetIndex(m, 0)];
+
+			if (type == kMaskBelowHeight || type == kMaskAboveHeight)
+			{
+				for (int n = 0; n < columns; n++)
+				{
+					maskRow[n] = (row[n] < threshold) == (type == kMaskBelowHeight) ? 1 : 0;
+				}
+				continue;
+			}
+
+			// slope from central differences (one sided at the borders)
+			heightField.ReadRow(std::max(m - 1, 0), above.data());
+			heightField.ReadRow(std::min(m + 1, rows - 1), below.data());
+			const float mSpacing = (m > 0 && m < rows - 1) ? 0.5f : 1.0f;
+			for (int n = 0; n < columns; n++)
+			{
+				const int left = std::max(n - 1, 0);
+				const int right = std::min(n + 1, columns - 1);
+				const float dn = (row[right] - row[left]) / (float)(right - left);
+				const float dm = (below[n] - above[n]) * mSpacing;
+				maskRow[n] = (sqrtf(dn * dn + dm * dm) > threshold) ? 1 : 0;
+			}
+		}
+	});
+}
+
+void DistanceTransform::Compute(XMINT2 resolution, const std::vector<unsigned char>& mask, std::vector<float>& distance)
+{
+	const int rows = resolution.x + 1;
+	const int columns = resolution.y + 1;
+
+	distance.resize(rows * columns);
+
+	// Pass 1: along every row the nearest point of the mask is found with a forward and a backward sweep.
+	// The result is the squared distance inside the row
+	Parallel::ForBlocks(0, rows, 16, [&](int mBegin, int mEnd)
+	{
+		for (int m = mBegin; m < mEnd; m++)
+		{
+			const unsigned char* maskRow = &mask[m * columns];
+			float* distanceRow = &distance[m * columns];
+
+			int last = -1;
+			for (int n = 0; n < columns; n++)
+			{
+				if (maskRow[n])
+				{
+					last = n;
+				}
+				distanceRow[n] = (last >= 0) ? (float)(n - last) : kSquaredInfinity;
+			}
+
+			last = -1;
+			for (int n = columns - 1; n >= 0; n--)
+			{
+				if (maskRow[n])
+				{
+					last = n;
+				}
+				if (last >= 0)
+				{
+					distanceRow[n] = std::min(distanceRow[n], (float)(last - n));
+				}
+				if (distanceRow[n] < kSquaredInfinity)
+				{
+					distanceRow[n] *= distanceRow[n];
+				}
+			}
+		}
+	});
+
+	// Pass 2: along every column, lower envelope of the parabolas rooted at the row distances.
+	// Groups of columns are copied out together, so the reads of the column are contiguous
+	const int groups = (columns + kColumnGroup - 1) / kColumnGroup;
+	Parallel::ForBlocks(0, groups, 1, [&](int groupBegin, int groupEnd)
+	{
+		std::vector<float> f(rows * kColumnGroup), d(rows);
+		std::vector<int> v(rows);
+		std::vector<float> z(rows + 1);
+
+		for (int group = groupBegin; group < groupEnd; group++)
+		{
+			const int nBegin = group * kColumnGroup;
+			const int groupSize = std::min(kColumnGroup, columns - nBegin);
+
+			// gather the columns of the group (f is column major)
+			for (int m = 0; m < rows; m++)
+			{
+				const float* distanceRow = &distance[m * columns + nBegin];
+				for (int c = 0; c < groupSize; c++)
+				{
+					f[c * rows + m] = distanceRow[c];
+				}
+			}
+
+			// transform every column and scatter the final distance
+			for (int c = 0; c < groupSize; c++)
+			{
+				Transform1D(&f[c * rows], d.data(), rows, v.data(), z.data());
+				for (int m = 0; m < rows; m++)
+				{
+					distance[m * columns + nBegin + c] = (d[m] < kSquaredInfinity) ? sqrtf(d[m]) : std::numeric_limits<float>::infinity();
+				}
+			}
+		}
+	});
+}
+
+void DistanceTransform::DistanceToWater(const HeightField& heightField, float waterLevel, std::vector<float>& distance)
+{
+	std::vector<unsigned char> mask;
+
+	BuildMask(heightField, kMaskBelowHeight, waterLevel, mask);
+	Compute(heightField.GetResolution(), mask, distance);
+}
+
+void DistanceTransform::Transform1D(const float* f, float* d, int count, int* v, float* z)
+{
+	// v: positions of the parabolas of the lower envelope
+	// z: limits of the range where each parabola is the lowest one
+	int k = -1;
+	for (int q = 0; q < count; q++)
+	{
+		if (f[q] >= kSquaredInfinity)
+		{
+			continue; // no parabola rooted here
+		}
+
+		// intersection with the last parabola of the envelope, removing the ones hidden by the new parabola.
+		// (q - p) * (q + p) == q^2 - p^2 kept in integers to avoid rounding on big maps
+		float s = 0.0f;
+		while (k >= 0)
+		{
+			const int p = v[k];
+			s = ((f[q] - f[p]) + (float)((q - p) * (q + p))) / (float)(2 * (q - p));
+			if (s > z[k])
+			{
+				break;
+			}
+			k--;
+		}
+
+		k++;
+		v[k] = q;
+		z[k] = (k == 0) ? -kSquaredInfinity : s;
+		z[k + 1] = kSquaredInfinity;
+	}
+
+	// empty envelope: no point of the line reaches the mask
+	if (k < 0)
+	{
+		for (int q = 0; q < count; q++)
+		{
+			d[q] = kSquaredInfinity;
+		}
+		return;
+	}
+
+	// evaluate the envelope
+	k = 0;
+	for (int q = 0; q < count; q++)
+	{
+		while (z[k + 1] < (float)q)
+		{
+			k++;
+		}
+		const float offset = (float)(q - v[k]);
+		d[q] = offset * offset + f[v[k]];
+	}
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <vector>
+
+#include "HeightField.h"
+
+// Binary masks that can be built from the height map
+enum MaskType
+{
+	kMaskBelowHeight = 0, // points below the threshold height (e.g. under the water level)
+	kMaskAboveHeight = 1, // points at or above the threshold height
+	kMaskSlopeAbove = 2 // points where the slope (rise over run) is over the threshold
+};
+
+class DistanceTransform
+{
+public:
+	// Build a mask with one value per height map point (1 inside the mask, 0 outside)
+	static void BuildMask(const HeightField& heightField, MaskType type, float threshold, std::vector<unsigned char>& mask);
+
+	// Exact Euclidean distance transform (Felzenszwalb & Huttenlocher 2012).
+	// Return, for every point, the distance (in points) to the nearest point inside the mask, 0 for the points inside.
+	// It is separable: a sweep along the rows and then the lower envelope along the columns, each line runs in parallel in linear time.
+	// If the mask is empty every distance is infinite
+	static void Compute(XMINT2 resolution, const std::vector<unsigned char>& mask, std::vector<float>& distance);
+
+	// Distance to the coast: distance from every dry point to the nearest point below the water level
+	static void DistanceToWater(const HeightField& heightField, float waterLevel, std::vector<float>& distance);
+
+private:
+	// 1D squared distance transform of the sampled function f (lower envelope of parabolas).
+	// v, z are scratch buffers of size count and count + 1
+	static void Transform1D(const float* f, float* d, int count, int* v, float* z);
+};
@@ -0,0 +1,62 @@
+#include "Frustum.h"
+
+#include <cmath>
+
+
+Frustum::Frustum()
+{
+	for (int plane = 0; plane < kPlaneCount; plane++)
+	{
+		planes[plane] = XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f);
+	}
+}
+
+void Frustum::Build(const XMMATRIX& worldViewProjection)
+{
+	// With row vectors clip = p * M, so every clip coordinate is the dot product with a column of M
+	XMFLOAT4X4 columns;
+	XMStoreFloat4x4(&columns, XMMatrixTranspose(worldViewProjection));
+	const XMVECTOR x = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(columns.m[0]));
+	const XMVECTOR y = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(columns.m[1]));
+	const XMVECTOR z = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(columns.m[2]));
+	const XMVECTOR w = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(columns.m[3]));
+
+	// -w <= x <= w, -w <= y <= w, 0 <= z <= w
+	XMVECTOR extracted[kPlaneCount];
+	extracted[kPlaneLeft] = XMVectorAdd(w, x);
+	extracted[kPlaneRight] = XMVectorSubtract(w, x);
+	extracted[kPlaneBottom] = XMVectorAdd(w, y);
+	extracted[kPlaneTop] = XMVectorSubtract(w, y);
+	extracted[kPlaneNear] = z;
+	extracted[kPlaneFar] = XMVectorSubtract(w, z);
+
+	for (int plane = 0; plane < kPlaneCount; plane++)
+	{
+		XMStoreFloat4(&planes[plane], XMPlaneNormalize(extracted[plane]));
+	}
+}
+
+FrustumTestResult Frustum::TestBox(const XMFLOAT3& boxMin, const XMFLOAT3& boxMax) const
+{
+	FrustumTestResult result = kFrustumInside;
+
+	for (int plane = 0; plane < kPlaneCount; plane++)
+	{
+		const XMFLOAT4& p = planes[plane];
+
+		// corner of the box furthest along the normal (positive) and the opposite one (negative)
+		const float positive = p.x * (p.x >= 0.0f ? boxMax.x : boxMin.x) + p.y * (p.y >= 0.0f ? boxMax.y : boxMin.y) + p.z * (p.z >= 0.0f ? boxMax.z : boxMin.z) + p.w;
+		if (positive < 0.0f)
+		{
+			return kFrustumOutside;
+		}
+
+		const float negative = p.x * (p.x >= 0.0f ? boxMin.x : boxMax.x) + p.y * (p.y >= 0.0f ? boxMin.y : boxMax.y) + p.z * (p.z >= 0.0f ? boxMin.z : boxMax.z) + p.w;
+		if (negative < 0.0f)
+		{
+			result = kFrustumIntersect;
+		}
+	}
+
+	return result;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <DirectXMath.h>
+
+using namespace DirectX;
+
+// Result of testing a volume against the frustum
+enum FrustumTestResult
+{
+	kFrustumOutside = 0,
+	kFrustumIntersect = 1,
+	kFrustumInside = 2
+};
+
+// View frustum as six planes, for culling on the CPU
+class Frustum
+{
+public:
+	enum Plane
+	{
+		kPlaneLeft = 0,
+		kPlaneRight,
+		kPlaneBottom,
+		kPlaneTop,
+		kPlaneNear,
+		kPlaneFar,
+		kPlaneCount
+	};
+
+	Frustum();
+
+	// Extract the planes from the combined world * view * projection matrix (Gribb & Hartmann),
+	// so the tests are done in the space of the object. Depth in [0, 1] as in Direct3D
+	void Build(const XMMATRIX& worldViewProjection);
+
+	// Test an axis aligned box: outside, crossing a plane or completely inside
+	FrustumTestResult TestBox(const XMFLOAT3& boxMin, const XMFLOAT3& boxMax) const;
+
+	// Plane (a, b, c, d) with the normal (a, b, c) pointing inside, normalised
+	const XMFLOAT4& GetPlane(int plane) const { return planes[plane]; }
+
+private:
+	XMFLOAT4 planes[kPlaneCount];
+};
@@ -0,0 +1,176 @@
+#include "GeometryClipmap.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+const int GeometryClipmap::kTextureSize;
+const int GeometryClipmap::kWindowSize;
+const int GeometryClipmap::kMaxLevels;
+const int GeometryClipmap::kTextureMask;
+
+static_assert((GeometryClipmap::kTextureSize & (GeometryClipmap::kTextureSize - 1)) == 0, "The texels wrap around with a mask");
+static_assert(GeometryClipmap::kWindowSize % 4 == 3, "The windows start on even points and their centre is a point");
+
+
+GeometryClipmap::GeometryClipmap()
+	: resolution(0, 0), allDirty(true)
+{
+}
+
+void GeometryClipmap::Resize(XMINT2 newResolution)
+{
+	resolution = newResolution;
+
+	// enough levels for the coarsest window to reach the far side of the height map from any point of it
+	const int halfWindow = (kWindowSize - 1) / 2;
+	const int size = (std::max)(resolution.x, resolution.y);
+	int levelCount = 1;
+	while (levelCount < kMaxLevels && (halfWindow << (levelCount - 1)) < size)
+	{
+		levelCount++;
+	}
+
+	levels.resize(levelCount);
+	for (Level& level : levels)
+	{
+		level.origin = XMINT2(0, 0);
+		level.valid = false;
+		level.heights.assign(kTextureSize * kTextureSize, 0.0f);
+	}
+	regions.clear();
+	MarkAllDirty();
+}
+
+void GeometryClipmap::MarkAllDirty()
+{
+	allDirty = true;
+	dirtyRect = HeightFieldRect();
+}
+
+void GeometryClipmap::MarkDirty(const HeightFieldRect& rect)
+{
+	if (rect.IsEmpty() || allDirty)
+	{
+		return;
+	}
+	if (dirtyRect.IsEmpty())
+	{
+		dirtyRect = rect;
+		return;
+	}
+	dirtyRect = HeightFieldRect((std::min)(dirtyRect.mMin, rect.mMin), (std::min)(dirtyRect.nMin, rect.nMin),
+		(std::max)(dirtyRect.mMax, rect.mMax), (std::max)(dirtyRect.nMax, rect.nMax));
+}
+
+XMINT2 GeometryClipmap::GetWindowOrigin(const XMFLOAT3& eye, int level)
+{
+	// The eye is in the two points around the centre of the window, which starts on an even point
+	const float scale = (float)(1 << level);
+	const int start = (kWindowSize - 1) / 2 - 1;
+	return XMINT2(2 * (int)floorf(eye.z / scale * 0.5f) - start, 2 * (int)floorf(eye.x / scale * 0.5f) - start);
+}
+
+int GeometryClipmap::Update(const HeightField& heightField, const XMFLOAT3& eye)
+{
+	regions.clear();
+	const int last = kWindowSize - 1;
+
+	for (int level = 0; level < (int)levels.size(); level++)
+	{
+		Level& clipLevel = levels[level];
+		const XMINT2 origin = GetWindowOrigin(eye, level);
+		const int dm = origin.x - clipLevel.origin.x;
+		const int dn = origin.y - clipLevel.origin.y;
+		clipLevel.origin = origin;
+
+		// nothing in common with the old window
+		if (!clipLevel.valid || allDirty || abs(dm) >= kWindowSize || abs(dn) >= kWindowSize)
+		{
+			clipLevel.valid = true;
+			Refresh(heightField, level, origin.x, origin.y, origin.x + last, origin.y + last);
+			continue;
+		}
+
+		// the rows that have entered the window, then the columns that have entered it in the other rows
+		int rowMin = origin.x, rowMax = origin.x + last;
+		if (dm > 0)
+		{
+			Refresh(heightField, level, rowMax - dm + 1, origin.y, rowMax, origin.y + last);
+			rowMax -= dm;
+		}
+		else if (dm < 0)
+		{
+			Refresh(heightField, level, rowMin, origin.y, rowMin - dm - 1, origin.y + last);
+			rowMin -= dm;
+		}
+		if (dn > 0)
+		{
+			Refresh(heightField, level, rowMin, origin.y + last - dn + 1, rowMax, origin.y + last);
+		}
+		else if (dn < 0)
+		{
+			Refresh(heightField, level, rowMin, origin.y, rowMax, origin.y - dn - 1);
+		}
+
+		// the edited points of the level inside the window. The points beyond the borders of the height map repeat
+		// the border, so they change with it
+		if (!dirtyRect.IsEmpty())
+		{
+			const int scale = 1 << level;
+			const int mMin = (std::max)(dirtyRect.mMin <= 0 ? INT_MIN : (dirtyRect.mMin + scale - 1) / scale, origin.x);
+			const int mMax = (std::min)(dirtyRect.mMax >= resolution.x ? INT_MAX : dirtyRect.mMax / scale, origin.x + last);
+			const int nMin = (std::max)(dirtyRect.nMin <= 0 ? INT_MIN : (dirtyRect.nMin + scale - 1) / scale, origin.y);
+			const int nMax = (std::min)(dirtyRect.nMax >= resolution.y ? INT_MAX : dirtyRect.nMax / scale, origin.y + last);
+			if (mMin <= mMax && nMin <= nMax)
+			{
+				Refresh(heightField, level, mMin, nMin, mMax, nMax);
+			}
+		}
+	}
+	allDirty = false;
+	dirtyRect = HeightFieldRect();
+
+	int texels = 0;
+	for (const ClipmapRegion& region : regions)
+	{
+		texels += region.rows * region.columns;
+	}
+	return texels;
+}
+
+void GeometryClipmap::Refresh(const HeightField& heightField, int level, int mMin, int nMin, int mMax, int nMax)
+{
+	// the point (m, n) of the level is the point (m, n) * 2^level of the height map, clamped to it
+	const int scale = 1 << level;
+	std::vector<float>& heights = levels[level].heights;
+	for (int m = mMin; m <= mMax; m++)
+	{
+		const int mapM = (std::min)((std::max)(m * scale, 0), resolution.x);
+		float* row = &heights[(m & kTextureMask) * kTextureSize];
+		for (int n = nMin; n <= nMax; n++)
+		{
+			row[n & kTextureMask] = heightField.Get(mapM, (std::min)((std::max)(n * scale, 0), resolution.y));
+		}
+	}
+
+	// the same rectangle in the texture, split where it wraps around
+	const int texelM = mMin & kTextureMask, texelN = nMin & kTextureMask;
+	const int rows = mMax - mMin + 1, columns = nMax - nMin + 1;
+	const int rowsBeforeWrap = (std::min)(rows, kTextureSize - texelM);
+	const int columnsBeforeWrap = (std::min)(columns, kTextureSize - texelN);
+	const ClipmapRegion parts[4] =
+	{
+		{ level, texelM, texelN, rowsBeforeWrap, columnsBeforeWrap },
+		{ level, texelM, 0, rowsBeforeWrap, columns - columnsBeforeWrap },
+		{ level, 0, texelN, rows - rowsBeforeWrap, columnsBeforeWrap },
+		{ level, 0, 0, rows - rowsBeforeWrap, columns - columnsBeforeWrap }
+	};
+	for (const ClipmapRegion& part : parts)
+	{
+		if (part.rows > 0 && part.columns > 0)
+		{
+			regions.push_back(part);
+		}
+	}
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <vector>
+
+#include "HeightField.h"
+
+// Rectangle of the toroidal texture of a clipmap level refreshed by GeometryClipmap::Update(), it never wraps
+struct ClipmapRegion
+{
+	int level;
+	int texelM, texelN; // first texel (row, column)
+	int rows, columns;
+};
+
+// Height data of a geometry clipmap (Losasso & Hoppe): nested square windows of kWindowSize^2 points centred on the eye,
+// the level l has a point every 2^l points of the height map so every level covers twice the area of the previous one.
+// Each window is kept in a texture of kTextureSize^2 texels addressed toroidally (the point (m, n) of the level is in the
+// texel (m & mask, n & mask)), so when the eye moves only the rows and columns that enter the window are written
+// and the upload is proportional to the movement, not to the size of the terrain.
+// Everything is in the space of the height map: x = n, y = height, z = m
+class GeometryClipmap
+{
+public:
+	static const int kTextureSize = 256; // texels per side of the texture of a level, a power of two
+	static const int kWindowSize = kTextureSize - 1; // points per side of a window
+	static const int kMaxLevels = 10;
+
+	GeometryClipmap();
+
+	// Choose the number of levels for a height map of the given resolution, all of them dirty
+	void Resize(XMINT2 resolution);
+
+	// Flag the heights of rect (or everything) to be refreshed in every level in the next Update()
+	void MarkAllDirty();
+	void MarkDirty(const HeightFieldRect& rect);
+
+	// Move the windows to the eye and refresh the points that have entered them or are dirty.
+	// Return the number of texels refreshed, GetUpdatedRegions() has the parts of the textures to upload
+	int Update(const HeightField& heightField, const XMFLOAT3& eye);
+
+	int GetLevelCount() const { return (int)levels.size(); }
+	// First point (m, n) of the window of a level, in points of the level (2^level points of the height map).
+	// It is always even, so the border of a window is on the points of the next level
+	XMINT2 GetLevelOrigin(int level) const { return levels[level].origin; }
+	// Toroidal image of a level: the height of the point (m, n) of the level is at (n & mask) + (m & mask) * kTextureSize
+	const std::vector<float>& GetLevelHeights(int level) const { return levels[level].heights; }
+	const std::vector<ClipmapRegion>& GetUpdatedRegions() const { return regions; }
+
+	// Window of the level containing the eye, as Update() places it
+	static XMINT2 GetWindowOrigin(const XMFLOAT3& eye, int level);
+
+private:
+	struct Level
+	{
+		XMINT2 origin;
+		bool valid; // the heights match the window at origin
+		std::vector<float> heights;
+	};
+
+	// Refresh the points [mMin, mMax] x [nMin, nMax] of the level (in its points, inside the window)
+	void Refresh(const HeightField& heightField, int level, int mMin, int nMin, int mMax, int nMax);
+
+	static const int kTextureMask = kTextureSize - 1;
+
+	XMINT2 resolution;
+	std::vector<Level> levels;
+	std::vector<ClipmapRegion> regions;
+	bool allDirty;
+	HeightFieldRect dirtyRect; // union of the changed points of the height map since the last update
+};
@@ -0,0 +1,135 @@
+#pragma once
+#include <DirectXMath.h>
+#include <algorithm>
+
+#include "HeightMapLayout.h"
+#include "QuantisedHeightMap.h"
+
+using namespace DirectX;
+
+// Rectangle of height map points, both corners included
+struct HeightFieldRect
+{
+	HeightFieldRect() : mMin(0), nMin(0), mMax(-1), nMax(-1) {} // empty
+	HeightFieldRect(int iMMin, int iNMin, int iMMax, int iNMax) : mMin(iMMin), nMin(iNMin), mMax(iMMax), nMax(iNMax) {}
+
+	bool IsEmpty() const { return mMax < mMin || nMax < nMin; }
+	int GetArea() const { return IsEmpty() ? 0 : (mMax - mMin + 1) * (nMax - nMin + 1); }
+
+	int mMin, nMin;
+	int mMax, nMax;
+};
+
+// View over the height map data held by a TerrainMesh, either floats or a QuantisedHeightMap.
+// The points are addressed the same way as the terrain: m == rows == x, n == columns == y
+// and there are (resolution + 1) points along each axis. The floats are stored in Layout, the terrain uses
+// HeightField (the HeightMapLayout chosen at compile time); HeightMapLayoutBenchmark runs the same operations on the others.
+// It does not own the data, so it is only valid while the terrain keeps the same resolution and storage.
+template <class Layout>
+class BasicHeightField
+{
+public:
+	BasicHeightField(float* iData, XMINT2 iResolution)
+		: data(iData), quantised(nullptr), resolution(iResolution), layout(iResolution)
+	{
+	}
+	BasicHeightField(QuantisedHeightMap* iQuantised)
+		: data(nullptr), quantised(iQuantised), resolution(iQuantised->GetResolution()), layout(resolution)
+	{
+	}
+
+	bool IsQuantised() const { return quantised != nullptr; }
+
+	XMINT2 GetResolution() const { return resolution; }
+	int GetRows() const { return resolution.x + 1; } // number of points along m
+	int GetColumns() const { return resolution.y + 1; } // number of points along n
+	int GetSize() const { return GetRows() * GetColumns(); } // total number of points
+
+	// check if a point is in the map/terrain
+	bool InBounds(int m, int n) const
+	{
+		return (m >= 0 && m <= resolution.x && n >= 0 && n <= resolution.y);
+	}
+
+	// rectangle covering the whole map
+	HeightFieldRect GetBounds() const { return HeightFieldRect(0, 0, resolution.x, resolution.y); }
+
+	// part of the rectangle inside the map
+	HeightFieldRect Clip(const HeightFieldRect& rect) const
+	{
+		return HeightFieldRect(rect.mMin < 0 ? 0 : rect.mMin, rect.nMin < 0 ? 0 : rect.nMin,
+			rect.mMax > resolution.x ? resolution.x : rect.mMax, rect.nMax > resolution.y ? resolution.y : rect.nMax);
+	}
+
+	// return the index of the point in a row-major per point array (the same size as the map)
+	int GetIndex(int m, int n) const
+	{
+		return (n + (m * (resolution.y + 1)));
+	}
+
+	// Floats to allocate for the heights of a resolution in Layout
+	static int GetStorageSize(XMINT2 resolution) { return Layout(resolution).GetSize(); }
+
+	float Get(int m, int n) const { return data ? data[layout.GetOffset(m, n)] : quantised->Get(m, n); }
+	void Set(int m, int n, float height)
+	{
+		if (data)
+		{
+			data[layout.GetOffset(m, n)] = height;
+		}
+		else
+		{
+			quantised->Set(m, n, height);
+		}
+	}
+
+	// Copy a full row (GetColumns() floats) out of/into the height map
+	void ReadRow(int m, float* dst) const { ReadRow(m, 0, GetColumns(), dst); }
+	void WriteRow(int m, const float* src) { WriteRow(m, 0, GetColumns(), src); }
+	// Copy count points of a row from (m, nMin)
+	void ReadRow(int m, int nMin, int count, float* dst) const
+	{
+		if (data)
+		{
+			// the points of the row that are together in memory at a time, the whole row in row-major
+			for (int n = nMin; n < nMin + count;)
+			{
+				const int run = (std::min)(layout.GetRun(m, n), nMin + count - n);
+				const float* src = &data[layout.GetOffset(m, n)];
+				std::copy(src, src + run, &dst[n - nMin]);
+				n += run;
+			}
+		}
+		else
+		{
+			quantised->ReadRow(m, nMin, count, dst);
+		}
+	}
+	void WriteRow(int m, int nMin, int count, const float* src)
+	{
+		if (data)
+		{
+			for (int n = nMin; n < nMin + count;)
+			{
+				const int run = (std::min)(layout.GetRun(m, n), nMin + count - n);
+				std::copy(&src[n - nMin], &src[n - nMin + run], &data[layout.GetOffset(m, n)]);
+				n += run;
+			}
+		}
+		else
+		{
+			quantised->WriteRow(m, nMin, count, src);
+		}
+	}
+	// Address of the point (m, n), the rows are GetColumns() floats apart (to upload a part of the map to a texture).
+	// Null if the heights are quantised or not row-major, they have to be read with ReadRow()
+	const float* GetPointer(int m, int n) const { return data && Layout::kRowMajor ? &data[layout.GetOffset(m, n)] : nullptr; }
+
+private:
+	float* data;
+	QuantisedHeightMap* quantised;
+	XMINT2 resolution; // x=m=rows, y=n=columns
+	Layout layout; // offsets of the points in data
+};
+
+typedef BasicHeightField<HeightMapLayout> HeightField;
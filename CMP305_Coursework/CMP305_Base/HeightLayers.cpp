@@ -0,0 +1,411 @@
+#include "HeightLayers.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "Parallel.h"
+
+// Blends of the modes, 4 points at a time: the height of the layer over the height below
+struct LayerAddBlend
+{
+	static XMVECTOR Apply(FXMVECTOR below, FXMVECTOR height) { return XMVectorAdd(below, height); }
+};
+struct LayerMaxBlend
+{
+	static XMVECTOR Apply(FXMVECTOR below, FXMVECTOR height) { return XMVectorMax(below, height); }
+};
+struct LayerMinBlend
+{
+	static XMVECTOR Apply(FXMVECTOR below, FXMVECTOR height) { return XMVectorMin(below, height); }
+};
+struct LayerReplaceBlend
+{
+	static XMVECTOR Apply(FXMVECTOR, FXMVECTOR height) { return height; }
+};
+
+// row = row + coverage * opacity * (Blend(row, heights) - row), for a row of a tile
+template <class Blend>
+static void BlendRow(float* row, const float* heights, const float* coverage, float opacity)
+{
+	const XMVECTOR opacityVector = XMVectorReplicate(opacity);
+	for (int i = 0; i < HeightLayerStack::kTileSize; i += 4)
+	{
+		const XMVECTOR below = XMLoadFloat4((const XMFLOAT4*)&row[i]);
+		const XMVECTOR weight = XMVectorMultiply(XMLoadFloat4((const XMFLOAT4*)&coverage[i]), opacityVector);
+		const XMVECTOR blended = Blend::Apply(below, XMLoadFloat4((const XMFLOAT4*)&heights[i]));
+		XMStoreFloat4((XMFLOAT4*)&row[i], XMVectorMultiplyAdd(weight, XMVectorSubtract(blended, below), below));
+	}
+}
+
+
+HeightLayerStack::HeightLayerStack()
+	: resolution(0, 0), tileRows(0), tileColumns(0), dirtyCount(0)
+{
+}
+
+void HeightLayerStack::Resize(XMINT2 newResolution)
+{
+	resolution = newResolution;
+	tileRows = (resolution.x + kTileSize) / kTileSize; // resolution + 1 points
+	tileColumns = (resolution.y + kTileSize) / kTileSize;
+	const int tiles = tileRows * tileColumns;
+
+	base.assign(tiles * kTilePoints, 0.0f);
+	for (HeightLayer& layer : layers)
+	{
+		layer.tiles.clear();
+		layer.tiles.resize(tiles);
+		layer.allocatedTiles = 0;
+	}
+	dirty.assign(tiles, 0);
+	dirtyCount = 0;
+	MarkAllDirty();
+}
+
+void HeightLayerStack::SetBase(const HeightField& source)
+{
+	Parallel::ForBlocks(0, GetTileCount(), 1, [&](int begin, int end)
+	{
+		for (int tile = begin; tile < end; tile++)
+		{
+			const HeightFieldRect rect = GetTileRect(tile);
+			for (int m = rect.mMin; m <= rect.mMax; m++)
+			{
+				source.ReadRow(m, rect.nMin, rect.nMax - rect.nMin + 1, &base[tile * kTilePoints + (m - rect.mMin) * kTileSize]);
+			}
+		}
+	});
+	MarkAllDirty();
+}
+
+void HeightLayerStack::ReadBase(HeightField& destination) const
+{
+	Parallel::ForBlocks(0, GetTileCount(), 1, [&](int begin, int end)
+	{
+		for (int tile = begin; tile < end; tile++)
+		{
+			const HeightFieldRect rect = GetTileRect(tile);
+			for (int m = rect.mMin; m <= rect.mMax; m++)
+			{
+				destination.WriteRow(m, rect.nMin, rect.nMax - rect.nMin + 1, &base[tile * kTilePoints + (m - rect.mMin) * kTileSize]);
+			}
+		}
+	});
+}
+
+void HeightLayerStack::AddToBase(const HeightFieldRect& rect, const float* delta)
+{
+	const int columns = rect.nMax - rect.nMin + 1;
+	for (int m = rect.mMin; m <= rect.mMax; m++)
+	{
+		for (int n = rect.nMin; n <= rect.nMax; n++)
+		{
+			const int tile = GetTileIndex(m / kTileSize, n / kTileSize);
+			base[tile * kTilePoints + (n % kTileSize) + (m % kTileSize) * kTileSize] += delta[(n - rect.nMin) + (m - rect.mMin) * columns];
+		}
+	}
+
+	for (int tileM = rect.mMin / kTileSize; tileM <= rect.mMax / kTileSize; tileM++)
+	{
+		for (int tileN = rect.nMin / kTileSize; tileN <= rect.nMax / kTileSize; tileN++)
+		{
+			MarkDirty(GetTileIndex(tileM, tileN));
+		}
+	}
+}
+
+int HeightLayerStack::AddLayer(const std::string& name, LayerBlendMode blendMode)
+{
+	HeightLayer layer;
+	layer.name = name;
+	layer.blendMode = blendMode;
+	layer.opacity = 1.0f;
+	layer.visible = true;
+	layer.tiles.resize(GetTileCount());
+	layer.allocatedTiles = 0;
+	layers.push_back(std::move(layer));
+	return (int)layers.size() - 1;
+}
+
+void HeightLayerStack::RemoveLayer(int layer)
+{
+	MarkLayerDirty(layer);
+	layers.erase(layers.begin() + layer);
+}
+
+void HeightLayerStack::SetLayerBlend(int layer, int blendMode, float opacity, bool visible)
+{
+	HeightLayer& heightLayer = layers[layer];
+	if (heightLayer.blendMode == blendMode && heightLayer.opacity == opacity && heightLayer.visible == visible)
+	{
+		return;
+	}
+	heightLayer.blendMode = blendMode;
+	heightLayer.opacity = opacity;
+	heightLayer.visible = visible;
+	MarkLayerDirty(layer);
+}
+
+template <class Function>
+void HeightLayerStack::ForStroke(float m, float n, float radius, float strength, const Function& function)
+{
+	// points of the square around the stroke, inside the map
+	const int mMin = (std::max)((int)ceilf(m - radius), 0);
+	const int mMax = (std::min)((int)floorf(m + radius), resolution.x);
+	const int nMin = (std::max)((int)ceilf(n - radius), 0);
+	const int nMax = (std::min)((int)floorf(n + radius), resolution.y);
+
+	for (int tileM = mMin / kTileSize; tileM <= mMax / kTileSize && mMin <= mMax; tileM++)
+	{
+		for (int tileN = nMin / kTileSize; tileN <= nMax / kTileSize && nMin <= nMax; tileN++)
+		{
+			const int tile = GetTileIndex(tileM, tileN);
+			for (int pointM = (std::max)(mMin, tileM * kTileSize); pointM <= (std::min)(mMax, tileM * kTileSize + kTileSize - 1); pointM++)
+			{
+				for (int pointN = (std::max)(nMin, tileN * kTileSize); pointN <= (std::min)(nMax, tileN * kTileSize + kTileSize - 1); pointN++)
+				{
+					const float distance = sqrtf((pointM - m) * (pointM - m) + (pointN - n) * (pointN - n));
+					if (distance >= radius)
+					{
+						continue;
+					}
+					// smoothstep from the edge to the centre
+					float t = 1.0f - distance / radius;
+					t = t * t * (3.0f - 2.0f * t);
+					function(tile, (pointN - tileN * kTileSize) + (pointM - tileM * kTileSize) * kTileSize, t * strength);
+				}
+			}
+		}
+	}
+}
+
+void HeightLayerStack::Paint(int layer, float m, float n, float radius, float height, float strength)
+{
+	HeightLayer& heightLayer = layers[layer];
+	ForStroke(m, n, radius, strength, [&](int tile, int local, float weight)
+	{
+		if (weight <= 0.0f)
+		{
+			return;
+		}
+		// the stroke over what the layer had, as a colour over another
+		HeightLayerTile& layerTile = AllocateTile(heightLayer, tile);
+		const float coverage = layerTile.coverage[local];
+		const float newCoverage = weight + (1.0f - weight) * coverage;
+		layerTile.heights[local] = (weight * height + (1.0f - weight) * coverage * layerTile.heights[local]) / newCoverage;
+		layerTile.coverage[local] = newCoverage;
+		MarkDirty(tile);
+	});
+}
+
+void HeightLayerStack::Erase(int layer, float m, float n, float radius, float strength)
+{
+	HeightLayer& heightLayer = layers[layer];
+	std::vector<int> touched;
+	ForStroke(m, n, radius, strength, [&](int tile, int local, float weight)
+	{
+		if (!heightLayer.tiles[tile])
+		{
+			return;
+		}
+		heightLayer.tiles[tile]->coverage[local] *= 1.0f - weight;
+		if (touched.empty() || touched.back() != tile)
+		{
+			touched.push_back(tile);
+		}
+		MarkDirty(tile);
+	});
+	for (int tile : touched)
+	{
+		CompactTile(heightLayer, tile);
+	}
+}
+
+void HeightLayerStack::Fill(int layer, const HeightField& source)
+{
+	HeightLayer& heightLayer = layers[layer];
+	std::vector<float> heights(kTilePoints);
+	for (int tile = 0; tile < GetTileCount(); tile++)
+	{
+		const HeightFieldRect rect = GetTileRect(tile);
+		std::fill(heights.begin(), heights.end(), 0.0f);
+		bool covers = false;
+		for (int m = rect.mMin; m <= rect.mMax; m++)
+		{
+			float* row = &heights[(m - rect.mMin) * kTileSize];
+			source.ReadRow(m, rect.nMin, rect.nMax - rect.nMin + 1, row);
+			for (int i = 0; i <= rect.nMax - rect.nMin && !covers; i++)
+			{
+				covers = row[i] != 0.0f;
+			}
+		}
+
+		if (heightLayer.tiles[tile])
+		{
+			MarkDirty(tile);
+		}
+		if (!covers)
+		{
+			heightLayer.allocatedTiles -= heightLayer.tiles[tile] ? 1 : 0;
+			heightLayer.tiles[tile].reset();
+			continue;
+		}
+
+		HeightLayerTile& layerTile = AllocateTile(heightLayer, tile);
+		layerTile.heights = heights;
+		std::fill(layerTile.coverage.begin(), layerTile.coverage.end(), 0.0f);
+		for (int m = rect.mMin; m <= rect.mMax; m++)
+		{
+			std::fill_n(&layerTile.coverage[(m - rect.mMin) * kTileSize], rect.nMax - rect.nMin + 1, 1.0f);
+		}
+		MarkDirty(tile);
+	}
+}
+
+void HeightLayerStack::Clear(int layer)
+{
+	MarkLayerDirty(layer);
+	HeightLayer& heightLayer = layers[layer];
+	for (std::unique_ptr<HeightLayerTile>& tile : heightLayer.tiles)
+	{
+		tile.reset();
+	}
+	heightLayer.allocatedTiles = 0;
+}
+
+void HeightLayerStack::GetDirtyRects(std::vector<HeightFieldRect>& rects) const
+{
+	rects.clear();
+	for (int tile = 0; tile < GetTileCount(); tile++)
+	{
+		if (dirty[tile])
+		{
+			rects.push_back(GetTileRect(tile));
+		}
+	}
+}
+
+void HeightLayerStack::MarkAllDirty()
+{
+	std::fill(dirty.begin(), dirty.end(), (unsigned char)1);
+	dirtyCount = GetTileCount();
+}
+
+int HeightLayerStack::Composite(HeightField& destination)
+{
+	std::vector<int> tiles;
+	for (int tile = 0; tile < GetTileCount(); tile++)
+	{
+		if (dirty[tile])
+		{
+			tiles.push_back(tile);
+			dirty[tile] = 0;
+		}
+	}
+	dirtyCount = 0;
+
+	// every tile is a tile of the quantised storage too, so no two threads write the same one
+	Parallel::ForBlocks(0, (int)tiles.size(), 1, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			CompositeTile(tiles[i], destination);
+		}
+	});
+	return (int)tiles.size();
+}
+
+size_t HeightLayerStack::GetBytes() const
+{
+	size_t bytes = base.size() * sizeof(float);
+	for (int layer = 0; layer < GetLayerCount(); layer++)
+	{
+		bytes += GetLayerBytes(layer);
+	}
+	return bytes;
+}
+
+size_t HeightLayerStack::GetLayerBytes(int layer) const
+{
+	return (size_t)layers[layer].allocatedTiles * 2 * kTilePoints * sizeof(float);
+}
+
+HeightFieldRect HeightLayerStack::GetTileRect(int tile) const
+{
+	const int mMin = (tile / tileColumns) * kTileSize;
+	const int nMin = (tile % tileColumns) * kTileSize;
+	return HeightFieldRect(mMin, nMin, (std::min)(mMin + kTileSize - 1, resolution.x), (std::min)(nMin + kTileSize - 1, resolution.y));
+}
+
+void HeightLayerStack::MarkDirty(int tile)
+{
+	if (!dirty[tile])
+	{
+		dirty[tile] = 1;
+		dirtyCount++;
+	}
+}
+
+void HeightLayerStack::MarkLayerDirty(int layer)
+{
+	for (int tile = 0; tile < GetTileCount(); tile++)
+	{
+		if (layers[layer].tiles[tile])
+		{
+			MarkDirty(tile);
+		}
+	}
+}
+
+HeightLayerTile& HeightLayerStack::AllocateTile(HeightLayer& layer, int tile)
+{
+	if (!layer.tiles[tile])
+	{
+		layer.tiles[tile].reset(new HeightLayerTile());
+		layer.tiles[tile]->heights.assign(kTilePoints, 0.0f);
+		layer.tiles[tile]->coverage.assign(kTilePoints, 0.0f);
+		layer.allocatedTiles++;
+	}
+	return *layer.tiles[tile];
+}
+
+void HeightLayerStack::CompactTile(HeightLayer& layer, int tile)
+{
+	const std::vector<float>& coverage = layer.tiles[tile]->coverage;
+	// what is left of a stroke that covers nothing visible
+	if (std::all_of(coverage.begin(), coverage.end(), [](float c) { return c < 1.0f / 1024.0f; }))
+	{
+		layer.tiles[tile].reset();
+		layer.allocatedTiles--;
+	}
+}
+
+void HeightLayerStack::CompositeTile(int tile, HeightField& destination) const
+{
+	const HeightFieldRect rect = GetTileRect(tile);
+	float row[kTileSize];
+	for (int m = rect.mMin; m <= rect.mMax; m++)
+	{
+		const int offset = (m - rect.mMin) * kTileSize;
+		std::copy(&base[tile * kTilePoints + offset], &base[tile * kTilePoints + offset] + kTileSize, row);
+
+		for (const HeightLayer& layer : layers)
+		{
+			const HeightLayerTile* layerTile = layer.tiles[tile].get();
+			if (!layerTile || !layer.visible || layer.opacity <= 0.0f)
+			{
+				continue;
+			}
+			const float* heights = &layerTile->heights[offset];
+			const float* coverage = &layerTile->coverage[offset];
+			switch (layer.blendMode)
+			{
+			case kLayerAdd: BlendRow<LayerAddBlend>(row, heights, coverage, layer.opacity); break;
+			case kLayerMax: BlendRow<LayerMaxBlend>(row, heights, coverage, layer.opacity); break;
+			case kLayerMin: BlendRow<LayerMinBlend>(row, heights, coverage, layer.opacity); break;
+			case kLayerReplace: BlendRow<LayerReplaceBlend>(row, heights, coverage, layer.opacity); break;
+			}
+		}
+		destination.WriteRow(m, rect.nMin, rect.nMax - rect.nMin + 1, row);
+	}
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "HeightField.h"
+
+// How a layer is blended over the layers below it, where it covers them
+enum LayerBlendMode
+{
+	kLayerAdd = 0, // its heights are added
+	kLayerMax, // the highest of both
+	kLayerMin, // the lowest of both
+	kLayerReplace, // its heights instead
+	kLayerBlendModeCount
+};
+
+// Tile of a layer: the heights and how much of them covers the layers below (0 nothing, 1 all).
+// The points of the tile are row-major, kTileSize floats per row even at the last tiles of the map
+struct HeightLayerTile
+{
+	std::vector<float> heights;
+	std::vector<float> coverage;
+};
+
+// Edit layer over the base of a HeightLayerStack
+struct HeightLayer
+{
+	std::string name;
+	int blendMode; // LayerBlendMode, an int for the combo of the GUI
+	float opacity; // scales the coverage of every point
+	bool visible;
+	std::vector<std::unique_ptr<HeightLayerTile>> tiles; // null where it covers nothing
+	int allocatedTiles;
+};
+
+// Non-destructive height map: a base and layers of edits on top of it, blended with their own mode and opacity.
+// The layers are sparse, they only keep the tiles where they cover something, so a local edit costs a few tiles of memory.
+// The stack remembers which tiles have changed (an edit, a layer setting, a new base) and Composite() only blends those,
+// every tile in parallel and 4 points at a time.
+// The tiles are the ones of QuantisedHeightMap, so a composited tile is a single tile of the quantised storage too
+class HeightLayerStack
+{
+public:
+	static const int kTileSize = QuantisedHeightMap::kTileSize;
+	static const int kTilePoints = kTileSize * kTileSize;
+
+	HeightLayerStack();
+
+	// Flat base for the new resolution, the layers are kept without their tiles
+	void Resize(XMINT2 resolution);
+	XMINT2 GetResolution() const { return resolution; }
+
+	// Take every height of source (same resolution) as the base, every tile has to be composited again
+	void SetBase(const HeightField& source);
+	// Copy the base into destination (same resolution)
+	void ReadBase(HeightField& destination) const;
+	// Add delta, row by row over rect, to the heights of the base. Only the tiles under rect have to be composited again
+	void AddToBase(const HeightFieldRect& rect, const float* delta);
+
+	int AddLayer(const std::string& name, LayerBlendMode blendMode);
+	void RemoveLayer(int layer);
+	int GetLayerCount() const { return (int)layers.size(); }
+	const HeightLayer& GetLayer(int layer) const { return layers[layer]; }
+	// Change how the layer is blended, only its tiles have to be composited again
+	void SetLayerBlend(int layer, int blendMode, float opacity, bool visible);
+
+	// Paint a round stroke on the layer: towards height with a weight that goes from strength at the centre (m, n)
+	// to 0 at radius (in points). The tiles are allocated as the stroke reaches them
+	void Paint(int layer, float m, float n, float radius, float height, float strength);
+	// Take away the coverage of the layer in a round stroke, the tiles left without coverage are freed
+	void Erase(int layer, float m, float n, float radius, float strength);
+	// Cover the whole layer with the heights of source (same resolution), only the tiles where some height is not 0
+	void Fill(int layer, const HeightField& source);
+	void Clear(int layer);
+
+	// Rectangles of the tiles to composite
+	void GetDirtyRects(std::vector<HeightFieldRect>& rects) const;
+	bool IsDirty() const { return dirtyCount > 0; }
+	void MarkAllDirty();
+	// Blend the changed tiles of the stack into destination (same resolution), return how many
+	int Composite(HeightField& destination);
+
+	// Bytes of the base and of the tiles allocated by the layers
+	size_t GetBytes() const;
+	size_t GetLayerBytes(int layer) const;
+	int GetTileCount() const { return (int)base.size() / kTilePoints; }
+
+private:
+	int GetTileIndex(int tileM, int tileN) const { return tileN + tileM * tileColumns; }
+	HeightFieldRect GetTileRect(int tile) const;
+	void MarkDirty(int tile);
+	void MarkLayerDirty(int layer);
+	HeightLayerTile& AllocateTile(HeightLayer& layer, int tile);
+	// Free the tile if it covers nothing
+	void CompactTile(HeightLayer& layer, int tile);
+	// Apply function(tile, local, weight) to every point of the layer within radius of (m, n)
+	template <class Function>
+	void ForStroke(float m, float n, float radius, float strength, const Function& function);
+	void CompositeTile(int tile, HeightField& destination) const;
+
+	XMINT2 resolution;
+	int tileRows, tileColumns;
+	std::vector<float> base; // dense, in tiles as the layers
+	std::vector<HeightLayer> layers;
+	std::vector<unsigned char> dirty; // per tile
+	int dirtyCount;
+};
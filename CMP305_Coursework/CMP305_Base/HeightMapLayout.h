@@ -0,0 +1,107 @@
+#pragma once
+#include <DirectXMath.h>
+
+using namespace DirectX;
+
+// Layouts of the float height map in memory. Each one maps the point (m, n) to its offset in the array
+// and gives the number of floats to allocate for a resolution (in quads, as the one of HeightField).
+// Only the storage of the heights changes, the other per point arrays (distances, flow, masks...) stay row-major
+// and are still indexed with HeightField::GetIndex().
+//
+// The layout is chosen at compile time with one of these defines (row-major if none is set):
+//   HEIGHT_MAP_LAYOUT_TILED   blocks of 32x32 points
+//   HEIGHT_MAP_LAYOUT_MORTON  Z-order inside blocks of 64x64 points
+// HeightMapLayoutBenchmark times the operations of the terrain on a BasicHeightField in each of them.
+
+// Row after row, the layout of all the other per point arrays
+class RowMajorLayout
+{
+public:
+	static const bool kRowMajor = true;
+
+	explicit RowMajorLayout(XMINT2 resolution) : rows(resolution.x + 1), columns(resolution.y + 1) {}
+	static const char* GetName() { return "Row-major"; }
+
+	int GetSize() const { return rows * columns; }
+	int GetOffset(int m, int n) const { return n + m * columns; }
+	// Points of a row from n that follow each other in memory, the same for every row
+	int GetRun(int, int n) const { return columns - n; }
+
+private:
+	int rows, columns;
+};
+
+// Square blocks stored one after the other, row-major inside a block and the blocks row-major.
+// A 3x3 neighbourhood or a short column is in one or two blocks instead of spread over rows of the whole map
+class TiledLayout
+{
+public:
+	static const bool kRowMajor = false;
+	static const int kBlockShift = 5;
+	static const int kBlockSize = 1 << kBlockShift; // 32x32 floats, a 4 KB page
+	static const int kBlockMask = kBlockSize - 1;
+
+	explicit TiledLayout(XMINT2 resolution)
+		: blockRows((resolution.x + kBlockSize) >> kBlockShift), blockColumns((resolution.y + kBlockSize) >> kBlockShift)
+	{
+	}
+	static const char* GetName() { return "Tiled 32x32"; }
+
+	int GetSize() const { return (blockRows * blockColumns) << (2 * kBlockShift); }
+	int GetOffset(int m, int n) const
+	{
+		const int block = (n >> kBlockShift) + (m >> kBlockShift) * blockColumns;
+		return (block << (2 * kBlockShift)) + (n & kBlockMask) + ((m & kBlockMask) << kBlockShift);
+	}
+	int GetRun(int, int n) const { return kBlockSize - (n & kBlockMask); }
+
+private:
+	int blockRows, blockColumns;
+};
+
+// Z-order (Morton) inside square blocks, the blocks row-major. The bits of m and n are interleaved, so the points close
+// in both directions are close in memory. Z-order over the whole map would pad it to a square power of two, 4x the memory
+// of a 2049x2049 map, the blocks keep the padding under a block per side
+class MortonLayout
+{
+public:
+	static const bool kRowMajor = false;
+	static const int kBlockShift = 6;
+	static const int kBlockSize = 1 << kBlockShift; // 64x64 points
+	static const int kBlockMask = kBlockSize - 1;
+
+	explicit MortonLayout(XMINT2 resolution)
+		: blockRows((resolution.x + kBlockSize) >> kBlockShift), blockColumns((resolution.y + kBlockSize) >> kBlockShift)
+	{
+	}
+	static const char* GetName() { return "Morton 64x64"; }
+
+	int GetSize() const { return (blockRows * blockColumns) << (2 * kBlockShift); }
+	int GetOffset(int m, int n) const
+	{
+		const int block = (n >> kBlockShift) + (m >> kBlockShift) * blockColumns;
+		return (block << (2 * kBlockShift)) + (Spread(n & kBlockMask) | (Spread(m & kBlockMask) << 1));
+	}
+	// n and n + 1 are next to each other when n is even
+	int GetRun(int, int n) const { return 2 - (n & 1); }
+
+private:
+	// bits of a coordinate in the block moved to the even positions: b5 b4 b3 b2 b1 b0 -> b5 0 b4 0 b3 0 b2 0 b1 0 b0
+	static int Spread(int value)
+	{
+		value = (value | (value << 4)) & 0x0F0F;
+		value = (value | (value << 2)) & 0x3333;
+		value = (value | (value << 1)) & 0x5555;
+		return value;
+	}
+
+	int blockRows, blockColumns;
+};
+
+#if defined(HEIGHT_MAP_LAYOUT_TILED)
+typedef TiledLayout HeightMapLayout;
+#elif defined(HEIGHT_MAP_LAYOUT_MORTON)
+typedef MortonLayout HeightMapLayout;
+#else
+typedef RowMajorLayout HeightMapLayout;
+#endif
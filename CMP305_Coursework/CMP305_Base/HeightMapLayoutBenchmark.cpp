@@ -0,0 +1,154 @@
+#include "HeightMapLayoutBenchmark.h"
+#include "HeightField.h"
+#include "Stencil.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+
+const int HeightMapLayoutBenchmark::kSizes[kSizeCount] = { 2049, 4097 };
+
+static const int kParticleCount = 1000000;
+
+// The floats of a map in a layout and the view of the terrain over them
+template <class Layout>
+class LayoutMap
+{
+public:
+	LayoutMap(int points) : heights(BasicHeightField<Layout>::GetStorageSize(XMINT2(points - 1, points - 1))), field(heights.data(), XMINT2(points - 1, points - 1)) {}
+
+	BasicHeightField<Layout>& GetField() { return field; }
+
+private:
+	std::vector<float> heights;
+	BasicHeightField<Layout> field;
+};
+
+template <class Field>
+static void Fill(Field& field)
+{
+	// waves with some noise, so the particles have somewhere to roll
+	std::mt19937 generator(1);
+	std::uniform_real_distribution<float> noise(-0.5f, 0.5f);
+	for (int m = 0; m < field.GetRows(); m++)
+	{
+		for (int n = 0; n < field.GetColumns(); n++)
+		{
+			field.Set(m, n, 10.0f * sinf(m * 0.02f) + 10.0f * cosf(n * 0.03f) + noise(generator));
+		}
+	}
+}
+
+// Every row into the other map, as the history, the tiles and the pipeline read and write them
+template <class Field>
+static void RowCopy(const Field& source, Field& destination)
+{
+	std::vector<float> row(source.GetColumns());
+	for (int m = 0; m < source.GetRows(); m++)
+	{
+		source.ReadRow(m, row.data());
+		destination.WriteRow(m, row.data());
+	}
+}
+
+// Get and Set of every point in order, as the nodes of the graph and the hydrology go through the map
+template <class Field>
+static void Points(Field& field)
+{
+	for (int m = 0; m < field.GetRows(); m++)
+	{
+		for (int n = 0; n < field.GetColumns(); n++)
+		{
+			field.Set(m, n, field.Get(m, n) * 0.99f + 0.01f);
+		}
+	}
+}
+
+// TerrainMesh::ParticleDeposition: a particle at a random point goes to the lowest of its neighbours and adds height there
+template <class Field>
+static void Deposition(Field& field)
+{
+	std::mt19937 generator(2);
+	std::uniform_int_distribution<int> position(0, field.GetRows() - 1);
+	for (int particle = 0; particle < kParticleCount; particle++)
+	{
+		const int m = position(generator);
+		const int n = position(generator);
+		const XMINT2 lowestPoint = Stencil::FindNeighbour<StencilClamp>(field, m, n, false);
+		field.Set(lowestPoint.x, lowestPoint.y, field.Get(lowestPoint.x, lowestPoint.y) + 0.01f);
+	}
+}
+
+template <class Function>
+static float Time(Function function)
+{
+	const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	function();
+	return std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+template <class Layout>
+static void TimeLayout(int points, float milliseconds[HeightMapLayoutBenchmark::kOperationCount])
+{
+	LayoutMap<Layout> map(points);
+	LayoutMap<Layout> copy(points);
+	BasicHeightField<Layout>& field = map.GetField();
+	Fill(field);
+
+	milliseconds[HeightMapLayoutBenchmark::kSmooth] = Time([&]() { Stencil::Apply<StencilBoxKernel, StencilClamp>(field, field); });
+	milliseconds[HeightMapLayoutBenchmark::kRowCopy] = Time([&]() { RowCopy(field, copy.GetField()); });
+	milliseconds[HeightMapLayoutBenchmark::kPoints] = Time([&]() { Points(field); });
+	milliseconds[HeightMapLayoutBenchmark::kDeposition] = Time([&]() { Deposition(field); });
+}
+
+
+HeightMapLayoutBenchmark::HeightMapLayoutBenchmark()
+	: hasRun(false)
+{
+	std::fill(&milliseconds[0][0][0], &milliseconds[0][0][0] + kSizeCount * kLayoutCount * kOperationCount, 0.0f);
+}
+
+HeightMapLayoutBenchmark::~HeightMapLayoutBenchmark()
+{
+	TaskScheduler::Get().Wait(task);
+}
+
+void HeightMapLayoutBenchmark::Start()
+{
+	if (IsRunning())
+	{
+		return;
+	}
+	task = TaskScheduler::Get().SubmitBackground([this]() { Run(); });
+}
+
+void HeightMapLayoutBenchmark::Run()
+{
+	for (int size = 0; size < kSizeCount; size++)
+	{
+		TimeLayout<RowMajorLayout>(kSizes[size], milliseconds[size][kRowMajor]);
+		TimeLayout<TiledLayout>(kSizes[size], milliseconds[size][kTiled]);
+		TimeLayout<MortonLayout>(kSizes[size], milliseconds[size][kMorton]);
+	}
+	hasRun = true;
+}
+
+float HeightMapLayoutBenchmark::GetSpeedup(int size, int layout, int operation) const
+{
+	const float time = milliseconds[size][layout][operation];
+	return time > 0.0f ? milliseconds[size][kRowMajor][operation] / time : 0.0f;
+}
+
+const char* HeightMapLayoutBenchmark::GetLayoutName(int layout)
+{
+	static const char* names[kLayoutCount] = { RowMajorLayout::GetName(), TiledLayout::GetName(), MortonLayout::GetName() };
+	return names[layout];
+}
+
+const char* HeightMapLayoutBenchmark::GetOperationName(int operation)
+{
+	static const char* names[kOperationCount] = { "3x3 smooth", "Row copy", "Every point", "Deposition" };
+	return names[operation];
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <atomic>
+
+#include "TaskScheduler.h"
+
+// Times the operations of the terrain on a BasicHeightField in each of the layouts of HeightMapLayout.h, on square maps
+// of 2049 and 4097 points per side, so the layout to compile with can be chosen from the numbers of this machine.
+// The operations are the ones the terrain runs: Stencil::Apply of the Smooth pass, the row copies of the history, the tiles
+// and the pipeline, a pass over every point (the graph nodes and the hydrology) and the particle deposition of TerrainMesh.
+// It runs as a background task of the TaskScheduler, the GUI polls IsRunning() and shows the times once it has run
+class HeightMapLayoutBenchmark
+{
+public:
+	enum Layout { kRowMajor = 0, kTiled, kMorton, kLayoutCount };
+	enum Operation { kSmooth = 0, kRowCopy, kPoints, kDeposition, kOperationCount };
+	static const int kSizeCount = 2;
+	static const int kSizes[kSizeCount]; // points per side
+
+	HeightMapLayoutBenchmark();
+	// Waits for the run to end, it uses the benchmark
+	~HeightMapLayoutBenchmark();
+
+	// Run every operation on every layout and size in the background, it takes a few seconds. Nothing if it is running
+	void Start();
+	bool IsRunning() const { return !TaskScheduler::IsDone(task); }
+	bool HasRun() const { return hasRun && !IsRunning(); }
+
+	float GetMilliseconds(int size, int layout, int operation) const { return milliseconds[size][layout][operation]; }
+	// Time of the row-major layout divided by the time of the layout
+	float GetSpeedup(int size, int layout, int operation) const;
+
+	static const char* GetLayoutName(int layout);
+	static const char* GetOperationName(int operation);
+
+private:
+	void Run();
+
+	float milliseconds[kSizeCount][kLayoutCount][kOperationCount];
+	std::atomic<bool> hasRun;
+	TaskHandle task;
+};
@@ -0,0 +1,116 @@
+#include "HeightPipeline.h"
+
+#include <atomic>
+
+#include "Parallel.h"
+
+
+void HeightPipeline::AddPointPass(const std::string& name, const PointFunction& function, bool replacesHeights)
+{
+	// nothing recorded before can change the result
+	if (replacesHeights)
+	{
+		passes.clear();
+	}
+
+	Pass pass;
+	pass.name = name;
+	pass.pointFunction = function;
+	passes.push_back(pass);
+}
+
+void HeightPipeline::AddMapPass(const std::string& name, const TerrainJobFunction& function, bool replacesHeights)
+{
+	if (replacesHeights)
+	{
+		passes.clear();
+	}
+
+	Pass pass;
+	pass.name = name;
+	pass.mapFunction = function;
+	passes.push_back(pass);
+}
+
+int HeightPipeline::GetTraversalCount() const
+{
+	int traversals = 0;
+	for (size_t i = 0; i < passes.size(); i++)
+	{
+		// a run of point passes counts once, at its first pass
+		if (passes[i].mapFunction || i == 0 || passes[i - 1].mapFunction)
+		{
+			traversals++;
+		}
+	}
+	return traversals;
+}
+
+std::string HeightPipeline::GetName() const
+{
+	std::string name;
+	for (const Pass& pass : passes)
+	{
+		name += name.empty() ? pass.name : " + " + pass.name;
+	}
+	return name;
+}
+
+void HeightPipeline::Run(HeightField& field, TerrainJobProgress& progress) const
+{
+	const int traversals = GetTraversalCount();
+	int traversal = 0;
+	int first = 0;
+	while (first < (int)passes.size() && !progress.IsCancelled())
+	{
+		// every traversal reports its progress in its part of the bar
+		progress.SetRange((float)traversal / traversals, (float)(traversal + 1) / traversals);
+		if (passes[first].mapFunction)
+		{
+			passes[first].mapFunction(field, progress);
+			first++;
+		}
+		else
+		{
+			int last = first + 1;
+			while (last < (int)passes.size() && !passes[last].mapFunction)
+			{
+				last++;
+			}
+			RunPointPasses(field, first, last, progress);
+			first = last;
+		}
+		traversal++;
+	}
+}
+
+void HeightPipeline::RunPointPasses(HeightField& field, int first, int last, TerrainJobProgress& progress) const
+{
+	const int rows = field.GetRows();
+	const int columns = field.GetColumns();
+	const int tileSize = QuantisedHeightMap::kTileSize;
+	const int tiles = ((rows + tileSize - 1) / tileSize) * ((columns + tileSize - 1) / tileSize);
+	std::atomic<int> tilesDone(0);
+
+	// the tiles are the ones of the quantised storage, so no two threads write the same one
+	Parallel::ForTiles(0, rows, 0, columns, tileSize, tileSize, [&](int mBegin, int mEnd, int nBegin, int nEnd)
+	{
+		if (progress.IsCancelled())
+		{
+			return;
+		}
+
+		const int count = nEnd - nBegin;
+		std::vector<float> heights(count);
+		for (int m = mBegin; m < mEnd; m++)
+		{
+			field.ReadRow(m, nBegin, count, heights.data());
+			for (int pass = first; pass < last; pass++)
+			{
+				passes[pass].pointFunction(m, nBegin, count, heights.data());
+			}
+			field.WriteRow(m, nBegin, count, heights.data());
+		}
+		progress.Set((float)++tilesDone / tiles);
+	});
+}
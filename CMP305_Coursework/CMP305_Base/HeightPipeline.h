@@ -0,0 +1,47 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "HeightField.h"
+#include "TerrainJobs.h"
+
+// Operations on the height map recorded to be run later, all together, as a single terrain job.
+// A point pass computes every point from its own height only (fill, fault, scale, clamp): the consecutive ones are fused
+// into a single traversal of the map, where every pass runs on a part of a row while it is in the cache.
+// A map pass needs more than the point (neighbours, flow, distances) and runs on its own.
+// A pass that replaces every height without reading them (a fill) drops the passes recorded before it
+class HeightPipeline
+{
+public:
+	// Point pass: update count heights of row m from the point (m, nBegin)
+	typedef std::function<void(int m, int nBegin, int count, float* heights)> PointFunction;
+
+	void AddPointPass(const std::string& name, const PointFunction& function, bool replacesHeights = false);
+	void AddMapPass(const std::string& name, const TerrainJobFunction& function, bool replacesHeights = false);
+
+	bool IsEmpty() const { return passes.empty(); }
+	void Clear() { passes.clear(); }
+	int GetPassCount() const { return (int)passes.size(); }
+	// Traversals of the map after fusing the point passes
+	int GetTraversalCount() const;
+	// Names of the passes, in order
+	std::string GetName() const;
+
+	// Run the passes on field, the fused point passes in parallel over tiles of QuantisedHeightMap::kTileSize.
+	// It stops between tiles if the progress is cancelled
+	void Run(HeightField& field, TerrainJobProgress& progress) const;
+
+private:
+	struct Pass
+	{
+		std::string name;
+		PointFunction pointFunction; // only one of both
+		TerrainJobFunction mapFunction;
+	};
+
+	// Point passes [first, last) in one traversal
+	void RunPointPasses(HeightField& field, int first, int last, TerrainJobProgress& progress) const;
+
+	std::vector<Pass> passes;
+};
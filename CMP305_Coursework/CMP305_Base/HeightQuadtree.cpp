@@ -0,0 +1,127 @@
+#include "HeightQuadtree.h"
+
+#include <algorithm>
+#include <cfloat>
+
+#include "Parallel.h"
+
+const int HeightQuadtree::kLeafSize;
+
+
+HeightQuadtree::HeightQuadtree()
+	: resolution(0, 0)
+{
+}
+
+void HeightQuadtree::Build(const HeightField& heightField)
+{
+	resolution = heightField.GetResolution();
+
+	// halve the grid of leaves until there is a single node
+	levelSizes.clear();
+	XMINT2 size((resolution.x + kLeafSize - 1) / kLeafSize, (resolution.y + kLeafSize - 1) / kLeafSize);
+	levelSizes.push_back(size);
+	while (size.x > 1 || size.y > 1)
+	{
+		size = XMINT2((size.x + 1) / 2, (size.y + 1) / 2);
+		levelSizes.push_back(size);
+	}
+
+	levels.resize(levelSizes.size());
+	for (int level = 0; level < (int)levels.size(); level++)
+	{
+		levels[level].resize(levelSizes[level].x * levelSizes[level].y);
+	}
+
+	Update(heightField, heightField.GetBounds());
+}
+
+void HeightQuadtree::Update(const HeightField& heightField, const HeightFieldRect& rect)
+{
+	const HeightFieldRect points = heightField.Clip(rect);
+	if (points.IsEmpty() || levels.empty())
+	{
+		return;
+	}
+
+	// A point on the border between two leaves belongs to both of them
+	int iMin = std::max(points.mMin - 1, 0) / kLeafSize;
+	int iMax = std::min(points.mMax / kLeafSize, levelSizes[0].x - 1);
+	int jMin = std::max(points.nMin - 1, 0) / kLeafSize;
+	int jMax = std::min(points.nMax / kLeafSize, levelSizes[0].y - 1);
+
+	ComputeLeaves(heightField, iMin, iMax, jMin, jMax);
+	for (int level = 1; level < (int)levels.size(); level++)
+	{
+		iMin /= 2;
+		iMax /= 2;
+		jMin /= 2;
+		jMax /= 2;
+		ComputeParents(level, iMin, iMax, jMin, jMax);
+	}
+}
+
+HeightFieldRect HeightQuadtree::GetNodeQuads(int level, int i, int j) const
+{
+	const int size = GetNodeSize(level);
+	return HeightFieldRect(i * size, j * size, std::min((i + 1) * size, resolution.x) - 1, std::min((j + 1) * size, resolution.y) - 1);
+}
+
+void HeightQuadtree::ComputeLeaves(const HeightField& heightField, int iMin, int iMax, int jMin, int jMax)
+{
+	const int columns = heightField.GetColumns();
+
+	Parallel::ForBlocks(iMin, iMax + 1, 4, [&](int blockBegin, int blockEnd)
+	{
+		std::vector<float> row(columns);
+		for (int i = blockBegin; i < blockEnd; i++)
+		{
+			XMFLOAT2* leaves = &levels[0][i * levelSizes[0].y];
+			for (int j = jMin; j <= jMax; j++)
+			{
+				leaves[j] = XMFLOAT2(FLT_MAX, -FLT_MAX);
+			}
+
+			// the points of the leaf row, including the first row of the next leaf
+			const int mEnd = std::min((i + 1) * kLeafSize, resolution.x);
+			for (int m = i * kLeafSize; m <= mEnd; m++)
+			{
+				heightField.ReadRow(m, row.data());
+				for (int j = jMin; j <= jMax; j++)
+				{
+					const int nEnd = std::min((j + 1) * kLeafSize, resolution.y);
+					XMFLOAT2& bounds = leaves[j];
+					for (int n = j * kLeafSize; n <= nEnd; n++)
+					{
+						bounds.x = std::min(bounds.x, row[n]);
+						bounds.y = std::max(bounds.y, row[n]);
+					}
+				}
+			}
+		}
+	});
+}
+
+void HeightQuadtree::ComputeParents(int level, int iMin, int iMax, int jMin, int jMax)
+{
+	const XMINT2 childSize = levelSizes[level - 1];
+	const std::vector<XMFLOAT2>& children = levels[level - 1];
+
+	for (int i = iMin; i <= iMax; i++)
+	{
+		for (int j = jMin; j <= jMax; j++)
+		{
+			XMFLOAT2 bounds(FLT_MAX, -FLT_MAX);
+			for (int ci = 2 * i; ci <= std::min(2 * i + 1, childSize.x - 1); ci++)
+			{
+				for (int cj = 2 * j; cj <= std::min(2 * j + 1, childSize.y - 1); cj++)
+				{
+					const XMFLOAT2& child = children[cj + ci * childSize.y];
+					bounds.x = std::min(bounds.x, child.x);
+					bounds.y = std::max(bounds.y, child.y);
+				}
+			}
+			levels[level][j + i * levelSizes[level].y] = bounds;
+		}
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <vector>
+
+#include "HeightField.h"
+
+// Quadtree of min/max heights over the quads of a height map, stored as a pyramid of grids.
+// Level 0 are the leaves of kLeafSize x kLeafSize quads, every level above halves the grid
+// (node (i, j) has the children (2i, 2j), (2i, 2j + 1), (2i + 1, 2j), (2i + 1, 2j + 1)) up to a single root.
+// The bounds of a node include the border points shared with its neighbours
+class HeightQuadtree
+{
+public:
+	static const int kLeafSize = 8; // quads per side of a leaf
+
+	HeightQuadtree();
+
+	// Compute every level for the height map, the leaves are computed in parallel
+	void Build(const HeightField& heightField);
+	// Recompute the nodes covering the changed points of rect. It must have been built with the same resolution
+	void Update(const HeightField& heightField, const HeightFieldRect& rect);
+
+	XMINT2 GetResolution() const { return resolution; }
+	int GetLevelCount() const { return (int)levels.size(); }
+	XMINT2 GetLevelSize(int level) const { return levelSizes[level]; }
+	// Quads along each side of the nodes of a level
+	int GetNodeSize(int level) const { return kLeafSize << level; }
+	// Min (x) and max (y) height of the points of the node
+	XMFLOAT2 GetBounds(int level, int i, int j) const { return levels[level][j + i * levelSizes[level].y]; }
+	// Quads covered by the node, clipped to the height map
+	HeightFieldRect GetNodeQuads(int level, int i, int j) const;
+
+private:
+	void ComputeLeaves(const HeightField& heightField, int iMin, int iMax, int jMin, int jMax);
+	void ComputeParents(int level, int iMin, int iMax, int jMin, int jMax);
+
+	XMINT2 resolution;
+	std::vector<XMINT2> levelSizes; // nodes along m and n at each level
+	std::vector<std::vector<XMFLOAT2>> levels; // node (i, j) of a level is at j + i * levelSize.y
+};
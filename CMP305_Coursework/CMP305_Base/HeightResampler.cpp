@@ -0,0 +1,135 @@
+#include "HeightResampler.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "Parallel.h"
+
+// half width of the filters, in source points when the map is enlarged
+static const float kBilinearRadius = 1.0f;
+static const float kBicubicRadius = 2.0f;
+
+
+void HeightResampler::Resample(const HeightField& source, HeightField& destination, ResampleFilter filter)
+{
+	const int sourceRows = source.GetRows();
+	const int sourceColumns = source.GetColumns();
+	const int rows = destination.GetRows();
+	const int columns = destination.GetColumns();
+
+	Taps columnTaps, rowTaps;
+	BuildTaps(sourceColumns, columns, filter, columnTaps);
+	BuildTaps(sourceRows, rows, filter, rowTaps);
+
+	// resample every source row along n, the scratch rows are columnTaps.stride floats apart
+	const int stride = columnTaps.stride;
+	std::vector<float> scratch(sourceRows * stride);
+	Parallel::ForBlocks(0, sourceRows, 16, [&](int mBegin, int mEnd)
+	{
+		std::vector<float> row(sourceColumns);
+		for (int m = mBegin; m < mEnd; m++)
+		{
+			source.ReadRow(m, row.data());
+			float* resampled = &scratch[m * stride];
+			for (int n = 0; n < stride; n += 4)
+			{
+				// the 4 outputs read different source points: gathered, then weighted together
+				XMVECTOR sum = XMVectorZero();
+				for (int tap = 0; tap < columnTaps.taps; tap++)
+				{
+					const int* indices = &columnTaps.indices[tap * stride + n];
+					const XMVECTOR heights = XMVectorSet(row[indices[0]], row[indices[1]], row[indices[2]], row[indices[3]]);
+					sum = XMVectorMultiplyAdd(heights, XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&columnTaps.weights[tap * stride + n])), sum);
+				}
+				XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(&resampled[n]), sum);
+			}
+		}
+	});
+
+	// resample along m from the scratch rows. In bands aligned to the tiles of QuantisedHeightMap,
+	// so no two threads write the same tile
+	const int bandRows = QuantisedHeightMap::kTileSize;
+	const int bands = (rows + bandRows - 1) / bandRows;
+	Parallel::ForBlocks(0, bands, 1, [&](int bandBegin, int bandEnd)
+	{
+		std::vector<float> row(stride);
+		for (int m = bandBegin * bandRows; m < (std::min)(bandEnd * bandRows, rows); m++)
+		{
+			// the same weight for the whole row: 4 points at a time straight from the scratch rows
+			std::fill(row.begin(), row.end(), 0.0f);
+			for (int tap = 0; tap < rowTaps.taps; tap++)
+			{
+				const float* scratchRow = &scratch[rowTaps.indices[tap * rowTaps.stride + m] * stride];
+				const XMVECTOR weight = XMVectorReplicate(rowTaps.weights[tap * rowTaps.stride + m]);
+				for (int n = 0; n < stride; n += 4)
+				{
+					XMFLOAT4* sum = reinterpret_cast<XMFLOAT4*>(&row[n]);
+					XMStoreFloat4(sum, XMVectorMultiplyAdd(XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&scratchRow[n])), weight, XMLoadFloat4(sum)));
+				}
+			}
+			destination.WriteRow(m, 0, columns, row.data());
+		}
+	});
+}
+
+XMINT2 HeightResampler::GetHalfResolution(XMINT2 resolution)
+{
+	return XMINT2((std::max)(resolution.x / 2, 1), (std::max)(resolution.y / 2, 1));
+}
+
+void HeightResampler::BuildTaps(int sourceCount, int outputCount, ResampleFilter filter, Taps& taps)
+{
+	// distance between two outputs in source points, the first and last points of both maps are at the same place
+	const float step = outputCount > 1 ? (float)(sourceCount - 1) / (float)(outputCount - 1) : 0.0f;
+	// the filter covers at least the source points between two outputs
+	const float scale = (std::max)(step, 1.0f);
+	const float support = (filter == kResampleBicubic ? kBicubicRadius : kBilinearRadius) * scale;
+
+	// the points strictly inside (x - support, x + support)
+	taps.taps = (std::max)((int)ceilf(2.0f * support), 1);
+	taps.stride = (outputCount + 3) & ~3;
+	taps.indices.assign(taps.taps * taps.stride, 0);
+	taps.weights.assign(taps.taps * taps.stride, 0.0f);
+
+	for (int i = 0; i < outputCount; i++)
+	{
+		const float x = i * step;
+		const int first = (int)floorf(x - support) + 1;
+		float sum = 0.0f;
+		for (int tap = 0; tap < taps.taps; tap++)
+		{
+			const int j = first + tap;
+			const float weight = GetWeight(filter, (x - j) / scale);
+			// the points outside the map are the ones of the edge
+			taps.indices[tap * taps.stride + i] = (std::min)((std::max)(j, 0), sourceCount - 1);
+			taps.weights[tap * taps.stride + i] = weight;
+			sum += weight;
+		}
+
+		// the weights add up to 1, a flat map stays flat
+		for (int tap = 0; tap < taps.taps; tap++)
+		{
+			taps.weights[tap * taps.stride + i] /= sum;
+		}
+	}
+}
+
+float HeightResampler::GetWeight(ResampleFilter filter, float distance)
+{
+	const float x = fabsf(distance);
+	if (filter == kResampleBilinear)
+	{
+		return (std::max)(1.0f - x, 0.0f);
+	}
+
+	// Catmull-Rom (a = -0.5)
+	if (x < 1.0f)
+	{
+		return (1.5f * x - 2.5f) * x * x + 1.0f;
+	}
+	if (x < 2.0f)
+	{
+		return ((-0.5f * x + 2.5f) * x - 4.0f) * x + 2.0f;
+	}
+	return 0.0f;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <vector>
+
+#include "HeightField.h"
+
+// Filters to resample the height map
+enum ResampleFilter
+{
+	kResampleBilinear = 0, // tent over the 2 nearest points along each axis
+	kResampleBicubic = 1 // Catmull-Rom over the 4 nearest points, sharper and smooth across the points
+};
+
+// Resampling of a height map to another resolution, keeping its shape (the corners of both maps are the same points).
+// It is separable: every source row is resampled along n into a scratch map, and then every destination row along m
+// from the scratch rows. Both passes run 4 points at a time with SIMD and split the rows across the threads.
+// When a map is reduced the filter is stretched over the source points between two destination ones, so the
+// result is filtered and not just point sampled: it can build the levels of a LOD pyramid as well as change the resolution
+class HeightResampler
+{
+public:
+	// Fill every point of destination from source, they can have any resolution (both of them at least one point)
+	static void Resample(const HeightField& source, HeightField& destination, ResampleFilter filter);
+
+	// Resolution of the next level of a pyramid: half the quads, at least 1
+	static XMINT2 GetHalfResolution(XMINT2 resolution);
+
+private:
+	// Source points and weights read by every output point along an axis:
+	// the output i reads indices[tap * stride + i] * weights[tap * stride + i] for every tap.
+	// stride is the output count rounded up to 4, the extra outputs read the point 0 with weight 0
+	struct Taps
+	{
+		int taps;
+		int stride;
+		std::vector<int> indices;
+		std::vector<float> weights;
+	};
+
+	static void BuildTaps(int sourceCount, int outputCount, ResampleFilter filter, Taps& taps);
+	static float GetWeight(ResampleFilter filter, float distance);
+};
@@ -0,0 +1,251 @@
+#include "HeightStatistics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+#include "Parallel.h"
+
+const int HeightStatistics::kNumBins;
+
+
+HeightStatistics::HeightStatistics()
+	: count(0), sum(0.0), sumSquares(0.0), minHeight(0.0f), maxHeight(0.0f), minApproximate(false), maxApproximate(false),
+	histogram(kNumBins, 0), histogramMin(0.0f), binWidth(1.0f), underflow(0), overflow(0)
+{
+}
+
+void HeightStatistics::Compute(const HeightField& heightField)
+{
+	const int rows = heightField.GetRows();
+	const int columns = heightField.GetColumns();
+	std::mutex mergeMutex;
+
+	// Pass 1: range, sum and sum of squares. Every band reduces its own rows and then merges the result
+	count = 0;
+	sum = 0.0;
+	sumSquares = 0.0;
+	minHeight = heightField.Get(0, 0);
+	maxHeight = minHeight;
+	Parallel::ForBlocks(0, rows, 16, [&](int mBegin, int mEnd)
+	{
+		std::vector<float> row(columns);
+		double bandSum = 0.0, bandSumSquares = 0.0;
+		float bandMin = heightField.Get(mBegin, 0);
+		float bandMax = bandMin;
+
+		for (int m = mBegin; m < mEnd; m++)
+		{
+			heightField.ReadRow(m, row.data());
+			double rowSum = 0.0, rowSumSquares = 0.0;
+			for (int n = 0; n < columns; n++)
+			{
+				const float height = row[n];
+				rowSum += height;
+				rowSumSquares += (double)height * height;
+				bandMin = std::min(bandMin, height);
+				bandMax = std::max(bandMax, height);
+			}
+			bandSum += rowSum;
+			bandSumSquares += rowSumSquares;
+		}
+
+		std::lock_guard<std::mutex> lock(mergeMutex);
+		sum += bandSum;
+		sumSquares += bandSumSquares;
+		minHeight = std::min(minHeight, bandMin);
+		maxHeight = std::max(maxHeight, bandMax);
+	});
+	count = (long long)rows * columns;
+	minApproximate = false;
+	maxApproximate = false;
+
+	// The histogram covers the range plus a quarter of it at each side for the local edits
+	const float range = std::max(maxHeight - minHeight, 1.0f);
+	histogramMin = minHeight - range * 0.25f;
+	binWidth = (range * 1.5f) / (float)kNumBins;
+
+	// Pass 2: histogram, every band fills its own one and then merges it
+	std::fill(histogram.begin(), histogram.end(), 0);
+	underflow = 0;
+	overflow = 0;
+	Parallel::ForBlocks(0, rows, 16, [&](int mBegin, int mEnd)
+	{
+		std::vector<float> row(columns);
+		std::vector<int> bandHistogram(kNumBins, 0);
+
+		for (int m = mBegin; m < mEnd; m++)
+		{
+			heightField.ReadRow(m, row.data());
+			for (int n = 0; n < columns; n++)
+			{
+				bandHistogram[std::min(std::max(GetBin(row[n]), 0), kNumBins - 1)]++;
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(mergeMutex);
+		for (int bin = 0; bin < kNumBins; bin++)
+		{
+			histogram[bin] += bandHistogram[bin];
+		}
+	});
+}
+
+void HeightStatistics::RemoveRegion(const HeightField& heightField, const HeightFieldRect& rect)
+{
+	AccumulateRegion(heightField, rect, -1);
+}
+
+void HeightStatistics::AddRegion(const HeightField& heightField, const HeightFieldRect& rect)
+{
+	AccumulateRegion(heightField, rect, 1);
+}
+
+bool HeightStatistics::NeedsRebuild() const
+{
+	return count == 0 || (underflow + overflow) * 100 > count;
+}
+
+float HeightStatistics::GetMin() const
+{
+	if (!minApproximate || underflow > 0)
+	{
+		return minHeight;
+	}
+
+	// lower edge of the first bin with points
+	for (int bin = 0; bin < kNumBins; bin++)
+	{
+		if (histogram[bin] > 0)
+		{
+			return histogramMin + bin * binWidth;
+		}
+	}
+	return minHeight;
+}
+
+float HeightStatistics::GetMax() const
+{
+	if (!maxApproximate || overflow > 0)
+	{
+		return maxHeight;
+	}
+
+	// upper edge of the last bin with points
+	for (int bin = kNumBins - 1; bin >= 0; bin--)
+	{
+		if (histogram[bin] > 0)
+		{
+			return histogramMin + (bin + 1) * binWidth;
+		}
+	}
+	return maxHeight;
+}
+
+float HeightStatistics::GetMean() const
+{
+	return count > 0 ? (float)(sum / (double)count) : 0.0f;
+}
+
+float HeightStatistics::GetStdDev() const
+{
+	if (count == 0)
+	{
+		return 0.0f;
+	}
+
+	const double mean = sum / (double)count;
+	return (float)sqrt(std::max(sumSquares / (double)count - mean * mean, 0.0));
+}
+
+float HeightStatistics::GetPercentile(float p) const
+{
+	if (count == 0)
+	{
+		return 0.0f;
+	}
+
+	const double target = (double)std::min(std::max(p, 0.0f), 1.0f) * (double)count;
+
+	// the points out of the histogram range are only known to be below/above it
+	double cumulative = (double)underflow;
+	if (target <= cumulative && underflow > 0)
+	{
+		return GetMin();
+	}
+
+	for (int bin = 0; bin < kNumBins; bin++)
+	{
+		const double binCount = (double)histogram[bin];
+		if (binCount > 0.0 && cumulative + binCount >= target)
+		{
+			// interpolate inside the bin and keep the result inside the real range
+			const float t = (float)((target - cumulative) / binCount);
+			const float height = histogramMin + ((float)bin + t) * binWidth;
+			return std::min(std::max(height, GetMin()), GetMax());
+		}
+		cumulative += binCount;
+	}
+
+	return GetMax();
+}
+
+int HeightStatistics::GetBin(float height) const
+{
+	return (int)floorf((height - histogramMin) / binWidth);
+}
+
+void HeightStatistics::AccumulateRegion(const HeightField& heightField, const HeightFieldRect& rect, int sign)
+{
+	const HeightFieldRect region = heightField.Clip(rect);
+	if (region.IsEmpty())
+	{
+		return;
+	}
+
+	for (int m = region.mMin; m <= region.mMax; m++)
+	{
+		for (int n = region.nMin; n <= region.nMax; n++)
+		{
+			const float height = heightField.Get(m, n);
+
+			count += sign;
+			sum += sign * (double)height;
+			sumSquares += sign * (double)height * height;
+
+			const int bin = GetBin(height);
+			if (bin < 0)
+			{
+				underflow += sign;
+			}
+			else if (bin >= kNumBins)
+			{
+				overflow += sign;
+			}
+			else
+			{
+				histogram[bin] += sign;
+			}
+
+			if (sign > 0)
+			{
+				if (height < minHeight)
+				{
+					minHeight = height;
+					minApproximate = false;
+				}
+				if (height > maxHeight)
+				{
+					maxHeight = height;
+					maxApproximate = false;
+				}
+			}
+			else
+			{
+				// removing an extreme, it can only be recovered from the histogram
+				minApproximate = minApproximate || height <= minHeight;
+				maxApproximate = maxApproximate || height >= maxHeight;
+			}
+		}
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <vector>
+
+#include "HeightField.h"
+
+// Statistics of the height distribution of a height map: min, max, mean, standard deviation and a
+// fixed-bin histogram to answer percentile queries without scanning the map.
+// After a full-map operation call Compute(). After a local edit call RemoveRegion() with the old heights
+// and AddRegion() with the new ones, which costs O(area of the region).
+class HeightStatistics
+{
+public:
+	static const int kNumBins = 512;
+
+	HeightStatistics();
+
+	// Full scan of the height map, split in bands of rows computed in parallel.
+	// The histogram covers the current height range plus a margin, so local edits rarely fall outside it
+	void Compute(const HeightField& heightField);
+
+	// Incremental update from a dirty rectangle: remove the points before the edit and add them back after it
+	void RemoveRegion(const HeightField& heightField, const HeightFieldRect& rect);
+	void AddRegion(const HeightField& heightField, const HeightFieldRect& rect);
+
+	// True when there is no data or too many points have gone out of the histogram range, so Compute() should be called
+	bool NeedsRebuild() const;
+
+	int GetCount() const { return (int)count; }
+	float GetMin() const; // exact unless the lowest point has been removed by a local edit, then it is within one bin
+	float GetMax() const; // exact unless the highest point has been removed by a local edit, then it is within one bin
+	float GetMean() const;
+	float GetStdDev() const;
+
+	// Height below which the fraction p [0, 1] of the points are. O(kNumBins), linear interpolation inside the bin
+	float GetPercentile(float p) const;
+
+	// Histogram access for display
+	const std::vector<int>& GetHistogram() const { return histogram; }
+	float GetHistogramMin() const { return histogramMin; }
+	float GetBinWidth() const { return binWidth; }
+
+private:
+	int GetBin(float height) const;
+	void AccumulateRegion(const HeightField& heightField, const HeightFieldRect& rect, int sign);
+
+	long long count;
+	double sum;
+	double sumSquares;
+	float minHeight, maxHeight;
+	bool minApproximate, maxApproximate;
+
+	std::vector<int> histogram; // number of points per bin
+	float histogramMin;
+	float binWidth;
+	long long underflow, overflow; // points outside the histogram range
+};
@@ -0,0 +1,215 @@
+#include "HorizonOcclusion.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+const int HorizonOcclusion::kBinCount;
+
+static_assert((HorizonOcclusion::kBinCount & (HorizonOcclusion::kBinCount - 1)) == 0, "The bins wrap around with a mask");
+
+
+HorizonOcclusion::HorizonOcclusion()
+	: hiddenLeaves(0)
+{
+	horizon.resize(kBinCount);
+}
+
+void HorizonOcclusion::Compute(const HeightQuadtree& quadtree, const XMFLOAT3& eye, float heightFloor)
+{
+	// same pyramid as the quadtree
+	levelSizes.resize(quadtree.GetLevelCount());
+	levels.resize(quadtree.GetLevelCount());
+	for (int level = 0; level < quadtree.GetLevelCount(); level++)
+	{
+		levelSizes[level] = quadtree.GetLevelSize(level);
+		levels[level].resize(levelSizes[level].x * levelSizes[level].y);
+	}
+	hiddenLeaves = 0;
+	if (levels.empty())
+	{
+		return;
+	}
+
+	const XMINT2 leafGrid = levelSizes[0];
+	const int leafCount = leafGrid.x * leafGrid.y;
+	const float bucketSize = (float)HeightQuadtree::kLeafSize;
+	const XMINT2 resolution = quadtree.GetResolution();
+
+	// Directions of the corners of the leaves from the eye
+	cornerAngles.resize((leafGrid.x + 1) * (leafGrid.y + 1));
+	for (int i = 0; i <= leafGrid.x; i++)
+	{
+		const float dz = (float)(std::min)(i * HeightQuadtree::kLeafSize, resolution.x) - eye.z;
+		for (int j = 0; j <= leafGrid.y; j++)
+		{
+			const float dx = (float)(std::min)(j * HeightQuadtree::kLeafSize, resolution.y) - eye.x;
+			cornerAngles[j + i * (leafGrid.y + 1)] = (dx != 0.0f || dz != 0.0f) ? PseudoAngle(dx, dz) : 0.0f;
+		}
+	}
+
+	// Horizontal distance from the eye to the nearest and furthest point of every leaf and the directions it covers
+	leafMinDistance.resize(leafCount);
+	leafMaxDistance.resize(leafCount);
+	leafAngleLo.resize(leafCount);
+	leafAngleHi.resize(leafCount);
+	float furthest = 0.0f;
+	for (int i = 0; i < leafGrid.x; i++)
+	{
+		for (int j = 0; j < leafGrid.y; j++)
+		{
+			const HeightFieldRect quads = quadtree.GetNodeQuads(0, i, j);
+			const float xMin = (float)quads.nMin, xMax = (float)(quads.nMax + 1);
+			const float zMin = (float)quads.mMin, zMax = (float)(quads.mMax + 1);
+
+			const float nearX = (std::max)((std::max)(xMin - eye.x, eye.x - xMax), 0.0f);
+			const float nearZ = (std::max)((std::max)(zMin - eye.z, eye.z - zMax), 0.0f);
+			const float farX = (std::max)(fabsf(eye.x - xMin), fabsf(eye.x - xMax));
+			const float farZ = (std::max)(fabsf(eye.z - zMin), fabsf(eye.z - zMax));
+
+			const int leaf = j + i * leafGrid.y;
+			leafMinDistance[leaf] = sqrtf(nearX * nearX + nearZ * nearZ);
+			leafMaxDistance[leaf] = sqrtf(farX * farX + farZ * farZ);
+			furthest = (std::max)(furthest, leafMaxDistance[leaf]);
+			if (leafMinDistance[leaf] > 0.0f)
+			{
+				const int corner = j + i * (leafGrid.y + 1);
+				float angles[4] = { cornerAngles[corner], cornerAngles[corner + 1], cornerAngles[corner + leafGrid.y + 1], cornerAngles[corner + leafGrid.y + 2] };
+				GetAngularSpan(angles, leafAngleLo[leaf], leafAngleHi[leaf]);
+			}
+		}
+	}
+
+	// Counting sort of the leaves in buckets of distance. A leaf is tested in the bucket of its nearest point
+	// and becomes part of the horizon in the bucket after its furthest point, so the horizon used to test a
+	// leaf only has leaves which are completely nearer than it (and it is always tested before it is added)
+	const int bucketCount = (int)(furthest / bucketSize) + 2;
+	bucketStarts.assign(bucketCount + 1, 0);
+	commitBucketStarts.assign(bucketCount + 1, 0);
+	for (int leaf = 0; leaf < leafCount; leaf++)
+	{
+		bucketStarts[(int)(leafMinDistance[leaf] / bucketSize) + 1]++;
+		commitBucketStarts[(int)ceilf(leafMaxDistance[leaf] / bucketSize) + 1]++;
+	}
+	for (int bucket = 0; bucket < bucketCount; bucket++)
+	{
+		bucketStarts[bucket + 1] += bucketStarts[bucket];
+		commitBucketStarts[bucket + 1] += commitBucketStarts[bucket];
+	}
+	testOrder.resize(leafCount);
+	commitOrder.resize(leafCount);
+	{
+		std::vector<int> testNext(bucketStarts.begin(), bucketStarts.end() - 1);
+		std::vector<int> commitNext(commitBucketStarts.begin(), commitBucketStarts.end() - 1);
+		for (int leaf = 0; leaf < leafCount; leaf++)
+		{
+			testOrder[testNext[(int)(leafMinDistance[leaf] / bucketSize)]++] = leaf;
+			commitOrder[commitNext[(int)ceilf(leafMaxDistance[leaf] / bucketSize)]++] = leaf;
+		}
+	}
+
+	// Sweep front to back
+	const float binScale = kBinCount / 4.0f;
+	std::fill(horizon.begin(), horizon.end(), -FLT_MAX);
+	std::vector<unsigned char>& leaves = levels[0];
+	for (int bucket = 0; bucket < bucketCount; bucket++)
+	{
+		// Add the leaves that end before this bucket to the horizon. Their lowest point sets the slope under which
+		// everything further away is hidden, in the bins completely covered by the leaf
+		for (int c = commitBucketStarts[bucket]; c < commitBucketStarts[bucket + 1]; c++)
+		{
+			// A hidden leaf is under the horizon already, and the eye over a leaf sees it in every direction
+			const int leaf = commitOrder[c];
+			if (leaves[leaf] == kOcclusionHidden || leafMinDistance[leaf] <= 0.0f)
+			{
+				continue;
+			}
+
+			// the slope is lowest at the furthest point when the leaf is above the eye and at the nearest one when below
+			const float height = (std::max)(quadtree.GetBounds(0, leaf / leafGrid.y, leaf % leafGrid.y).x, heightFloor) - eye.y;
+			const float slope = height / (height > 0.0f ? leafMaxDistance[leaf] : leafMinDistance[leaf]);
+
+			const int binEnd = (int)floorf(leafAngleHi[leaf] * binScale);
+			for (int bin = (int)ceilf(leafAngleLo[leaf] * binScale); bin < binEnd; bin++)
+			{
+				float& binSlope = horizon[bin & (kBinCount - 1)];
+				binSlope = (std::max)(binSlope, slope);
+			}
+		}
+
+		// Test the leaves that start in this bucket: hidden when their highest slope is under the horizon in every bin they touch
+		for (int t = bucketStarts[bucket]; t < bucketStarts[bucket + 1]; t++)
+		{
+			const int leaf = testOrder[t];
+			if (leafMinDistance[leaf] <= 0.0f)
+			{
+				leaves[leaf] = kOcclusionVisible;
+				continue;
+			}
+
+			const float height = (std::max)(quadtree.GetBounds(0, leaf / leafGrid.y, leaf % leafGrid.y).y, heightFloor) - eye.y;
+			const float slope = height / (height > 0.0f ? leafMinDistance[leaf] : leafMaxDistance[leaf]);
+
+			bool hidden = true;
+			const int binLast = (int)floorf(leafAngleHi[leaf] * binScale);
+			for (int bin = (int)floorf(leafAngleLo[leaf] * binScale); bin <= binLast && hidden; bin++)
+			{
+				hidden = slope < horizon[bin & (kBinCount - 1)];
+			}
+
+			leaves[leaf] = hidden ? kOcclusionHidden : kOcclusionVisible;
+			hiddenLeaves += hidden ? 1 : 0;
+		}
+	}
+
+	// A parent is hidden or visible if all its children are, partial otherwise
+	for (int level = 1; level < (int)levels.size(); level++)
+	{
+		const XMINT2 childSize = levelSizes[level - 1];
+		const std::vector<unsigned char>& children = levels[level - 1];
+		for (int i = 0; i < levelSizes[level].x; i++)
+		{
+			for (int j = 0; j < levelSizes[level].y; j++)
+			{
+				bool anyHidden = false, anyVisible = false;
+				for (int ci = 2 * i; ci <= (std::min)(2 * i + 1, childSize.x - 1); ci++)
+				{
+					for (int cj = 2 * j; cj <= (std::min)(2 * j + 1, childSize.y - 1); cj++)
+					{
+						const unsigned char child = children[cj + ci * childSize.y];
+						anyHidden |= (child != kOcclusionVisible);
+						anyVisible |= (child != kOcclusionHidden);
+					}
+				}
+				levels[level][j + i * levelSizes[level].y] = (unsigned char)(anyHidden ? (anyVisible ? kOcclusionPartial : kOcclusionHidden) : kOcclusionVisible);
+			}
+		}
+	}
+}
+
+void HorizonOcclusion::GetAngularSpan(float angles[4], float& lo, float& hi)
+{
+	// The eye is outside the rectangle, so it spans less than half a turn (2 in pseudo-angle) between two of its corners
+	lo = (std::min)((std::min)(angles[0], angles[1]), (std::min)(angles[2], angles[3]));
+	hi = (std::max)((std::max)(angles[0], angles[1]), (std::max)(angles[2], angles[3]));
+	if (hi - lo > 2.0f)
+	{
+		// it crosses the direction 0, unwrap the angles before it
+		for (int corner = 0; corner < 4; corner++)
+		{
+			angles[corner] += angles[corner] < 2.0f ? 4.0f : 0.0f;
+		}
+		lo = (std::min)((std::min)(angles[0], angles[1]), (std::min)(angles[2], angles[3]));
+		hi = (std::max)((std::max)(angles[0], angles[1]), (std::max)(angles[2], angles[3]));
+	}
+}
+
+float HorizonOcclusion::PseudoAngle(float dx, float dz)
+{
+	// "diamond angle": 0 along +x, 1 along +z, 2 along -x, 3 along -z
+	if (dz >= 0.0f)
+	{
+		return dx >= 0.0f ? dz / (dx + dz) : 1.0f - dx / (dz - dx);
+	}
+	return dx < 0.0f ? 2.0f - dz / (-dx - dz) : 3.0f + dx / (dx - dz);
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <vector>
+
+#include "HeightQuadtree.h"
+
+// Occlusion state of a quadtree node after the horizon sweep
+enum OcclusionState
+{
+	kOcclusionHidden = 0, // every leaf of the node is behind the horizon
+	kOcclusionPartial = 1, // some leaves are hidden
+	kOcclusionVisible = 2 // no leaf is hidden
+};
+
+// Occlusion culling of the terrain by the terrain itself. The leaves of the quadtree are swept front to back
+// from the eye and a horizon buffer keeps, for every direction (azimuth bin) around the eye, the highest slope
+// (height over horizontal distance) of the leaves already swept. A leaf whose highest possible slope is under
+// the horizon in all the directions it covers is hidden by nearer ridges.
+// Everything is in the space of the height map: x = n, y = height, z = m
+class HorizonOcclusion
+{
+public:
+	static const int kBinCount = 1024; // azimuth bins of the horizon buffer, a power of two
+
+	HorizonOcclusion();
+
+	// Sweep the leaves of the quadtree from the eye. Heights below heightFloor count as heightFloor (fake water level)
+	void Compute(const HeightQuadtree& quadtree, const XMFLOAT3& eye, float heightFloor);
+
+	OcclusionState GetState(int level, int i, int j) const { return (OcclusionState)levels[level][j + i * levelSizes[level].y]; }
+	int GetHiddenLeafCount() const { return hiddenLeaves; }
+	int GetLeafCount() const { return levels.empty() ? 0 : (int)levels[0].size(); }
+
+private:
+	// Angular span of a leaf from the pseudo-angles of its corners, in [0, 4) (hi can be up to 8 when it wraps)
+	static void GetAngularSpan(float angles[4], float& lo, float& hi);
+	// Monotonic replacement of atan2 in [0, 4) for the direction (dx, dz)
+	static float PseudoAngle(float dx, float dz);
+
+	std::vector<float> horizon; // highest slope of the committed leaves in each bin
+	std::vector<XMINT2> levelSizes;
+	std::vector<std::vector<unsigned char>> levels; // OcclusionState of the nodes, same layout as the quadtree
+	int hiddenLeaves;
+
+	// leaves sorted by distance buckets (counting sort) to sweep them front to back
+	std::vector<float> cornerAngles; // pseudo-angle of the corners of the leaves, shared by the neighbours
+	std::vector<float> leafMinDistance, leafMaxDistance, leafAngleLo, leafAngleHi;
+	std::vector<int> bucketStarts, commitBucketStarts, testOrder, commitOrder;
+};
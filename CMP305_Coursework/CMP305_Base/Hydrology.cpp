@@ -0,0 +1,254 @@
+#include "Hydrology.h"
+
+#include <algorithm>
+#include <cmath>
+
+const int Hydrology::kNeighbourOffsetM[8] = { -1, -1, -1, 0, 0, 1, 1, 1 };
+const int Hydrology::kNeighbourOffsetN[8] = { -1, 0, 1, -1, 1, -1, 0, 1 };
+const float Hydrology::kNeighbourDistance[8] = { 1.41421356f, 1.0f, 1.41421356f, 1.0f, 1.0f, 1.41421356f, 1.0f, 1.41421356f };
+
+
+bool Hydrology::Analyse(const HeightField& heightField, HydrologyMaps& maps, const std::atomic<bool>* cancel)
+{
+	std::vector<unsigned char> floodDirection;
+
+	maps.resolution = heightField.GetResolution();
+
+	FillDepressions(heightField, maps.filledHeight, floodDirection, cancel);
+	if (cancel && *cancel)
+	{
+		return false;
+	}
+	ComputeFlowDirections(maps.resolution, maps.filledHeight, floodDirection, maps.flowDirection);
+	if (cancel && *cancel)
+	{
+		return false;
+	}
+	ComputeFlowAccumulation(maps.resolution, maps.flowDirection, maps.flowAccumulation);
+	return !(cancel && *cancel);
+}
+
+void Hydrology::FillDepressions(const HeightField& heightField, std::vector<float>& filledHeight, std::vector<unsigned char>& floodDirection,
+	const std::atomic<bool>* cancel)
+{
+	const int rows = heightField.GetRows();
+	const int columns = heightField.GetColumns();
+	const int size = heightField.GetSize();
+
+	filledHeight.resize(size);
+	floodDirection.assign(size, kFlowOutlet);
+
+	// copy the height map and get its range to quantise the heights into buckets
+	float minHeight = heightField.Get(0, 0);
+	float maxHeight = minHeight;
+	for (int m = 0; m < rows; m++)
+	{
+		heightField.ReadRow(m, &filledHeight[heightField.GetIndex(m, 0)]);
+	}
+	for (int i = 0; i < size; i++)
+	{
+		minHeight = std::min(minHeight, filledHeight[i]);
+		maxHeight = std::max(maxHeight, filledHeight[i]);
+	}
+	const float bucketScale = (maxHeight > minHeight) ? (float)(kNumBuckets - 1) / (maxHeight - minHeight) : 0.0f;
+
+	// Monotone bucket queue: a point is never pushed into a bucket lower than the one being processed,
+	// as the filled height of a neighbour is always >= the height of the point that reached it
+	std::vector<std::vector<int>> buckets(kNumBuckets);
+	std::vector<unsigned char> visited(size, 0);
+
+	auto push = [&](int index)
+	{
+		int bucket = (int)((filledHeight[index] - minHeight) * bucketScale);
+		buckets[std::min(std::max(bucket, 0), kNumBuckets - 1)].push_back(index);
+		visited[index] = 1;
+	};
+
+	// the borders are the outlets of the map, so they are the seeds of the flood
+	for (int m = 0; m < rows; m++)
+	{
+		for (int n = 0; n < columns; n++)
+		{
+			if (m == 0 || n == 0 || m == rows - 1 || n == columns - 1)
+			{
+				push(heightField.GetIndex(m, n));
+			}
+		}
+	}
+
+	for (int bucket = 0; bucket < kNumBuckets && !(cancel && *cancel); bucket++)
+	{
+		// the bucket can grow while it is processed, so iterate by index
+		std::vector<int>& queue = buckets[bucket];
+		for (size_t i = 0; i < queue.size(); i++)
+		{
+			const int index = queue[i];
+			const int m = index / columns;
+			const int n = index % columns;
+
+			for (int d = 0; d < 8; d++)
+			{
+				const int neighbourM = m + kNeighbourOffsetM[d];
+				const int neighbourN = n + kNeighbourOffsetN[d];
+				if (!heightField.InBounds(neighbourM, neighbourN))
+				{
+					continue;
+				}
+
+				const int neighbour = heightField.GetIndex(neighbourM, neighbourN);
+				if (visited[neighbour])
+				{
+					continue;
+				}
+
+				// raise the neighbour to the spill height and remember from where it has been flooded
+				filledHeight[neighbour] = std::max(filledHeight[neighbour], filledHeight[index]);
+				floodDirection[neighbour] = (unsigned char)(7 - d);
+				push(neighbour);
+			}
+		}
+
+		// release the memory of the processed bucket
+		std::vector<int>().swap(queue);
+	}
+}
+
+void Hydrology::ComputeFlowDirections(XMINT2 resolution, const std::vector<float>& filledHeight, const std::vector<unsigned char>& floodDirection, std::vector<unsigned char>& flowDirection)
+{
+	const int rows = resolution.x + 1;
+	const int columns = resolution.y + 1;
+
+	flowDirection.resize(rows * columns);
+
+	for (int m = 0; m < rows; m++)
+	{
+		for (int n = 0; n < columns; n++)
+		{
+			const int index = n + m * columns;
+			const float height = filledHeight[index];
+
+			// look for the steepest descent through the neighbours of the current point
+			float steepestSlope = 0.0f;
+			unsigned char direction = floodDirection[index];
+			for (int d = 0; d < 8; d++)
+			{
+				const int neighbourM = m + kNeighbourOffsetM[d];
+				const int neighbourN = n + kNeighbourOffsetN[d];
+				if (neighbourM < 0 || neighbourM >= rows || neighbourN < 0 || neighbourN >= columns)
+				{
+					continue;
+				}
+
+				const float slope = (height - filledHeight[neighbourN + neighbourM * columns]) / kNeighbourDistance[d];
+				if (slope > steepestSlope)
+				{
+					steepestSlope = slope;
+					direction = (unsigned char)d;
+				}
+			}
+
+			flowDirection[index] = direction;
+		}
+	}
+}
+
+void Hydrology::ComputeFlowAccumulation(XMINT2 resolution, const std::vector<unsigned char>& flowDirection, std::vector<float>& flowAccumulation)
+{
+	const int rows = resolution.x + 1;
+	const int columns = resolution.y + 1;
+	const int size = rows * columns;
+
+	// every point contributes with itself
+	flowAccumulation.assign(size, 1.0f);
+
+	// offset in the array of each direction
+	int directionOffset[8];
+	for (int d = 0; d < 8; d++)
+	{
+		directionOffset[d] = kNeighbourOffsetN[d] + kNeighbourOffsetM[d] * columns;
+	}
+
+	// return the point which receives the water of index, or -1 if it leaves the map
+	auto receiver = [&](int index) -> int
+	{
+		const unsigned char d = flowDirection[index];
+		if (d == kFlowOutlet)
+		{
+			return -1;
+		}
+		return index + directionOffset[d];
+	};
+
+	// count how many points drain into each point
+	std::vector<unsigned char> donorCount(size, 0);
+	for (int i = 0; i < size; i++)
+	{
+		const int r = receiver(i);
+		if (r >= 0)
+		{
+			donorCount[r]++;
+		}
+	}
+
+	// start from the points with no donors (ridges) and pass their water downstream.
+	// A point is only processed when all its donors have been processed
+	std::vector<int> queue;
+	queue.reserve(size);
+	for (int i = 0; i < size; i++)
+	{
+		if (donorCount[i] == 0)
+		{
+			queue.push_back(i);
+		}
+	}
+
+	for (size_t i = 0; i < queue.size(); i++)
+	{
+		const int index = queue[i];
+		const int r = receiver(index);
+		if (r < 0)
+		{
+			continue;
+		}
+
+		flowAccumulation[r] += flowAccumulation[index];
+		if (--donorCount[r] == 0)
+		{
+			queue.push_back(r);
+		}
+	}
+}
+
+int Hydrology::CarveRivers(HeightField& heightField, const HydrologyMaps& maps, float accumulationThreshold, float maxDepth,
+	const std::atomic<bool>* cancel)
+{
+	const int rows = heightField.GetRows();
+	const int columns = heightField.GetColumns();
+	int carvedPoints = 0;
+
+	if (accumulationThreshold < 1.0f)
+	{
+		accumulationThreshold = 1.0f;
+	}
+
+	for (int m = 0; m < rows && !(cancel && *cancel); m++)
+	{
+		for (int n = 0; n < columns; n++)
+		{
+			const int index = heightField.GetIndex(m, n);
+			const float accumulation = maps.flowAccumulation[index];
+			if (accumulation < accumulationThreshold)
+			{
+				continue;
+			}
+
+			// half depth when the river starts and full depth when it carries 4 times the threshold.
+			// Carve below the filled height, so the channel keeps draining through the depressions
+			const float depth = maxDepth * std::min(1.0f, 0.5f * sqrtf(accumulation / accumulationThreshold));
+			heightField.Set(m, n, std::min(heightField.Get(m, n), maps.filledHeight[index] - depth));
+			carvedPoints++;
+		}
+	}
+
+	return carvedPoints;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <atomic>
+#include <vector>
+
+#include "HeightField.h"
+
+// D8 flow direction of a point, stored as an index into the 8 neighbours:
+//
+// ---------
+// | 0| 1| 2|
+// | 3|mn| 4|
+// | 5| 6| 7|
+// ---------
+//
+// The opposite direction of d is (7 - d)
+enum FlowDirection
+{
+	kFlowNorthWest = 0,
+	kFlowNorth = 1,
+	kFlowNorthEast = 2,
+	kFlowWest = 3,
+	kFlowEast = 4,
+	kFlowSouthWest = 5,
+	kFlowSouth = 6,
+	kFlowSouthEast = 7,
+	kFlowOutlet = 8 // the water leaves the map through this point (only at the borders)
+};
+
+// Auxiliary planes produced by the hydrology analysis.
+// All of them have one value per height map point and use the same indexing as the HeightField
+struct HydrologyMaps
+{
+	XMINT2 resolution = XMINT2(0, 0);
+	std::vector<float> filledHeight; // height map without depressions (every point can drain to the border)
+	std::vector<unsigned char> flowDirection; // FlowDirection of every point
+	std::vector<float> flowAccumulation; // number of points draining through each point (including itself)
+};
+
+class Hydrology
+{
+public:
+	// Number of buckets used by the priority queue of the depression filling.
+	// The heights are quantised into buckets, so the filling can overshoot by (maxHeight - minHeight) / kNumBuckets at most
+	static const int kNumBuckets = 65536;
+
+	// Run the full analysis: depression filling, D8 flow directions and flow accumulation.
+	// If cancel is set while it runs it returns false as soon as it can, the maps are then incomplete
+	static bool Analyse(const HeightField& heightField, HydrologyMaps& maps, const std::atomic<bool>* cancel = nullptr);
+
+	// Priority-Flood depression filling (Barnes et al. 2014) using a monotone bucket queue.
+	// It floods the map from the borders inwards, raising every point to at least the height of the point that reached it.
+	// floodDirection returns, for every point, the direction to the point that flooded it, which is used to drain flat areas.
+	// cancel is checked between buckets
+	static void FillDepressions(const HeightField& heightField, std::vector<float>& filledHeight, std::vector<unsigned char>& floodDirection,
+		const std::atomic<bool>* cancel = nullptr);
+
+	// D8 flow directions over a depression-free height map. Each point drains to its steepest downslope neighbour,
+	// points without a lower neighbour (flats left by the filling) drain following the flood direction.
+	static void ComputeFlowDirections(XMINT2 resolution, const std::vector<float>& filledHeight, const std::vector<unsigned char>& floodDirection, std::vector<unsigned char>& flowDirection);
+
+	// Flow accumulation following the D8 directions in topological order (upstream points first)
+	static void ComputeFlowAccumulation(XMINT2 resolution, const std::vector<unsigned char>& flowDirection, std::vector<float>& flowAccumulation);
+
+	// Lower the height map along the river network (points with an accumulation over the threshold).
+	// The channel gets deeper as more water flows through it, up to maxDepth. Return the number of points carved.
+	// cancel is checked between rows, a cancelled carve leaves the rows after it untouched
+	static int CarveRivers(HeightField& heightField, const HydrologyMaps& maps, float accumulationThreshold, float maxDepth,
+		const std::atomic<bool>* cancel = nullptr);
+
+	// Offsets (m, n) of each FlowDirection
+	static const int kNeighbourOffsetM[8];
+	static const int kNeighbourOffsetN[8];
+	static const float kNeighbourDistance[8];
+};
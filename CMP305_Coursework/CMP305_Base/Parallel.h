@@ -0,0 +1,96 @@
+#pragma once
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#include "TaskScheduler.h"
+
+// Helper to split a loop across the threads of the TaskScheduler
+class Parallel
+{
+public:
+	// Blocks per thread, so the threads that finish first can steal the blocks of the slower ones
+	static const int kBlocksPerThread = 4;
+
+	// Number of threads used by the parallel loops
+	static int GetThreadCount()
+	{
+		return TaskScheduler::Get().GetThreadCount();
+	}
+
+	// Split [begin, end) into contiguous blocks of at least minBlockSize iterations and call body(blockBegin, blockEnd) on each of them.
+	// The calling thread works on the first block and on the ones not taken yet before returning
+	template<typename Function>
+	static void ForBlocks(int begin, int end, int minBlockSize, const Function& body)
+	{
+		const int count = end - begin;
+		if (count <= 0)
+		{
+			return;
+		}
+
+		const int blocks = (std::max)(1, (std::min)(GetThreadCount() * kBlocksPerThread, count / (std::max)(1, minBlockSize)));
+		if (blocks == 1)
+		{
+			body(begin, end);
+			return;
+		}
+
+		TaskScheduler& scheduler = TaskScheduler::Get();
+		std::vector<TaskHandle> tasks;
+		tasks.reserve(blocks - 1);
+		for (int b = 1; b < blocks; b++)
+		{
+			const int blockBegin = begin + (int)((long long)count * b / blocks);
+			const int blockEnd = begin + (int)((long long)count * (b + 1) / blocks);
+			tasks.push_back(scheduler.Submit([&body, blockBegin, blockEnd]() { body(blockBegin, blockEnd); }));
+		}
+		body(begin, begin + count / blocks);
+
+		for (const TaskHandle& task : tasks)
+		{
+			scheduler.Wait(task);
+		}
+	}
+
+	// Split the rectangle [mBegin, mEnd) x [nBegin, nEnd) into tiles of grain.x x grain.y iterations, aligned to multiples of the grain
+	// (so a grain of QuantisedHeightMap::kTileSize never puts two threads on a quantised tile),
+	// and call body(tileMBegin, tileMEnd, tileNBegin, tileNEnd) on each of them
+	template<typename Function>
+	static void ForTiles(int mBegin, int mEnd, int nBegin, int nEnd, int mGrain, int nGrain, const Function& body)
+	{
+		if (mEnd <= mBegin || nEnd <= nBegin)
+		{
+			return;
+		}
+
+		mGrain = (std::max)(1, mGrain);
+		nGrain = (std::max)(1, nGrain);
+		const int mFirst = mBegin / mGrain;
+		const int nFirst = nBegin / nGrain;
+		const int tilesN = (nEnd - 1) / nGrain - nFirst + 1;
+		const int tiles = ((mEnd - 1) / mGrain - mFirst + 1) * tilesN;
+		ForBlocks(0, tiles, 1, [&](int tileBegin, int tileEnd)
+		{
+			for (int tile = tileBegin; tile < tileEnd; tile++)
+			{
+				const int m = (mFirst + tile / tilesN) * mGrain;
+				const int n = (nFirst + tile % tilesN) * nGrain;
+				body((std::max)(m, mBegin), (std::min)(m + mGrain, mEnd), (std::max)(n, nBegin), (std::min)(n + nGrain, nEnd));
+			}
+		});
+	}
+
+	// Call body(i) for every i in [begin, end)
+	template<typename Function>
+	static void For(int begin, int end, const Function& body)
+	{
+		ForBlocks(begin, end, 1, [&body](int blockBegin, int blockEnd)
+		{
+			for (int i = blockBegin; i < blockEnd; i++)
+			{
+				body(i);
+			}
+		});
+	}
+};
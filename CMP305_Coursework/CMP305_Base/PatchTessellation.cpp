@@ -0,0 +1,333 @@
+#include "PatchTessellation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "Parallel.h"
+
+const int PatchTessellation::kBlockSize;
+const unsigned int PatchTessellation::kCulledPatch;
+const unsigned int PatchTessellation::kMixedBlock;
+
+
+PatchTessellation::PatchTessellation()
+	: resolution(0, 0), blockGrid(0, 0), factorsTexture(nullptr), factorsView(nullptr), updated(false)
+{
+}
+
+PatchTessellation::~PatchTessellation()
+{
+	Release();
+}
+
+void PatchTessellation::Resize(ID3D11Device* device, XMINT2 newResolution)
+{
+	Release();
+
+	resolution = newResolution;
+	blockGrid = XMINT2((resolution.x + kBlockSize - 1) / kBlockSize, (resolution.y + kBlockSize - 1) / kBlockSize);
+	factors.assign(resolution.x * resolution.y, 0);
+	blockValues.assign(blockGrid.x * blockGrid.y, kMixedBlock);
+	blockDirty.assign(blockGrid.x * blockGrid.y, 1);
+	blockUpload.assign(blockGrid.x * blockGrid.y, 0);
+	updated = false;
+
+	// One texel per quad: the columns (n) are the width and the rows (m) the height
+	D3D11_TEXTURE2D_DESC textureDesc;
+	textureDesc.Width = resolution.y;
+	textureDesc.Height = resolution.x;
+	textureDesc.MipLevels = 1;
+	textureDesc.ArraySize = 1;
+	textureDesc.Format = DXGI_FORMAT_R32_UINT;
+	textureDesc.SampleDesc.Count = 1;
+	textureDesc.SampleDesc.Quality = 0;
+	textureDesc.Usage = D3D11_USAGE_DEFAULT;
+	textureDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	textureDesc.CPUAccessFlags = 0;
+	textureDesc.MiscFlags = 0;
+	if (device)
+	{
+		device->CreateTexture2D(&textureDesc, NULL, &factorsTexture);
+	}
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc;
+	viewDesc.Format = textureDesc.Format;
+	viewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+	viewDesc.Texture2D.MostDetailedMip = 0;
+	viewDesc.Texture2D.MipLevels = 1;
+	if (factorsTexture)
+	{
+		device->CreateShaderResourceView(factorsTexture, &viewDesc, &factorsView);
+	}
+}
+
+void PatchTessellation::MarkAllDirty()
+{
+	std::fill(blockDirty.begin(), blockDirty.end(), (unsigned char)1);
+}
+
+void PatchTessellation::MarkDirty(const HeightFieldRect& rect)
+{
+	if (rect.IsEmpty() || blockDirty.empty())
+	{
+		return;
+	}
+
+	// The quad q reads the points q and q + 1, and its edges the centres of the quads q - 1 and q + 1,
+	// so a point p changes the factors of the quads [p - 2, p + 1]
+	const int bmMin = (std::max)(rect.mMin - 2, 0) / kBlockSize;
+	const int bmMax = (std::min)((std::max)(rect.mMax + 1, 0) / kBlockSize, blockGrid.x - 1);
+	const int bnMin = (std::max)(rect.nMin - 2, 0) / kBlockSize;
+	const int bnMax = (std::min)((std::max)(rect.nMax + 1, 0) / kBlockSize, blockGrid.y - 1);
+
+	for (int bm = bmMin; bm <= bmMax; bm++)
+	{
+		for (int bn = bnMin; bn <= bnMax; bn++)
+		{
+			blockDirty[bn + bm * blockGrid.y] = 1;
+		}
+	}
+}
+
+int PatchTessellation::Update(ID3D11DeviceContext* deviceContext, const HeightField& heightField, const XMFLOAT3& eye, const TessellationSettings& settings)
+{
+	if (factors.empty())
+	{
+		return 0;
+	}
+
+	const bool settingsChanged = !updated || memcmp(&settings, &lastSettings, sizeof(TessellationSettings)) != 0;
+	const bool eyeMoved = !updated || eye.x != lastEye.x || eye.y != lastEye.y || eye.z != lastEye.z;
+	if (settingsChanged)
+	{
+		MarkAllDirty();
+	}
+	if (!eyeMoved && std::find(blockDirty.begin(), blockDirty.end(), (unsigned char)1) == blockDirty.end())
+	{
+		return 0;
+	}
+	updated = true;
+	lastEye = eye;
+	lastSettings = settings;
+
+	// Every patch further than dMin and dMax gets the same factor (the minimum level of detail unless dMax < dMin),
+	// whatever its height. A block whose quads and neighbours are all that far away is filled with a single value
+	const float farDistance = (std::max)(settings.dMin, settings.dMax);
+	const float farFactor = CalculateTessFactor(farDistance, settings);
+	const float farEdges[kEdgeCount] = { farFactor, farFactor, farFactor, farFactor };
+	const unsigned int farValue = PackFactors(farFactor, farEdges);
+
+	Parallel::ForBlocks(0, blockGrid.x, 1, [&](int blockBegin, int blockEnd)
+	{
+		for (int bm = blockBegin; bm < blockEnd; bm++)
+		{
+			// the centres read by the block are inside its quads and the ring of neighbours
+			const float zMin = (float)(bm * kBlockSize - 1);
+			const float zMax = (float)((std::min)((bm + 1) * kBlockSize, resolution.x) + 1);
+			const float dz = (std::max)((std::max)(zMin - eye.z, eye.z - zMax), 0.0f);
+
+			for (int bn = 0; bn < blockGrid.y; bn++)
+			{
+				const int block = bn + bm * blockGrid.y;
+				const float xMin = (float)(bn * kBlockSize - 1);
+				const float xMax = (float)((std::min)((bn + 1) * kBlockSize, resolution.y) + 1);
+				const float dx = (std::max)((std::max)(xMin - eye.x, eye.x - xMax), 0.0f);
+
+				if (dx * dx + dz * dz >= farDistance * farDistance)
+				{
+					if (blockValues[block] != farValue)
+					{
+						FillBlock(bm, bn, farValue);
+						blockUpload[block] = 1;
+					}
+				}
+				else if (eyeMoved || blockDirty[block])
+				{
+					ComputeBlock(heightField, bm, bn, eye, settings);
+					blockUpload[block] = 1;
+				}
+				blockDirty[block] = 0;
+			}
+		}
+	});
+
+	const int uploaded = (int)std::count(blockUpload.begin(), blockUpload.end(), (unsigned char)1);
+	Upload(deviceContext);
+	return uploaded;
+}
+
+float PatchTessellation::CalculateTessFactor(float d, const TessellationSettings& settings)
+{
+	// lerp from lodMin to lodMax with t in [0, 1]. saturate() turns a NaN (dMin == dMax) into 0
+	float t = (settings.dMax - d) / (settings.dMax - settings.dMin);
+	t = t > 0.0f ? (t < 1.0f ? t : 1.0f) : 0.0f;
+	return settings.lodMin + (t * (settings.lodMax - settings.lodMin));
+}
+
+void PatchTessellation::ComputePatchFactors(const HeightField& heightField, int m, int n, const XMFLOAT3& eye, const TessellationSettings& settings,
+	float& inside, float edges[kEdgeCount])
+{
+	const float tessFactorCenter = CalculateTessFactor(GetPatchDistance(heightField, m, n, eye), settings);
+
+	inside = tessFactorCenter;
+	edges[kEdgeLeft] = (std::min)(tessFactorCenter, CalculateTessFactor(GetPatchDistance(heightField, m, n - 1, eye), settings));
+	edges[kEdgeTop] = (std::min)(tessFactorCenter, CalculateTessFactor(GetPatchDistance(heightField, m + 1, n, eye), settings));
+	edges[kEdgeRight] = (std::min)(tessFactorCenter, CalculateTessFactor(GetPatchDistance(heightField, m, n + 1, eye), settings));
+	edges[kEdgeBottom] = (std::min)(tessFactorCenter, CalculateTessFactor(GetPatchDistance(heightField, m - 1, n, eye), settings));
+}
+
+unsigned int PatchTessellation::PackFactors(float inside, const float edges[kEdgeCount])
+{
+	// integer partitioning rounds the factors up, 6 bits store 1 to 64 as 0 to 63
+	auto pack = [](float factor) { return (unsigned int)(std::min)((std::max)(ceilf(factor), 1.0f), 64.0f) - 1; };
+
+	unsigned int packed = pack(inside);
+	for (int edge = 0; edge < kEdgeCount; edge++)
+	{
+		// a patch with an edge factor of 0 (or NaN) is not drawn
+		if (!(edges[edge] > 0.0f))
+		{
+			return kCulledPatch;
+		}
+		packed |= pack(edges[edge]) << (6 * (edge + 1));
+	}
+	return packed;
+}
+
+void PatchTessellation::UnpackFactors(unsigned int packed, float& inside, float edges[kEdgeCount])
+{
+	if (packed == kCulledPatch)
+	{
+		inside = 0.0f;
+		for (int edge = 0; edge < kEdgeCount; edge++)
+		{
+			edges[edge] = 0.0f;
+		}
+		return;
+	}
+
+	inside = (float)(packed & 63) + 1.0f;
+	for (int edge = 0; edge < kEdgeCount; edge++)
+	{
+		edges[edge] = (float)((packed >> (6 * (edge + 1))) & 63) + 1.0f;
+	}
+}
+
+float PatchTessellation::GetPatchDistance(const HeightField& heightField, int m, int n, const XMFLOAT3& eye)
+{
+	const XMINT2 size = heightField.GetResolution();
+	const int m0 = (std::min)((std::max)(m, 0), size.x);
+	const int m1 = (std::min)((std::max)(m + 1, 0), size.x);
+	const int n0 = (std::min)((std::max)(n, 0), size.y);
+	const int n1 = (std::min)((std::max)(n + 1, 0), size.y);
+
+	// centre of the control points 0 to 3 in the same order as the hull shader: (m + 1, n), (m, n), (m, n + 1), (m + 1, n + 1)
+	const float x = 0.25f * (float)(n0 + n0 + n1 + n1);
+	const float y = 0.25f * (heightField.Get(m1, n0) + heightField.Get(m0, n0) + heightField.Get(m0, n1) + heightField.Get(m1, n1));
+	const float z = 0.25f * (float)(m1 + m0 + m0 + m1);
+
+	const float dx = x - eye.x;
+	const float dy = y - eye.y;
+	const float dz = z - eye.z;
+	return sqrtf(dx * dx + dy * dy + dz * dz);
+}
+
+void PatchTessellation::ComputeBlock(const HeightField& heightField, int bm, int bn, const XMFLOAT3& eye, const TessellationSettings& settings)
+{
+	const int mBegin = bm * kBlockSize, mEnd = (std::min)(mBegin + kBlockSize, resolution.x);
+	const int nBegin = bn * kBlockSize, nEnd = (std::min)(nBegin + kBlockSize, resolution.y);
+
+	// factor of the centre of every quad of the block and of the ring of neighbours around it
+	float centres[kBlockSize + 2][kBlockSize + 2];
+	for (int m = mBegin - 1; m <= mEnd; m++)
+	{
+		for (int n = nBegin - 1; n <= nEnd; n++)
+		{
+			centres[m - mBegin + 1][n - nBegin + 1] = CalculateTessFactor(GetPatchDistance(heightField, m, n, eye), settings);
+		}
+	}
+
+	unsigned int blockValue = kMixedBlock;
+	for (int m = mBegin; m < mEnd; m++)
+	{
+		const int i = m - mBegin + 1;
+		for (int n = nBegin; n < nEnd; n++)
+		{
+			const int j = n - nBegin + 1;
+			const float centre = centres[i][j];
+			float edges[kEdgeCount];
+			edges[kEdgeLeft] = (std::min)(centre, centres[i][j - 1]);
+			edges[kEdgeTop] = (std::min)(centre, centres[i + 1][j]);
+			edges[kEdgeRight] = (std::min)(centre, centres[i][j + 1]);
+			edges[kEdgeBottom] = (std::min)(centre, centres[i - 1][j]);
+
+			const unsigned int packed = PackFactors(centre, edges);
+			factors[n + m * resolution.y] = packed;
+			blockValue = (m == mBegin && n == nBegin) ? packed : (blockValue == packed ? packed : kMixedBlock);
+		}
+	}
+	blockValues[bn + bm * blockGrid.y] = blockValue;
+}
+
+void PatchTessellation::FillBlock(int bm, int bn, unsigned int packed)
+{
+	const int mBegin = bm * kBlockSize, mEnd = (std::min)(mBegin + kBlockSize, resolution.x);
+	const int nBegin = bn * kBlockSize, nEnd = (std::min)(nBegin + kBlockSize, resolution.y);
+
+	for (int m = mBegin; m < mEnd; m++)
+	{
+		std::fill(factors.begin() + nBegin + m * resolution.y, factors.begin() + nEnd + m * resolution.y, packed);
+	}
+	blockValues[bn + bm * blockGrid.y] = packed;
+}
+
+void PatchTessellation::Upload(ID3D11DeviceContext* deviceContext)
+{
+	for (int bm = 0; bm < blockGrid.x; bm++)
+	{
+		int bn = 0;
+		while (bn < blockGrid.y)
+		{
+			if (!blockUpload[bn + bm * blockGrid.y])
+			{
+				bn++;
+				continue;
+			}
+
+			// run of consecutive blocks to upload in this row of blocks
+			const int runBegin = bn;
+			while (bn < blockGrid.y && blockUpload[bn + bm * blockGrid.y])
+			{
+				blockUpload[bn + bm * blockGrid.y] = 0;
+				bn++;
+			}
+
+			D3D11_BOX box;
+			box.left = runBegin * kBlockSize;
+			box.right = (std::min)(bn * kBlockSize, resolution.y);
+			box.top = bm * kBlockSize;
+			box.bottom = (std::min)((bm + 1) * kBlockSize, resolution.x);
+			box.front = 0;
+			box.back = 1;
+			if (factorsTexture)
+			{
+				deviceContext->UpdateSubresource(factorsTexture, 0, &box, &factors[box.left + box.top * resolution.y], resolution.y * sizeof(unsigned int), 0);
+			}
+		}
+	}
+}
+
+void PatchTessellation::Release()
+{
+	if (factorsView)
+	{
+		factorsView->Release();
+		factorsView = nullptr;
+	}
+	if (factorsTexture)
+	{
+		factorsTexture->Release();
+		factorsTexture = nullptr;
+	}
+}
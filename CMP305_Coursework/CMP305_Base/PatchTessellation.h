@@ -0,0 +1,88 @@
+#pragma once
+#include <d3d11.h>
+#include <vector>
+
+#include "HeightField.h"
+
+// Parameters of the distance based tessellation, the same as the TessellationFactorBuffer of the hull shaders
+struct TessellationSettings
+{
+	float dMin, dMax; // the patches closer than dMin get lodMax and the ones further than dMax get lodMin
+	float lodMin, lodMax;
+};
+
+// Tessellation factors of every patch of the terrain computed on the CPU, so the patches only need their 4 corners
+// as control points (the hull shader needed 12 to find the distance of the neighbour patches).
+// The factors of the quad (m, n) are packed in the texel (n, m) of a 32 bit texture: 6 bits for the inside factor and
+// each edge factor, rounded up as the integer partitioning does. Every edge takes the minimum of the factors of the two
+// patches that share it, so both sides are tessellated the same and there are no cracks.
+// Only the blocks of kBlockSize^2 quads whose factors can have changed are recomputed and uploaded
+class PatchTessellation
+{
+public:
+	static const int kBlockSize = 8;
+	static const unsigned int kCulledPatch = 0xFFFFFFFF; // an edge factor is 0, the hull shader discards the patch
+
+	// Edges of a quad, in the order of SV_TessFactor, by the neighbour quad they share: (m, n - 1), (m + 1, n), (m, n + 1), (m - 1, n)
+	enum Edge
+	{
+		kEdgeLeft = 0,
+		kEdgeTop,
+		kEdgeRight,
+		kEdgeBottom,
+		kEdgeCount
+	};
+
+	PatchTessellation();
+	~PatchTessellation();
+
+	// Create the texture of the factors for a height map of the given resolution.
+	// Without a device the factors are only kept on the CPU (the headless tests)
+	void Resize(ID3D11Device* device, XMINT2 resolution);
+
+	// Flag the factors that read the heights of rect (or everything) to be recomputed in the next Update()
+	void MarkAllDirty();
+	void MarkDirty(const HeightFieldRect& rect);
+
+	// Recompute the factors for the eye (in the space of the height map: x = n, y = height, z = m) and upload the
+	// blocks that have changed. Return the number of blocks uploaded
+	int Update(ID3D11DeviceContext* deviceContext, const HeightField& heightField, const XMFLOAT3& eye, const TessellationSettings& settings);
+
+	ID3D11ShaderResourceView* GetShaderResourceView() const { return factorsView; }
+	unsigned int GetPackedFactors(int m, int n) const { return factors[n + m * resolution.y]; }
+
+	// C++ port of CalculateTessFactor() of tessellation_hs.hlsl
+	static float CalculateTessFactor(float d, const TessellationSettings& settings);
+	// Factors of the quad (m, n) as PatchConstantFunction() of tessellation_hs.hlsl computes them from the 12 control points
+	static void ComputePatchFactors(const HeightField& heightField, int m, int n, const XMFLOAT3& eye, const TessellationSettings& settings,
+		float& inside, float edges[kEdgeCount]);
+
+	static unsigned int PackFactors(float inside, const float edges[kEdgeCount]);
+	static void UnpackFactors(unsigned int packed, float& inside, float edges[kEdgeCount]);
+
+private:
+	// Distance from the eye to the centre of the quad (m, n), with the points clamped to the height map as the apron of the tiles does
+	static float GetPatchDistance(const HeightField& heightField, int m, int n, const XMFLOAT3& eye);
+	void ComputeBlock(const HeightField& heightField, int bm, int bn, const XMFLOAT3& eye, const TessellationSettings& settings);
+	void FillBlock(int bm, int bn, unsigned int packed);
+	// Copy the flagged blocks to the texture, merging the consecutive ones of each row of blocks
+	void Upload(ID3D11DeviceContext* deviceContext);
+	void Release();
+
+	static const unsigned int kMixedBlock = 0xFFFFFFFE; // not a valid packed value either
+
+	XMINT2 resolution;
+	XMINT2 blockGrid;
+	std::vector<unsigned int> factors; // packed factors of the quad (m, n) at n + m * resolution.y
+	std::vector<unsigned int> blockValues; // the packed factors of all the quads of the block if they are the same, kMixedBlock if not
+	std::vector<unsigned char> blockDirty; // the heights read by the block have changed
+	std::vector<unsigned char> blockUpload; // the factors of the block have changed since the last upload
+
+	ID3D11Texture2D* factorsTexture;
+	ID3D11ShaderResourceView* factorsView;
+
+	// eye and settings of the last update, nothing changes if they are the same and no height is dirty
+	bool updated;
+	XMFLOAT3 lastEye;
+	TessellationSettings lastSettings;
+};
@@ -0,0 +1,283 @@
+#include "ProgressiveGenerator.h"
+
+#include <chrono>
+#include <cmath>
+
+#include "HeightResampler.h"
+#include "Hydrology.h"
+#include "Stencil.h"
+
+static float GetMilliseconds(std::chrono::high_resolution_clock::time_point start)
+{
+	return std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+
+ProgressiveGenerator::ProgressiveGenerator()
+	: cancelRefinement(false), refining(false), refinedSize(0), refinedVersion(-1), version(0),
+	previewMilliseconds(0.0f), refinementMilliseconds(0.0f), reusedLevels(0)
+{
+	previewLevels.size = 0;
+	fullLevels.size = 0;
+}
+
+ProgressiveGenerator::~ProgressiveGenerator()
+{
+	Cancel();
+	Join();
+}
+
+void ProgressiveGenerator::BuildPreview(const GenerationSettings& newSettings, HeightField& destination)
+{
+	Cancel();
+	const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	settings = newSettings;
+
+	// the diamond-square of the preview is reused while the seed, range and size stay the same
+	const int fullSize = GetPipelineSize(destination.GetResolution());
+	const int size = (std::max)(fullSize / (std::max)(settings.previewDivisor, 1), 2);
+	if (previewLevels.size != size || previewLevels.fullSize != fullSize || previewLevels.seed != settings.seed ||
+		previewLevels.rangeMin != settings.heightRange.min || previewLevels.rangeMax != settings.heightRange.max)
+	{
+		previewLevels.seed = settings.seed;
+		previewLevels.rangeMin = settings.heightRange.min;
+		previewLevels.rangeMax = settings.heightRange.max;
+		previewLevels.fullSize = fullSize;
+		previewLevels.size = size;
+		previewLevels.heights.assign(HeightField::GetStorageSize(XMINT2(size, size)), 0.0f);
+		DiamondSquare(previewLevels, size, nullptr);
+	}
+
+	std::vector<float> preview(previewLevels.heights);
+	HeightField previewField(preview.data(), XMINT2(size, size));
+	const float scale = (float)fullSize / (float)size;
+	Finish(settings, previewField, scale * scale, nullptr);
+	HeightResampler::Resample(previewField, destination, kResampleBilinear);
+
+	previewMilliseconds = GetMilliseconds(start);
+}
+
+void ProgressiveGenerator::StartRefinement()
+{
+	if (previewLevels.size == 0)
+	{
+		return;
+	}
+
+	// the task of a cancelled refinement may still be finishing, it returns at its next check of cancelRefinement
+	Join();
+	cancelRefinement = false;
+	refining = true;
+	version++;
+	const GenerationSettings refinementSettings = settings;
+	const DiamondSquareLevels preview = previewLevels;
+	const int refinementVersion = version;
+	refinementTask = TaskScheduler::Get().SubmitBackground([this, refinementSettings, preview, refinementVersion]()
+	{
+		RefinementLoop(refinementSettings, preview, refinementVersion);
+	});
+}
+
+void ProgressiveGenerator::Cancel()
+{
+	// a new version makes the result of the running refinement unusable even if it finishes
+	cancelRefinement = true;
+	refining = false;
+	version++;
+}
+
+bool ProgressiveGenerator::TakeRefinement(HeightField& destination)
+{
+	std::lock_guard<std::mutex> lock(resultMutex);
+	if (refinedVersion != version)
+	{
+		return false;
+	}
+
+	HeightField refinedField(refined.data(), XMINT2(refinedSize, refinedSize));
+	HeightResampler::Resample(refinedField, destination, kResampleBicubic);
+	refinedVersion = -1;
+	std::vector<float>().swap(refined);
+	return true;
+}
+
+bool ProgressiveGenerator::HasRefinement()
+{
+	std::lock_guard<std::mutex> lock(resultMutex);
+	return refinedVersion == version;
+}
+
+int ProgressiveGenerator::GetPipelineSize(XMINT2 resolution)
+{
+	int size = 2;
+	while (size < (std::max)(resolution.x, resolution.y))
+	{
+		size *= 2;
+	}
+	return size;
+}
+
+void ProgressiveGenerator::BuildDiamondSquare(int seed, Range heightRange, HeightField& destination)
+{
+	DiamondSquareLevels levels;
+	levels.seed = seed;
+	levels.rangeMin = heightRange.min;
+	levels.rangeMax = heightRange.max;
+	levels.fullSize = GetPipelineSize(destination.GetResolution());
+	levels.size = levels.fullSize;
+	levels.heights.assign(HeightField::GetStorageSize(XMINT2(levels.size, levels.size)), 0.0f);
+	DiamondSquare(levels, levels.size, nullptr);
+
+	HeightField field(levels.heights.data(), XMINT2(levels.size, levels.size));
+	HeightResampler::Resample(field, destination, kResampleBicubic);
+}
+
+bool ProgressiveGenerator::DiamondSquare(DiamondSquareLevels& levels, int firstChunk, const std::atomic<bool>* cancel)
+{
+	const int size = levels.size;
+	const int scale = levels.fullSize / size; // points of the full map between two of this map
+	HeightField field(levels.heights.data(), XMINT2(size, size));
+
+	// Asign a random height to each corner
+	if (firstChunk == size)
+	{
+		field.Set(0, 0, GetOffset(levels, 0, 0, 1.0f));
+		field.Set(0, size, GetOffset(levels, 0, size * scale, 1.0f));
+		field.Set(size, 0, GetOffset(levels, size * scale, 0, 1.0f));
+		field.Set(size, size, GetOffset(levels, size * scale, size * scale, 1.0f));
+	}
+
+	for (int chunk = firstChunk; chunk > 1; chunk /= 2)
+	{
+		if (cancel && *cancel)
+		{
+			return false;
+		}
+
+		// the height offset is halved on every level, from the whole range on the chunk of the full map
+		const int half = chunk / 2;
+		const float amplitude = (float)(chunk * scale) / (float)levels.fullSize;
+
+		// Square step: centre of every square from its four corners
+		for (int m = 0; m < size; m += chunk)
+		{
+			for (int n = 0; n < size; n += chunk)
+			{
+				const float cornersAvg = (field.Get(m, n) + field.Get(m, n + chunk) + field.Get(m + chunk, n) + field.Get(m + chunk, n + chunk)) / 4.0f;
+				field.Set(m + half, n + half, cornersAvg + GetOffset(levels, (m + half) * scale, (n + half) * scale, amplitude));
+			}
+		}
+
+		// Diamond step: the middle of every edge from the four points around it, mirrored at the border of the map
+		for (int m = 0; m <= size; m += half)
+		{
+			for (int n = (m + half) % chunk; n <= size; n += chunk)
+			{
+				const float cornersSum = field.Get(StencilMirror::Resolve(m - half, size + 1), n) + field.Get(m, StencilMirror::Resolve(n - half, size + 1)) +
+					field.Get(m, StencilMirror::Resolve(n + half, size + 1)) + field.Get(StencilMirror::Resolve(m + half, size + 1), n);
+				field.Set(m, n, cornersSum / 4.0f + GetOffset(levels, m * scale, n * scale, amplitude));
+			}
+		}
+	}
+	return true;
+}
+
+float ProgressiveGenerator::GetOffset(const DiamondSquareLevels& levels, int m, int n, float amplitude)
+{
+	// a hash of the point of the full map, the same point gets the same offset at any preview size
+	const float random = Utils::GetPointRandom((unsigned int)levels.seed, m, n); // [0, 1)
+	return (levels.rangeMin + random * (levels.rangeMax - levels.rangeMin)) * amplitude;
+}
+
+bool ProgressiveGenerator::Finish(const GenerationSettings& settings, HeightField& field, float areaScale, const std::atomic<bool>* cancel)
+{
+	// a point of a smaller map drains the area of areaScale points of the full one
+	if (settings.carveRivers)
+	{
+		HydrologyMaps hydrologyMaps;
+		if (!Hydrology::Analyse(field, hydrologyMaps, cancel))
+		{
+			return false;
+		}
+		Hydrology::CarveRivers(field, hydrologyMaps, settings.riverThreshold / areaScale, settings.riverDepth, cancel);
+	}
+
+	for (int pass = 0; pass < settings.smoothPasses; pass++)
+	{
+		if (cancel && *cancel)
+		{
+			return false;
+		}
+		Stencil::Apply<StencilBoxKernel, StencilClamp>(field, field);
+	}
+	return !(cancel && *cancel);
+}
+
+void ProgressiveGenerator::RefinementLoop(GenerationSettings refinementSettings, DiamondSquareLevels preview, int refinementVersion)
+{
+	const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	const int fullSize = preview.fullSize;
+
+	// fullLevels is only used by this task, and there is one at a time
+	int reused = 0;
+	if (fullLevels.size == fullSize && fullLevels.fullSize == fullSize && fullLevels.seed == preview.seed &&
+		fullLevels.rangeMin == preview.rangeMin && fullLevels.rangeMax == preview.rangeMax)
+	{
+		// the same diamond-square as the last refinement: every level is reused
+		for (int chunk = fullSize; chunk > 1; chunk /= 2)
+		{
+			reused++;
+		}
+	}
+	else
+	{
+		// the preview points are the points of the full map at a multiple of scale, only the finer levels are left
+		const int scale = fullSize / preview.size;
+		fullLevels = preview;
+		fullLevels.size = fullSize;
+		fullLevels.heights.assign(HeightField::GetStorageSize(XMINT2(fullSize, fullSize)), 0.0f);
+		HeightField previewField(preview.heights.data(), XMINT2(preview.size, preview.size));
+		HeightField fullField(fullLevels.heights.data(), XMINT2(fullSize, fullSize));
+		for (int m = 0; m <= preview.size; m++)
+		{
+			for (int n = 0; n <= preview.size; n++)
+			{
+				fullField.Set(m * scale, n * scale, previewField.Get(m, n));
+			}
+		}
+		for (int chunk = preview.size; chunk > 1; chunk /= 2)
+		{
+			reused++;
+		}
+
+		if (!DiamondSquare(fullLevels, scale, &cancelRefinement))
+		{
+			fullLevels.size = 0; // unfinished
+			return;
+		}
+	}
+
+	std::vector<float> result(fullLevels.heights);
+	HeightField resultField(result.data(), XMINT2(fullSize, fullSize));
+	if (!Finish(refinementSettings, resultField, 1.0f, &cancelRefinement))
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(resultMutex);
+	refined.swap(result);
+	refinedSize = fullSize;
+	refinedVersion = refinementVersion;
+	refinementMilliseconds = GetMilliseconds(start);
+	reusedLevels = reused;
+	refining = false;
+}
+
+void ProgressiveGenerator::Join()
+{
+	if (refinementTask)
+	{
+		TaskScheduler::Get().Wait(refinementTask);
+		refinementTask.reset();
+	}
+}
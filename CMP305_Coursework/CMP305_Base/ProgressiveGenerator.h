@@ -0,0 +1,112 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "HeightField.h"
+#include "TaskScheduler.h"
+#include "Utils.h"
+
+// Parameters of the generation pipeline: diamond-square, rivers carved by the hydrology and smoothing
+struct GenerationSettings
+{
+	GenerationSettings()
+	{
+		// initialise values
+		seed = 1;
+		heightRange.min = -30.0f;
+		heightRange.max = 40.0f;
+		carveRivers = true;
+		riverThreshold = 2000.0f;
+		riverDepth = 2.0f;
+		smoothPasses = 2;
+		previewDivisor = 4;
+	}
+
+	int seed;
+	Range heightRange; // random offset of the corners, halved on every level of the diamond-square
+	bool carveRivers;
+	float riverThreshold; // flow accumulation of a river at full resolution, the preview scales it to its area
+	float riverDepth;
+	int smoothPasses;
+	int previewDivisor; // the preview has this many times fewer points per side (4 or 8)
+};
+
+// Generation in two steps: the pipeline runs first on a map previewDivisor times smaller, which is shown at once,
+// and then at full resolution in a background task, whose result is swapped in when it is ready.
+// The pipeline works on a square map of a power of two quads (at least the resolution of the terrain), resampled to the terrain.
+// The diamond-square is hierarchical: the random offset of a point depends only on the seed and on its position in the full map,
+// so the preview is exactly the first levels of the full map. The refinement starts from the preview levels and only adds the
+// finer ones, and a run with the same seed, range and size reuses all the levels of the previous one
+class ProgressiveGenerator
+{
+public:
+	ProgressiveGenerator();
+	~ProgressiveGenerator(); // cancels the refinement in progress
+
+	// Run the pipeline at the preview size and resample it to destination, on the calling thread.
+	// It cancels the refinement in progress
+	void BuildPreview(const GenerationSettings& settings, HeightField& destination);
+	// Start the full resolution pipeline of the last preview in the background
+	void StartRefinement();
+	// Drop the refinement in progress, its result is never taken. It does not wait for the task
+	void Cancel();
+
+	// If the refinement has finished resample its result to destination and return true (only once per refinement)
+	bool TakeRefinement(HeightField& destination);
+	// The refinement has finished and TakeRefinement() would take it
+	bool HasRefinement();
+	bool IsRefining() const { return refining; }
+
+	float GetPreviewMilliseconds() const { return previewMilliseconds; }
+	float GetRefinementMilliseconds() const { return refinementMilliseconds; }
+	// Levels of the diamond-square of the last refinement that were not computed again
+	int GetReusedLevels() const { return reusedLevels; }
+
+	// Quads per side of the square map of the pipeline for a terrain resolution: the next power of two
+	static int GetPipelineSize(XMINT2 resolution);
+	// The diamond-square of the pipeline alone (the same heights for the same seed and range), resampled to destination
+	static void BuildDiamondSquare(int seed, Range heightRange, HeightField& destination);
+
+private:
+	// Raw diamond-square (before the rest of the pipeline) of a square map, to be reused
+	struct DiamondSquareLevels
+	{
+		int seed;
+		float rangeMin, rangeMax;
+		int fullSize; // quads per side of the full map it belongs to
+		int size; // quads per side of this map
+		std::vector<float> heights; // a HeightField of size quads per side
+	};
+
+	// Diamond-square of levels.heights from the chunks of firstChunk quads down to 1 (levels.size at the start).
+	// The heights at a multiple of firstChunk must be set already, except for the corners at the start.
+	// Return false if cancelled
+	static bool DiamondSquare(DiamondSquareLevels& levels, int firstChunk, const std::atomic<bool>* cancel);
+	// Random offset of the point (m, n) of the full map
+	static float GetOffset(const DiamondSquareLevels& levels, int m, int n, float amplitude);
+	// Rivers and smoothing of the diamond-square, areaScale is the area of a point of the map in points of the full map.
+	// cancel is checked between the passes and inside the hydrology, return false if cancelled
+	static bool Finish(const GenerationSettings& settings, HeightField& field, float areaScale, const std::atomic<bool>* cancel);
+
+	void RefinementLoop(GenerationSettings refinementSettings, DiamondSquareLevels preview, int version);
+	void Join();
+
+	GenerationSettings settings; // of the last preview
+	DiamondSquareLevels previewLevels;
+	DiamondSquareLevels fullLevels; // of the last finished refinement
+
+	// Shared with the refinement task
+	TaskHandle refinementTask;
+	std::atomic<bool> cancelRefinement;
+	std::atomic<bool> refining;
+	std::mutex resultMutex;
+	std::vector<float> refined; // result of the full pipeline, a HeightField of refinedSize quads per side
+	int refinedSize;
+	int refinedVersion; // version of the refinement that produced refined, -1 when taken
+	int version; // of the last refinement started
+
+	float previewMilliseconds;
+	std::atomic<float> refinementMilliseconds; // written by the refinement task
+	std::atomic<int> reusedLevels;
+};
@@ -0,0 +1,347 @@
+#include "QuantisedHeightMap.h"
+
+#include <DirectXPackedVector.h>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+using namespace DirectX::PackedVector;
+
+const int QuantisedHeightMap::kTileShift;
+const int QuantisedHeightMap::kTileSize;
+const int QuantisedHeightMap::kTilePoints;
+
+static const float kMaxCode = 65535.0f;
+static const float kMinError = 1e-6f; // a zero error would need a zero step
+
+// Range given to a tile holding heights over range: headroom so the heights that drift slowly out of it
+// do not refit the tile on every write, but never wider than the precision check allows
+static float GetPaddedRange(float range, float widest)
+{
+	return (std::min)((std::max)(range * 1.5f, widest / 64.0f), widest);
+}
+
+
+QuantisedHeightMap::QuantisedHeightMap()
+	: resolution(0, 0), tileColumns(0), maxError(0.001f)
+{
+}
+
+void QuantisedHeightMap::Resize(XMINT2 newResolution, float newMaxError)
+{
+	resolution = newResolution;
+	maxError = (std::max)(newMaxError, kMinError);
+	tileColumns = (resolution.y + kTileSize) / kTileSize;
+	const int tileRows = (resolution.x + kTileSize) / kTileSize;
+
+	tiles.assign(tileRows * tileColumns, Tile());
+	codes.assign(tiles.size() * kTilePoints, 0);
+	for (int tile = 0; tile < (int)tiles.size(); tile++)
+	{
+		tiles[tile].offset = 0.0f;
+		tiles[tile].step = 0.0f;
+		Fit(tile, 0.0f, 0.0f);
+	}
+}
+
+void QuantisedHeightMap::SetMaxError(float newMaxError)
+{
+	maxError = (std::max)(newMaxError, kMinError);
+
+	// only the tiles that fail the new check, or can be quantised now, change
+	const float widest = GetWidestRange();
+	for (int tile = 0; tile < (int)tiles.size(); tile++)
+	{
+		float low, high;
+		GetTileRange(tile, low, high);
+		const bool fits = high - low <= widest;
+		if (tiles[tile].exact.empty() ? tiles[tile].step > GetCoarsestStep() : fits)
+		{
+			Fit(tile, low, high);
+		}
+	}
+}
+
+void QuantisedHeightMap::Set(int m, int n, float height)
+{
+	const int tile = (n >> kTileShift) + (m >> kTileShift) * tileColumns;
+	const int local = (n & (kTileSize - 1)) + ((m & (kTileSize - 1)) << kTileShift);
+	Tile& heights = tiles[tile];
+
+	if (heights.exact.empty() && !(height >= heights.offset && height <= heights.offset + heights.step * kMaxCode))
+	{
+		float low, high;
+		GetTileRange(tile, low, high);
+		Fit(tile, (std::min)(low, height), (std::max)(high, height));
+	}
+
+	if (!heights.exact.empty())
+	{
+		heights.exact[local] = height;
+		return;
+	}
+	const float code = heights.step > 0.0f ? (height - heights.offset) / heights.step + 0.5f : 0.0f;
+	codes[tile * kTilePoints + local] = (uint16_t)(std::min)((std::max)(code, 0.0f), kMaxCode);
+}
+
+void QuantisedHeightMap::ReadRow(int m, int nMin, int count, float* dst) const
+{
+	const int rowOffset = (m & (kTileSize - 1)) << kTileShift;
+	const int nEnd = nMin + count;
+	for (int n = nMin; n < nEnd;)
+	{
+		// the part of the row inside a tile
+		const int tile = (n >> kTileShift) + (m >> kTileShift) * tileColumns;
+		const int localN = n & (kTileSize - 1);
+		const int segment = (std::min)(kTileSize - localN, nEnd - n);
+		const Tile& heights = tiles[tile];
+		float* segmentDst = &dst[n - nMin];
+		n += segment;
+
+		if (!heights.exact.empty())
+		{
+			memcpy(segmentDst, &heights.exact[rowOffset + localN], sizeof(float) * segment);
+			continue;
+		}
+
+		const uint16_t* segmentCodes = &codes[tile * kTilePoints + rowOffset + localN];
+		const XMVECTOR offset = XMVectorReplicate(heights.offset);
+		const XMVECTOR step = XMVectorReplicate(heights.step);
+		int i = 0;
+		for (; i + 4 <= segment; i += 4)
+		{
+			const XMVECTOR code = XMLoadUShort4(reinterpret_cast<const XMUSHORT4*>(&segmentCodes[i]));
+			XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(&segmentDst[i]), XMVectorMultiplyAdd(code, step, offset));
+		}
+		for (; i < segment; i++)
+		{
+			segmentDst[i] = heights.offset + heights.step * segmentCodes[i];
+		}
+	}
+}
+
+void QuantisedHeightMap::WriteRow(int m, int nMin, int count, const float* src)
+{
+	const int rowOffset = (m & (kTileSize - 1)) << kTileShift;
+	const int nEnd = nMin + count;
+	for (int n = nMin; n < nEnd;)
+	{
+		const int tile = (n >> kTileShift) + (m >> kTileShift) * tileColumns;
+		const int localN = n & (kTileSize - 1);
+		const int segment = (std::min)(kTileSize - localN, nEnd - n);
+		Tile& heights = tiles[tile];
+		const float* segmentSrc = &src[n - nMin];
+		n += segment;
+
+		if (heights.exact.empty())
+		{
+			// range of the new heights, the tile is refitted if they do not fit in it
+			XMVECTOR low = XMVectorReplicate(FLT_MAX);
+			XMVECTOR high = XMVectorReplicate(-FLT_MAX);
+			int i = 0;
+			for (; i + 4 <= segment; i += 4)
+			{
+				const XMVECTOR height = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&segmentSrc[i]));
+				low = XMVectorMin(low, height);
+				high = XMVectorMax(high, height);
+			}
+			XMFLOAT4 lows, highs;
+			XMStoreFloat4(&lows, low);
+			XMStoreFloat4(&highs, high);
+			float segmentLow = (std::min)((std::min)(lows.x, lows.y), (std::min)(lows.z, lows.w));
+			float segmentHigh = (std::max)((std::max)(highs.x, highs.y), (std::max)(highs.z, highs.w));
+			for (; i < segment; i++)
+			{
+				segmentLow = (std::min)(segmentLow, segmentSrc[i]);
+				segmentHigh = (std::max)(segmentHigh, segmentSrc[i]);
+			}
+
+			if (segmentLow < heights.offset || segmentHigh > heights.offset + heights.step * kMaxCode)
+			{
+				float tileLow, tileHigh;
+				GetTileRange(tile, tileLow, tileHigh);
+				Fit(tile, (std::min)(tileLow, segmentLow), (std::max)(tileHigh, segmentHigh));
+			}
+		}
+
+		if (!heights.exact.empty())
+		{
+			memcpy(&heights.exact[rowOffset + localN], segmentSrc, sizeof(float) * segment);
+			continue;
+		}
+
+		uint16_t* segmentCodes = &codes[tile * kTilePoints + rowOffset + localN];
+		const float inverseStep = heights.step > 0.0f ? 1.0f / heights.step : 0.0f;
+		const XMVECTOR offset = XMVectorReplicate(heights.offset);
+		const XMVECTOR scale = XMVectorReplicate(inverseStep);
+		int i = 0;
+		for (; i + 4 <= segment; i += 4)
+		{
+			const XMVECTOR height = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&segmentSrc[i]));
+			XMStoreUShort4(reinterpret_cast<XMUSHORT4*>(&segmentCodes[i]), XMVectorRound(XMVectorMultiply(XMVectorSubtract(height, offset), scale)));
+		}
+		for (; i < segment; i++)
+		{
+			const float code = (segmentSrc[i] - heights.offset) * inverseStep + 0.5f;
+			segmentCodes[i] = (uint16_t)(std::min)((std::max)(code, 0.0f), kMaxCode);
+		}
+	}
+}
+
+void QuantisedHeightMap::Compact()
+{
+	const float widest = GetWidestRange();
+	for (int tile = 0; tile < (int)tiles.size(); tile++)
+	{
+		float low, high;
+		GetTileRange(tile, low, high);
+
+		// the float tiles that pass the check, and the quantised tiles that would use less than a quarter of their codes
+		const Tile& heights = tiles[tile];
+		if (heights.exact.empty() ? GetPaddedRange(high - low, widest) * 4.0f < heights.step * kMaxCode : high - low <= widest)
+		{
+			Fit(tile, low, high);
+		}
+	}
+}
+
+size_t QuantisedHeightMap::GetByteSize() const
+{
+	size_t bytes = codes.size() * sizeof(uint16_t) + tiles.size() * sizeof(Tile);
+	for (const Tile& heights : tiles)
+	{
+		bytes += heights.exact.size() * sizeof(float);
+	}
+	return bytes;
+}
+
+int QuantisedHeightMap::GetExactTileCount() const
+{
+	int count = 0;
+	for (const Tile& heights : tiles)
+	{
+		count += heights.exact.empty() ? 0 : 1;
+	}
+	return count;
+}
+
+float QuantisedHeightMap::GetLargestStep() const
+{
+	float largest = 0.0f;
+	for (const Tile& heights : tiles)
+	{
+		if (heights.exact.empty())
+		{
+			largest = (std::max)(largest, heights.step);
+		}
+	}
+	return largest;
+}
+
+void QuantisedHeightMap::Fit(int tile, float low, float high)
+{
+	float heights[kTilePoints];
+	DecodeTile(tile, heights);
+
+	Tile& fitted = tiles[tile];
+	const float widest = GetWidestRange();
+	float range = high - low;
+	if (!(range <= widest))
+	{
+		// fails the precision check
+		fitted.exact.assign(heights, heights + kTilePoints);
+		return;
+	}
+
+	// the finest step whose codes hold the padded range from an offset up to a step under it. Powers of two keep the products
+	// and the offsets exact in floats, so the heights already on the grid of the new step are encoded back to themselves
+	const float padded = GetPaddedRange(range, widest);
+	float step = GetCoarsestStep();
+	while (step * 0.5f * (kMaxCode - 1.0f) >= padded)
+	{
+		step *= 0.5f;
+	}
+	low -= (padded - range) * 0.5f;
+
+	fitted.offset = floorf(low / step) * step;
+	fitted.step = step;
+	std::vector<float>().swap(fitted.exact);
+
+	// the points outside the map are clamped to the range, they are never read
+	const float inverseStep = 1.0f / fitted.step;
+	uint16_t* tileCodes = &codes[tile * kTilePoints];
+	for (int i = 0; i < kTilePoints; i++)
+	{
+		const float code = (heights[i] - fitted.offset) * inverseStep + 0.5f;
+		tileCodes[i] = (uint16_t)(std::min)((std::max)(code, 0.0f), kMaxCode);
+	}
+}
+
+void QuantisedHeightMap::DecodeTile(int tile, float* heights) const
+{
+	const Tile& decoded = tiles[tile];
+	if (!decoded.exact.empty())
+	{
+		memcpy(heights, decoded.exact.data(), sizeof(float) * kTilePoints);
+		return;
+	}
+
+	const uint16_t* tileCodes = &codes[tile * kTilePoints];
+	for (int i = 0; i < kTilePoints; i++)
+	{
+		heights[i] = decoded.offset + decoded.step * tileCodes[i];
+	}
+}
+
+void QuantisedHeightMap::GetTileRange(int tile, float& low, float& high) const
+{
+	// points of the tile inside the map, the last row and column of tiles are partial
+	const int tm = tile / tileColumns;
+	const int tn = tile % tileColumns;
+	const int rows = (std::min)(kTileSize, resolution.x + 1 - tm * kTileSize);
+	const int columns = (std::min)(kTileSize, resolution.y + 1 - tn * kTileSize);
+
+	const Tile& heights = tiles[tile];
+	if (!heights.exact.empty())
+	{
+		low = FLT_MAX;
+		high = -FLT_MAX;
+		for (int i = 0; i < rows; i++)
+		{
+			for (int j = 0; j < columns; j++)
+			{
+				low = (std::min)(low, heights.exact[j + i * kTileSize]);
+				high = (std::max)(high, heights.exact[j + i * kTileSize]);
+			}
+		}
+		return;
+	}
+
+	uint16_t lowCode = UINT16_MAX, highCode = 0;
+	const uint16_t* tileCodes = &codes[tile * kTilePoints];
+	for (int i = 0; i < rows; i++)
+	{
+		for (int j = 0; j < columns; j++)
+		{
+			lowCode = (std::min)(lowCode, tileCodes[j + i * kTileSize]);
+			highCode = (std::max)(highCode, tileCodes[j + i * kTileSize]);
+		}
+	}
+	low = heights.offset + heights.step * lowCode;
+	high = heights.offset + heights.step * highCode;
+}
+
+float QuantisedHeightMap::GetCoarsestStep() const
+{
+	// a point rounded to coarser and coarser steps is less than the last one away from its height, not half of it
+	int exponent;
+	frexpf(maxError, &exponent);
+	return ldexpf(1.0f, exponent - 1);
+}
+
+float QuantisedHeightMap::GetWidestRange() const
+{
+	// the offset can be up to a step under the lowest height
+	return GetCoarsestStep() * (kMaxCode - 1.0f);
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+
+using namespace DirectX;
+
+// Height map stored with 16 bits per point: the points are split in tiles of kTileSize^2 and every tile keeps
+// its heights as offset + code * step, with the range of the tile spread over the 65536 codes.
+// The steps are powers of two no larger than the maximum error and the offsets are multiples of the step, so every grid
+// of codes holds the points of the coarser ones. The precision check: a tile whose range would need a larger step is kept in floats instead.
+// A refit to a finer step keeps the heights exactly and one to a coarser step rounds them to it, so the error of a point stays under
+// the last step it was rounded to and the heights are never further than maxError from what was written, however many times
+// the range of their tile moves. A lower maxError only holds for the heights written after it is set.
+// The points are addressed as in HeightField: m == rows == x, n == columns == y, (resolution + 1) points along each axis.
+// A tile is contiguous in memory, so the neighbours of a point are closer than in a row-major float map
+class QuantisedHeightMap
+{
+public:
+	static const int kTileShift = 6;
+	static const int kTileSize = 1 << kTileShift; // points per side of a tile
+	static const int kTilePoints = kTileSize * kTileSize;
+
+	QuantisedHeightMap();
+
+	// All the points at 0 for the new resolution, which is in quads as the one of HeightField
+	void Resize(XMINT2 resolution, float maxError);
+	XMINT2 GetResolution() const { return resolution; }
+
+	// Change the precision check, the tiles are refitted to it
+	void SetMaxError(float maxError);
+	float GetMaxError() const { return maxError; }
+
+	float Get(int m, int n) const
+	{
+		const int tile = (n >> kTileShift) + (m >> kTileShift) * tileColumns;
+		const int local = (n & (kTileSize - 1)) + ((m & (kTileSize - 1)) << kTileShift);
+		const Tile& heights = tiles[tile];
+		return heights.exact.empty() ? heights.offset + heights.step * codes[tile * kTilePoints + local] : heights.exact[local];
+	}
+	void Set(int m, int n, float height);
+
+	// Decode/encode the points [nMin, nMin + count) of the row m, 4 at a time with SIMD
+	void ReadRow(int m, int nMin, int count, float* dst) const;
+	void WriteRow(int m, int nMin, int count, const float* src);
+
+	// Refit the range of the tiles that have become much wider than their heights, and quantise again the float tiles
+	// that pass the precision check
+	void Compact();
+
+	// Bytes used by the heights
+	size_t GetByteSize() const;
+	int GetTileCount() const { return (int)tiles.size(); }
+	int GetExactTileCount() const;
+	// Largest step of the quantised tiles, their error is under it
+	float GetLargestStep() const;
+
+private:
+	struct Tile
+	{
+		float offset; // height of the code 0
+		float step; // height between two codes
+		std::vector<float> exact; // the heights of the tile if it does not pass the precision check, the codes are unused then
+	};
+
+	// Choose the range of a tile to hold [low, high] with some headroom and encode its heights again,
+	// or keep them in floats if the step would be too large
+	void Fit(int tile, float low, float high);
+	// Heights of a tile, kTilePoints from the first one
+	void DecodeTile(int tile, float* heights) const;
+	// Range of the heights held by the points of a tile inside the map
+	void GetTileRange(int tile, float& low, float& high) const;
+	// Largest step of a quantised tile, the largest power of two not over maxError
+	float GetCoarsestStep() const;
+	// Largest range of a quantised tile
+	float GetWidestRange() const;
+
+	XMINT2 resolution;
+	int tileColumns; // tiles along n
+	float maxError;
+	std::vector<Tile> tiles; // tile (tm, tn) at tn + tm * tileColumns
+	std::vector<uint16_t> codes; // kTilePoints per tile, row by row inside the tile
+};
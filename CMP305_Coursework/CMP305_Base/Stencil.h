@@ -0,0 +1,247 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+
+#include "HeightField.h"
+#include "Parallel.h"
+
+using namespace DirectX;
+
+// Border policies of the stencils: map a coordinate outside [0, count) back into it.
+// The coordinate can be up to count - 1 outside, which covers the strided neighbours of the Diamond-Square too
+
+// The nearest point of the edge
+struct StencilClamp
+{
+	static int Resolve(int i, int count) { return i < 0 ? 0 : (i >= count ? count - 1 : i); }
+};
+
+// Reflected on the edge without repeating it: -1 -> 1, count -> count - 2
+struct StencilMirror
+{
+	static int Resolve(int i, int count) { return i < 0 ? -i : (i >= count ? 2 * (count - 1) - i : i); }
+};
+
+// The other side of the map, as if it was tiled
+struct StencilWrap
+{
+	static int Resolve(int i, int count) { return i < 0 ? i + count : (i >= count ? i - count : i); }
+};
+
+
+// Kernels of the stencils: a function of the 3x3 neighbourhood, p[i][j] is the point (m - 1 + i, n - 1 + j).
+// The vector version computes 4 consecutive points of a row at a time, the lanes of p[i][j] are the points n..n+3 shifted by j - 1.
+// The scalar version is the reference for one point
+
+// Average of the 9 points (the Smooth of the terrain)
+struct StencilBoxKernel
+{
+	static XMVECTOR Apply(const XMVECTOR p[3][3])
+	{
+		XMVECTOR sum = XMVectorZero();
+		for (int i = 0; i < 3; i++)
+		{
+			sum = XMVectorAdd(sum, XMVectorAdd(XMVectorAdd(p[i][0], p[i][1]), p[i][2]));
+		}
+		return XMVectorScale(sum, 1.0f / 9.0f);
+	}
+	static float Apply(const float p[3][3])
+	{
+		float sum = 0.0f;
+		for (int i = 0; i < 3; i++)
+		{
+			sum += p[i][0] + p[i][1] + p[i][2];
+		}
+		return sum / 9.0f;
+	}
+};
+
+// 1 2 1 / 2 4 2 / 1 2 1 weights: smooths less than the box and keeps no square artefacts
+struct StencilGaussianKernel
+{
+	static XMVECTOR Apply(const XMVECTOR p[3][3])
+	{
+		const XMVECTOR two = XMVectorReplicate(2.0f);
+		XMVECTOR rows[3];
+		for (int i = 0; i < 3; i++)
+		{
+			rows[i] = XMVectorMultiplyAdd(p[i][1], two, XMVectorAdd(p[i][0], p[i][2]));
+		}
+		return XMVectorScale(XMVectorMultiplyAdd(rows[1], two, XMVectorAdd(rows[0], rows[2])), 1.0f / 16.0f);
+	}
+	static float Apply(const float p[3][3])
+	{
+		float rows[3];
+		for (int i = 0; i < 3; i++)
+		{
+			rows[i] = p[i][0] + 2.0f * p[i][1] + p[i][2];
+		}
+		return (rows[0] + 2.0f * rows[1] + rows[2]) / 16.0f;
+	}
+};
+
+// Unsharp mask: the point plus its difference with the Gaussian average, the ridges and valleys get sharper
+struct StencilSharpenKernel
+{
+	static XMVECTOR Apply(const XMVECTOR p[3][3])
+	{
+		return XMVectorAdd(p[1][1], XMVectorSubtract(p[1][1], StencilGaussianKernel::Apply(p)));
+	}
+	static float Apply(const float p[3][3])
+	{
+		return p[1][1] + (p[1][1] - StencilGaussianKernel::Apply(p));
+	}
+};
+
+
+// 3x3 stencils over the height map, in any layout of BasicHeightField
+class Stencil
+{
+public:
+	// Rows processed by a band, aligned to the tiles of QuantisedHeightMap so no two threads write the same tile
+	static const int kBandRows = QuantisedHeightMap::kTileSize;
+
+	// destination(m, n) = Kernel(source around (m, n)) for every point, Border gives the neighbours outside the map.
+	// The source and the destination can be the same map.
+	// The rows are split in bands computed in parallel. Each band keeps three rows with a halo column on each side,
+	// so the kernel runs on every point 4 at a time without any bounds check: the border is all in the halo.
+	// The rows around a band are read before any band writes, which makes it safe in place
+	template <class Kernel, class Border, class Field>
+	static void Apply(const Field& source, Field& destination)
+	{
+		const int rows = source.GetRows();
+		const int columns = source.GetColumns();
+		const int groups = (columns + 3) / 4;
+		const int width = groups * 4 + 2; // the halo columns and whole groups of 4
+		const int bands = (rows + kBandRows - 1) / kBandRows;
+
+		// the row above and below every band, with the original heights
+		std::vector<float> halos(bands * 2 * width);
+		for (int band = 0; band < bands; band++)
+		{
+			const int begin = band * kBandRows;
+			const int end = (std::min)(begin + kBandRows, rows);
+			ReadPaddedRow<Border>(source, Border::Resolve(begin - 1, rows), &halos[(band * 2) * width]);
+			ReadPaddedRow<Border>(source, Border::Resolve(end, rows), &halos[(band * 2 + 1) * width]);
+		}
+
+		Parallel::ForBlocks(0, bands, 1, [&](int bandBegin, int bandEnd)
+		{
+			std::vector<float> window(3 * width);
+			std::vector<float> output(groups * 4);
+			float* above = &window[0];
+			float* row = &window[width];
+			float* below = &window[2 * width];
+
+			for (int band = bandBegin; band < bandEnd; band++)
+			{
+				const int begin = band * kBandRows;
+				const int end = (std::min)(begin + kBandRows, rows);
+				const float* bandBelow = &halos[(band * 2 + 1) * width];
+
+				std::copy(&halos[(band * 2) * width], &halos[(band * 2) * width] + width, above);
+				ReadPaddedRow<Border>(source, begin, row);
+				if (begin + 1 < end)
+				{
+					ReadPaddedRow<Border>(source, begin + 1, below);
+				}
+				else
+				{
+					std::copy(bandBelow, bandBelow + width, below);
+				}
+
+				for (int m = begin; m < end; m++)
+				{
+					const float* window3[3] = { above, row, below };
+					for (int group = 0; group < groups; group++)
+					{
+						XMVECTOR p[3][3];
+						for (int i = 0; i < 3; i++)
+						{
+							for (int j = 0; j < 3; j++)
+							{
+								p[i][j] = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&window3[i][group * 4 + j]));
+							}
+						}
+						XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(&output[group * 4]), Kernel::Apply(p));
+					}
+					// the row below is already read, so row m can be written
+					destination.WriteRow(m, 0, columns, output.data());
+
+					// move the window a row down
+					float* oldAbove = above;
+					above = row;
+					row = below;
+					below = oldAbove;
+					if (m + 2 < end)
+					{
+						ReadPaddedRow<Border>(source, m + 2, below);
+					}
+					else
+					{
+						std::copy(bandBelow, bandBelow + width, below);
+					}
+				}
+			}
+		});
+	}
+
+	// The 3x3 neighbourhood of a point, for the operations on a single point (the deposition).
+	// The neighbours outside the map are given by Border, their coordinates by ResolvePoint()
+	template <class Border, class Field>
+	static void Gather(const Field& field, int m, int n, float neighbourhood[3][3])
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			for (int j = 0; j < 3; j++)
+			{
+				const XMINT2 point = ResolvePoint<Border>(field, m - 1 + i, n - 1 + j);
+				neighbourhood[i][j] = field.Get(point.x, point.y);
+			}
+		}
+	}
+
+	// The point (m, n) or, outside the map, the one that Border gives for it
+	template <class Border, class Field>
+	static XMINT2 ResolvePoint(const Field& field, int m, int n)
+	{
+		return XMINT2(Border::Resolve(m, field.GetRows()), Border::Resolve(n, field.GetColumns()));
+	}
+
+	// The lowest (or highest) point of the 3x3 neighbourhood of (m, n), the centre wins the ties
+	template <class Border, class Field>
+	static XMINT2 FindNeighbour(const Field& field, int m, int n, bool highest)
+	{
+		float neighbourhood[3][3];
+		Gather<Border>(field, m, n, neighbourhood);
+
+		int bestI = 1, bestJ = 1;
+		for (int i = 0; i < 3; i++)
+		{
+			for (int j = 0; j < 3; j++)
+			{
+				if (highest ? neighbourhood[i][j] > neighbourhood[bestI][bestJ] : neighbourhood[i][j] < neighbourhood[bestI][bestJ])
+				{
+					bestI = i;
+					bestJ = j;
+				}
+			}
+		}
+		return ResolvePoint<Border>(field, m - 1 + bestI, n - 1 + bestJ);
+	}
+
+private:
+	// Row m from the element 1 of padded, with the halo columns from Border and the padding up to the whole groups of 4
+	template <class Border, class Field>
+	static void ReadPaddedRow(const Field& field, int m, float* padded)
+	{
+		const int columns = field.GetColumns();
+		const int groups = (columns + 3) / 4;
+		field.ReadRow(m, 0, columns, &padded[1]);
+		padded[0] = padded[1 + Border::Resolve(-1, columns)];
+		for (int n = columns; n <= groups * 4; n++)
+		{
+			padded[1 + n] = padded[1 + Border::Resolve(n, columns)];
+		}
+	}
+};
@@ -0,0 +1,111 @@
+#include "StencilBenchmark.h"
+#include "Stencil.h"
+
+#include <chrono>
+#include <cmath>
+#include <random>
+
+const int StencilBenchmark::kSizes[kSizeCount] = { 2049, 4097 };
+
+// The loop the filters used before the stencil: every neighbour checked against the edges of the map
+template <class Kernel, class Border>
+static void Reference(const HeightField& source, HeightField& destination)
+{
+	const int rows = source.GetRows();
+	const int columns = source.GetColumns();
+	for (int m = 0; m < rows; m++)
+	{
+		for (int n = 0; n < columns; n++)
+		{
+			float p[3][3];
+			for (int i = 0; i < 3; i++)
+			{
+				for (int j = 0; j < 3; j++)
+				{
+					int neighbourM = m - 1 + i;
+					int neighbourN = n - 1 + j;
+					if (!source.InBounds(neighbourM, neighbourN))
+					{
+						neighbourM = Border::Resolve(neighbourM, rows);
+						neighbourN = Border::Resolve(neighbourN, columns);
+					}
+					p[i][j] = source.Get(neighbourM, neighbourN);
+				}
+			}
+			destination.Set(m, n, Kernel::Apply(p));
+		}
+	}
+}
+
+template <class Function>
+static float Time(Function function)
+{
+	const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	function();
+	return std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+template <class Kernel, class Border>
+static float TimeOperation(const std::vector<float>& heights, XMINT2 resolution, float milliseconds[StencilBenchmark::kVersionCount])
+{
+	// the reference writes to another map, the stencil works in place as the terrain does
+	std::vector<float> source(heights), reference(heights.size()), filtered(heights);
+	HeightField sourceField(source.data(), resolution);
+	HeightField referenceField(reference.data(), resolution);
+	HeightField filteredField(filtered.data(), resolution);
+
+	milliseconds[StencilBenchmark::kReference] = Time([&]() { Reference<Kernel, Border>(sourceField, referenceField); });
+	milliseconds[StencilBenchmark::kStencil] = Time([&]() { Stencil::Apply<Kernel, Border>(filteredField, filteredField); });
+
+	float maxDifference = 0.0f;
+	for (size_t i = 0; i < reference.size(); i++)
+	{
+		maxDifference = (std::max)(maxDifference, fabsf(reference[i] - filtered[i]));
+	}
+	return maxDifference;
+}
+
+
+StencilBenchmark::StencilBenchmark()
+	: maxDifference(0.0f), hasRun(false)
+{
+	std::fill(&milliseconds[0][0][0], &milliseconds[0][0][0] + kSizeCount * kOperationCount * kVersionCount, 0.0f);
+}
+
+void StencilBenchmark::Run()
+{
+	maxDifference = 0.0f;
+	for (int size = 0; size < kSizeCount; size++)
+	{
+		// waves with some noise
+		const XMINT2 resolution(kSizes[size] - 1, kSizes[size] - 1);
+		std::vector<float> heights(HeightField::GetStorageSize(resolution));
+		HeightField heightField(heights.data(), resolution);
+		std::mt19937 generator(1);
+		std::uniform_real_distribution<float> noise(-0.5f, 0.5f);
+		for (int m = 0; m <= resolution.x; m++)
+		{
+			for (int n = 0; n <= resolution.y; n++)
+			{
+				heightField.Set(m, n, 10.0f * sinf(m * 0.02f) + 10.0f * cosf(n * 0.03f) + noise(generator));
+			}
+		}
+
+		maxDifference = (std::max)(maxDifference, TimeOperation<StencilBoxKernel, StencilClamp>(heights, resolution, milliseconds[size][kBox]));
+		maxDifference = (std::max)(maxDifference, TimeOperation<StencilGaussianKernel, StencilClamp>(heights, resolution, milliseconds[size][kGaussian]));
+		maxDifference = (std::max)(maxDifference, TimeOperation<StencilSharpenKernel, StencilMirror>(heights, resolution, milliseconds[size][kSharpen]));
+	}
+	hasRun = true;
+}
+
+float StencilBenchmark::GetSpeedup(int size, int operation) const
+{
+	const float time = milliseconds[size][operation][kStencil];
+	return time > 0.0f ? milliseconds[size][operation][kReference] / time : 0.0f;
+}
+
+const char* StencilBenchmark::GetOperationName(int operation)
+{
+	static const char* names[kOperationCount] = { "Smooth (box, clamp)", "Gaussian (clamp)", "Sharpen (mirror)" };
+	return names[operation];
+}
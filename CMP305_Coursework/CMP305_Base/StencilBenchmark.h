@@ -0,0 +1,31 @@
+#pragma once
+
+// Times the filters of Stencil against the hand-rolled loop they replace (a bounds check per neighbour, one thread),
+// on square maps of 2049 and 4097 points per side
+class StencilBenchmark
+{
+public:
+	enum Operation { kBox = 0, kGaussian, kSharpen, kOperationCount };
+	enum Version { kReference = 0, kStencil, kVersionCount };
+	static const int kSizeCount = 2;
+	static const int kSizes[kSizeCount]; // points per side
+
+	StencilBenchmark();
+
+	// Run every filter in both versions at every size, it takes a few seconds
+	void Run();
+	bool HasRun() const { return hasRun; }
+
+	float GetMilliseconds(int size, int operation, int version) const { return milliseconds[size][operation][version]; }
+	// Time of the reference divided by the time of the stencil
+	float GetSpeedup(int size, int operation) const;
+	// Largest difference between the heights of both versions, it should be rounding only
+	float GetMaxDifference() const { return maxDifference; }
+
+	static const char* GetOperationName(int operation);
+
+private:
+	float milliseconds[kSizeCount][kOperationCount][kVersionCount];
+	float maxDifference;
+	bool hasRun;
+};
@@ -0,0 +1,243 @@
+#include "TaskScheduler.h"
+
+#include <algorithm>
+
+// The scheduler of the calling thread (null for the shared one) and, for a worker, its deque
+static thread_local TaskScheduler* threadScheduler = nullptr;
+static thread_local TaskScheduler* threadWorkerOwner = nullptr;
+static thread_local int threadWorker = -1;
+
+
+TaskScheduler::TaskScheduler(int workerCount)
+	: nextWorker(0), queuedTasks(0), stopWorkers(false)
+{
+	if (workerCount < 0)
+	{
+		workerCount = (std::max)(1, (int)std::thread::hardware_concurrency() - 1);
+	}
+
+	// all the deques exist before any worker can steal from them
+	for (int i = 0; i < workerCount; i++)
+	{
+		workers.emplace_back(new Worker());
+	}
+	for (int i = 0; i < workerCount; i++)
+	{
+		workers[i]->thread = std::thread(&TaskScheduler::WorkerLoop, this, i);
+	}
+}
+
+TaskScheduler::~TaskScheduler()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		stopWorkers = true;
+	}
+	taskAvailable.notify_all();
+	for (std::unique_ptr<Worker>& worker : workers)
+	{
+		worker->thread.join();
+	}
+}
+
+TaskScheduler& TaskScheduler::Get()
+{
+	static TaskScheduler shared;
+	return threadScheduler ? *threadScheduler : shared;
+}
+
+TaskScheduler::Scope::Scope(TaskScheduler& scheduler)
+	: previous(threadScheduler)
+{
+	threadScheduler = &scheduler;
+}
+
+TaskScheduler::Scope::~Scope()
+{
+	threadScheduler = previous;
+}
+
+TaskHandle TaskScheduler::Submit(const std::function<void()>& function, const std::vector<TaskHandle>& dependencies)
+{
+	return Submit(function, dependencies, false);
+}
+
+TaskHandle TaskScheduler::SubmitBackground(const std::function<void()>& function, const std::vector<TaskHandle>& dependencies)
+{
+	return Submit(function, dependencies, true);
+}
+
+TaskHandle TaskScheduler::Submit(const std::function<void()>& function, const std::vector<TaskHandle>& dependencies, bool background)
+{
+	std::shared_ptr<TaskState> task = std::make_shared<TaskState>();
+	task->function = function;
+	task->done = false;
+	task->background = background;
+
+	// the extra dependency keeps the task from being scheduled by a dependency finishing before all of them are registered
+	task->unfinishedDependencies = (int)dependencies.size() + 1;
+	for (const TaskHandle& dependency : dependencies)
+	{
+		if (!dependency)
+		{
+			task->unfinishedDependencies--;
+			continue;
+		}
+
+		std::lock_guard<std::mutex> lock(dependency->continuationMutex);
+		if (dependency->done)
+		{
+			task->unfinishedDependencies--;
+		}
+		else
+		{
+			dependency->continuations.push_back(task);
+		}
+	}
+	if (--task->unfinishedDependencies == 0)
+	{
+		Schedule(task);
+	}
+	return task;
+}
+
+void TaskScheduler::Wait(const TaskHandle& task)
+{
+	const int worker = threadWorkerOwner == this ? threadWorker : -1;
+	while (!IsDone(task))
+	{
+		// a background task could take much longer than the one waited for
+		std::shared_ptr<TaskState> other = Take(worker, false);
+		if (other)
+		{
+			Run(other);
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+void TaskScheduler::Schedule(const std::shared_ptr<TaskState>& task)
+{
+	if (workers.empty())
+	{
+		Run(task);
+		return;
+	}
+
+	if (task->background)
+	{
+		std::lock_guard<std::mutex> lock(backgroundMutex);
+		backgroundTasks.push_back(task);
+	}
+	else
+	{
+		// a worker keeps the tasks it submits, the rest are spread over the deques
+		const int worker = threadWorkerOwner == this ? threadWorker : (int)(nextWorker++ % workers.size());
+		std::lock_guard<std::mutex> lock(workers[worker]->mutex);
+		workers[worker]->tasks.push_back(task);
+	}
+
+	queuedTasks++;
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+	}
+	taskAvailable.notify_one();
+}
+
+void TaskScheduler::Run(const std::shared_ptr<TaskState>& task)
+{
+	task->function();
+	task->function = std::function<void()>(); // free what it holds
+
+	std::vector<std::shared_ptr<TaskState>> continuations;
+	{
+		std::lock_guard<std::mutex> lock(task->continuationMutex);
+		task->done = true;
+		continuations.swap(task->continuations);
+	}
+	for (const std::shared_ptr<TaskState>& continuation : continuations)
+	{
+		if (--continuation->unfinishedDependencies == 0)
+		{
+			Schedule(continuation);
+		}
+	}
+}
+
+std::shared_ptr<TaskState> TaskScheduler::Take(int worker, bool allowBackground)
+{
+	std::shared_ptr<TaskState> task;
+
+	// newest of its own deque: the data of the task it has just split is still in the cache
+	if (worker >= 0)
+	{
+		Worker& own = *workers[worker];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.tasks.empty())
+		{
+			task = own.tasks.back();
+			own.tasks.pop_back();
+		}
+	}
+
+	// oldest of the others: the biggest part of their work
+	const int count = (int)workers.size();
+	for (int i = 1; i <= count && !task; i++)
+	{
+		const int victim = (worker + i + count) % count;
+		if (victim == worker)
+		{
+			continue;
+		}
+		Worker& other = *workers[victim];
+		std::lock_guard<std::mutex> lock(other.mutex);
+		if (!other.tasks.empty())
+		{
+			task = other.tasks.front();
+			other.tasks.pop_front();
+		}
+	}
+
+	if (!task && allowBackground)
+	{
+		std::lock_guard<std::mutex> lock(backgroundMutex);
+		if (!backgroundTasks.empty())
+		{
+			task = backgroundTasks.front();
+			backgroundTasks.pop_front();
+		}
+	}
+
+	if (task)
+	{
+		queuedTasks--;
+	}
+	return task;
+}
+
+void TaskScheduler::WorkerLoop(int worker)
+{
+	threadScheduler = this;
+	threadWorkerOwner = this;
+	threadWorker = worker;
+
+	while (true)
+	{
+		std::shared_ptr<TaskState> task = Take(worker, true);
+		if (task)
+		{
+			Run(task);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		taskAvailable.wait(lock, [this] { return stopWorkers || queuedTasks > 0; });
+		if (stopWorkers && queuedTasks == 0)
+		{
+			return;
+		}
+	}
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Task run by the TaskScheduler, with the tasks that wait for it
+struct TaskState
+{
+	std::function<void()> function;
+	std::atomic<int> unfinishedDependencies; // plus one while it is being submitted
+	std::atomic<bool> done;
+	bool background;
+	std::mutex continuationMutex;
+	std::vector<std::shared_ptr<TaskState>> continuations; // submitted when this one is done
+};
+
+// Handle of a submitted task, to wait for it or to make other tasks depend on it
+typedef std::shared_ptr<TaskState> TaskHandle;
+
+// Work-stealing pool of worker threads shared by all the terrain work.
+// Every worker has its own deque: it takes the newest task of its deque and, when it is empty, steals the oldest one
+// of another worker. The background tasks (long ones: terrain jobs, refinement, streamed tiles) are in a shared queue that
+// the workers only take when there is nothing else, so the loops of the render thread are not queued behind them.
+// A thread waiting for a task runs other (not background) tasks meanwhile, so the tasks can wait for the tasks they submit
+class TaskScheduler
+{
+public:
+	// workerCount -1 uses all the cores but one, the thread that waits works too.
+	// Without workers every task runs on the thread that submits it (or finishes its last dependency)
+	explicit TaskScheduler(int workerCount = -1);
+	~TaskScheduler(); // runs the tasks left and joins the workers
+
+	// The scheduler of the calling thread: the one of the worker, the one of the innermost Scope or the shared one
+	static TaskScheduler& Get();
+
+	// Make the calling thread use scheduler in Get() (the parallel loops) while it lives, to run them on another pool
+	class Scope
+	{
+	public:
+		explicit Scope(TaskScheduler& scheduler);
+		~Scope();
+	private:
+		TaskScheduler* previous;
+	};
+
+	// Threads working on the tasks: the workers and the one waiting
+	int GetThreadCount() const { return (int)workers.size() + 1; }
+
+	// Run function once all the dependencies are done
+	TaskHandle Submit(const std::function<void()>& function, const std::vector<TaskHandle>& dependencies = std::vector<TaskHandle>());
+	// The same for a long task, which never delays the short ones
+	TaskHandle SubmitBackground(const std::function<void()>& function, const std::vector<TaskHandle>& dependencies = std::vector<TaskHandle>());
+
+	// Run other tasks until task is done
+	void Wait(const TaskHandle& task);
+	static bool IsDone(const TaskHandle& task) { return !task || task->done; }
+
+private:
+	struct Worker
+	{
+		std::mutex mutex;
+		std::deque<std::shared_ptr<TaskState>> tasks;
+		std::thread thread;
+	};
+
+	TaskHandle Submit(const std::function<void()>& function, const std::vector<TaskHandle>& dependencies, bool background);
+	// Queue a task whose dependencies are done
+	void Schedule(const std::shared_ptr<TaskState>& task);
+	void Run(const std::shared_ptr<TaskState>& task);
+	// Take a task: the newest of the deque of worker (if any), the oldest of another one and then, if allowed, a background one
+	std::shared_ptr<TaskState> Take(int worker, bool allowBackground);
+
+	void WorkerLoop(int worker);
+
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::atomic<unsigned int> nextWorker; // deque for the tasks submitted by other threads, round robin
+
+	std::mutex backgroundMutex;
+	std::deque<std::shared_ptr<TaskState>> backgroundTasks;
+
+	// Sleep of the idle workers
+	std::mutex sleepMutex;
+	std::condition_variable taskAvailable;
+	std::atomic<int> queuedTasks;
+	bool stopWorkers;
+};
@@ -0,0 +1,81 @@
+#include "TaskSchedulerBenchmark.h"
+#include "HeightResampler.h"
+#include "Parallel.h"
+#include "Stencil.h"
+#include "TaskScheduler.h"
+#include "TerrainAnalysis.h"
+#include "TerrainStreamer.h"
+
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+const int TaskSchedulerBenchmark::kThreadCounts[kThreadCountCount] = { 1, 2, 4, 8, 16 };
+
+static const int kSize = 2049; // points per side of the maps
+
+template <class Function>
+static float Time(Function function)
+{
+	const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	function();
+	return std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+
+TaskSchedulerBenchmark::TaskSchedulerBenchmark()
+	: hasRun(false)
+{
+	std::fill(&milliseconds[0][0], &milliseconds[0][0] + kThreadCountCount * kOperationCount, 0.0f);
+}
+
+void TaskSchedulerBenchmark::Run()
+{
+	const XMINT2 resolution(kSize - 1, kSize - 1);
+	const XMINT2 fineResolution(2 * (kSize - 1), 2 * (kSize - 1));
+	std::vector<float> heights(HeightField::GetStorageSize(resolution));
+	std::vector<float> fine(HeightField::GetStorageSize(fineResolution));
+	HeightField heightField(heights.data(), resolution);
+	HeightField fineField(fine.data(), fineResolution);
+	StreamingTerrainSettings noiseSettings;
+	TerrainAnalysisMaps analysisMaps;
+
+	for (int threadCount = 0; threadCount < kThreadCountCount; threadCount++)
+	{
+		// the parallel loops of this thread run on a pool of the size measured, the thread itself is one of them
+		TaskScheduler scheduler(kThreadCounts[threadCount] - 1);
+		TaskScheduler::Scope scope(scheduler);
+		float* times = milliseconds[threadCount];
+
+		// the noise of the infinite terrain, also the heights of the rest
+		times[kNoiseFill] = Time([&]()
+		{
+			Parallel::ForTiles(0, kSize, 0, kSize, QuantisedHeightMap::kTileSize, QuantisedHeightMap::kTileSize, [&](int mBegin, int mEnd, int nBegin, int nEnd)
+			{
+				for (int m = mBegin; m < mEnd; m++)
+				{
+					for (int n = nBegin; n < nEnd; n++)
+					{
+						heightField.Set(m, n, TerrainStreamer::SampleHeight(noiseSettings, (float)n, (float)m));
+					}
+				}
+			});
+		});
+		times[kSmooth] = Time([&]() { Stencil::Apply<StencilBoxKernel, StencilClamp>(heightField, heightField); });
+		times[kResample] = Time([&]() { HeightResampler::Resample(heightField, fineField, kResampleBicubic); });
+		times[kNormals] = Time([&]() { TerrainAnalysis::Compute(heightField, kAnalysisAll, analysisMaps); });
+	}
+	hasRun = true;
+}
+
+float TaskSchedulerBenchmark::GetSpeedup(int threadCount, int operation) const
+{
+	const float time = milliseconds[threadCount][operation];
+	return time > 0.0f ? milliseconds[0][operation] / time : 0.0f;
+}
+
+const char* TaskSchedulerBenchmark::GetOperationName(int operation)
+{
+	static const char* names[kOperationCount] = { "Smooth", "Resample x2 (bicubic)", "Noise fill", "Slope and normal maps" };
+	return names[operation];
+}
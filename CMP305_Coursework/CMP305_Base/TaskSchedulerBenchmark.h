@@ -0,0 +1,27 @@
+#pragma once
+
+// Times terrain work on schedulers of 1, 2, 4, 8 and 16 threads, to see how far every operation scales on the machine.
+// The counts over the cores of the machine show the cost of oversubscribing it
+class TaskSchedulerBenchmark
+{
+public:
+	enum Operation { kSmooth = 0, kResample, kNoiseFill, kNormals, kOperationCount };
+	static const int kThreadCountCount = 5;
+	static const int kThreadCounts[kThreadCountCount];
+
+	TaskSchedulerBenchmark();
+
+	// Run every operation with every thread count, it takes a few seconds
+	void Run();
+	bool HasRun() const { return hasRun; }
+
+	float GetMilliseconds(int threadCount, int operation) const { return milliseconds[threadCount][operation]; }
+	// Time with one thread divided by the time with kThreadCounts[threadCount]
+	float GetSpeedup(int threadCount, int operation) const;
+
+	static const char* GetOperationName(int operation);
+
+private:
+	float milliseconds[kThreadCountCount][kOperationCount];
+	bool hasRun;
+};
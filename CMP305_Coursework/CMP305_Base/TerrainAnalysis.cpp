@@ -0,0 +1,164 @@
+#include "TerrainAnalysis.h"
+
+#include <algorithm>
+
+#include "Parallel.h"
+
+
+void TerrainAnalysis::Compute(const HeightField& heightField, int outputs, TerrainAnalysisMaps& maps)
+{
+	const int rows = heightField.GetRows();
+	const int columns = heightField.GetColumns();
+	const int size = heightField.GetSize();
+
+	maps.resolution = heightField.GetResolution();
+	maps.outputs = outputs;
+	maps.slope.resize((outputs & kAnalysisSlope) ? size : 0);
+	maps.aspect.resize((outputs & kAnalysisAspect) ? size : 0);
+	maps.planCurvature.resize((outputs & kAnalysisPlanCurvature) ? size : 0);
+	maps.profileCurvature.resize((outputs & kAnalysisProfileCurvature) ? size : 0);
+	maps.normal.resize((outputs & kAnalysisNormal) ? size : 0);
+
+	if (outputs == 0)
+	{
+		return;
+	}
+
+	Parallel::ForBlocks(0, rows, 16, [&](int mBegin, int mEnd)
+	{
+		// Three rows with one replicated point at each side plus padding, so the last group of 4 columns can be read whole.
+		// The rows are rotated as the band moves down
+		const int paddedColumns = columns + 8;
+		std::vector<float> above(paddedColumns), row(paddedColumns), below(paddedColumns);
+
+		auto readRow = [&](int m, std::vector<float>& buffer)
+		{
+			m = std::min(std::max(m, 0), rows - 1);
+			heightField.ReadRow(m, &buffer[1]);
+			buffer[0] = buffer[1];
+			for (int n = columns + 1; n < paddedColumns; n++)
+			{
+				buffer[n] = buffer[columns];
+			}
+		};
+
+		readRow(mBegin - 1, above);
+		readRow(mBegin, row);
+		for (int m = mBegin; m < mEnd; m++)
+		{
+			readRow(m + 1, below);
+			ComputeRow(above.data(), row.data(), below.data(), m, columns, outputs, maps);
+
+			// the row above is no longer needed, it will be the next row below
+			std::swap(above, row);
+			std::swap(row, below);
+		}
+	});
+}
+
+void TerrainAnalysis::ComputeRow(const float* above, const float* row, const float* below, int m, int columns, int outputs, TerrainAnalysisMaps& maps)
+{
+	// Stencil of the point e (the rows are padded, so column n is at n + 1):
+	//
+	// ---------
+	// | a| b| c|   above
+	// | d| e| f|   row
+	// | g| h| i|   below
+	// ---------
+	const XMVECTOR half = XMVectorReplicate(0.5f);
+	const XMVECTOR quarter = XMVectorReplicate(0.25f);
+	const XMVECTOR two = XMVectorReplicate(2.0f);
+	const XMVECTOR one = XMVectorReplicate(1.0f);
+	const XMVECTOR flatEpsilon = XMVectorReplicate(1e-12f);
+	const XMVECTOR zero = XMVectorZero();
+
+	const int rowStart = m * columns;
+
+	for (int n = 0; n < columns; n += 4)
+	{
+		const XMVECTOR a = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&above[n]));
+		const XMVECTOR b = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&above[n + 1]));
+		const XMVECTOR c = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&above[n + 2]));
+		const XMVECTOR d = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&row[n]));
+		const XMVECTOR e = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&row[n + 1]));
+		const XMVECTOR f = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&row[n + 2]));
+		const XMVECTOR g = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&below[n]));
+		const XMVECTOR h = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&below[n + 1]));
+		const XMVECTOR i = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&below[n + 2]));
+
+		// first derivatives along n (p) and m (q)
+		const XMVECTOR p = XMVectorMultiply(XMVectorSubtract(f, d), half);
+		const XMVECTOR q = XMVectorMultiply(XMVectorSubtract(h, b), half);
+		const XMVECTOR gradientSq = XMVectorMultiplyAdd(p, p, XMVectorMultiply(q, q));
+
+		// valid lanes of this group of 4
+		const int lanes = std::min(4, columns - n);
+		XMFLOAT4 result;
+
+		if (outputs & kAnalysisSlope)
+		{
+			XMStoreFloat4(&result, XMVectorATan(XMVectorSqrt(gradientSq)));
+			memcpy(&maps.slope[rowStart + n], &result, sizeof(float) * lanes);
+		}
+
+		if (outputs & kAnalysisAspect)
+		{
+			XMStoreFloat4(&result, XMVectorATan2(XMVectorNegate(q), XMVectorNegate(p)));
+			memcpy(&maps.aspect[rowStart + n], &result, sizeof(float) * lanes);
+		}
+
+		if (outputs & (kAnalysisPlanCurvature | kAnalysisProfileCurvature))
+		{
+			// second derivatives
+			const XMVECTOR twoE = XMVectorMultiply(e, two);
+			const XMVECTOR r = XMVectorSubtract(XMVectorAdd(d, f), twoE);
+			const XMVECTOR t = XMVectorSubtract(XMVectorAdd(b, h), twoE);
+			const XMVECTOR s = XMVectorMultiply(XMVectorSubtract(XMVectorSubtract(i, g), XMVectorSubtract(c, a)), quarter);
+
+			const XMVECTOR pp = XMVectorMultiply(p, p);
+			const XMVECTOR qq = XMVectorMultiply(q, q);
+			const XMVECTOR pqs2 = XMVectorMultiply(XMVectorMultiply(p, q), XMVectorMultiply(s, two));
+			// the curvatures are not defined on flat points, they are set to 0 there
+			const XMVECTOR notFlat = XMVectorGreater(gradientSq, flatEpsilon);
+
+			if (outputs & kAnalysisProfileCurvature)
+			{
+				// -(p^2 r + 2pqs + q^2 t) / ((p^2 + q^2) (1 + p^2 + q^2)^1.5)
+				const XMVECTOR numerator = XMVectorAdd(XMVectorMultiplyAdd(pp, r, pqs2), XMVectorMultiply(qq, t));
+				const XMVECTOR onePlus = XMVectorAdd(one, gradientSq);
+				const XMVECTOR denominator = XMVectorMultiply(gradientSq, XMVectorMultiply(onePlus, XMVectorSqrt(onePlus)));
+				const XMVECTOR curvature = XMVectorNegate(XMVectorDivide(numerator, denominator));
+				XMStoreFloat4(&result, XMVectorSelect(zero, curvature, notFlat));
+				memcpy(&maps.profileCurvature[rowStart + n], &result, sizeof(float) * lanes);
+			}
+
+			if (outputs & kAnalysisPlanCurvature)
+			{
+				// -(q^2 r - 2pqs + p^2 t) / (p^2 + q^2)^1.5
+				const XMVECTOR numerator = XMVectorAdd(XMVectorSubtract(XMVectorMultiply(qq, r), pqs2), XMVectorMultiply(pp, t));
+				const XMVECTOR denominator = XMVectorMultiply(gradientSq, XMVectorSqrt(gradientSq));
+				const XMVECTOR curvature = XMVectorNegate(XMVectorDivide(numerator, denominator));
+				XMStoreFloat4(&result, XMVectorSelect(zero, curvature, notFlat));
+				memcpy(&maps.planCurvature[rowStart + n], &result, sizeof(float) * lanes);
+			}
+		}
+
+		if (outputs & kAnalysisNormal)
+		{
+			// normalize(-p, 1, -q)
+			const XMVECTOR inverseLength = XMVectorReciprocalSqrt(XMVectorAdd(gradientSq, one));
+			XMFLOAT4 normalX, normalZ, normalY;
+			XMStoreFloat4(&normalX, XMVectorNegate(XMVectorMultiply(p, inverseLength)));
+			XMStoreFloat4(&normalY, inverseLength);
+			XMStoreFloat4(&normalZ, XMVectorNegate(XMVectorMultiply(q, inverseLength)));
+
+			const float* x = &normalX.x;
+			const float* y = &normalY.x;
+			const float* z = &normalZ.x;
+			for (int lane = 0; lane < lanes; lane++)
+			{
+				maps.normal[rowStart + n + lane] = XMFLOAT3(x[lane], y[lane], z[lane]);
+			}
+		}
+	}
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <vector>
+
+#include "HeightField.h"
+
+// Maps that can be computed by the analysis, combined as a bitmask so the unused ones are skipped
+enum TerrainAnalysisOutput
+{
+	kAnalysisSlope = 1 << 0,
+	kAnalysisAspect = 1 << 1,
+	kAnalysisPlanCurvature = 1 << 2,
+	kAnalysisProfileCurvature = 1 << 3,
+	kAnalysisNormal = 1 << 4,
+	kAnalysisAll = kAnalysisSlope | kAnalysisAspect | kAnalysisPlanCurvature | kAnalysisProfileCurvature | kAnalysisNormal
+};
+
+// One value per height map point, same indexing as the HeightField.
+// Only the maps requested in outputs are filled, the rest are left empty
+struct TerrainAnalysisMaps
+{
+	XMINT2 resolution = XMINT2(0, 0);
+	int outputs = 0;
+	std::vector<float> slope; // angle with the horizontal plane in radians [0, pi/2)
+	std::vector<float> aspect; // direction of the steepest descent in radians (atan2 of the m and n components)
+	std::vector<float> planCurvature; // curvature across the slope (convergence/divergence of the flow)
+	std::vector<float> profileCurvature; // curvature along the slope (acceleration/deceleration of the flow)
+	std::vector<XMFLOAT3> normal; // unit normal in terrain space (x = n, y = height, z = m)
+};
+
+class TerrainAnalysis
+{
+public:
+	// Compute the requested maps in a single 3x3 stencil pass over the height map (Zevenbergen & Thorne derivatives).
+	// The rows are processed in parallel and the columns 4 at a time with DirectXMath vectors.
+	// The borders replicate the edge points, the spacing between points is 1 unit as in the terrain mesh
+	static void Compute(const HeightField& heightField, int outputs, TerrainAnalysisMaps& maps);
+
+private:
+	// Analyse the row m, whose neighbour rows have been read (with one replicated point at each side) into above, row and below
+	static void ComputeRow(const float* above, const float* row, const float* below, int m, int columns, int outputs, TerrainAnalysisMaps& maps);
+};
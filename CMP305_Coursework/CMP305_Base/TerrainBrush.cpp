@@ -0,0 +1,287 @@
+#include "TerrainBrush.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#include "SimplexNoise.h"
+
+const float TerrainBrush::kPickMargin = 1e-3f;
+
+TerrainBrush::TerrainBrush()
+	: stroking(false), targetHeight(0.0f), lastM(0.0f), lastN(0.0f), strokeStamps(0)
+{
+}
+
+void TerrainBrush::BeginStroke(const BrushSettings& brushSettings, const HeightField& heightField, float m, float n)
+{
+	settings = brushSettings;
+	settings.radius = (std::max)(settings.radius, 1.0f);
+	settings.spacing = (std::max)(settings.spacing, 0.05f);
+	stroking = true;
+	targetHeight = SampleHeight(heightField, m, n);
+	lastM = m;
+	lastN = n;
+	strokeStamps = 0;
+
+	Stamp stamp = { m, n, 1.0f };
+	stamps.push_back(stamp);
+}
+
+void TerrainBrush::MoveStroke(float m, float n, float dt)
+{
+	if (!stroking)
+	{
+		return;
+	}
+
+	const float spacing = settings.spacing * settings.radius;
+	const float dm = m - lastM;
+	const float dn = n - lastN;
+	const float distance = sqrtf(dm * dm + dn * dn);
+	if (distance < spacing)
+	{
+		// holding still (or moving less than the spacing) keeps stamping on the last stamp at a fixed rate
+		Stamp stamp = { lastM, lastN, (std::min)(dt * kStationaryStamps, 1.0f) };
+		stamps.push_back(stamp);
+		return;
+	}
+
+	// full stamps along the way, the rest of the distance is left for the next move
+	const int count = (int)(distance / spacing);
+	for (int i = 1; i <= count; i++)
+	{
+		const float t = (i * spacing) / distance;
+		Stamp stamp = { lastM + dm * t, lastN + dn * t, 1.0f };
+		stamps.push_back(stamp);
+	}
+	lastM = stamps.back().m;
+	lastN = stamps.back().n;
+}
+
+void TerrainBrush::EndStroke()
+{
+	stroking = false;
+}
+
+HeightFieldRect TerrainBrush::GetStampRect(const HeightField& heightField, const Stamp& stamp) const
+{
+	const float radius = settings.radius;
+	return heightField.Clip(HeightFieldRect((int)ceilf(stamp.m - radius), (int)ceilf(stamp.n - radius), (int)floorf(stamp.m + radius), (int)floorf(stamp.n + radius)));
+}
+
+HeightFieldRect TerrainBrush::GetStampsRect(const HeightField& heightField) const
+{
+	HeightFieldRect rect;
+	for (const Stamp& stamp : stamps)
+	{
+		const HeightFieldRect stampRect = GetStampRect(heightField, stamp);
+		if (stampRect.IsEmpty())
+		{
+			continue;
+		}
+		if (rect.IsEmpty())
+		{
+			rect = stampRect;
+		}
+		else
+		{
+			rect = HeightFieldRect((std::min)(rect.mMin, stampRect.mMin), (std::min)(rect.nMin, stampRect.nMin),
+				(std::max)(rect.mMax, stampRect.mMax), (std::max)(rect.nMax, stampRect.nMax));
+		}
+	}
+	return rect;
+}
+
+int TerrainBrush::Apply(HeightField& heightField)
+{
+	// in order: every stamp reads what the ones before it have written
+	for (const Stamp& stamp : stamps)
+	{
+		ApplyStamp(heightField, stamp);
+	}
+
+	const int applied = (int)stamps.size();
+	strokeStamps += applied;
+	stamps.clear();
+	return applied;
+}
+
+void TerrainBrush::ApplyStamp(HeightField& heightField, const Stamp& stamp)
+{
+	const HeightFieldRect rect = GetStampRect(heightField, stamp);
+	if (rect.IsEmpty())
+	{
+		return;
+	}
+
+	// the points of the stamp with a border of one point for the smooth brush, clamped to the map
+	const HeightFieldRect sourceRect = heightField.Clip(HeightFieldRect(rect.mMin - 1, rect.nMin - 1, rect.mMax + 1, rect.nMax + 1));
+	const int sourceColumns = sourceRect.nMax - sourceRect.nMin + 1;
+	source.resize((sourceRect.mMax - sourceRect.mMin + 1) * sourceColumns);
+	for (int m = sourceRect.mMin; m <= sourceRect.mMax; m++)
+	{
+		heightField.ReadRow(m, sourceRect.nMin, sourceColumns, &source[(m - sourceRect.mMin) * sourceColumns]);
+	}
+	auto sourceHeight = [&](int m, int n)
+	{
+		m = (std::min)((std::max)(m, sourceRect.mMin), sourceRect.mMax);
+		n = (std::min)((std::max)(n, sourceRect.nMin), sourceRect.nMax);
+		return source[(n - sourceRect.nMin) + (m - sourceRect.mMin) * sourceColumns];
+	};
+
+	const float radiusSquared = settings.radius * settings.radius;
+	const float strength = settings.strength * stamp.weight;
+	const int columns = rect.nMax - rect.nMin + 1;
+	row.resize(columns);
+
+	for (int m = rect.mMin; m <= rect.mMax; m++)
+	{
+		const float dm = m - stamp.m;
+		for (int n = rect.nMin; n <= rect.nMax; n++)
+		{
+			float height = sourceHeight(m, n);
+
+			const float dn = n - stamp.n;
+			const float distanceSquared = dm * dm + dn * dn;
+			if (distanceSquared < radiusSquared)
+			{
+				const float falloff = 1.0f - distanceSquared / radiusSquared;
+				const float weight = falloff * falloff * strength;
+
+				switch (settings.type)
+				{
+				case kBrushRaise:
+					height += weight;
+					break;
+				case kBrushLower:
+					height -= weight;
+					break;
+				case kBrushSmooth:
+				{
+					float sum = 0.0f;
+					for (int i = -1; i <= 1; i++)
+					{
+						for (int j = -1; j <= 1; j++)
+						{
+							sum += sourceHeight(m + i, n + j);
+						}
+					}
+					height += (sum / 9.0f - height) * (std::min)(weight, 1.0f);
+					break;
+				}
+				case kBrushFlatten:
+					height += (targetHeight - height) * (std::min)(weight, 1.0f);
+					break;
+				case kBrushNoise:
+					height += weight * SimplexNoise::noise(n * settings.noiseScale, m * settings.noiseScale);
+					break;
+				}
+			}
+
+			row[n - rect.nMin] = height;
+		}
+		heightField.WriteRow(m, rect.nMin, columns, row.data());
+	}
+}
+
+float TerrainBrush::SampleHeight(const HeightField& heightField, float m, float n)
+{
+	const XMINT2 resolution = heightField.GetResolution();
+	m = (std::min)((std::max)(m, 0.0f), (float)resolution.x);
+	n = (std::min)((std::max)(n, 0.0f), (float)resolution.y);
+
+	const int m0 = (std::min)((int)m, resolution.x - 1);
+	const int n0 = (std::min)((int)n, resolution.y - 1);
+	const float u = m - m0;
+	const float v = n - n0;
+	const float top = heightField.Get(m0, n0) + (heightField.Get(m0, n0 + 1) - heightField.Get(m0, n0)) * v;
+	const float bottom = heightField.Get(m0 + 1, n0) + (heightField.Get(m0 + 1, n0 + 1) - heightField.Get(m0 + 1, n0)) * v;
+	return top + (bottom - top) * u;
+}
+
+bool TerrainBrush::Pick(const HeightField& heightField, const HeightQuadtree& quadtree, const XMFLOAT3& origin, const XMFLOAT3& direction, XMFLOAT3& point)
+{
+	if (quadtree.GetLevelCount() == 0)
+	{
+		return false;
+	}
+
+	// clip the ray to the box of the terrain, from the root of the quadtree to its highest point.
+	// The top is raised a little, so a ray entering it over the highest peak starts above the terrain
+	const XMINT2 resolution = heightField.GetResolution();
+	const XMFLOAT2 bounds = quadtree.GetBounds(quadtree.GetLevelCount() - 1, 0, 0);
+	const float boxMin[3] = { 0.0f, bounds.x, 0.0f };
+	const float boxMax[3] = { (float)resolution.y, bounds.y + kPickMargin * (1.0f + fabsf(bounds.y)), (float)resolution.x };
+	const float rayOrigin[3] = { origin.x, origin.y, origin.z };
+	const float rayDirection[3] = { direction.x, direction.y, direction.z };
+
+	float tNear = 0.0f;
+	float tFar = FLT_MAX;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		if (fabsf(rayDirection[axis]) < 1e-8f)
+		{
+			if (rayOrigin[axis] < boxMin[axis] || rayOrigin[axis] > boxMax[axis])
+			{
+				return false;
+			}
+			continue;
+		}
+		float t0 = (boxMin[axis] - rayOrigin[axis]) / rayDirection[axis];
+		float t1 = (boxMax[axis] - rayOrigin[axis]) / rayDirection[axis];
+		if (t0 > t1)
+		{
+			std::swap(t0, t1);
+		}
+		tNear = (std::max)(tNear, t0);
+		tFar = (std::min)(tFar, t1);
+		if (tNear > tFar)
+		{
+			return false;
+		}
+	}
+
+	// above the terrain at t
+	auto above = [&](float t)
+	{
+		return origin.y + direction.y * t > SampleHeight(heightField, origin.z + direction.z * t, origin.x + direction.x * t);
+	};
+
+	if (!above(tNear))
+	{
+		return false; // starts under the terrain
+	}
+
+	// half a point across the map at a time, a single step for a ray straight down
+	const float across = sqrtf(direction.x * direction.x + direction.z * direction.z);
+	const float step = across > 1e-6f ? 0.5f / across : tFar - tNear;
+	float tAbove = tNear;
+	for (float t = tNear + step; ; t += step)
+	{
+		const float tEnd = (std::min)(t, tFar);
+		if (!above(tEnd))
+		{
+			// the crossing is between the last point above and this one
+			float tBelow = tEnd;
+			for (int i = 0; i < 16; i++)
+			{
+				const float tMiddle = (tAbove + tBelow) * 0.5f;
+				if (above(tMiddle))
+				{
+					tAbove = tMiddle;
+				}
+				else
+				{
+					tBelow = tMiddle;
+				}
+			}
+			point = XMFLOAT3(origin.x + direction.x * tBelow, origin.y + direction.y * tBelow, origin.z + direction.z * tBelow);
+			return true;
+		}
+		if (tEnd >= tFar)
+		{
+			return false;
+		}
+		tAbove = tEnd;
+	}
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include <vector>
+
+#include "HeightField.h"
+#include "HeightQuadtree.h"
+
+// What a stamp of the brush does to the points under it
+enum BrushType
+{
+	kBrushRaise = 0, // add height
+	kBrushLower, // take height away
+	kBrushSmooth, // towards the average of the 3x3 neighbourhood
+	kBrushFlatten, // towards the height where the stroke started
+	kBrushNoise, // add simplex noise
+	kBrushTypeCount
+};
+
+struct BrushSettings
+{
+	BrushSettings()
+	{
+		type = kBrushRaise;
+		radius = 16.0f;
+		strength = 0.5f;
+		spacing = 0.25f;
+		noiseScale = 0.05f;
+	}
+
+	int type; // BrushType, an int for the combo of the GUI
+	float radius; // in points
+	float strength; // height of a stamp at its centre (raise, lower, noise), or how far it moves to its target (smooth, flatten, up to 1)
+	float spacing; // distance between the stamps of a stroke, in radii
+	float noiseScale; // frequency of the noise brush, per point
+};
+
+// Sculpting brush: a stroke queues round stamps as it moves (spaced along the way, so a fast drag leaves no gaps)
+// and Apply() writes all the stamps queued since the last call at once, so the terrain only does one local edit a frame
+// over the rectangle of the stamps however many there are. The weight of a stamp goes smoothly from 1 at the centre to 0 at the radius
+class TerrainBrush
+{
+public:
+	static const int kStationaryStamps = 30; // stamps per second while the stroke does not move
+	static const float kPickMargin; // over the highest point of the terrain, relative to its height
+
+	TerrainBrush();
+
+	// Start a stroke at (m, n), the flatten brush takes the height there as its target
+	void BeginStroke(const BrushSettings& brushSettings, const HeightField& heightField, float m, float n);
+	// Move the stroke to (m, n) dt seconds after the last move: a stamp every spacing along the way,
+	// or a stamp weighted by dt if it has not moved
+	void MoveStroke(float m, float n, float dt);
+	void EndStroke();
+	bool IsStroking() const { return stroking; }
+
+	bool HasStamps() const { return !stamps.empty(); }
+	// Points changed by the queued stamps, clipped to the height map
+	HeightFieldRect GetStampsRect(const HeightField& heightField) const;
+	// Write the queued stamps into the height map in order and drop them, return how many
+	int Apply(HeightField& heightField);
+	// Stamps applied since the stroke started
+	int GetStrokeStampCount() const { return strokeStamps; }
+
+	// Point where the ray (in the space of the height map: x = n, y = height, z = m) hits the terrain, false if it misses.
+	// It is marched a point at a time between the bounds of the quadtree root and refined by bisection
+	static bool Pick(const HeightField& heightField, const HeightQuadtree& quadtree, const XMFLOAT3& origin, const XMFLOAT3& direction, XMFLOAT3& point);
+	// Height between the points, bilinear
+	static float SampleHeight(const HeightField& heightField, float m, float n);
+
+private:
+	struct Stamp
+	{
+		float m, n;
+		float weight;
+	};
+
+	HeightFieldRect GetStampRect(const HeightField& heightField, const Stamp& stamp) const;
+	void ApplyStamp(HeightField& heightField, const Stamp& stamp);
+
+	BrushSettings settings;
+	bool stroking;
+	float targetHeight; // of the flatten brush
+	float lastM, lastN; // where the last stamp is
+	std::vector<Stamp> stamps; // queued, not applied yet
+	int strokeStamps;
+
+	// Points under a stamp and its border, read before writing it
+	std::vector<float> source;
+	std::vector<float> row;
+};
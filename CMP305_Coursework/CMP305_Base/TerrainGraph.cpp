@@ -0,0 +1,387 @@
+#include "TerrainGraph.h"
+
+#include <chrono>
+#include <cmath>
+
+#include "Hydrology.h"
+#include "Parallel.h"
+#include "ProgressiveGenerator.h"
+#include "Stencil.h"
+#include "TaskScheduler.h"
+#include "TerrainStreamer.h"
+#include "Utils.h"
+
+static const float kPi = 3.14159265f;
+
+const size_t TerrainGraph::kDefaultCacheBudget;
+
+static const TerrainGraph::NodeTypeInfo kTypeInfo[kNodeTypeCount] =
+{
+	// name, inputs, seed, parameters: names, min, max, defaults
+	{ "Noise", 0, true, 4, { "Frequency", "Amplitude", "Octaves", "Ridges" }, { 0.001f, 0.0f, 1.0f, 0.0f }, { 0.05f, 100.0f, 8.0f, 1.0f }, { 0.01f, 20.0f, 6.0f, 0.3f } },
+	{ "Diamond-square", 0, true, 2, { "Min height", "Max height" }, { -50.0f, 0.0f }, { 0.0f, 50.0f }, { -10.0f, 10.0f } },
+	{ "Waves", 0, false, 2, { "Frequency", "Amplitude" }, { 0.0f, 0.0f }, { 0.5f, 20.0f }, { 0.05f, 3.0f } },
+	{ "Fault", 1, true, 3, { "Faults", "Height offset", "Decay" }, { 1.0f, 0.0f, 0.9f }, { 200.0f, 5.0f, 1.0f }, { 50.0f, 1.0f, 0.98f } },
+	{ "Smooth", 1, false, 1, { "Passes" }, { 1.0f }, { 20.0f }, { 2.0f } },
+	{ "Erosion", 1, false, 2, { "Flow threshold", "Depth" }, { 10.0f, 0.0f }, { 5000.0f, 10.0f }, { 200.0f, 2.0f } },
+	{ "Add", 2, false, 2, { "Weight A", "Weight B" }, { -2.0f, -2.0f }, { 2.0f, 2.0f }, { 1.0f, 1.0f } },
+	{ "Max", 2, false, 0, {}, {}, {}, {} },
+	{ "Mask blend", 3, false, 2, { "Mask low", "Mask high" }, { -50.0f, -50.0f }, { 50.0f, 50.0f }, { 0.0f, 10.0f } },
+};
+
+static const char* const kTypeNames[kNodeTypeCount] =
+{
+	kTypeInfo[0].name, kTypeInfo[1].name, kTypeInfo[2].name, kTypeInfo[3].name, kTypeInfo[4].name,
+	kTypeInfo[5].name, kTypeInfo[6].name, kTypeInfo[7].name, kTypeInfo[8].name
+};
+
+// FNV-1a, 64 bits
+static void Hash(unsigned long long& hash, const void* data, size_t size)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 0x100000001B3ull;
+	}
+}
+
+// height(m, n) for every point of field, in tiles of the quantised storage
+template <class Function>
+static void FillPoints(HeightField& field, const Function& function)
+{
+	const int tileSize = QuantisedHeightMap::kTileSize;
+	Parallel::ForTiles(0, field.GetRows(), 0, field.GetColumns(), tileSize, tileSize, [&](int mBegin, int mEnd, int nBegin, int nEnd)
+	{
+		for (int m = mBegin; m < mEnd; m++)
+		{
+			for (int n = nBegin; n < nEnd; n++)
+			{
+				field.Set(m, n, function(m, n));
+			}
+		}
+	});
+}
+
+// output[i] = function(i) for every height of the storage, for the nodes that do not depend on the point
+template <class Function>
+static void ForEachHeight(std::vector<float>& output, const Function& function)
+{
+	Parallel::ForBlocks(0, (int)output.size(), 4096, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			output[i] = function(i);
+		}
+	});
+}
+
+
+TerrainGraph::TerrainGraph()
+	: output(0), cache(std::make_shared<TerrainGraphCache>(kDefaultCacheBudget))
+{
+	AddNode(kNodeDiamondSquare);
+	AddNode(kNodeNoise);
+	AddNode(kNodeAdd);
+	AddNode(kNodeFault);
+	AddNode(kNodeSmooth);
+	AddNode(kNodeErosion);
+}
+
+const TerrainGraph::NodeTypeInfo& TerrainGraph::GetTypeInfo(int type)
+{
+	return kTypeInfo[type];
+}
+
+const char* const* TerrainGraph::GetTypeNames()
+{
+	return kTypeNames;
+}
+
+int TerrainGraph::AddNode(int type)
+{
+	const int count = (int)nodes.size();
+
+	TerrainNode node;
+	node.type = type;
+	node.seed = count + 1;
+	// the last nodes, in order, as the inputs
+	const int inputCount = kTypeInfo[type].inputCount;
+	for (int input = 0; input < TerrainNode::kMaxInputs; input++)
+	{
+		node.inputs[input] = input < inputCount && count - inputCount + input >= 0 ? count - inputCount + input : -1;
+	}
+	nodes.push_back(node);
+	ResetParameters(count);
+
+	output = count;
+	return count;
+}
+
+void TerrainGraph::RemoveLastNode()
+{
+	if (nodes.size() <= 1)
+	{
+		return;
+	}
+	nodes.pop_back();
+	if (output >= (int)nodes.size())
+	{
+		output = (int)nodes.size() - 1;
+	}
+}
+
+void TerrainGraph::ResetParameters(int node)
+{
+	const NodeTypeInfo& info = kTypeInfo[nodes[node].type];
+	for (int parameter = 0; parameter < TerrainNode::kMaxParameters; parameter++)
+	{
+		nodes[node].parameters[parameter] = parameter < info.parameterCount ? info.parameterDefaults[parameter] : 0.0f;
+	}
+}
+
+unsigned long long TerrainGraph::GetHash(int node, XMINT2 resolution, const std::vector<unsigned long long>& hashes) const
+{
+	const TerrainNode& terrainNode = nodes[node];
+	const NodeTypeInfo& info = kTypeInfo[terrainNode.type];
+
+	// only what changes the heights: the unused parameters, seed and inputs of the type are left out
+	unsigned long long hash = 0xCBF29CE484222325ull;
+	Hash(hash, &terrainNode.type, sizeof(terrainNode.type));
+	Hash(hash, &resolution, sizeof(resolution));
+	if (info.usesSeed)
+	{
+		Hash(hash, &terrainNode.seed, sizeof(terrainNode.seed));
+	}
+	Hash(hash, terrainNode.parameters, info.parameterCount * sizeof(float));
+	for (int input = 0; input < info.inputCount; input++)
+	{
+		const int source = terrainNode.inputs[input];
+		const unsigned long long inputHash = source >= 0 && source < node ? hashes[source] : 0;
+		Hash(hash, &inputHash, sizeof(inputHash));
+	}
+	return hash;
+}
+
+HeightField TerrainGraph::Evaluate(XMINT2 resolution)
+{
+	const int count = (int)nodes.size();
+
+	// content hashes, every input is before its node
+	std::vector<unsigned long long> hashes(count);
+	for (int node = 0; node < count; node++)
+	{
+		hashes[node] = GetHash(node, resolution, hashes);
+	}
+
+	// nodes the output depends on, from the cache or to compute. The inputs of a node in the cache are not needed.
+	// The outputs found are held until the end, so the cache can drop them meanwhile
+	TerrainGraphEvaluation evaluation;
+	evaluation.evaluated.assign(count, 0);
+	evaluation.milliseconds.assign(count, 0.0f);
+	NodeOutputs outputs(count);
+	std::vector<bool> needed(count, false);
+	needed[output] = true;
+	for (int node = output; node >= 0; node--)
+	{
+		if (!needed[node])
+		{
+			continue;
+		}
+		outputs[node] = cache->Find(hashes[node]);
+		if (outputs[node])
+		{
+			evaluation.cachedCount++;
+			continue;
+		}
+		for (int input = 0; input < kTypeInfo[nodes[node].type].inputCount; input++)
+		{
+			const int source = nodes[node].inputs[input];
+			if (source >= 0 && source < node)
+			{
+				needed[source] = true;
+			}
+		}
+	}
+
+	// a task for every needed node not in the cache, after the tasks of its inputs.
+	// A node computed changes the hash of every node downstream, so all the tasks end before the one of the output
+	TaskScheduler& scheduler = TaskScheduler::Get();
+	std::vector<TaskHandle> tasks(count);
+	for (int node = 0; node < count; node++)
+	{
+		if (!needed[node] || outputs[node])
+		{
+			continue;
+		}
+
+		std::vector<TaskHandle> dependencies;
+		for (int input = 0; input < kTypeInfo[nodes[node].type].inputCount; input++)
+		{
+			const int source = nodes[node].inputs[input];
+			if (source >= 0 && source < node && tasks[source])
+			{
+				dependencies.push_back(tasks[source]);
+			}
+		}
+		const unsigned long long hash = hashes[node];
+		float& milliseconds = evaluation.milliseconds[node];
+		tasks[node] = scheduler.Submit([this, node, resolution, hash, &outputs, &milliseconds]()
+		{
+			EvaluateNode(node, resolution, hash, outputs, milliseconds);
+		}, dependencies);
+		evaluation.evaluated[node] = 1;
+		evaluation.evaluatedCount++;
+	}
+	scheduler.Wait(tasks[output]);
+
+	outputHeights = outputs[output];
+	cache->SetLastEvaluation(evaluation);
+	return HeightField(outputHeights->data(), resolution);
+}
+
+void TerrainGraph::EvaluateNode(int node, XMINT2 resolution, unsigned long long hash, NodeOutputs& outputs, float& milliseconds) const
+{
+	const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	const TerrainNode& terrainNode = nodes[node];
+	const float* parameters = terrainNode.parameters;
+	const int storageSize = HeightField::GetStorageSize(resolution);
+
+	// the heights of the inputs, flat at 0 if not connected
+	std::shared_ptr<std::vector<float>> inputs[TerrainNode::kMaxInputs];
+	for (int input = 0; input < kTypeInfo[terrainNode.type].inputCount; input++)
+	{
+		const int source = terrainNode.inputs[input];
+		inputs[input] = source >= 0 && source < node ? outputs[source] : nullptr;
+		if (!inputs[input])
+		{
+			inputs[input] = std::make_shared<std::vector<float>>(storageSize, 0.0f);
+		}
+	}
+
+	// a new vector, the outputs in the cache are never written again
+	std::shared_ptr<std::vector<float>> heights = std::make_shared<std::vector<float>>(storageSize, 0.0f);
+	HeightField field(heights->data(), resolution);
+
+	switch (terrainNode.type)
+	{
+	case kNodeNoise:
+	{
+		StreamingTerrainSettings settings;
+		settings.seed = terrainNode.seed;
+		settings.frequency = parameters[0];
+		settings.amplitude = parameters[1];
+		settings.octaves = (int)parameters[2];
+		settings.ridgeWeight = parameters[3];
+		FillPoints(field, [&](int m, int n) { return TerrainStreamer::SampleHeight(settings, (float)n, (float)m); });
+		break;
+	}
+	case kNodeDiamondSquare:
+	{
+		Range heightRange;
+		heightRange.min = parameters[0];
+		heightRange.max = parameters[1];
+		ProgressiveGenerator::BuildDiamondSquare(terrainNode.seed, heightRange, field);
+		break;
+	}
+	case kNodeWaves:
+	{
+		// three octaves of sin along m and cos along n
+		const float frequency = parameters[0];
+		const float amplitude = parameters[1];
+		FillPoints(field, [&](int m, int n)
+		{
+			float height = 0.0f;
+			for (int octave = 0; octave < 3; octave++)
+			{
+				const float scale = (float)(1 << octave);
+				height += amplitude / scale * (sinf(m * frequency * scale) + cosf(n * frequency * scale));
+			}
+			return height;
+		});
+		break;
+	}
+	case kNodeFault:
+	{
+		// the faults of TerrainMesh::Fault() with hash randoms, so the same seed gives the same faults
+		const int faults = (int)parameters[0];
+		const std::vector<float>& source = *inputs[0];
+		*heights = source;
+		std::vector<XMFLOAT4> lines(faults); // point (x, y), direction (z, w)
+		std::vector<float> offsets(faults);
+		float offset = parameters[1];
+		for (int fault = 0; fault < faults; fault++)
+		{
+			const float angle = 2.0f * kPi * Utils::GetPointRandom(terrainNode.seed, fault, 2);
+			lines[fault] = XMFLOAT4(Utils::GetPointRandom(terrainNode.seed, fault, 0) * resolution.x,
+				Utils::GetPointRandom(terrainNode.seed, fault, 1) * resolution.y, cosf(angle), sinf(angle));
+			offsets[fault] = offset;
+			offset *= parameters[2];
+		}
+		FillPoints(field, [&](int m, int n)
+		{
+			float height = field.Get(m, n);
+			for (int fault = 0; fault < faults; fault++)
+			{
+				const XMFLOAT4& line = lines[fault];
+				const bool left = (m - line.x) * line.w - (n - line.y) * line.z > 0.0f;
+				height += left ? offsets[fault] : -offsets[fault];
+			}
+			return height;
+		});
+		break;
+	}
+	case kNodeSmooth:
+	{
+		*heights = *inputs[0];
+		for (int pass = 0; pass < (int)parameters[0]; pass++)
+		{
+			Stencil::Apply<StencilBoxKernel, StencilClamp>(field, field);
+		}
+		break;
+	}
+	case kNodeErosion:
+	{
+		*heights = *inputs[0];
+		HydrologyMaps hydrologyMaps;
+		Hydrology::Analyse(field, hydrologyMaps);
+		Hydrology::CarveRivers(field, hydrologyMaps, parameters[0], parameters[1]);
+		break;
+	}
+	case kNodeAdd:
+	{
+		const std::vector<float>& a = *inputs[0];
+		const std::vector<float>& b = *inputs[1];
+		const float weightA = parameters[0];
+		const float weightB = parameters[1];
+		ForEachHeight(*heights, [&](int i) { return weightA * a[i] + weightB * b[i]; });
+		break;
+	}
+	case kNodeMax:
+	{
+		const std::vector<float>& a = *inputs[0];
+		const std::vector<float>& b = *inputs[1];
+		ForEachHeight(*heights, [&](int i) { return (std::max)(a[i], b[i]); });
+		break;
+	}
+	case kNodeMaskBlend:
+	{
+		const std::vector<float>& a = *inputs[0];
+		const std::vector<float>& b = *inputs[1];
+		const std::vector<float>& mask = *inputs[2];
+		const float low = parameters[0];
+		const float range = (std::max)(parameters[1] - low, 0.0001f);
+		ForEachHeight(*heights, [&](int i)
+		{
+			const float t = (std::min)((std::max)((mask[i] - low) / range, 0.0f), 1.0f);
+			return a[i] + t * (b[i] - a[i]);
+		});
+		break;
+	}
+	}
+
+	outputs[node] = heights;
+	cache->Add(hash, heights);
+	milliseconds = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <memory>
+#include <vector>
+
+#include "HeightField.h"
+#include "TerrainGraphCache.h"
+
+// Kinds of node of the TerrainGraph
+enum TerrainNodeType
+{
+	// generators, no inputs
+	kNodeNoise = 0, // fBm with ridges, the noise of the infinite terrain
+	kNodeDiamondSquare, // the diamond-square of the progressive generation
+	kNodeWaves, // sin and cos waves along m and n
+	// modifiers of one input
+	kNodeFault, // faults through the map, each one moving each side up or down
+	kNodeSmooth, // box filter passes
+	kNodeErosion, // river channels carved by the hydrology
+	// combiners of two inputs (and a mask)
+	kNodeAdd, // weighted sum
+	kNodeMax, // highest of both
+	kNodeMaskBlend, // from the first to the second input where the mask goes from its low to its high height
+	kNodeTypeCount
+};
+
+// A node of the graph: what it computes
+struct TerrainNode
+{
+	static const int kMaxInputs = 3;
+	static const int kMaxParameters = 4;
+
+	int type; // TerrainNodeType, an int for the combo of the GUI
+	int seed;
+	float parameters[kMaxParameters];
+	int inputs[kMaxInputs]; // index of an earlier node, -1 if not connected
+};
+
+// Terrain described as a graph of nodes instead of a sequence of operations on the height map.
+// The outputs of the nodes are kept in a TerrainGraphCache with a hash of their type, seed, parameters, resolution and the hashes
+// of their inputs, so an evaluation only computes the nodes whose hash is not there: the one edited and the ones downstream of it.
+// The nodes to compute are tasks of the TaskScheduler that depend on the tasks of their inputs, so independent branches
+// run at the same time. The inputs of a node are always earlier nodes, so there are no cycles.
+// A copy of the graph shares its cache, so it can be evaluated on a worker (TerrainMesh::SetHeights) while this one is edited
+class TerrainGraph
+{
+public:
+	// Information of a node type for the GUI
+	struct NodeTypeInfo
+	{
+		const char* name;
+		int inputCount;
+		bool usesSeed;
+		int parameterCount;
+		const char* parameterNames[TerrainNode::kMaxParameters];
+		float parameterMin[TerrainNode::kMaxParameters];
+		float parameterMax[TerrainNode::kMaxParameters];
+		float parameterDefaults[TerrainNode::kMaxParameters];
+	};
+
+	// A diamond-square and a noise added, faulted, smoothed and eroded
+	TerrainGraph();
+
+	static const NodeTypeInfo& GetTypeInfo(int type);
+	static const char* const* GetTypeNames();
+
+	// Add a node of type with its default parameters and the last nodes as inputs, return its index
+	int AddNode(int type);
+	// Remove the last node (not the only one), the output moves to the new last one if it was that one
+	void RemoveLastNode();
+	// Reset the parameters of a node to the defaults of its type (after the type changes)
+	void ResetParameters(int node);
+
+	int GetNodeCount() const { return (int)nodes.size(); }
+	TerrainNode& GetNode(int node) { return nodes[node]; }
+	const TerrainNode& GetNode(int node) const { return nodes[node]; }
+	int GetOutput() const { return output; }
+	void SetOutput(int node) { output = node; }
+
+	// Compute the output node at resolution, reusing every node whose output is in the cache.
+	// The view is valid until the next evaluation of this graph
+	HeightField Evaluate(XMINT2 resolution);
+	// Of the last evaluation of this graph or of any of its copies
+	TerrainGraphEvaluation GetLastEvaluation() const { return cache->GetLastEvaluation(); }
+	TerrainGraphCache& GetCache() { return *cache; }
+
+	// Budget of the cache of a new graph
+	static const size_t kDefaultCacheBudget = 256 * 1024 * 1024;
+
+private:
+	typedef std::vector<std::shared_ptr<std::vector<float>>> NodeOutputs;
+
+	unsigned long long GetHash(int node, XMINT2 resolution, const std::vector<unsigned long long>& hashes) const;
+	// Compute the node into outputs[node] from the outputs of its inputs and add it to the cache
+	void EvaluateNode(int node, XMINT2 resolution, unsigned long long hash, NodeOutputs& outputs, float& milliseconds) const;
+
+	std::vector<TerrainNode> nodes;
+	int output;
+	std::shared_ptr<TerrainGraphCache> cache;
+	std::shared_ptr<std::vector<float>> outputHeights; // of the last Evaluate(), its view reads it
+};
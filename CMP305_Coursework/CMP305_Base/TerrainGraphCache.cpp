@@ -0,0 +1,93 @@
+#include "TerrainGraphCache.h"
+
+#include <algorithm>
+
+
+TerrainGraphCache::TerrainGraphCache(size_t iBudget)
+	: budget(iBudget), bytes(0), useCount(0)
+{
+}
+
+std::shared_ptr<std::vector<float>> TerrainGraphCache::Find(unsigned long long hash)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	for (Entry& entry : entries)
+	{
+		if (entry.hash == hash)
+		{
+			entry.lastUse = ++useCount;
+			return entry.heights;
+		}
+	}
+	return nullptr;
+}
+
+void TerrainGraphCache::Add(unsigned long long hash, const std::shared_ptr<std::vector<float>>& heights)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	for (Entry& entry : entries)
+	{
+		if (entry.hash == hash)
+		{
+			// computed again by another copy of the graph, the same heights
+			entry.lastUse = ++useCount;
+			return;
+		}
+	}
+
+	Entry entry;
+	entry.hash = hash;
+	entry.heights = heights;
+	entry.lastUse = ++useCount;
+	entries.push_back(entry);
+	bytes += heights->size() * sizeof(float);
+	Trim();
+}
+
+void TerrainGraphCache::SetBudget(size_t newBudget)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	budget = newBudget;
+	Trim();
+}
+
+size_t TerrainGraphCache::GetBudget() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return budget;
+}
+
+size_t TerrainGraphCache::GetBytes() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return bytes;
+}
+
+int TerrainGraphCache::GetEntryCount() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return (int)entries.size();
+}
+
+void TerrainGraphCache::SetLastEvaluation(const TerrainGraphEvaluation& evaluation)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	lastEvaluation = evaluation;
+}
+
+TerrainGraphEvaluation TerrainGraphCache::GetLastEvaluation() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return lastEvaluation;
+}
+
+void TerrainGraphCache::Trim()
+{
+	while (bytes > budget && !entries.empty())
+	{
+		const std::vector<Entry>::iterator oldest = std::min_element(entries.begin(), entries.end(),
+			[](const Entry& a, const Entry& b) { return a.lastUse < b.lastUse; });
+		bytes -= oldest->heights->size() * sizeof(float);
+		entries.erase(oldest);
+	}
+}
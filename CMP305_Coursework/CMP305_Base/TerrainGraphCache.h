@@ -0,0 +1,58 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Nodes computed and reused by an evaluation of a TerrainGraph
+struct TerrainGraphEvaluation
+{
+	TerrainGraphEvaluation() : evaluatedCount(0), cachedCount(0) {}
+
+	std::vector<unsigned char> evaluated; // per node, 0 if it was in the cache or not needed
+	std::vector<float> milliseconds; // per node, time of its evaluation
+	int evaluatedCount;
+	int cachedCount;
+};
+
+// Outputs of the nodes of a TerrainGraph by the content hash of everything they were computed from.
+// It is shared by a graph and its copies, so a copy evaluated by a terrain job fills the cache of the graph the GUI edits.
+// Over the byte budget the outputs used least recently are dropped; an evaluation holds the ones it uses until it ends,
+// so they can go over the budget for that long. Every function can be called from any thread
+class TerrainGraphCache
+{
+public:
+	explicit TerrainGraphCache(size_t budget);
+
+	// The output with the hash, null if it is not in the cache
+	std::shared_ptr<std::vector<float>> Find(unsigned long long hash);
+	// Keep an output, the ones used least recently are dropped if it goes over the budget
+	void Add(unsigned long long hash, const std::shared_ptr<std::vector<float>>& heights);
+
+	void SetBudget(size_t bytes);
+	size_t GetBudget() const;
+	// Bytes of the outputs kept and their number
+	size_t GetBytes() const;
+	int GetEntryCount() const;
+
+	// Of the last evaluation that has ended, by the graph or any of its copies
+	void SetLastEvaluation(const TerrainGraphEvaluation& evaluation);
+	TerrainGraphEvaluation GetLastEvaluation() const;
+
+private:
+	struct Entry
+	{
+		unsigned long long hash;
+		std::shared_ptr<std::vector<float>> heights;
+		unsigned long long lastUse;
+	};
+
+	// Drop the entries used least recently until the bytes are within the budget, the mutex is held
+	void Trim();
+
+	mutable std::mutex mutex;
+	std::vector<Entry> entries; // a few per node of the graph, searched in order
+	size_t budget;
+	size_t bytes;
+	unsigned long long useCount;
+	TerrainGraphEvaluation lastEvaluation;
+};
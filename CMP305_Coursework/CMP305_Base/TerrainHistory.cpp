@@ -0,0 +1,438 @@
+#include "TerrainHistory.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+#include "Parallel.h"
+
+
+void HistoryTile::Read(float* destination) const
+{
+	if (IsCompressed())
+	{
+		for (int i = 0; i < TerrainHistory::kTilePoints; i++)
+		{
+			destination[i] = offset + step * codes[i];
+		}
+	}
+	else if (heights.size() == 1)
+	{
+		std::fill_n(destination, TerrainHistory::kTilePoints, heights[0]);
+	}
+	else
+	{
+		std::copy(heights.begin(), heights.end(), destination);
+	}
+}
+
+bool HistoryTile::Matches(const float* source) const
+{
+	if (IsCompressed())
+	{
+		return false;
+	}
+	if (heights.size() == 1)
+	{
+		return std::all_of(source, source + TerrainHistory::kTilePoints, [this](float height) { return height == heights[0]; });
+	}
+	return std::equal(heights.begin(), heights.end(), source);
+}
+
+
+TerrainHistory::TerrainHistory()
+	: resolution(0, 0), tileRows(0), tileColumns(0), position(0), budget(256 * 1024 * 1024), bytes(0), compress(true), maxError(0.001f), editing(false), editMerge(false)
+{
+}
+
+void TerrainHistory::Resize(XMINT2 newResolution)
+{
+	resolution = newResolution;
+	tileRows = (resolution.x + kTileSize) / kTileSize; // resolution + 1 points
+	tileColumns = (resolution.y + kTileSize) / kTileSize;
+	Clear();
+}
+
+void TerrainHistory::Clear()
+{
+	entries.clear();
+	position = 0;
+	latest.assign(tileRows * tileColumns, nullptr);
+	references.clear();
+	compressedTiles.clear();
+	bytes = 0;
+	editing = false;
+	editTiles.clear();
+	editBefore.clear();
+}
+
+void TerrainHistory::SetBudget(size_t newBudget)
+{
+	budget = newBudget;
+	Trim();
+}
+
+void TerrainHistory::SetCompression(bool newCompress, float newMaxError)
+{
+	// the copies made with another error are not reused
+	if (newMaxError != maxError)
+	{
+		compressedTiles.clear();
+	}
+	compress = newCompress;
+	maxError = newMaxError;
+	Trim();
+}
+
+void TerrainHistory::BeginEdit(const std::string& name, const HeightField& field, const HeightFieldRect& rect, bool merge)
+{
+	editing = true;
+	editName = name;
+	editMerge = merge;
+	editTiles.clear();
+	editBefore.clear();
+
+	const HeightFieldRect clipped = field.Clip(rect);
+	if (clipped.IsEmpty())
+	{
+		return;
+	}
+	std::vector<float> heights(kTilePoints);
+	for (int tileM = clipped.mMin / kTileSize; tileM <= clipped.mMax / kTileSize; tileM++)
+	{
+		for (int tileN = clipped.nMin / kTileSize; tileN <= clipped.nMax / kTileSize; tileN++)
+		{
+			const int tile = tileN + tileM * tileColumns;
+			ReadTile(field, tile, heights.data());
+			editTiles.push_back(tile);
+			editBefore.push_back(MakeTile(tile, heights.data()));
+		}
+	}
+}
+
+void TerrainHistory::EndEdit(const HeightField& field)
+{
+	if (!editing)
+	{
+		return;
+	}
+	editing = false;
+
+	// the tiles under the rectangle that have really changed
+	Entry entry;
+	entry.name = editName;
+	entry.compressed = false;
+	std::vector<float> heights(kTilePoints);
+	for (size_t i = 0; i < editTiles.size(); i++)
+	{
+		ReadTile(field, editTiles[i], heights.data());
+		if (editBefore[i]->Matches(heights.data()))
+		{
+			continue;
+		}
+		entry.tiles.push_back(editTiles[i]);
+		entry.before.push_back(editBefore[i]);
+		entry.after.push_back(MakeTile(editTiles[i], heights.data()));
+	}
+	editTiles.clear();
+	editBefore.clear();
+
+	if (editMerge && position > 0 && position == (int)entries.size() && entries.back().name == editName && !entries.back().compressed)
+	{
+		// the entry keeps its before, the after of every tile is the new one
+		Entry& last = entries.back();
+		for (size_t i = 0; i < entry.tiles.size(); i++)
+		{
+			const std::vector<int>::iterator found = std::lower_bound(last.tiles.begin(), last.tiles.end(), entry.tiles[i]);
+			const size_t index = found - last.tiles.begin();
+			Retain(entry.after[i]);
+			if (found != last.tiles.end() && *found == entry.tiles[i])
+			{
+				Release(entry.tiles[i], last.after[index]);
+				last.after[index] = entry.after[i];
+			}
+			else
+			{
+				Retain(entry.before[i]);
+				last.tiles.insert(found, entry.tiles[i]);
+				last.before.insert(last.before.begin() + index, entry.before[i]);
+				last.after.insert(last.after.begin() + index, entry.after[i]);
+			}
+			latest[entry.tiles[i]] = entry.after[i];
+		}
+		Trim();
+		return;
+	}
+	Push(entry);
+}
+
+void TerrainHistory::Record(const std::string& name, const HeightField& before, const HeightField& after)
+{
+	const int tiles = tileRows * tileColumns;
+	std::vector<HistoryTilePointer> beforeTiles(tiles);
+	std::vector<HistoryTilePointer> afterTiles(tiles);
+	Parallel::ForBlocks(0, tiles, 1, [&](int begin, int end)
+	{
+		std::vector<float> beforeHeights(kTilePoints);
+		std::vector<float> afterHeights(kTilePoints);
+		for (int tile = begin; tile < end; tile++)
+		{
+			ReadTile(before, tile, beforeHeights.data());
+			ReadTile(after, tile, afterHeights.data());
+			if (beforeHeights != afterHeights)
+			{
+				beforeTiles[tile] = MakeTile(tile, beforeHeights.data());
+				afterTiles[tile] = MakeTile(tile, afterHeights.data());
+			}
+		}
+	});
+
+	Entry entry;
+	entry.name = name;
+	entry.compressed = false;
+	for (int tile = 0; tile < tiles; tile++)
+	{
+		if (beforeTiles[tile])
+		{
+			entry.tiles.push_back(tile);
+			entry.before.push_back(beforeTiles[tile]);
+			entry.after.push_back(afterTiles[tile]);
+		}
+	}
+	Push(entry);
+}
+
+void TerrainHistory::GetUndoRects(std::vector<HeightFieldRect>& rects) const
+{
+	rects.clear();
+	if (CanUndo())
+	{
+		GetRects(entries[position - 1], rects);
+	}
+}
+
+void TerrainHistory::GetRedoRects(std::vector<HeightFieldRect>& rects) const
+{
+	rects.clear();
+	if (CanRedo())
+	{
+		GetRects(entries[position], rects);
+	}
+}
+
+bool TerrainHistory::Undo(HeightField& field)
+{
+	if (!CanUndo())
+	{
+		return false;
+	}
+	const Entry& entry = entries[--position];
+	for (size_t i = 0; i < entry.tiles.size(); i++)
+	{
+		WriteTile(field, entry.tiles[i], *entry.before[i]);
+		latest[entry.tiles[i]] = entry.before[i];
+	}
+	return true;
+}
+
+bool TerrainHistory::Redo(HeightField& field)
+{
+	if (!CanRedo())
+	{
+		return false;
+	}
+	const Entry& entry = entries[position++];
+	for (size_t i = 0; i < entry.tiles.size(); i++)
+	{
+		WriteTile(field, entry.tiles[i], *entry.after[i]);
+		latest[entry.tiles[i]] = entry.after[i];
+	}
+	return true;
+}
+
+HeightFieldRect TerrainHistory::GetTileRect(int tile) const
+{
+	const int mMin = (tile / tileColumns) * kTileSize;
+	const int nMin = (tile % tileColumns) * kTileSize;
+	return HeightFieldRect(mMin, nMin, (std::min)(mMin + kTileSize - 1, resolution.x), (std::min)(nMin + kTileSize - 1, resolution.y));
+}
+
+void TerrainHistory::ReadTile(const HeightField& field, int tile, float* heights) const
+{
+	// the points outside the map stay at 0, so they always match
+	const HeightFieldRect rect = GetTileRect(tile);
+	std::fill_n(heights, kTilePoints, 0.0f);
+	for (int m = rect.mMin; m <= rect.mMax; m++)
+	{
+		field.ReadRow(m, rect.nMin, rect.nMax - rect.nMin + 1, &heights[(m - rect.mMin) * kTileSize]);
+	}
+}
+
+void TerrainHistory::WriteTile(HeightField& field, int tile, const HistoryTile& heights) const
+{
+	const HeightFieldRect rect = GetTileRect(tile);
+	float tileHeights[kTilePoints];
+	heights.Read(tileHeights);
+	for (int m = rect.mMin; m <= rect.mMax; m++)
+	{
+		field.WriteRow(m, rect.nMin, rect.nMax - rect.nMin + 1, &tileHeights[(m - rect.mMin) * kTileSize]);
+	}
+}
+
+HistoryTilePointer TerrainHistory::MakeTile(int tile, const float* heights) const
+{
+	// copy-on-write: the heights of the tile have not changed since the last entry that kept them
+	if (latest[tile] && latest[tile]->Matches(heights))
+	{
+		return latest[tile];
+	}
+
+	std::shared_ptr<HistoryTile> newTile = std::make_shared<HistoryTile>();
+	newTile->offset = 0.0f;
+	newTile->step = 0.0f;
+	if (std::all_of(heights, heights + kTilePoints, [heights](float height) { return height == heights[0]; }))
+	{
+		newTile->heights.assign(1, heights[0]);
+	}
+	else
+	{
+		newTile->heights.assign(heights, heights + kTilePoints);
+	}
+	return newTile;
+}
+
+void TerrainHistory::GetRects(const Entry& entry, std::vector<HeightFieldRect>& rects) const
+{
+	for (int tile : entry.tiles)
+	{
+		rects.push_back(GetTileRect(tile));
+	}
+}
+
+void TerrainHistory::Push(Entry& entry)
+{
+	if (entry.tiles.empty())
+	{
+		return;
+	}
+
+	while ((int)entries.size() > position)
+	{
+		ReleaseEntry(entries.back());
+		entries.pop_back();
+	}
+	for (size_t i = 0; i < entry.tiles.size(); i++)
+	{
+		Retain(entry.before[i]);
+		Retain(entry.after[i]);
+		latest[entry.tiles[i]] = entry.after[i];
+	}
+	entries.push_back(std::move(entry));
+	position = (int)entries.size();
+	Trim();
+}
+
+void TerrainHistory::Trim()
+{
+	if (compress)
+	{
+		// 16 bits per point for the tiles of the old entries whose range allows it, once per tile even if shared
+		const auto compressTile = [&](int index, HistoryTilePointer& tile)
+		{
+			if (tile->IsCompressed() || tile->heights.size() == 1)
+			{
+				return;
+			}
+			HistoryTilePointer& compressed = compressedTiles[tile.get()];
+			if (!compressed)
+			{
+				const std::pair<std::vector<float>::const_iterator, std::vector<float>::const_iterator> range = std::minmax_element(tile->heights.begin(), tile->heights.end());
+				const float step = (*range.second - *range.first) / 65535.0f;
+				if (step > 2.0f * maxError)
+				{
+					compressed = tile;
+					return;
+				}
+				std::shared_ptr<HistoryTile> newTile = std::make_shared<HistoryTile>();
+				newTile->offset = *range.first;
+				newTile->step = step;
+				newTile->codes.resize(kTilePoints);
+				for (int i = 0; i < kTilePoints; i++)
+				{
+					newTile->codes[i] = step > 0.0f ? (uint16_t)((tile->heights[i] - newTile->offset) / step + 0.5f) : 0;
+				}
+				compressed = newTile;
+			}
+			if (compressed != tile)
+			{
+				// releasing the exact tile forgets its copy, keep it first
+				const HistoryTilePointer exact = tile;
+				tile = compressed;
+				Retain(tile);
+				Release(index, exact);
+			}
+		};
+		for (int entry = 0; entry < (int)entries.size() - kExactEntries; entry++)
+		{
+			if (entries[entry].compressed)
+			{
+				continue;
+			}
+			for (size_t i = 0; i < entries[entry].tiles.size(); i++)
+			{
+				compressTile(entries[entry].tiles[i], entries[entry].before[i]);
+				compressTile(entries[entry].tiles[i], entries[entry].after[i]);
+			}
+			entries[entry].compressed = true;
+		}
+	}
+
+	// the oldest undo entries first, then the furthest redo ones
+	while (bytes > budget && !entries.empty())
+	{
+		if (position > 0)
+		{
+			ReleaseEntry(entries.front());
+			entries.pop_front();
+			position--;
+		}
+		else
+		{
+			ReleaseEntry(entries.back());
+			entries.pop_back();
+		}
+	}
+}
+
+void TerrainHistory::Retain(const HistoryTilePointer& tile)
+{
+	if (references[tile.get()]++ == 0)
+	{
+		bytes += tile->GetBytes();
+	}
+}
+
+void TerrainHistory::Release(int index, const HistoryTilePointer& tile)
+{
+	const std::unordered_map<const HistoryTile*, int>::iterator found = references.find(tile.get());
+	if (--found->second > 0)
+	{
+		return;
+	}
+	bytes -= tile->GetBytes();
+	references.erase(found);
+	compressedTiles.erase(tile.get());
+	// no entry keeps it, it is not worth its memory to share it with the next one
+	if (latest[index] == tile)
+	{
+		latest[index].reset();
+	}
+}
+
+void TerrainHistory::ReleaseEntry(const Entry& entry)
+{
+	for (size_t i = 0; i < entry.tiles.size(); i++)
+	{
+		Release(entry.tiles[i], entry.before[i]);
+		Release(entry.tiles[i], entry.after[i]);
+	}
+}
@@ -0,0 +1,124 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "HeightField.h"
+
+// Heights of a tile of the height map at some point of the history, never modified once made (copy-on-write):
+// the entries that see the same heights share it. kTilePoints floats, a single one if the tile is flat,
+// or 16-bit codes of offset + code * step once compressed
+struct HistoryTile
+{
+	std::vector<float> heights;
+	std::vector<uint16_t> codes;
+	float offset, step;
+
+	bool IsCompressed() const { return !codes.empty(); }
+	size_t GetBytes() const { return heights.size() * sizeof(float) + codes.size() * sizeof(uint16_t); }
+	// The kTilePoints heights, within the compression error of the ones captured
+	void Read(float* destination) const;
+	// Exactly the same heights as source (kTilePoints floats), never if compressed
+	bool Matches(const float* source) const;
+};
+
+typedef std::shared_ptr<const HistoryTile> HistoryTilePointer;
+
+// Undo and redo of the height map in tiles of QuantisedHeightMap::kTileSize points.
+// An entry only keeps the tiles its operation changed, before and after it, so undoing a local edit
+// only writes a few tiles back. A tile shared by consecutive entries (the after of one, the before of the next) is stored once.
+// The history keeps the newest entries that fit in a memory budget and, if the compression is on, stores the tiles of the older
+// ones with 16 bits per point (within the maximum error, as QuantisedHeightMap). Flat tiles (a flattened map) take a single float
+class TerrainHistory
+{
+public:
+	static const int kTileSize = QuantisedHeightMap::kTileSize;
+	static const int kTilePoints = kTileSize * kTileSize;
+	static const int kExactEntries = 4; // newest entries never compressed
+
+	TerrainHistory();
+
+	// Empty history for a height map of the resolution
+	void Resize(XMINT2 resolution);
+	void Clear();
+
+	void SetBudget(size_t bytes);
+	size_t GetBudget() const { return budget; }
+	void SetCompression(bool compress, float maxError);
+	bool IsCompressing() const { return compress; }
+
+	// An operation on field about to write rect: keep the tiles under it, until EndEdit().
+	// With merge, an entry of the same name just before takes its changes instead of a new one (animations, strokes of a drag)
+	void BeginEdit(const std::string& name, const HeightField& field, const HeightFieldRect& rect, bool merge = false);
+	bool IsEditing() const { return editing; }
+	// The operation has finished: add an entry with the tiles it has changed (none if nothing has changed)
+	void EndEdit(const HeightField& field);
+	// An operation that wrote after instead of before (a job on the back height map), both of the same resolution.
+	// Every tile is compared, in parallel
+	void Record(const std::string& name, const HeightField& before, const HeightField& after);
+
+	bool CanUndo() const { return position > 0; }
+	bool CanRedo() const { return position < (int)entries.size(); }
+	const std::string& GetUndoName() const { return entries[position - 1].name; }
+	const std::string& GetRedoName() const { return entries[position].name; }
+	// Rectangles of the tiles the next Undo()/Redo() writes
+	void GetUndoRects(std::vector<HeightFieldRect>& rects) const;
+	void GetRedoRects(std::vector<HeightFieldRect>& rects) const;
+	// Write the tiles of the entry back into field, false if there is none
+	bool Undo(HeightField& field);
+	bool Redo(HeightField& field);
+
+	int GetEntryCount() const { return (int)entries.size(); }
+	int GetPosition() const { return position; } // entries that can be undone
+	// Bytes of all the tiles kept, each shared tile once
+	size_t GetBytes() const { return bytes; }
+
+private:
+	struct Entry
+	{
+		std::string name;
+		std::vector<int> tiles; // in increasing order
+		std::vector<HistoryTilePointer> before;
+		std::vector<HistoryTilePointer> after;
+		bool compressed;
+	};
+
+	HeightFieldRect GetTileRect(int tile) const;
+	void ReadTile(const HeightField& field, int tile, float* heights) const;
+	void WriteTile(HeightField& field, int tile, const HistoryTile& heights) const;
+	// The tile with the heights, shared with the latest one kept for it if it matches
+	HistoryTilePointer MakeTile(int tile, const float* heights) const;
+	void GetRects(const Entry& entry, std::vector<HeightFieldRect>& rects) const;
+	// Drop the redo entries and add entry
+	void Push(Entry& entry);
+	// Compress the old entries and drop the oldest ones until the history fits in the budget
+	void Trim();
+	// Count the entries that keep a tile, its bytes count while there is one
+	void Retain(const HistoryTilePointer& tile);
+	void Release(int index, const HistoryTilePointer& tile);
+	void ReleaseEntry(const Entry& entry);
+
+	XMINT2 resolution;
+	int tileRows, tileColumns;
+	std::deque<Entry> entries;
+	int position; // entries [0, position) can be undone, the rest redone
+	std::vector<HistoryTilePointer> latest; // current heights of every tile, if kept by an entry
+	std::unordered_map<const HistoryTile*, int> references; // entries keeping every tile
+	// Compressed copy of the exact tiles kept, so the entries sharing a tile share its copy too
+	// even if they are compressed by different calls to Trim()
+	std::unordered_map<const HistoryTile*, HistoryTilePointer> compressedTiles;
+	size_t budget;
+	size_t bytes;
+	bool compress;
+	float maxError;
+
+	// Edit in progress
+	bool editing;
+	std::string editName;
+	bool editMerge;
+	std::vector<int> editTiles;
+	std::vector<HistoryTilePointer> editBefore;
+};
@@ -0,0 +1,139 @@
+#include "TerrainJobs.h"
+
+
+void TerrainEdit::Begin(const HeightField& field, const HeightFieldRect& editRect)
+{
+	rect = editRect;
+	const int columns = rect.nMax - rect.nMin + 1;
+	delta.resize(rect.GetArea());
+	for (int m = rect.mMin; m <= rect.mMax; m++)
+	{
+		field.ReadRow(m, rect.nMin, columns, &delta[(m - rect.mMin) * columns]);
+	}
+}
+
+void TerrainEdit::End(const HeightField& field)
+{
+	const int columns = rect.nMax - rect.nMin + 1;
+	std::vector<float> row(columns);
+	for (int m = rect.mMin; m <= rect.mMax; m++)
+	{
+		field.ReadRow(m, rect.nMin, columns, row.data());
+		float* rowDelta = &delta[(m - rect.mMin) * columns];
+		for (int i = 0; i < columns; i++)
+		{
+			rowDelta[i] = row[i] - rowDelta[i];
+		}
+	}
+}
+
+void TerrainEdit::ApplyTo(HeightField& field) const
+{
+	const int columns = rect.nMax - rect.nMin + 1;
+	std::vector<float> row(columns);
+	for (int m = rect.mMin; m <= rect.mMax; m++)
+	{
+		field.ReadRow(m, rect.nMin, columns, row.data());
+		const float* rowDelta = &delta[(m - rect.mMin) * columns];
+		for (int i = 0; i < columns; i++)
+		{
+			row[i] += rowDelta[i];
+		}
+		field.WriteRow(m, rect.nMin, columns, row.data());
+	}
+}
+
+
+TerrainJobQueue::TerrainJobQueue()
+	: running(false), field(nullptr, XMINT2(0, 0)), finished(false)
+{
+}
+
+TerrainJobQueue::~TerrainJobQueue()
+{
+	CancelAll();
+	if (running)
+	{
+		Collect();
+	}
+}
+
+void TerrainJobQueue::Push(const std::string& name, const TerrainJobFunction& function)
+{
+	Job job;
+	job.name = name;
+	job.function = function;
+	pending.push_back(job);
+}
+
+bool TerrainJobQueue::StartNext(const HeightField& jobField)
+{
+	if (running || pending.empty())
+	{
+		return false;
+	}
+
+	// the worker only reads the members set here, the render thread does not touch them until Collect()
+	runningName = pending.front().name;
+	runningFunction = pending.front().function;
+	pending.pop_front();
+	field = jobField;
+	progress.Reset();
+	finished = false;
+	running = true;
+
+	task = TaskScheduler::Get().SubmitBackground([this]()
+	{
+		runningFunction(field, progress);
+		progress.SetRange(1.0f, 1.0f); // all done
+		finished = true;
+	});
+	return true;
+}
+
+bool TerrainJobQueue::Collect()
+{
+	if (!running)
+	{
+		return false;
+	}
+
+	TaskScheduler::Get().Wait(task);
+	task.reset();
+	running = false;
+	runningFunction = TerrainJobFunction();
+
+	// the result of a cancelled job is discarded, and the edits with it
+	const bool completed = !progress.IsCancelled();
+	if (completed)
+	{
+		for (const TerrainEdit& edit : edits)
+		{
+			edit.ApplyTo(field);
+		}
+	}
+	edits.clear();
+	return completed;
+}
+
+void TerrainJobQueue::AddEdit(const TerrainEdit& edit)
+{
+	if (running && !edit.rect.IsEmpty())
+	{
+		edits.push_back(edit);
+	}
+}
+
+void TerrainJobQueue::Cancel()
+{
+	if (running)
+	{
+		progress.Cancel();
+	}
+}
+
+void TerrainJobQueue::CancelAll()
+{
+	pending.clear();
+	Cancel();
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "HeightField.h"
+#include "TaskScheduler.h"
+
+// Progress of a terrain job, shared between the worker that runs it and the render thread
+class TerrainJobProgress
+{
+public:
+	TerrainJobProgress() : fraction(0.0f), cancelled(false), rangeBegin(0.0f), rangeEnd(1.0f) {}
+
+	// Written by the job: done part in [0, 1] of the current range
+	void Set(float done) { fraction = rangeBegin + done * (rangeEnd - rangeBegin); }
+	float Get() const { return fraction; }
+	// Part of the whole job that Set() covers from now on, for a job made of steps that report their own progress
+	void SetRange(float begin, float end) { rangeBegin = begin; rangeEnd = end; fraction = begin; }
+
+	// The job checks it between rows (or steps) and returns as soon as it is set, its result is then discarded
+	bool IsCancelled() const { return cancelled; }
+	// The same flag for the functions that take one (Hydrology)
+	const std::atomic<bool>* GetCancelFlag() const { return &cancelled; }
+	void Cancel() { cancelled = true; }
+	void Reset() { fraction = 0.0f; cancelled = false; rangeBegin = 0.0f; rangeEnd = 1.0f; }
+
+private:
+	std::atomic<float> fraction;
+	std::atomic<bool> cancelled;
+	float rangeBegin, rangeEnd; // only used by the job
+};
+
+// Change made by a local edit to the front height map while a job (or the refinement) works on its own copy of it:
+// the heights after the edit minus the ones before, row by row over rect. Added to the result of the job, both are kept
+struct TerrainEdit
+{
+	HeightFieldRect rect;
+	std::vector<float> delta;
+
+	// Keep the heights of editRect before the edit
+	void Begin(const HeightField& field, const HeightFieldRect& editRect);
+	// Take them away from the heights after it
+	void End(const HeightField& field);
+	// Add the change to field, of the resolution of the edited one
+	void ApplyTo(HeightField& field) const;
+};
+
+// Operation on the whole height map run by a worker thread. It only touches the field it is given
+typedef std::function<void(HeightField&, TerrainJobProgress&)> TerrainJobFunction;
+
+// First in, first out queue of terrain jobs, run one at a time as background tasks of the TaskScheduler.
+// Everything but the job itself runs on the render thread: it pushes the jobs, starts the next one on a back height map
+// and collects the finished job to swap the back height map in
+class TerrainJobQueue
+{
+public:
+	TerrainJobQueue();
+	~TerrainJobQueue(); // cancels and waits for the running job
+
+	void Push(const std::string& name, const TerrainJobFunction& function);
+	int GetPendingCount() const { return (int)pending.size(); }
+
+	// Start the oldest pending job on field if none is running. Return false if there is nothing to start
+	bool StartNext(const HeightField& field);
+	// True from StartNext() until Collect()
+	bool IsRunning() const { return running; }
+	// The running job has returned, Collect() will not wait
+	bool IsFinished() const { return running && finished; }
+	// Wait for the running job and return true if it has completed, false if it was cancelled.
+	// The edits added while it ran are applied to its field first
+	bool Collect();
+
+	// Keep the change of a local edit made to the front height map while the job runs, so the job goes on
+	// and Collect() adds the edit to its result. Nothing is kept if no job is running
+	void AddEdit(const TerrainEdit& edit);
+
+	// Cancel the running job, the pending ones are kept
+	void Cancel();
+	// Cancel the running job and remove the pending ones
+	void CancelAll();
+
+	// Of the running job
+	const std::string& GetName() const { return runningName; }
+	float GetProgress() const { return progress.Get(); }
+
+private:
+	struct Job
+	{
+		std::string name;
+		TerrainJobFunction function;
+	};
+
+	std::deque<Job> pending;
+	std::string runningName;
+	bool running;
+	std::vector<TerrainEdit> edits; // made while the running job works
+
+	// Shared with the task
+	TaskHandle task;
+	HeightField field; // the back height map of the running job
+	TerrainJobFunction runningFunction;
+	TerrainJobProgress progress;
+	std::atomic<bool> finished;
+};
@@ -3,6 +3,7 @@
 #define _USE_MATH_DEFINES // it has to be set the first thing before any include <>
 #include <cmath>
 
+#include <algorithm>
 #include <cstdlib>
 #include <time.h>       /* time */
 
@@ -13,8 +14,24 @@ TerrainMesh::TerrainMesh( ID3D11Device* device, ID3D11DeviceContext* deviceConte
 	srand(time(NULL));
 
 	vertexBuffer = nullptr;
+	heightMap = nullptr;
+	backHeightMap = nullptr;
+	backResolution = XMINT2(0, 0);
+	riverPointsCarved = 0;
+	layersEnabled = false;
+	layerTilesComposited = 0;
+	brushStampsApplied = 0;
+	localEditKept = false;
+	quantisedStorage = false;
+	resolution = XMINT2(0, 0);
+	statisticsDirty = true;
+	tilesRebuilt = 0;
+	drawnPatches = 0;
+	occludedLeaves = 0;
+	tessellationBlocksUploaded = 0;
 
 	Resize(device, deviceContext, iResolution);
+	Regenerate(device, deviceContext);
 
 	emitter = new Emitter(GetRandomPos()); // create emitter and set it in a random pos
 
@@ -23,8 +40,14 @@ TerrainMesh::TerrainMesh( ID3D11Device* device, ID3D11DeviceContext* deviceConte
 
 TerrainMesh::~TerrainMesh()
 {
+	// the running job may still be writing the back height map
+	jobs.CancelAll();
+	jobs.Collect();
+
 	delete[] heightMap;
 	heightMap = 0;
+	delete[] backHeightMap;
+	backHeightMap = nullptr;
 
 	delete emitter;
 	emitter = nullptr;
@@ -34,227 +57,176 @@ TerrainMesh::~TerrainMesh()
 }
 
 
-void TerrainMesh::CreateBuffers(ID3D11Device* device, VertexType* vertices, unsigned long* indices) {
-
-	D3D11_BUFFER_DESC vertexBufferDesc, indexBufferDesc;
-	D3D11_SUBRESOURCE_DATA vertexData, indexData;
-
-	// Set up the description of the dyanmic vertex buffer.
-	vertexBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
-	vertexBufferDesc.ByteWidth = sizeof(VertexType) * vertexCount;
-	vertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-	vertexBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-	vertexBufferDesc.MiscFlags = 0;
-	vertexBufferDesc.StructureByteStride = 0;
-	// Give the subresource structure a pointer to the vertex data.
-	vertexData.pSysMem = vertices;
-	vertexData.SysMemPitch = 0;
-	vertexData.SysMemSlicePitch = 0;
-	// Now create the vertex buffer.
-	device->CreateBuffer(&vertexBufferDesc, &vertexData, &vertexBuffer);
-
-	// Set up the description of the static index buffer.
-	indexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
-	indexBufferDesc.ByteWidth = sizeof(unsigned long) * indexCount;
-	indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-	indexBufferDesc.CPUAccessFlags = 0;
-	indexBufferDesc.MiscFlags = 0;
-	indexBufferDesc.StructureByteStride = 0;
-	// Give the subresource structure a pointer to the index data.
-	indexData.pSysMem = indices;
-	indexData.SysMemPitch = 0;
-	indexData.SysMemSlicePitch = 0;
-
-	// Create the index buffer.
-	device->CreateBuffer(&indexBufferDesc, &indexData, &indexBuffer);
-}
-
-void TerrainMesh::Resize(ID3D11Device* device, ID3D11DeviceContext* deviceContext, XMINT2 newResolution) {
+void TerrainMesh::Resize(ID3D11Device* device, ID3D11DeviceContext* deviceContext, XMINT2 newResolution, ResampleFilter filter) {
 
 	// controlif the resolution has actually changed
 	if (resolution.x == newResolution.x && resolution.y == newResolution.y)
 	{
 		return;
 	}
-	
-	// if it has changed then apply it
-	resolution = newResolution;
 
-	// remove old heightMap
-	delete heightMap;
-	heightMap = nullptr;
-
-	// init new heightMap
-	heightMap = new float[(resolution.x + 1) * (resolution.y + 1)];
-	Flatten();
+	// the terrain is carried to the new resolution, there is nothing to carry the first time
+	const XMINT2 oldResolution = resolution;
+	const bool hasHeights = oldResolution.x > 0 && oldResolution.y > 0;
+	resolution = newResolution;
 
-	// Remove old vertex buffer
-	if (vertexBuffer != NULL)
+	// init new heightMap in the current storage mode, resampled from the old one which is then removed
+	if (quantisedStorage)
 	{
-		vertexBuffer->Release();
+		QuantisedHeightMap newHeightMap;
+		newHeightMap.Resize(resolution, quantisedHeightMap.GetMaxError());
+		HeightField newField(&newHeightMap);
+		if (hasHeights)
+		{
+			HeightResampler::Resample(HeightField(&quantisedHeightMap), newField, filter);
+		}
+		quantisedHeightMap = std::move(newHeightMap);
 	}
-	vertexBuffer = NULL;
-
-	// Init new buffer
-	Regenerate(device, deviceContext);
+	else
+	{
+		float* newHeightMap = new float[HeightField::GetStorageSize(resolution)];
+		HeightField newField(newHeightMap, resolution);
+		if (hasHeights)
+		{
+			HeightResampler::Resample(HeightField(heightMap, oldResolution), newField, filter);
+		}
+		delete[] heightMap;
+		heightMap = newHeightMap;
+	}
+	if (!hasHeights)
+	{
+		// flat right away, Flatten() is a job
+		HeightField heightField = GetHeightField();
+		std::vector<float> row(resolution.y + 1, 0.0f);
+		for (int m = 0; m < resolution.x + 1; m++)
+		{
+			heightField.WriteRow(m, row.data());
+		}
+	}
+	// it cancels the running job, which works on the old resolution. The history is of the old resolution too
+	history.Resize(resolution);
+	SetBaseLayer();
+	MarkHeightMapDirty();
+
+	// Create the tiles, the tessellation factors, the CDLOD heights and the clipmap for the new resolution, all of them dirty
+	tiles.Resize(device, resolution);
+	tessellation.Resize(device, resolution);
+	lodTerrain.Resize(device, resolution);
+	clipmapTerrain.Resize(device, resolution);
 }
 
-// Build quad (with texture coordinates and normals).
-#define cClamp(value, minimum, maximum) (max(min((value),(maximum)),(minimum)))
-void TerrainMesh::Regenerate(ID3D11Device* device, ID3D11DeviceContext* deviceContext)
+void TerrainMesh::SetQuantisedStorage(bool quantised, float maxError)
 {
-	VertexType* vertices;
-	unsigned long* indices;
-	D3D11_BUFFER_DESC vertexBufferDesc, indexBufferDesc;
-	D3D11_SUBRESOURCE_DATA vertexData, indexData;
-
-	float fDepth = static_cast<float>(resolution.x);
-	float fWidth = static_cast<float>(resolution.y);
-
-	vertexCount = (resolution.x + 1) * (resolution.y + 1); // need one more row and column if counting per patch
-	indexCount = resolution.x * resolution.y * 12; // using 12 for seamless
-
-	vertices = new VertexType[vertexCount];
-	indices = new unsigned long[indexCount];
-
-	///////////////// VERTICES //////////////////
-
-	// Load the vertex array with data.
-	for (int m = 0; m < (resolution.x + 1); m++) // x
+	if (quantised == quantisedStorage)
 	{
-		// calculate the v coord for texture
-		float v = static_cast<float>(m) / fDepth;
-
-		for (int n = 0; n < (resolution.y + 1); n++) // y
+		if (quantised && maxError != quantisedHeightMap.GetMaxError())
 		{
-			// calculate the u coord for texture
-			float u = static_cast<float>(n) / fWidth;
-
-			// get vertex index
-			int index = GetHeightMapIndex(m, n);
-			vertices[index].position = XMFLOAT3((float)n, heightMap[index], (float)m);
-			vertices[index].texture = XMFLOAT2(v, u);
-			vertices[index].normal = XMFLOAT3(0.0f, 1.0f, 0.0f); // looking up (+y)
+			quantisedHeightMap.SetMaxError(maxError);
+			MarkHeightMapDirty();
 		}
+		return;
 	}
 
-	///////////////// NORMALS //////////////////
-	//Set up normals
-	for (int m = 0; m < resolution.x; m++)
+	// move the heights row by row to the other storage, the old one is freed
+	HeightField oldField = GetHeightField();
+	std::vector<float> row(resolution.y + 1);
+	if (quantised)
 	{
-		for (int n = 0; n < resolution.y; n++)
+		quantisedHeightMap.Resize(resolution, maxError);
+		HeightField newField(&quantisedHeightMap);
+		for (int m = 0; m < resolution.x + 1; m++)
 		{
-			//Calculate the plane normals
-			XMFLOAT3 a, b, c;	//Three corner vertices
-			a = vertices[GetHeightMapIndex(m, n)].position;
-			b = vertices[GetHeightMapIndex(m, n+1)].position;
-			c = vertices[GetHeightMapIndex(m+1, n)].position;
-
-			//Two edges
-			XMFLOAT3 ab(c.x - a.x, c.y - a.y, c.z - a.z);
-			XMFLOAT3 ac(b.x - a.x, b.y - a.y, b.z - a.z);
-
-			//Calculate the cross product
-			XMFLOAT3 cross;
-			cross.x = ab.y * ac.z - ab.z * ac.y;
-			cross.y = ab.z * ac.x - ab.x * ac.z;
-			cross.z = ab.x * ac.y - ab.y * ac.x;
-			float mag = (cross.x * cross.x) + (cross.y * cross.y) + (cross.z * cross.z);
-			mag = sqrtf(mag);
-			cross.x /= mag;
-			cross.y /= mag;
-			cross.z /= mag;
-			vertices[GetHeightMapIndex(m, n)].normal = cross;
+			oldField.ReadRow(m, row.data());
+			newField.WriteRow(m, row.data());
 		}
+		delete[] heightMap;
+		heightMap = nullptr;
 	}
-
-	///////////////// INDICES //////////////////
-	// Indices Guide for passing 12 control points instead of 4:
-	//			   6 -------- 7
-	//			   |		  |
-	//			   |		  |
-	//			   |		  |
-	//  8 -------- 0 -------- 3 -------- 5
-	//	|		   |		  |			 |
-	//	|		   |		  |			 |
-	//	|		   |		  |			 |
-	//  9 -------- 1 -------- 2 -------- 4
-	//			   |		  |
-	//			   |		  |
-	//			   |		  |
-	//			  10 -------- 11
-	int i = 0;
-	for (int m = 0; m < resolution.x; m++) // x
-	{
-		for (int n = 0; n < resolution.y; n++) // y
+	else
+	{
+		heightMap = new float[HeightField::GetStorageSize(resolution)];
+		HeightField newField(heightMap, resolution);
+		for (int m = 0; m < resolution.x + 1; m++)
 		{
-			// from 0 to 3 are the actual quad (the first 4 indices)
-			// This indices will be in CCW
-			indices[i++] = GetHeightMapIndex(m + 1, n + 0); // 0 - furthest left corner	
-			indices[i++] = GetHeightMapIndex(m + 0, n + 0); // 1 - closest left corner
-			indices[i++] = GetHeightMapIndex(m + 0, n + 1); // 2 - closest right corner
-			indices[i++] = GetHeightMapIndex(m + 1, n + 1); // 3 - fursthest right corner			
+			oldField.ReadRow(m, row.data());
+			newField.WriteRow(m, row.data());
+		}
+		quantisedHeightMap = QuantisedHeightMap();
+	}
+	quantisedStorage = quantised;
 
+	// the quantised heights are not exactly the same
+	MarkHeightMapDirty();
+}
 
-			// Neighbours //
+size_t TerrainMesh::GetHeightMapBytes() const
+{
+	return quantisedStorage ? quantisedHeightMap.GetByteSize() : sizeof(float) * HeightField::GetStorageSize(resolution);
+}
 
-			// 4 and 5 are +n
-			indices[i++] = GetHeightMapIndex(cClamp(m + 0, 0, resolution.x), cClamp(n + 2, 0, resolution.y)); // 4
-			indices[i++] = GetHeightMapIndex(cClamp(m + 1, 0, resolution.x), cClamp(n + 2, 0, resolution.y)); // 5
+void TerrainMesh::Regenerate(ID3D11Device* device, ID3D11DeviceContext* deviceContext)
+{
+	// 4 control points per quad, drawn tile by tile
+	vertexCount = (resolution.x + 1) * (resolution.y + 1);
+	indexCount = tiles.GetPatchCount() * TerrainTiles::kIndicesPerPatch;
 
-			// 6 and 7 are +m
-			indices[i++] = GetHeightMapIndex(cClamp(m + 2, 0, resolution.x), cClamp(n + 0, 0, resolution.y));  // 6
-			indices[i++] = GetHeightMapIndex(cClamp(m + 2, 0, resolution.x), cClamp(n + 1, 0, resolution.y));  // 7
+	// only the tiles touched since the last call are rebuilt
+	tilesRebuilt = tiles.Update(deviceContext, GetHeightField());
+}
 
-			// 8 and 9 are -n
-			indices[i++] = GetHeightMapIndex(cClamp(m + 1, 0, resolution.x), cClamp(n - 1, 0, resolution.y)); // 8
-			indices[i++] = GetHeightMapIndex(cClamp(m + 0, 0, resolution.x), cClamp(n - 1, 0, resolution.y)); // 9
 
-			//10 and 11 are -m
-			indices[i++] = GetHeightMapIndex(cClamp(m - 1, 0, resolution.x), cClamp(n + 0, 0, resolution.y)); // 10
-			indices[i++] = GetHeightMapIndex(cClamp(m - 1, 0, resolution.x), cClamp(n + 1, 0, resolution.y)); // 11
-		}
+void TerrainMesh::Cull(const Frustum* frustum, float heightFloor, const XMFLOAT3* occlusionEye)
+{
+	occludedLeaves = 0;
+	if (occlusionEye)
+	{
+		occlusion.Compute(tiles.GetQuadtree(), *occlusionEye, heightFloor);
+		occludedLeaves = occlusion.GetHiddenLeafCount();
 	}
+	tiles.Cull(frustum, occlusionEye ? &occlusion : nullptr, heightFloor, drawRanges);
 
-	//If we've not yet created our dyanmic Vertex and Index buffers, do that now
-	if (vertexBuffer == nullptr)
+	drawnPatches = 0;
+	for (const TerrainDrawRange& range : drawRanges)
 	{
-		CreateBuffers(device, vertices, indices);
+		drawnPatches += range.indexCount / TerrainTiles::kIndicesPerPatch;
 	}
-	else 
-	{
-		//If we've already made our buffers, update the information
-		D3D11_MAPPED_SUBRESOURCE mappedResource;
-		ZeroMemory(&mappedResource, sizeof(D3D11_MAPPED_SUBRESOURCE));
+}
 
-		//  Disable GPU access to the vertex buffer data.
-		deviceContext->Map(vertexBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-		//  Update the vertex buffer here.
-		memcpy(mappedResource.pData, vertices, sizeof(VertexType) * vertexCount);
-		//  Reenable GPU access to the vertex buffer data.
-		deviceContext->Unmap(vertexBuffer, 0);
-	}
+void TerrainMesh::UpdateTessellation(ID3D11DeviceContext* deviceContext, const XMFLOAT3& eye, const TessellationSettings& settings)
+{
+	tessellationBlocksUploaded = tessellation.Update(deviceContext, GetHeightField(), eye, settings);
+}
 
-	// Release the arrays now that the vertex and index buffers have been created and loaded.
-	delete[] vertices;
-	vertices = 0;
-	delete[] indices;
-	indices = 0;
+void TerrainMesh::SelectLod(ID3D11Device* device, ID3D11DeviceContext* deviceContext, const XMFLOAT3& eye, const Frustum* frustum, float heightFloor,
+	bool occlusionCulling, const CdlodSettings& settings)
+{
+	occludedLeaves = 0;
+	if (occlusionCulling)
+	{
+		occlusion.Compute(tiles.GetQuadtree(), eye, heightFloor);
+		occludedLeaves = occlusion.GetHiddenLeafCount();
+	}
+	lodTerrain.Update(device, deviceContext, GetHeightField(), tiles.GetQuadtree(), eye, frustum, occlusionCulling ? &occlusion : nullptr, heightFloor, settings);
 }
 
+void TerrainMesh::UpdateClipmap(ID3D11Device* device, ID3D11DeviceContext* deviceContext, const XMFLOAT3& eye, const Frustum* frustum, float heightFloor)
+{
+	// the footprints are culled with the bounds of the whole terrain
+	const HeightQuadtree& quadtree = tiles.GetQuadtree();
+	XMFLOAT2 heightBounds(-FLT_MAX, FLT_MAX);
+	if (quadtree.GetLevelCount() > 0)
+	{
+		heightBounds = quadtree.GetBounds(quadtree.GetLevelCount() - 1, 0, 0);
+		heightBounds = XMFLOAT2((std::max)(heightBounds.x, heightFloor), (std::max)(heightBounds.y, heightFloor));
+	}
+	clipmapTerrain.Update(device, deviceContext, GetHeightField(), eye, frustum, heightBounds);
+}
 
 void TerrainMesh::sendData(ID3D11DeviceContext* deviceContext, D3D_PRIMITIVE_TOPOLOGY top)
 {
-	unsigned int stride;
-	unsigned int offset;
-
-	stride = sizeof(VertexType);
-	offset = 0;
-
-	deviceContext->IASetVertexBuffers(0, 1, &vertexBuffer, &stride, &offset);
-	deviceContext->IASetIndexBuffer(indexBuffer, DXGI_FORMAT_R32_UINT, 0);
-	// Set the type of primitive that should be rendered from this vertex buffer, in this case control patch for tessellation.
-	deviceContext->IASetPrimitiveTopology(top);
+	// Set the shared index buffer and the type of primitive that should be rendered, in this case control patch for tessellation.
+	// The vertex buffer is set per tile
+	tiles.SendIndexData(deviceContext, top);
 }
 
 
@@ -266,27 +238,42 @@ void TerrainMesh::sendData(ID3D11DeviceContext* deviceContext, D3D_PRIMITIVE_TOP
 
 void TerrainMesh::BuildSinCosWavesHeightMap(WavesData* wavesData, float dt) {
 
-	float height = 0.0f;
-
 	//Scale everything so that the look is consistent across terrain resolutions
 	const float scaleM = terrainSize / (float)resolution.x;
 	const float scaleN = terrainSize / (float)resolution.y;
 
-	for (int m = 0; m < resolution.x + 1; m++)
+	// in tiles of the quantised tiles, so no two tasks write the same one. The frames of an animation (dt) are not in the history
+	HeightField heightField = GetHeightField();
+	if (dt == 0.0f)
 	{
-		for (int n = 0; n < resolution.y + 1; n++)
+		BeginHistoryEdit("Waves", heightField.GetBounds());
+	}
+	Parallel::ForTiles(0, resolution.x + 1, 0, resolution.y + 1, QuantisedHeightMap::kTileSize, QuantisedHeightMap::kTileSize,
+		[&](int mBegin, int mEnd, int nBegin, int nEnd)
+	{
+		std::vector<float> row(nEnd - nBegin);
+		for (int m = mBegin; m < mEnd; m++)
 		{
-			// Waves along x-axis
-			height = (sin((float)n * wavesData->frequency.x * scaleN + wavesData->offset.x)) * wavesData->amplitude.x; // Waves 1 On x
-			height += (sin((float)n * wavesData->frequency.x * 2.0f * scaleN + wavesData->offset.x)) * wavesData->amplitude.x * 0.5f; // Waves 2 On x (it is half of amplitud1 and double of frequency1)
-			height += (sin((float)n * wavesData->frequency.x * 4.0f * scaleN + wavesData->offset.x)) * wavesData->amplitude.x * 0.25f; // Waves 3 On x (it is half of amplitud2 and double of frequency2)
-			// Waves along z-axis
-			height += (cos((float)m * wavesData->frequency.z * scaleM + wavesData->offset.z)) * wavesData->amplitude.z; // Waves 1 On z
-			height += (cos((float)m * wavesData->frequency.z * 2.0f * scaleM + wavesData->offset.z)) * wavesData->amplitude.z * 0.5f; // Waves 2 On z
-			height += (cos((float)m * wavesData->frequency.z * 4.0f * scaleM + wavesData->offset.z)) * wavesData->amplitude.z * 0.25f; // Waves 3 On z
-			heightMap[GetHeightMapIndex(m, n)] = height;
+			for (int n = nBegin; n < nEnd; n++)
+			{
+				float height;
+				// Waves along x-axis
+				height = (sin((float)n * wavesData->frequency.x * scaleN + wavesData->offset.x)) * wavesData->amplitude.x; // Waves 1 On x
+				height += (sin((float)n * wavesData->frequency.x * 2.0f * scaleN + wavesData->offset.x)) * wavesData->amplitude.x * 0.5f; // Waves 2 On x (it is half of amplitud1 and double of frequency1)
+				height += (sin((float)n * wavesData->frequency.x * 4.0f * scaleN + wavesData->offset.x)) * wavesData->amplitude.x * 0.25f; // Waves 3 On x (it is half of amplitud2 and double of frequency2)
+				// Waves along z-axis
+				height += (cos((float)m * wavesData->frequency.z * scaleM + wavesData->offset.z)) * wavesData->amplitude.z; // Waves 1 On z
+				height += (cos((float)m * wavesData->frequency.z * 2.0f * scaleM + wavesData->offset.z)) * wavesData->amplitude.z * 0.5f; // Waves 2 On z
+				height += (cos((float)m * wavesData->frequency.z * 4.0f * scaleM + wavesData->offset.z)) * wavesData->amplitude.z * 0.25f; // Waves 3 On z
+				row[n - nBegin] = height;
+			}
+			heightField.WriteRow(m, nBegin, nEnd - nBegin, row.data());
 		}
-	}
+	});
+
+	EndHistoryEdit();
+	SetBaseLayer();
+	MarkHeightMapDirty();
 
 	// Apply offset for the next pass if the user wants the waves to be moved
 	if (wavesData->moveWaves[0]) // x
@@ -297,14 +284,16 @@ void TerrainMesh::BuildSinCosWavesHeightMap(WavesData* wavesData, float dt) {
 
 void TerrainMesh::BuildRandomHeightMap(Range heightRange)
 {
-	// The number inside the sin or cos modify the amplitude and the number outside is the Amplitude
-	for (int m = 0; m < resolution.x + 1; m++)
+	// random numbers from a hash of the point and a seed drawn here, so the points can be filled in any order
+	const unsigned int seed = (unsigned int)rand();
+	pipeline.AddPointPass("Random", [heightRange, seed](int m, int nBegin, int count, float* heights)
 	{
-		for (int n = 0; n < resolution.y + 1; n++)
+		for (int i = 0; i < count; i++)
 		{
-			heightMap[GetHeightMapIndex(m, n)] = Utils::GetRandom(heightRange); // random number in the range [min, max]
+			// random number in the range [min, max]
+			heights[i] = heightRange.min + Utils::GetPointRandom(seed, m, nBegin + i) * (heightRange.max - heightRange.min);
 		}
-	}
+	}, true);
 }
 
 
@@ -312,66 +301,104 @@ void TerrainMesh::BuildRandomHeightMap(Range heightRange)
 
 void TerrainMesh::Flatten()
 {
-	for (int m = 0; m < (resolution.x + 1); m++)
+	pipeline.AddPointPass("Flatten", [](int, int, int count, float* heights)
 	{
-		for (int n = 0; n < (resolution.y + 1); n++)
+		std::fill(heights, heights + count, 0.0f);
+	}, true);
+}
+
+void TerrainMesh::ScaleHeights(float factor)
+{
+	pipeline.AddPointPass("Scale", [factor](int, int, int count, float* heights)
+	{
+		for (int i = 0; i < count; i++)
 		{
-			heightMap[GetHeightMapIndex(m, n)] = 0.0f;
+			heights[i] *= factor;
 		}
-	}
+	});
 }
 
-void TerrainMesh::Fault(Range heightOffsetRange)
+void TerrainMesh::ClampHeights(Range heightRange)
 {
-	XMFLOAT3 point1, point2, currentVertex;
-	XMVECTOR faultLine, linkedLine, crossResult;
+	pipeline.AddPointPass("Clamp", [heightRange](int, int, int count, float* heights)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			heights[i] = (std::min)((std::max)(heights[i], heightRange.min), heightRange.max);
+		}
+	});
+}
 
-	point1 = XMFLOAT3(rand() % resolution.x+1, 0.0f, rand() % resolution.y+1); // a random point in the map
-	point2 = XMFLOAT3(point1.x, point1.y, point1.z + 1.0f); // point 2 = point 1 displaced in z-axis
-	faultLine = XMVectorSet(point2.x - point1.x, point2.y - point1.y, point2.z - point1.z, 1.0f); // Line from point 1 to point 2
+void TerrainMesh::Fault(Range heightOffsetRange)
+{
+	// the fault line is drawn here: rand() keeps its state per thread, so it is not called from the job
+	const XMFLOAT3 point1 = XMFLOAT3(rand() % resolution.x+1, 0.0f, rand() % resolution.y+1); // a random point in the map
+	const XMFLOAT3 point2 = XMFLOAT3(point1.x, point1.y, point1.z + 1.0f); // point 2 = point 1 displaced in z-axis
+	XMVECTOR faultLine = XMVectorSet(point2.x - point1.x, point2.y - point1.y, point2.z - point1.z, 1.0f); // Line from point 1 to point 2
 	faultLine = XMVector3Rotate(faultLine, XMQuaternionRotationAxis(XMVectorSet(0.0f, 1.0f, 0.0f, 1.0f), ((rand() % 360) * M_PI) / 180)); // Rotate that line randomly
+	XMFLOAT3 faultDirection;
+	XMStoreFloat3(&faultDirection, faultLine);
 
 	// get the offset to move up and move down
-	float heightOffset = Utils::GetRandom(heightOffsetRange);
+	const float heightOffset = Utils::GetRandom(heightOffsetRange);
 
-	for (int m = 0; m < resolution.x + 1; m++)
+	pipeline.AddPointPass("Fault", [point1, faultDirection, heightOffset](int m, int nBegin, int count, float* heights)
 	{
-		for (int n = 0; n < resolution.y + 1; n++)
+		const XMVECTOR faultLine = XMLoadFloat3(&faultDirection);
+		for (int i = 0; i < count; i++)
 		{
-			currentVertex = XMFLOAT3(m, 0.0f, n); // get the current vertex
-			linkedLine = XMVectorSet(currentVertex.x - point1.x, currentVertex.y - point1.y, currentVertex.z - point1.z, 1.0f); // line from the current vertex to the a point in the fault line (point 1) 
+			const XMFLOAT3 currentVertex = XMFLOAT3(m, 0.0f, nBegin + i); // get the current vertex
+			const XMVECTOR linkedLine = XMVectorSet(currentVertex.x - point1.x, currentVertex.y - point1.y, currentVertex.z - point1.z, 1.0f); // line from the current vertex to the a point in the fault line (point 1) 
 
-			crossResult = XMVector3Cross(faultLine, linkedLine);
+			const XMVECTOR crossResult = XMVector3Cross(faultLine, linkedLine);
 
 			// detect if the current point is in the left or right side of the fault line
 			if (XMVectorGetY(crossResult) > 0) // left side
 			{
 				// move up
-				heightMap[GetHeightMapIndex(m, n)] += heightOffset;
+				heights[i] += heightOffset;
 			}
 			else // right side
 			{
 				// move down
-				heightMap[GetHeightMapIndex(m, n)] -= heightOffset;
+				heights[i] -= heightOffset;
 			}
 		}
-	}
+	});
 }
 
 void TerrainMesh::Smooth()
 {
-	float* smoothedHeightMap = new float[(resolution.x + 1) * (resolution.y + 1)];
+	// Every point is the average of itself and its eight neighbours.
+	// The points outside the map are the nearest ones of the edge
+	//
+	// ---------
+	// | 1| 2| 3|   above
+	// | 4|mn| 6|   row
+	// | 7| 8| 9|   below
+	// ---------
+	pipeline.AddMapPass("Smooth", [](HeightField& heightField, TerrainJobProgress&)
+	{
+		Stencil::Apply<StencilBoxKernel, StencilClamp>(heightField, heightField);
+	});
+}
 
-	for (int m = 0; m < resolution.x+1; m++)
+void TerrainMesh::GaussianSmooth()
+{
+	// the centre and the sides weigh more than the corners, it keeps more of the shape than Smooth()
+	pipeline.AddMapPass("Gaussian smooth", [](HeightField& heightField, TerrainJobProgress&)
 	{
-		for (int n = 0; n < resolution.y+1; n++)
-		{
-			smoothedHeightMap[GetHeightMapIndex(m, n)] = NeighboursAverage(m, n);;
-		}
-	}
+		Stencil::Apply<StencilGaussianKernel, StencilClamp>(heightField, heightField);
+	});
+}
 
-	// replace the old height map with the filtered one
-	heightMap = smoothedHeightMap;
+void TerrainMesh::Sharpen()
+{
+	// mirrored border: a clamped one would sharpen the edge against copies of itself
+	pipeline.AddMapPass("Sharpen", [](HeightField& heightField, TerrainJobProgress&)
+	{
+		Stencil::Apply<StencilSharpenKernel, StencilMirror>(heightField, heightField);
+	});
 }
 
 void TerrainMesh::ParticleDeposition(Range heightRange)
@@ -383,23 +410,16 @@ void TerrainMesh::ParticleDeposition(Range heightRange)
 	int x = (int)particle.position.x;
 	int z = (int)particle.position.z;
 
-	XMFLOAT3 lowest_height_point = particle.position;
-	bool found = false;
-
-	// look throught the possible neighbours of the current point
-	for (int m = x - 1; m <= x + 1; m++)
-	{
-		for (int n = z - 1; n <= z + 1; n++)
-		{
-			if (InBounds(m, n) && heightMap[GetHeightMapIndex(m, n)] < heightMap[GetHeightMapIndex(lowest_height_point.x, lowest_height_point.z)]) // avoid to check the center cell again and check if it is in bounds
-			{
-				lowest_height_point = XMFLOAT3(m, 0.0f, n);// save the new lowest height point
-			}
-		}
-	}
+	// look throught the neighbours of the current point for the lowest one (the centre if there is none lower),
+	// the ones outside the map are clamped to the edge so they are never lower than a point of the map
+	HeightField heightField = GetHeightField();
+	XMINT2 lowestPoint = Stencil::FindNeighbour<StencilClamp>(heightField, x, z, false);
 
 	// add height to the map
-	heightMap[GetHeightMapIndex(lowest_height_point.x, lowest_height_point.z)] += particle.height;
+	HeightFieldRect dirtyRect(lowestPoint.x, lowestPoint.y, lowestPoint.x, lowestPoint.y);
+	BeginLocalEdit(dirtyRect, "Particle deposition");
+	heightField.Set(lowestPoint.x, lowestPoint.y, heightField.Get(lowestPoint.x, lowestPoint.y) + particle.height);
+	EndLocalEdit(dirtyRect);
 }
 
 void TerrainMesh::AntiParticleDeposition(Range heightRange)
@@ -411,207 +431,566 @@ void TerrainMesh::AntiParticleDeposition(Range heightRange)
 	int x = (int)particle.position.x;
 	int z = (int)particle.position.z;
 
-	XMFLOAT3 highest_height_point = particle.position;
-	bool found = false;
+	// look throught the neighbours of the current point for the highest one
+	HeightField heightField = GetHeightField();
+	XMINT2 highestPoint = Stencil::FindNeighbour<StencilClamp>(heightField, x, z, true);
+
+	// substract height to the map
+	HeightFieldRect dirtyRect(highestPoint.x, highestPoint.y, highestPoint.x, highestPoint.y);
+	BeginLocalEdit(dirtyRect, "Anti-particle deposition");
+	heightField.Set(highestPoint.x, highestPoint.y, heightField.Get(highestPoint.x, highestPoint.y) - particle.height);
+	EndLocalEdit(dirtyRect);
+}
+
 
-	// look throught the possible neighbours of the current point
-	for (int m = x - 1; m <= x + 1; m++)
+
+void TerrainMesh::DiamondSquareAlgorithm(Range heightOffsetRange)
+{
+	// the seed is drawn here: rand() keeps its state per thread, so it is not called from the job
+	const unsigned int seed = (unsigned int)rand();
+	// on a square power of two map every point is written, so the passes recorded before it are dropped
+	const bool replacesHeights = resolution.x == resolution.y && IsDiamondSquareResolution(resolution);
+	pipeline.AddMapPass("Diamond-square", [heightOffsetRange, seed](HeightField& heightField, TerrainJobProgress& progress)
 	{
-		for (int n = z - 1; n <= z + 1; n++)
+		const XMINT2 resolution = heightField.GetResolution();
+		if (!IsDiamondSquareResolution(resolution))
 		{
-			if (InBounds(n, m) && heightMap[GetHeightMapIndex(m, n)] > heightMap[GetHeightMapIndex(highest_height_point.x, highest_height_point.z)]) // avoid to check the center cell again and check if it is in bounds
-			{
-				highest_height_point = XMFLOAT3(m, 0.0f, n);// save the new lowest height point
-			}
+			return; // exit this function as the terrain resolution is odd
 		}
-	}
 
-	// substract height to the map
-	heightMap[GetHeightMapIndex(highest_height_point.x, highest_height_point.z)] -= particle.height;
-}
+		// set m and n values
+		int m_start = 0;
+		int m_end = resolution.x;
+		int n_start = 0;
+		int n_end = resolution.y;
 
+		// set the height offset for the initial corner points
+		Range tmpHeightOffsetRange = heightOffsetRange;
 
+		// Asign a random height to each corner
+		heightField.Set(m_start, n_start, Utils::GetPointRandom(seed, m_start, n_start, tmpHeightOffsetRange)); // top left
+		heightField.Set(m_start, n_end, Utils::GetPointRandom(seed, m_start, n_end, tmpHeightOffsetRange)); // top right
+		heightField.Set(m_end, n_start, Utils::GetPointRandom(seed, m_end, n_start, tmpHeightOffsetRange)); // bottom left
+		heightField.Set(m_end, n_end, Utils::GetPointRandom(seed, m_end, n_end, tmpHeightOffsetRange)); // bottom right
 
-void TerrainMesh::DiamondSquareAlgorithm(Range heightOffsetRange)
+		XMINT2 chunkSize =  XMINT2(resolution.x, resolution.y); // portion we are working on
+		const float levels = log2((float)(std::min)(resolution.x, resolution.y));
+		int level = 0;
+
+		while (chunkSize.x > 1 && chunkSize.y > 1 && !progress.IsCancelled())
+		{
+			// get the half of the portion we are working on
+			XMINT2 half = XMINT2(chunkSize.x / 2, chunkSize.y / 2);
+
+			// Apply Square Step //
+			SquareStep(heightField, m_start, m_end, n_start, n_end, chunkSize, tmpHeightOffsetRange, half, seed);
+
+			// Apply Diamond Step //
+			DiamondStep(heightField, m_start, m_end, n_start, n_end, chunkSize, tmpHeightOffsetRange, half, seed);
+
+			// halve the portion of the plane where to work next
+			chunkSize = XMINT2(chunkSize.x/2.0f, chunkSize.y/2.0f);
+
+			// halve the height offset
+			tmpHeightOffsetRange.min /= 2.0f;
+			tmpHeightOffsetRange.max /= 2.0f;
+
+			// every level has four times the points of the one before
+			level++;
+			progress.Set(powf(4.0f, level - levels));
+		}
+	}, replacesHeights);
+}
+
+bool TerrainMesh::IsDiamondSquareResolution(XMINT2 resolution)
 {
 	// Check if this algorithm can be applied to this terrain 
 	// The vertices needs to be (2^n)+1 where n>0
 	// By taking log2 of N and then pass it to floor and ceil if both gives same result then N is power of 2
 	// as we are checking 2^n+1 then we neeed to substract 1 from the resolution to check this
 	// Removing the posibility of (2^0)+1 => 1+1 => 2
-	if ((ceil(log2(resolution.x)) != floor(log2(resolution.x)) || resolution.x == 2) ||
-		(ceil(log2(resolution.y)) != floor(log2(resolution.y)) || resolution.y == 2))
-		
-	{
-		return; // exit this function as the terrain resolution is odd
-	}
-
-	// Initialise corners points [(m*n) localitation in the array heightMap] //
-	int topLeft, topRight, bottomLeft, bottomRight;
-	int center;
+	return !((ceil(log2(resolution.x)) != floor(log2(resolution.x)) || resolution.x == 2) ||
+		(ceil(log2(resolution.y)) != floor(log2(resolution.y)) || resolution.y == 2));
+}
 
-	// set m and n values
-	int m_start = 0;
-	int m_end = resolution.x;
-	int n_start = 0;
-	int n_end = resolution.y;
+void TerrainMesh::GenerateProgressive(const GenerationSettings& settings)
+{
+	HeightField heightField = GetHeightField();
+	BeginHistoryEdit("Progressive generation", heightField.GetBounds());
+	progressiveGenerator.BuildPreview(settings, heightField);
+	EndHistoryEdit();
+	SetBaseLayer();
+	MarkHeightMapDirty();
+
+	// after marking the preview, which cancels any refinement
+	progressiveGenerator.StartRefinement();
+}
 
-	// get the height map indices of the corners in the heightmap array
-	topLeft = GetHeightMapIndex(m_start, n_start);
-	topRight = GetHeightMapIndex(m_start, n_end);
-	bottomLeft = GetHeightMapIndex(m_end, n_start);
-	bottomRight = GetHeightMapIndex(m_end, n_end);
+bool TerrainMesh::UpdateProgressive()
+{
+	if (!progressiveGenerator.HasRefinement())
+	{
+		return false;
+	}
 
-	// set the height offset for the initial corner points
-	Range tmpHeightOffsetRange = heightOffsetRange;
+	// the preview and its refinement are undone together, with the local edits made since the preview on top
+	HeightField heightField = GetHeightField();
+	BeginHistoryEdit("Progressive generation", heightField.GetBounds(), true);
+	progressiveGenerator.TakeRefinement(heightField);
+	for (const TerrainEdit& edit : refinementEdits)
+	{
+		edit.ApplyTo(heightField);
+	}
+	EndHistoryEdit();
+	SetBaseLayer();
+	MarkHeightMapDirty();
+	return true;
+}
 
-	// Asign a random height to each corner
-	heightMap[topLeft] = Utils::GetRandom(tmpHeightOffsetRange);
-	heightMap[topRight] = Utils::GetRandom(tmpHeightOffsetRange);
-	heightMap[bottomLeft] = Utils::GetRandom(tmpHeightOffsetRange);
-	heightMap[bottomRight] = Utils::GetRandom(tmpHeightOffsetRange);
+void TerrainMesh::CarveRivers(float accumulationThreshold, float maxDepth)
+{
+	pipeline.AddMapPass("Carve rivers", [this, accumulationThreshold, maxDepth](HeightField& heightField, TerrainJobProgress& progress)
+	{
+		HydrologyMaps hydrologyMaps;
+		if (!Hydrology::Analyse(heightField, hydrologyMaps, progress.GetCancelFlag()))
+		{
+			return;
+		}
+		progress.Set(0.5f);
 
-	XMINT2 chunkSize =  XMINT2(resolution.x, resolution.y); // portion we are working on
+		riverPointsCarved = Hydrology::CarveRivers(heightField, hydrologyMaps, accumulationThreshold, maxDepth, progress.GetCancelFlag());
+	});
+}
 
-	while (chunkSize.x > 1 && chunkSize.y > 1)
+void TerrainMesh::BuildBeaches(float waterLevel, float beachWidth)
+{
+	if (beachWidth <= 0.0f)
 	{
-		// get the half of the portion we are working on
-		XMINT2 half = XMINT2(chunkSize.x / 2, chunkSize.y / 2);
-
-		// Apply Square Step //
-		SquareStep(m_start, m_end, n_start, n_end, chunkSize, tmpHeightOffsetRange, half);
+		return;
+	}
 
-		// Apply Diamond Step //
-		DiamondStep(m_start, m_end, n_start, n_end, chunkSize, tmpHeightOffsetRange, half);
+	pipeline.AddMapPass("Beaches", [waterLevel, beachWidth](HeightField& heightField, TerrainJobProgress& progress)
+	{
+		std::vector<float> distanceToWater;
+		DistanceTransform::DistanceToWater(heightField, waterLevel, distanceToWater);
+		progress.Set(0.5f);
 
-		// halve the portion of the plane where to work next
-		chunkSize = XMINT2(chunkSize.x/2.0f, chunkSize.y/2.0f);
+		std::vector<float> row(heightField.GetColumns());
+		for (int m = 0; m < heightField.GetRows() && !progress.IsCancelled(); m++)
+		{
+			heightField.ReadRow(m, row.data());
+			for (int n = 0; n < heightField.GetColumns(); n++)
+			{
+				int index = n + m * heightField.GetColumns();
+				if (distanceToWater[index] >= beachWidth || row[n] <= waterLevel)
+				{
+					continue;
+				}
+
+				// smoothstep from the water level at the coast to the original height at beachWidth
+				float t = distanceToWater[index] / beachWidth;
+				t = t * t * (3.0f - 2.0f * t);
+				row[n] = waterLevel + t * (row[n] - waterLevel);
+			}
+			heightField.WriteRow(m, row.data());
+			progress.Set(0.5f + 0.5f * (m + 1) / heightField.GetRows());
+		}
+	});
+}
 
-		// halve the height offset
-		tmpHeightOffsetRange.min /= 2.0f;
-		tmpHeightOffsetRange.max /= 2.0f;
-	}
+void TerrainMesh::SetHeights(const TerrainGraph& graph)
+{
+	// a copy, the GUI keeps editing the graph while the job evaluates it. It shares the cache, so what the job computes is reused
+	const std::shared_ptr<TerrainGraph> evaluated = std::make_shared<TerrainGraph>(graph);
+	pipeline.AddMapPass("Node graph", [evaluated](HeightField& heightField, TerrainJobProgress&)
+	{
+		const HeightField source = evaluated->Evaluate(heightField.GetResolution());
+		std::vector<float> row(heightField.GetColumns());
+		for (int m = 0; m < heightField.GetRows(); m++)
+		{
+			source.ReadRow(m, row.data());
+			heightField.WriteRow(m, row.data());
+		}
+	}, true);
 }
 
 
-void TerrainMesh::SquareStep(int& m_start, int& m_end, int& n_start, int& n_end, XMINT2& chunkSize, Range& tmpHeightOffsetRange, XMINT2& half)
+void TerrainMesh::SquareStep(HeightField& heightField, int& m_start, int& m_end, int& n_start, int& n_end, XMINT2& chunkSize, Range& tmpHeightOffsetRange, XMINT2& half, unsigned int seed)
 {
 	for (int m = m_start; m < m_end; m += chunkSize.x)
 	{
 		for (int n = n_start; n < n_end; n += chunkSize.y)
 		{
-			// get the height map indices of the corners of the square in the heightmap array
-			int topLeft = GetHeightMapIndex(m, n);
-			int topRight = GetHeightMapIndex(m, n + chunkSize.y);
-			int bottomLeft = GetHeightMapIndex(m + chunkSize.x, n);
-			int bottomRight = GetHeightMapIndex(m + chunkSize.x, n + chunkSize.y);
-
-			// calculate the average of the four corners
-			float cornersAvg = (heightMap[topLeft] + heightMap[topRight] + heightMap[bottomLeft] + heightMap[bottomRight]) / 4.0f;
+			// calculate the average of the four corners of the square
+			float cornersAvg = (heightField.Get(m, n) + heightField.Get(m, n + chunkSize.y) + heightField.Get(m + chunkSize.x, n) + heightField.Get(m + chunkSize.x, n + chunkSize.y)) / 4.0f;
 
-			// square centre point
-			int centre = GetHeightMapIndex(m + half.x, n + half.y);
-
-			// set the height to the centre point
-			float randomHeightOffset = Utils::GetRandom(tmpHeightOffsetRange);
-			heightMap[centre] = cornersAvg + randomHeightOffset;
+			// set the height to the square centre point
+			float randomHeightOffset = Utils::GetPointRandom(seed, m + half.x, n + half.y, tmpHeightOffsetRange);
+			heightField.Set(m + half.x, n + half.y, cornersAvg + randomHeightOffset);
 		}
 	}
 }
 
-void TerrainMesh::DiamondStep(int& m_start, int& m_end, int& n_start, int& n_end, XMINT2& chunkSize, Range& tmpHeightOffsetRange, XMINT2& half)
+void TerrainMesh::DiamondStep(HeightField& heightField, int& m_start, int& m_end, int& n_start, int& n_end, XMINT2& chunkSize, Range& tmpHeightOffsetRange, XMINT2& half, unsigned int seed)
 {
 	for (int m = m_start; m <= m_end; m += half.x)
 	{
 		for (int n = (m + half.x) % chunkSize.y; n <= n_end; n += chunkSize.y)
 		{
-			int count = 0;
-			float cornersSum = 0;
-
-			// top corner
-			if (InBounds(m - half.x, n))
-			{
-				cornersSum += heightMap[GetHeightMapIndex(m - half.x, n)];
-				count++;
-			}
-			// left corner
-			if (InBounds(m, n - half.y))
-			{
-				cornersSum += heightMap[GetHeightMapIndex(m, n - half.y)];
-				count++;
-			}
-			// right corner
-			if (InBounds(m, n + half.y))
+			// top, left, right and bottom corners, the ones outside the map mirrored on the edge
+			const XMINT2 corners[4] =
 			{
-				cornersSum += heightMap[GetHeightMapIndex(m, n + half.y)];
-				count++;
-			}
-			// bottom corner
-			if (InBounds(m + half.x, n))
+				Stencil::ResolvePoint<StencilMirror>(heightField, m - half.x, n),
+				Stencil::ResolvePoint<StencilMirror>(heightField, m, n - half.y),
+				Stencil::ResolvePoint<StencilMirror>(heightField, m, n + half.y),
+				Stencil::ResolvePoint<StencilMirror>(heightField, m + half.x, n)
+			};
+			float cornersSum = 0.0f;
+			for (const XMINT2& corner : corners)
 			{
-				cornersSum += heightMap[GetHeightMapIndex(m + half.y, n)];
-				count++;
+				cornersSum += heightField.Get(corner.x, corner.y);
 			}
 
 			// calculate average
-			float cornersAvg = (float)cornersSum / (float)count;
-
-			// diamond center point
-			int center = GetHeightMapIndex(m, n);
+			float cornersAvg = cornersSum / 4.0f;
 
 			// set the value to the center point of the diamond
-			float random = Utils::GetRandom(tmpHeightOffsetRange);
-			heightMap[center] = cornersAvg + random;
+			float random = Utils::GetPointRandom(seed, m, n, tmpHeightOffsetRange);
+			heightField.Set(m, n, cornersAvg + random);
 		}
 	}
 }
 
 
 
-//////////////////////////////// TOOL FUNCTIONS FOR HEIGHT MAP MANIPULATION ////////////////////////////////
+//////////////////////////////// TERRAIN JOBS ////////////////////////////////
 
-XMFLOAT3 TerrainMesh::GetRandomPos()
+bool TerrainMesh::UpdateJobs()
 {
-	return XMFLOAT3(Utils::GetRandom(0.0f, (float)resolution.x), 0.0f, Utils::GetRandom(0.0f, (float)resolution.y));
+	bool changed = false;
+	if (jobs.IsFinished() && jobs.Collect())
+	{
+		// Collect() has added the local edits made while the job ran to the back height map.
+		// Only the tiles the job has changed go to the history
+		if (!layersEnabled)
+		{
+			history.Record(jobs.GetName(), GetHeightField(), quantisedStorage ? HeightField(&backQuantisedHeightMap) : HeightField(backHeightMap, resolution));
+		}
+
+		// the back height map has the result, it becomes the front one in a single swap
+		if (quantisedStorage)
+		{
+			std::swap(quantisedHeightMap, backQuantisedHeightMap);
+		}
+		else
+		{
+			std::swap(heightMap, backHeightMap);
+		}
+		SetBaseLayer();
+		MarkHeightMapDirty();
+		changed = true;
+	}
+
+	// everything recorded since the last job runs as a single one, with a single swap and rebuild of the tiles
+	if (!jobs.IsRunning() && !pipeline.IsEmpty())
+	{
+		const HeightPipeline recorded = pipeline;
+		pipeline.Clear();
+		jobs.Push(recorded.GetName(), [recorded](HeightField& heightField, TerrainJobProgress& progress)
+		{
+			recorded.Run(heightField, progress);
+		});
+	}
+	if (!jobs.IsRunning() && jobs.GetPendingCount() > 0)
+	{
+		jobs.StartNext(CopyToBackHeightMap());
+	}
+	return changed;
 }
 
-float TerrainMesh::NeighboursAverage(int mPos, int nPos) // neighbour postion ( mPpos, nPos)
+void TerrainMesh::CancelJobs()
 {
-	// Function computes the average height of the ik element.
-	// It averages itself with its eight neighbour pixels.
-	// Note that if a pixel is missing neighbour, we just don't include it
-	// in the average--that is, edge pixel don't have a neighbour pixel.
-	//      
-	// ---------
-	// | 1| 2| 3|
-	// | 4|mn| 6|
-	// | 7| 8| 9|
-	// ---------
+	pipeline.Clear();
+	jobs.CancelAll();
+}
+
+HeightField TerrainMesh::CopyToBackHeightMap()
+{
+	// no job is running, so the back height map can be reallocated. The one of the other storage mode is freed
+	if (quantisedStorage)
+	{
+		delete[] backHeightMap;
+		backHeightMap = nullptr;
+		backQuantisedHeightMap = quantisedHeightMap;
+		HeightField backField(&backQuantisedHeightMap);
+		if (layersEnabled)
+		{
+			layers.ReadBase(backField);
+		}
+		return backField;
+	}
+
+	backQuantisedHeightMap = QuantisedHeightMap();
+	if (!backHeightMap || backResolution.x != resolution.x || backResolution.y != resolution.y)
+	{
+		delete[] backHeightMap;
+		backHeightMap = new float[HeightField::GetStorageSize(resolution)];
+		backResolution = resolution;
+	}
+	HeightField backField(backHeightMap, resolution);
+	if (layersEnabled)
+	{
+		layers.ReadBase(backField);
+	}
+	else
+	{
+		std::copy(heightMap, heightMap + HeightField::GetStorageSize(resolution), backHeightMap);
+	}
+	return backField;
+}
+
+
+//////////////////////////////// HEIGHT LAYERS ////////////////////////////////
+
+void TerrainMesh::SetLayersEnabled(bool enabled)
+{
+	if (enabled == layersEnabled)
+	{
+		return;
+	}
+
+	// turned off, the heights keep the last composite. The layers are undone on their own, without the history
+	layersEnabled = enabled;
+	if (enabled)
+	{
+		history.Clear();
+		SetBaseLayer();
+		MarkHeightMapDirty();
+	}
+}
 
-	float totalHeight = 0.0f; // sum of the neighbours height plus the current point itself
-	int numPoints = 0; // number of points
+bool TerrainMesh::UpdateLayers()
+{
+	if (!layersEnabled || !layers.IsDirty())
+	{
+		return false;
+	}
 
-	// look throught the possible neighbours of the current point
-	for (int m = mPos - 1; m <= mPos + 1; m++)
+	// a local edit of every changed tile. A running job works on a copy of the base, so it goes on
+	HeightField heightField = GetHeightField();
+	std::vector<HeightFieldRect> rects;
+	layers.GetDirtyRects(rects);
+	if (!statisticsDirty)
 	{
-		for (int n = nPos - 1; n <= nPos + 1; n++)
+		for (const HeightFieldRect& rect : rects)
 		{
-			if (InBounds(m, n))
-			{
-				totalHeight += heightMap[GetHeightMapIndex(m, n)];
-				numPoints++; // count this point
-			}
+			statistics.RemoveRegion(heightField, rect);
 		}
 	}
+	layerTilesComposited = layers.Composite(heightField);
+	for (const HeightFieldRect& rect : rects)
+	{
+		EndLocalEdit(rect);
+	}
+	return true;
+}
+
+void TerrainMesh::SetBaseLayer()
+{
+	if (!layersEnabled)
+	{
+		return;
+	}
 
-	return totalHeight / (float)numPoints; // return the average
+	// the layers have no tiles after a resize, what they had is in the resampled heights
+	if (layers.GetResolution().x != resolution.x || layers.GetResolution().y != resolution.y)
+	{
+		layers.Resize(resolution);
+	}
+	HeightField heightField = GetHeightField();
+	layers.SetBase(heightField);
+	layerTilesComposited = layers.Composite(heightField);
 }
 
 
-bool TerrainMesh::InBounds(int m, int n)
+//////////////////////////////// HISTORY ////////////////////////////////
+
+bool TerrainMesh::Undo()
 {
-	// True if ik are valid indices; false otherwise
-	return (m >= 0 && m <= resolution.x && n >= 0 && n <= resolution.y);
+	return StepHistory(false);
+}
+
+bool TerrainMesh::Redo()
+{
+	return StepHistory(true);
+}
+
+bool TerrainMesh::StepHistory(bool redo)
+{
+	if (layersEnabled || (redo ? !history.CanRedo() : !history.CanUndo()))
+	{
+		return false;
+	}
+
+	// the running job, the recorded operations and the refinement started from the heights being replaced
+	CancelJobs();
+	progressiveGenerator.Cancel();
+
+	// a local edit of every tile of the entry
+	HeightField heightField = GetHeightField();
+	std::vector<HeightFieldRect> rects;
+	if (redo)
+	{
+		history.GetRedoRects(rects);
+	}
+	else
+	{
+		history.GetUndoRects(rects);
+	}
+	if (!statisticsDirty)
+	{
+		for (const HeightFieldRect& rect : rects)
+		{
+			statistics.RemoveRegion(heightField, rect);
+		}
+	}
+	if (redo)
+	{
+		history.Redo(heightField);
+	}
+	else
+	{
+		history.Undo(heightField);
+	}
+	for (const HeightFieldRect& rect : rects)
+	{
+		EndLocalEdit(rect);
+	}
+	return true;
+}
+
+void TerrainMesh::BeginHistoryEdit(const std::string& name, const HeightFieldRect& rect, bool merge)
+{
+	if (!layersEnabled)
+	{
+		history.BeginEdit(name, GetHeightField(), rect, merge);
+	}
+}
+
+void TerrainMesh::EndHistoryEdit()
+{
+	if (history.IsEditing())
+	{
+		history.EndEdit(GetHeightField());
+	}
+}
+
+
+//////////////////////////////// SCULPTING ////////////////////////////////
+
+bool TerrainMesh::ApplyBrush()
+{
+	if (!brush.HasStamps())
+	{
+		return false;
+	}
+
+	// every stamp queued since the last frame in one local edit, merged in the history with the previous frames of the stroke
+	HeightField heightField = GetHeightField();
+	const HeightFieldRect rect = brush.GetStampsRect(heightField);
+	BeginLocalEdit(rect, "Sculpt", brush.GetStrokeStampCount() > 0);
+	brushStampsApplied = brush.Apply(heightField);
+	EndLocalEdit(rect);
+	return true;
+}
+
+bool TerrainMesh::Pick(const XMFLOAT3& origin, const XMFLOAT3& direction, XMFLOAT3& point)
+{
+	return TerrainBrush::Pick(GetHeightField(), tiles.GetQuadtree(), origin, direction, point);
+}
+
+
+//////////////////////////////// TOOL FUNCTIONS FOR HEIGHT MAP MANIPULATION ////////////////////////////////
+
+const HeightStatistics& TerrainMesh::GetStatistics()
+{
+	if (statisticsDirty || statistics.NeedsRebuild())
+	{
+		statistics.Compute(GetHeightField());
+		statisticsDirty = false;
+	}
+	return statistics;
+}
+
+void TerrainMesh::MarkHeightMapDirty()
+{
+	// the refinement and the running job would overwrite this change
+	progressiveGenerator.Cancel();
+	refinementEdits.clear();
+	jobs.Cancel();
+
+	// a full-map operation can leave the ranges of the quantised tiles much wider than their heights
+	if (quantisedStorage)
+	{
+		quantisedHeightMap.Compact();
+	}
+
+	statisticsDirty = true;
+	tiles.MarkAllDirty();
+	tessellation.MarkAllDirty();
+	lodTerrain.MarkAllDirty();
+	clipmapTerrain.MarkAllDirty();
+}
+
+void TerrainMesh::BeginLocalEdit(const HeightFieldRect& rect, const std::string& name, bool merge)
+{
+	// the running job and the refinement work on their own copy of the heights, the change of the edit is added to their result.
+	// With the layers on it is added to the base as well
+	localEditKept = layersEnabled || jobs.IsRunning() || progressiveGenerator.IsRefining() || progressiveGenerator.HasRefinement();
+	if (localEditKept)
+	{
+		localEdit.Begin(GetHeightField(), rect);
+	}
+
+	// take the old heights out of the statistics (no need if they are going to be recomputed)
+	if (!statisticsDirty)
+	{
+		statistics.RemoveRegion(GetHeightField(), rect);
+	}
+	BeginHistoryEdit(name, rect, merge);
+}
+
+void TerrainMesh::EndLocalEdit(const HeightFieldRect& rect)
+{
+	EndHistoryEdit();
+	if (localEditKept)
+	{
+		localEdit.End(GetHeightField());
+		if (layersEnabled)
+		{
+			layers.AddToBase(localEdit.rect, localEdit.delta.data());
+		}
+		jobs.AddEdit(localEdit);
+		if (progressiveGenerator.IsRefining() || progressiveGenerator.HasRefinement())
+		{
+			refinementEdits.push_back(localEdit);
+		}
+		localEditKept = false;
+	}
+	if (!statisticsDirty)
+	{
+		statistics.AddRegion(GetHeightField(), rect);
+	}
+
+	tiles.MarkDirty(rect);
+	tessellation.MarkDirty(rect);
+	lodTerrain.MarkDirty(rect);
+	clipmapTerrain.MarkDirty(rect);
+}
+
+XMFLOAT3 TerrainMesh::GetRandomPos()
+{
+	return XMFLOAT3(Utils::GetRandom(0.0f, (float)resolution.x), 0.0f, Utils::GetRandom(0.0f, (float)resolution.y));
 }
 
 int TerrainMesh::GetHeightMapIndex(int m, int n)
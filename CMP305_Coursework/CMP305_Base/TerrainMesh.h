@@ -1,9 +1,27 @@
 #pragma once
 #include "BaseMesh.h"
+#include <cfloat>
 
 #include "Emitter.h"
 #include "Utils.h"
 #include "SimplexNoise.h"
+#include "HeightField.h"
+#include "Stencil.h"
+#include "HeightResampler.h"
+#include "ProgressiveGenerator.h"
+#include "TerrainJobs.h"
+#include "HeightPipeline.h"
+#include "HeightLayers.h"
+#include "TerrainHistory.h"
+#include "TerrainBrush.h"
+#include "Hydrology.h"
+#include "DistanceTransform.h"
+#include "HeightStatistics.h"
+#include "TerrainTiles.h"
+#include "PatchTessellation.h"
+#include "CdlodTerrain.h"
+#include "ClipmapTerrain.h"
+#include "TerrainGraph.h"
 
 // Frecuency, amplitude and all the data for Waves
 struct WavesData
@@ -33,18 +51,86 @@ public:
 	~TerrainMesh();
 
 	// Override sendData() to change topology type. Control point patch list is required for tessellation
-	void sendData(ID3D11DeviceContext* deviceContext, D3D_PRIMITIVE_TOPOLOGY top = D3D11_PRIMITIVE_TOPOLOGY_12_CONTROL_POINT_PATCHLIST) override;
+	// It binds the index buffer shared by all the tiles, then every tile is drawn after SendTileData()
+	void sendData(ID3D11DeviceContext* deviceContext, D3D_PRIMITIVE_TOPOLOGY top = D3D11_PRIMITIVE_TOPOLOGY_4_CONTROL_POINT_PATCHLIST) override;
 
+	// The terrain is drawn in tiles of TerrainTiles::kTileSize^2 quads, each one with its own vertex buffer
+	int GetTileCount() const { return tiles.GetTileCount(); }
+	void SendTileData(ID3D11DeviceContext* deviceContext, int tile) { tiles.SendTileData(deviceContext, tile); }
 
-	// Change the size of the terrain
-	void Resize(ID3D11Device* device, ID3D11DeviceContext* deviceContext, XMINT2 newResolution);
+	// Select the patches to draw with the min/max height quadtree: only the ones inside the frustum, or all of them if it is null.
+	// Heights below heightFloor are drawn at it (the fake water level of the domain shader).
+	// If occlusionEye (in the space of the height map) is not null the patches hidden behind nearer terrain are skipped too
+	void Cull(const Frustum* frustum, float heightFloor = -FLT_MAX, const XMFLOAT3* occlusionEye = nullptr);
+	// Index ranges (with the tile whose vertex buffer they use) selected by the last Cull()
+	int GetDrawRangeCount() const { return (int)drawRanges.size(); }
+	const TerrainDrawRange& GetDrawRange(int range) const { return drawRanges[range]; }
+	int GetDrawnPatchCount() const { return drawnPatches; }
+	int GetPatchCount() const { return tiles.GetPatchCount(); }
+	// Leaves of the quadtree hidden by the terrain in the last Cull() with occlusion
+	int GetOccludedLeafCount() const { return occludedLeaves; }
+	int GetLeafCount() const { return occlusion.GetLeafCount(); }
+	// Number of tiles rebuilt by the last Regenerate()
+	int GetTilesRebuilt() const { return tilesRebuilt; }
+	// Bytes of vertices uploaded by the last Regenerate() that rebuilt a tile, only the rows that changed
+	size_t GetTileBytesUploaded() const { return tiles.GetUploadedBytes(); }
 
-	// Set up the heightmap and create or update the appropriate buffers
+	// Compute the tessellation factors of the patches for the eye (in the space of the height map), only where they can have changed.
+	// The hull shader reads them from GetTessellationFactors()
+	void UpdateTessellation(ID3D11DeviceContext* deviceContext, const XMFLOAT3& eye, const TessellationSettings& settings);
+	ID3D11ShaderResourceView* GetTessellationFactors() const { return tessellation.GetShaderResourceView(); }
+	// Blocks of PatchTessellation::kBlockSize^2 patches uploaded by the last UpdateTessellation()
+	int GetTessellationBlocksUploaded() const { return tessellationBlocksUploaded; }
+
+	// Alternative to the tessellated tiles: select the CDLOD nodes for the eye (in the space of the height map), culled as Cull() does,
+	// and upload them with the heights changed since the last call. They are drawn with the grid of SendLodData()
+	void SelectLod(ID3D11Device* device, ID3D11DeviceContext* deviceContext, const XMFLOAT3& eye, const Frustum* frustum, float heightFloor,
+		bool occlusionCulling, const CdlodSettings& settings);
+	void SendLodData(ID3D11DeviceContext* deviceContext) { lodTerrain.SendData(deviceContext); }
+	const CdlodTerrain& GetLodTerrain() const { return lodTerrain; }
+
+	// Alternative for very large height maps: move the geometry clipmap to the eye (in the space of the height map), uploading only
+	// the heights that enter its windows or have changed. The footprints outside the frustum (if not null) are not drawn
+	void UpdateClipmap(ID3D11Device* device, ID3D11DeviceContext* deviceContext, const XMFLOAT3& eye, const Frustum* frustum, float heightFloor);
+	void SendClipmapData(ID3D11DeviceContext* deviceContext) { clipmapTerrain.SendData(deviceContext); }
+	const ClipmapTerrain& GetClipmapTerrain() const { return clipmapTerrain; }
+
+
+	// Change the size of the terrain, the current heights are resampled to the new resolution with the filter.
+	// The tiles are uploaded by the next Regenerate()
+	void Resize(ID3D11Device* device, ID3D11DeviceContext* deviceContext, XMINT2 newResolution, ResampleFilter filter = kResampleBicubic);
+
+	// Rebuild and upload the vertices of the tiles whose height map points have changed
 	void Regenerate(ID3D11Device* device, ID3D11DeviceContext* deviceContext);
 
 	// Get the resolution of the terrain (The number of unit quad on x-axis and z-axis subtracting One)
 	XMINT2 GetResolution()const { return resolution; }
 
+	// Get a view of the height map, valid until the terrain is resized or its storage changes
+	HeightField GetHeightField() { return quantisedStorage ? HeightField(&quantisedHeightMap) : HeightField(heightMap, resolution); }
+
+	// Store the heights in floats or with 16 bits per point (QuantisedHeightMap), where every point is within maxError of its value.
+	// The heights are moved to the new storage, every operation works on both through GetHeightField()
+	void SetQuantisedStorage(bool quantised, float maxError);
+	bool IsQuantisedStorage() const { return quantisedStorage; }
+	const QuantisedHeightMap& GetQuantisedHeightMap() const { return quantisedHeightMap; }
+	// Bytes used by the heights in the current storage
+	size_t GetHeightMapBytes() const;
+
+	// Get the height distribution of the terrain. It is only recomputed if a full-map operation has run since the last call
+	const HeightStatistics& GetStatistics();
+
+	// The operations on the whole map but the waves are recorded in a HeightPipeline, which runs as a job when the previous one
+	// has finished: on a worker thread, on a copy of the height map that is swapped in at the end.
+	// Any other full-map change to the heights cancels the running job, the local edits made while it runs are added to its result.
+	// Swap in the finished job and start the next one, true if the height map has changed (call Regenerate then)
+	bool UpdateJobs();
+	const TerrainJobQueue& GetJobs() const { return jobs; }
+	// Operations recorded for the next job
+	const HeightPipeline& GetPipeline() const { return pipeline; }
+	// Cancel the running job and the operations recorded for the next ones
+	void CancelJobs();
+
 	//// TERRAIN MANIPULATION HEIGHT MAP FUNCTIONS //// 
 
 	// BUILD HEIGHT MAP FROM 0 FUNCTIONS //
@@ -59,11 +145,19 @@ public:
 	// MODIFY HEIGHT MAP FUNCTIONS //
 	// Set to 0 the height of every point
 	void Flatten();
+	// Multiply every height by factor
+	void ScaleHeights(float factor);
+	// Keep every height in the range
+	void ClampHeights(Range heightRange);
 	// Fault is made by adding or subtracting the max height value
 	void Fault(Range heightOffsetRange);
 	// Algorithm from 3D Game Programming with Directx11 by Frank D. Luna (Page 603)
 	// Smooth all the terrain
 	void Smooth();
+	// Smooth with the 1 2 1 Gaussian weights, softer than Smooth()
+	void GaussianSmooth();
+	// Add to every point its difference with its Gaussian average, the opposite of GaussianSmooth()
+	void Sharpen();
 	// It randomly distributes, or emits, particles across the surface of our terrain.
 	// Each time a particle "lands", raise the terrain a little
 	// As the particles stack up, you get natural raises in the terrain and organic features
@@ -74,32 +168,141 @@ public:
 	// Apply the Diando-Square (Midpoint Displacement) Algorithm to the terrain
 	// It has been based on the pseudocode: https://www.youtube.com/watch?v=4GuAV1PnurU&t=796s
 	void DiamondSquareAlgorithm(Range heightRange);
+	// Generate the terrain with the diamond-square, rivers and smoothing pipeline: a preview at a lower resolution right away
+	// and the full resolution result later, from a background thread. Any other full-map operation cancels the refinement,
+	// the local edits made while it runs are added to its result
+	void GenerateProgressive(const GenerationSettings& settings);
+	// Swap in the full resolution result if it has finished, true if the height map has changed (call Regenerate then)
+	bool UpdateProgressive();
+	const ProgressiveGenerator& GetProgressiveGenerator() const { return progressiveGenerator; }
+	// Fill the depressions, compute the D8 flow and carve the river network on the points
+	// where the flow accumulation is over the threshold
+	void CarveRivers(float accumulationThreshold, float maxDepth);
+	// Number of points carved by the last CarveRivers() job
+	int GetRiverPointsCarved() const { return riverPointsCarved; }
+	// Flatten the dry land towards the water level near the coast, using the distance to the nearest water point.
+	// The terrain is untouched further than beachWidth from the water
+	void BuildBeaches(float waterLevel, float beachWidth);
+	// Replace every height with the output of graph, evaluated by the next job on a copy of it.
+	// The operations recorded before it are dropped, so a live update records one evaluation per job at most
+	void SetHeights(const TerrainGraph& graph);
+
+	// Non-destructive editing: with the layers on, the heights are the composite of a base and the edit layers of GetLayers().
+	// The full-map operations work on the base (what they write becomes the new base) and the layers are composited over it,
+	// a resize bakes the layers into the base. The change of a local edit (particles, the brush) is added to the base too.
+	// Turning the layers on takes the current heights as the base and clears the history
+	void SetLayersEnabled(bool enabled);
+	bool IsLayersEnabled() const { return layersEnabled; }
+	HeightLayerStack& GetLayers() { return layers; }
+	// Composite the tiles changed in the layers, true if the height map has changed (call Regenerate then)
+	bool UpdateLayers();
+	// Tiles composited by the last update of the layers
+	int GetLayerTilesComposited() const { return layerTilesComposited; }
+
+	// Undo and redo the changes of the operations to the height map, only the tiles each one changed are written back.
+	// They cancel the jobs and the refinement in progress. Nothing is recorded with the layers on, they are undone on their own
+	bool Undo();
+	bool Redo();
+	TerrainHistory& GetHistory() { return history; }
+
+	// Sculpting: the strokes of GetBrush() queue their stamps and ApplyBrush() writes the ones queued since the last call
+	// as a single local edit, so only the rows of the tiles under them are rebuilt. A stroke is one entry of the history.
+	// With the layers on the strokes sculpt the base under them, and they are not recorded
+	TerrainBrush& GetBrush() { return brush; }
+	// True if the height map has changed (call Regenerate then)
+	bool ApplyBrush();
+	// Stamps written by the last ApplyBrush() that changed the height map
+	int GetBrushStampsApplied() const { return brushStampsApplied; }
+	// Point of the terrain hit by the ray, both in the space of the height map (x = n, y = height, z = m)
+	bool Pick(const XMFLOAT3& origin, const XMFLOAT3& direction, XMFLOAT3& point);
 
 private:
 	//Create the vertex and index buffers that will be passed along to the graphics card for rendering
 	//For CMP305, you don't need to worry so much about how or why yet, but notice the Vertex buffer is DYNAMIC here as we are changing the values often
 	void initBuffers(ID3D11Device*) override {};
-	void CreateBuffers( ID3D11Device* device, VertexType* vertices, unsigned long* indices );
 	int GetHeightMapIndex(int m, int n); // return the height map index
 
-	// check if a point is in the map/terrain
-	bool InBounds(int m, int n);
-	// return the height average of the neighbours to that point (inluding that point too)
-	float NeighboursAverage(int m, int n);
+	// Every operation reports what it has modified in the height map:
+	// full-map operations mark everything as dirty, local ones wrap the edit of their rectangle
+	// so only the tiles under it are rebuilt
+	void MarkHeightMapDirty();
+	// A local edit does not cancel the running job or the refinement, its change is added to their result when they are swapped in.
+	// With the layers on its change is added to the base too, or the next composite of its tiles would overwrite it
+	void BeginLocalEdit(const HeightFieldRect& rect, const std::string& name, bool merge = false); // name of the edit in the history
+	void EndLocalEdit(const HeightFieldRect& rect);
+
 	// return a random position from the map
 	XMFLOAT3 GetRandomPos();
 
-	void SquareStep(int& m_start, int& m_end, int& n_start, int& n_end, XMINT2& chunkSize, Range& tmpHeightOffsetRange, XMINT2& half);
-	void DiamondStep(int& m_start, int& m_end, int& n_start, int& n_end, XMINT2& chunkSize, Range& tmpHeightOffsetRange, XMINT2& half);
+	// Resolutions the diamond-square can run on, a power of two along each axis
+	static bool IsDiamondSquareResolution(XMINT2 resolution);
+	// The random offsets are a hash of the point and the seed (Utils::GetPointRandom), so the job needs no random state
+	static void SquareStep(HeightField& heightField, int& m_start, int& m_end, int& n_start, int& n_end, XMINT2& chunkSize, Range& tmpHeightOffsetRange, XMINT2& half, unsigned int seed);
+	static void DiamondStep(HeightField& heightField, int& m_start, int& m_end, int& n_start, int& n_end, XMINT2& chunkSize, Range& tmpHeightOffsetRange, XMINT2& half, unsigned int seed);
+
+	// Copy the heights (the base layer with the layers on) to the back height map of the current storage and return it, for the next job
+	HeightField CopyToBackHeightMap();
+	// With the layers on, take the heights written by a full-map operation as the base and composite the layers over them
+	void SetBaseLayer();
+	// Keep the tiles under rect for the history until EndHistoryEdit(), if it is recording
+	void BeginHistoryEdit(const std::string& name, const HeightFieldRect& rect, bool merge = false);
+	void EndHistoryEdit();
+	bool StepHistory(bool redo);
 
 	const float m_UVscale = 10.0f;			//Tile the UV map 10 times across the plane
 	const float terrainSize = 100.0f;		//What is the width and height of our terrain
 	// resolution per patch, per vertex is resolution+1
 	XMINT2 resolution; // x=m=rows, y=n=columns
-	float* heightMap;
+	float* heightMap; // null when the heights are quantised
+	QuantisedHeightMap quantisedHeightMap;
+	bool quantisedStorage;
+
+	// GPU data of the terrain split in tiles
+	TerrainTiles tiles;
+	int tilesRebuilt;
+	std::vector<TerrainDrawRange> drawRanges;
+	int drawnPatches;
+	HorizonOcclusion occlusion;
+	int occludedLeaves;
+	PatchTessellation tessellation;
+	int tessellationBlocksUploaded;
+	CdlodTerrain lodTerrain;
+	ClipmapTerrain clipmapTerrain;
+
+	// Height distribution, updated incrementally by the local edits
+	HeightStatistics statistics;
+	bool statisticsDirty;
 
 	// Object which will randomly emit particles across the terrain
 	Emitter* emitter;
 
+	// Preview and background refinement of GenerateProgressive()
+	ProgressiveGenerator progressiveGenerator;
+	std::vector<TerrainEdit> refinementEdits; // local edits made while the refinement runs
+
+	// Change of the local edit in progress, kept while a job or the refinement is running or the layers are on
+	TerrainEdit localEdit;
+	bool localEditKept;
+
+	// Jobs and the back height map they write, in the storage of the front one
+	HeightPipeline pipeline; // recorded operations, not yet a job
+	TerrainJobQueue jobs;
+	float* backHeightMap;
+	XMINT2 backResolution;
+	QuantisedHeightMap backQuantisedHeightMap;
+	std::atomic<int> riverPointsCarved; // written by the job
+
+	// Base and edit layers composited into the height map
+	HeightLayerStack layers;
+	bool layersEnabled;
+	int layerTilesComposited;
+
+	// Tiles changed by the operations, to undo and redo them
+	TerrainHistory history;
+
+	// Sculpting brush and its stamps queued for the next ApplyBrush()
+	TerrainBrush brush;
+	int brushStampsApplied;
+
 
 };
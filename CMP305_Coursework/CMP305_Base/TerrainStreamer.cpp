@@ -0,0 +1,381 @@
+#include "TerrainStreamer.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "SimplexNoise.h"
+
+const int TerrainStreamer::kMaxUploadsPerFrame;
+const size_t TerrainStreamer::kTileBytes;
+
+
+TerrainStreamer::TerrainStreamer(ID3D11Device* iDevice, int workerCount)
+	: device(iDevice), settingsVersion(0), viewDistance(400.0f), prefetchTime(2.0f), memoryBudget(256u * 1024u * 1024u),
+	frame(0), lastCameraPosition(0.0f, 0.0f, 0.0f), cameraVelocity(0.0f, 0.0f, 0.0f), hasLastCameraPosition(false),
+	workerSettingsVersion(0), stopWorkers(false), generationsInFlight(0), generatedTiles(0)
+{
+	indexBuffer = TerrainTiles::CreateIndexBuffer(device, TerrainTiles::kNeighbourIndicesPerPatch);
+	workerSettings = settings;
+
+	if (workerCount <= 0)
+	{
+		workerCount = (std::max)(1, TaskScheduler::Get().GetThreadCount() - 1);
+	}
+	maxGenerations = workerCount;
+}
+
+TerrainStreamer::~TerrainStreamer()
+{
+	{
+		std::unique_lock<std::mutex> lock(jobsMutex);
+		stopWorkers = true;
+		generationsFinished.wait(lock, [this] { return generationsInFlight == 0; });
+	}
+
+	ClearCache();
+	for (ID3D11Buffer* buffer : freeBuffers)
+	{
+		buffer->Release();
+	}
+	freeBuffers.clear();
+
+	if (indexBuffer)
+	{
+		indexBuffer->Release();
+		indexBuffer = nullptr;
+	}
+}
+
+void TerrainStreamer::SetSettings(const StreamingTerrainSettings& newSettings)
+{
+	settings = newSettings;
+	settingsVersion++;
+	ClearCache();
+
+	// the tiles being generated with the old settings are discarded when they arrive
+	std::lock_guard<std::mutex> lock(jobsMutex);
+	workerSettings = settings;
+	workerSettingsVersion = settingsVersion;
+	for (const XMINT2& key : pendingJobs)
+	{
+		requestedTiles.erase(GetKeyHash(key));
+	}
+	pendingJobs.clear();
+	for (const GeneratedTile& tile : generated)
+	{
+		requestedTiles.erase(GetKeyHash(tile.key));
+	}
+	generated.clear();
+}
+
+void TerrainStreamer::Update(ID3D11DeviceContext* deviceContext, XMFLOAT3 cameraPosition, float dt)
+{
+	frame++;
+
+	// Smoothed camera velocity, so a single jerky frame does not move the prefetch area
+	if (hasLastCameraPosition && dt > 0.0f)
+	{
+		const float blend = 0.2f;
+		cameraVelocity.x += ((cameraPosition.x - lastCameraPosition.x) / dt - cameraVelocity.x) * blend;
+		cameraVelocity.y += ((cameraPosition.y - lastCameraPosition.y) / dt - cameraVelocity.y) * blend;
+		cameraVelocity.z += ((cameraPosition.z - lastCameraPosition.z) / dt - cameraVelocity.z) * blend;
+	}
+	lastCameraPosition = cameraPosition;
+	hasLastCameraPosition = true;
+
+	UploadGeneratedTiles(deviceContext);
+
+	// Tiles around the camera: the resident ones are drawn, the rest requested by distance.
+	// Then the tiles around the position predicted along the velocity, after all the ones in view
+	const float tileSize = (float)TerrainTiles::kTileSize;
+	std::vector<std::pair<float, XMINT2>> requests;
+	visibleTiles.clear();
+	RequestTilesAround(XMFLOAT2(cameraPosition.z / tileSize, cameraPosition.x / tileSize), viewDistance, 0.0f, &visibleTiles, requests);
+
+	const XMFLOAT2 predicted((cameraPosition.z + cameraVelocity.z * prefetchTime) / tileSize, (cameraPosition.x + cameraVelocity.x * prefetchTime) / tileSize);
+	RequestTilesAround(predicted, viewDistance, viewDistance, nullptr, requests);
+
+	// Replace the pending jobs, the tiles that are no longer wanted are dropped
+	std::sort(requests.begin(), requests.end(), [](const std::pair<float, XMINT2>& a, const std::pair<float, XMINT2>& b) { return a.first < b.first; });
+	{
+		std::lock_guard<std::mutex> lock(jobsMutex);
+		for (const XMINT2& key : pendingJobs)
+		{
+			requestedTiles.erase(GetKeyHash(key));
+		}
+		pendingJobs.clear();
+
+		// a tile requested twice keeps its most urgent priority, the tiles being generated are skipped
+		for (const std::pair<float, XMINT2>& request : requests)
+		{
+			if (requestedTiles.insert(GetKeyHash(request.second)).second)
+			{
+				pendingJobs.push_back(request.second);
+			}
+		}
+		// the tasks take the most urgent one from the back
+		std::reverse(pendingJobs.begin(), pendingJobs.end());
+	}
+	StartGenerations();
+
+	EvictTiles();
+}
+
+void TerrainStreamer::SendIndexData(ID3D11DeviceContext* deviceContext, D3D_PRIMITIVE_TOPOLOGY top)
+{
+	deviceContext->IASetIndexBuffer(indexBuffer, DXGI_FORMAT_R16_UINT, 0);
+	deviceContext->IASetPrimitiveTopology(top);
+}
+
+void TerrainStreamer::SendTileData(ID3D11DeviceContext* deviceContext, int visibleTile)
+{
+	unsigned int stride = sizeof(TerrainVertexType);
+	unsigned int offset = 0;
+
+	deviceContext->IASetVertexBuffers(0, 1, &visibleTiles[visibleTile], &stride, &offset);
+}
+
+float TerrainStreamer::SampleHeight(const StreamingTerrainSettings& settings, float x, float z)
+{
+	// The seed selects a slice of the 3D noise, so every seed gives a different and repeatable terrain
+	const SimplexNoise noise(settings.frequency, 1.0f, settings.lacunarity, settings.persistence);
+	const float slice = (float)settings.seed * 7.31f;
+
+	const float fbm = noise.fractal(settings.octaves, x, z, slice);
+	// ridged fBm: sharp crests where the noise crosses 0
+	const float ridged = 1.0f - 2.0f * fabsf(fbm);
+
+	return settings.amplitude * (fbm + (ridged - fbm) * settings.ridgeWeight);
+}
+
+int TerrainStreamer::GetPendingTileCount()
+{
+	std::lock_guard<std::mutex> lock(jobsMutex);
+	return (int)requestedTiles.size();
+}
+
+void TerrainStreamer::StartGenerations()
+{
+	std::lock_guard<std::mutex> lock(jobsMutex);
+	while (generationsInFlight < maxGenerations && generationsInFlight < (int)pendingJobs.size())
+	{
+		generationsInFlight++;
+		TaskScheduler::Get().SubmitBackground([this]() { GenerateNext(); });
+	}
+}
+
+void TerrainStreamer::GenerateNext()
+{
+	GeneratedTile tile;
+	StreamingTerrainSettings jobSettings;
+	{
+		std::lock_guard<std::mutex> lock(jobsMutex);
+		if (stopWorkers || pendingJobs.empty())
+		{
+			generationsInFlight--;
+			generationsFinished.notify_all();
+			return;
+		}
+
+		tile.key = pendingJobs.back();
+		pendingJobs.pop_back();
+		tile.settingsVersion = workerSettingsVersion;
+		jobSettings = workerSettings;
+	}
+
+	GenerateTile(jobSettings, tile);
+
+	// the tile stays in requestedTiles until it is uploaded, so it is not requested again
+	std::lock_guard<std::mutex> lock(jobsMutex);
+	generated.push_back(std::move(tile));
+	generatedTiles++;
+	if (!stopWorkers && !pendingJobs.empty())
+	{
+		TaskScheduler::Get().SubmitBackground([this]() { GenerateNext(); });
+	}
+	else
+	{
+		generationsInFlight--;
+		generationsFinished.notify_all();
+	}
+}
+
+void TerrainStreamer::GenerateTile(const StreamingTerrainSettings& settings, GeneratedTile& tile)
+{
+	// Same vertex grid as the tiles of a TerrainMesh: kTileVertices^2 points from (origin - 1) with one more
+	// row and column of samples for the normals
+	const int samples = TerrainTiles::kTileVertices + 1;
+	const int mStart = tile.key.x * TerrainTiles::kTileSize - 1;
+	const int nStart = tile.key.y * TerrainTiles::kTileSize - 1;
+	const float uvScale = 1.0f / (float)TerrainTiles::kTileSize; // the textures repeat once per tile
+
+	std::vector<float> heights(samples * samples);
+	for (int i = 0; i < samples; i++)
+	{
+		for (int j = 0; j < samples; j++)
+		{
+			heights[j + i * samples] = SampleHeight(settings, (float)(nStart + j), (float)(mStart + i));
+		}
+	}
+
+	tile.vertices.resize(TerrainTiles::kTileVertices * TerrainTiles::kTileVertices);
+	tile.minHeight = heights[0];
+	tile.maxHeight = heights[0];
+	for (int i = 0; i < TerrainTiles::kTileVertices; i++)
+	{
+		const float m = (float)(mStart + i);
+		for (int j = 0; j < TerrainTiles::kTileVertices; j++)
+		{
+			const float n = (float)(nStart + j);
+			const float height = heights[j + i * samples];
+			const float dhn = heights[(j + 1) + i * samples] - height;
+			const float dhm = heights[j + (i + 1) * samples] - height;
+			const float inverseLength = 1.0f / sqrtf(dhn * dhn + 1.0f + dhm * dhm);
+
+			TerrainVertexType& vertex = tile.vertices[j + i * TerrainTiles::kTileVertices];
+			vertex.position = XMFLOAT3(n, height, m);
+			vertex.texture = XMFLOAT2(m * uvScale, n * uvScale);
+			vertex.normal = XMFLOAT3(-dhn * inverseLength, inverseLength, -dhm * inverseLength);
+
+			tile.minHeight = (std::min)(tile.minHeight, height);
+			tile.maxHeight = (std::max)(tile.maxHeight, height);
+		}
+	}
+}
+
+void TerrainStreamer::RequestTilesAround(XMFLOAT2 centre, float radius, float priorityOffset, std::vector<ID3D11Buffer*>* residentTiles, std::vector<std::pair<float, XMINT2>>& requests)
+{
+	const float tileSize = (float)TerrainTiles::kTileSize;
+	const float tileRadius = radius / tileSize;
+	const int tmMin = (int)floorf(centre.x - tileRadius);
+	const int tmMax = (int)floorf(centre.x + tileRadius);
+	const int tnMin = (int)floorf(centre.y - tileRadius);
+	const int tnMax = (int)floorf(centre.y + tileRadius);
+
+	for (int tm = tmMin; tm <= tmMax; tm++)
+	{
+		for (int tn = tnMin; tn <= tnMax; tn++)
+		{
+			// distance (in tiles) from the centre to the closest point of the tile
+			const float dm = (std::max)((std::max)((float)tm - centre.x, centre.x - (float)(tm + 1)), 0.0f);
+			const float dn = (std::max)((std::max)((float)tn - centre.y, centre.y - (float)(tn + 1)), 0.0f);
+			const float distance = sqrtf(dm * dm + dn * dn) * tileSize;
+			if (distance > radius)
+			{
+				continue;
+			}
+
+			const XMINT2 key(tm, tn);
+			auto cached = cache.find(GetKeyHash(key));
+			if (cached != cache.end())
+			{
+				// most recently used
+				StreamedTile& tile = cached->second;
+				if (tile.lastUsedFrame != frame)
+				{
+					tile.lastUsedFrame = frame;
+					lru.splice(lru.begin(), lru, tile.lruPosition);
+				}
+				if (residentTiles)
+				{
+					residentTiles->push_back(tile.vertexBuffer);
+				}
+			}
+			else
+			{
+				requests.push_back(std::make_pair(distance + priorityOffset, key));
+			}
+		}
+	}
+}
+
+void TerrainStreamer::UploadGeneratedTiles(ID3D11DeviceContext* deviceContext)
+{
+	std::vector<GeneratedTile> uploads;
+	{
+		std::lock_guard<std::mutex> lock(jobsMutex);
+		const int count = (std::min)((int)generated.size(), kMaxUploadsPerFrame);
+		for (int i = 0; i < count; i++)
+		{
+			requestedTiles.erase(GetKeyHash(generated[i].key));
+			uploads.push_back(std::move(generated[i]));
+		}
+		generated.erase(generated.begin(), generated.begin() + count);
+	}
+
+	D3D11_BUFFER_DESC vertexBufferDesc;
+	vertexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+	vertexBufferDesc.ByteWidth = (UINT)kTileBytes;
+	vertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	vertexBufferDesc.CPUAccessFlags = 0;
+	vertexBufferDesc.MiscFlags = 0;
+	vertexBufferDesc.StructureByteStride = 0;
+
+	for (GeneratedTile& generatedTile : uploads)
+	{
+		const long long hash = GetKeyHash(generatedTile.key);
+		if (generatedTile.settingsVersion != settingsVersion || cache.count(hash) > 0)
+		{
+			continue;
+		}
+
+		// reuse the buffer of an evicted tile when there is one
+		ID3D11Buffer* buffer = nullptr;
+		if (!freeBuffers.empty())
+		{
+			buffer = freeBuffers.back();
+			freeBuffers.pop_back();
+		}
+		else
+		{
+			device->CreateBuffer(&vertexBufferDesc, NULL, &buffer);
+		}
+		deviceContext->UpdateSubresource(buffer, 0, NULL, generatedTile.vertices.data(), 0, 0);
+
+		lru.push_front(hash);
+		StreamedTile& tile = cache[hash];
+		tile.key = generatedTile.key;
+		tile.vertexBuffer = buffer;
+		tile.minHeight = generatedTile.minHeight;
+		tile.maxHeight = generatedTile.maxHeight;
+		tile.lastUsedFrame = 0;
+		tile.lruPosition = lru.begin();
+	}
+}
+
+void TerrainStreamer::EvictTiles()
+{
+	// Evict from the least recently used end, never a tile wanted in this frame
+	while (cache.size() * kTileBytes > memoryBudget && !lru.empty())
+	{
+		auto evicted = cache.find(lru.back());
+		if (evicted->second.lastUsedFrame == frame)
+		{
+			break;
+		}
+
+		// keep a few buffers for the next uploads, release the rest
+		if ((int)freeBuffers.size() < kMaxUploadsPerFrame)
+		{
+			freeBuffers.push_back(evicted->second.vertexBuffer);
+		}
+		else
+		{
+			evicted->second.vertexBuffer->Release();
+		}
+
+		cache.erase(evicted);
+		lru.pop_back();
+	}
+}
+
+void TerrainStreamer::ClearCache()
+{
+	for (auto& entry : cache)
+	{
+		entry.second.vertexBuffer->Release();
+	}
+	cache.clear();
+	lru.clear();
+	visibleTiles.clear();
+}
@@ -0,0 +1,135 @@
+#pragma once
+#include <d3d11.h>
+#include <atomic>
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "TaskScheduler.h"
+#include "TerrainTiles.h"
+
+// Parameters of the procedural height function of the infinite terrain
+struct StreamingTerrainSettings
+{
+	int seed = 1;
+	int octaves = 6;
+	float frequency = 0.004f; // of the first octave, per unit
+	float amplitude = 40.0f;
+	float lacunarity = 2.0f;
+	float persistence = 0.5f;
+	float ridgeWeight = 0.3f; // blend from fBm (0) to ridged fBm (1)
+};
+
+// Tile of the infinite terrain resident in the cache
+struct StreamedTile
+{
+	XMINT2 key; // tile coordinates (m, n), the tile covers the quads from key * kTileSize
+	ID3D11Buffer* vertexBuffer;
+	float minHeight, maxHeight;
+	int lastUsedFrame;
+	std::list<long long>::iterator lruPosition;
+};
+
+// Terrain without bounds generated around the camera in tiles of TerrainTiles::kTileSize^2 quads.
+// The tiles are generated on demand from the seeded noise by background tasks of the TaskScheduler, closest first,
+// and also ahead of the camera along its velocity. The uploaded tiles are kept in a LRU cache with a memory budget.
+// Everything that touches D3D runs on the calling (render) thread, at most kMaxUploadsPerFrame tiles per frame
+class TerrainStreamer
+{
+public:
+	static const int kMaxUploadsPerFrame = 8;
+
+	TerrainStreamer(ID3D11Device* device, int workerCount = 0); // tiles generated at the same time, 0 uses the workers of the scheduler
+	~TerrainStreamer();
+
+	// A change of the settings drops every cached tile and pending job
+	void SetSettings(const StreamingTerrainSettings& newSettings);
+	const StreamingTerrainSettings& GetSettings() const { return settings; }
+
+	void SetViewDistance(float distance) { viewDistance = distance; } // radius around the camera that has to be resident
+	void SetPrefetchTime(float seconds) { prefetchTime = seconds; } // how far ahead along the velocity the tiles are requested
+	void SetMemoryBudget(size_t bytes) { memoryBudget = bytes; }
+
+	// Request the tiles around the camera and ahead of it, upload the finished ones and evict the least recently used
+	void Update(ID3D11DeviceContext* deviceContext, XMFLOAT3 cameraPosition, float dt);
+
+	// Drawing: bind the index buffer once, then every visible tile
+	void SendIndexData(ID3D11DeviceContext* deviceContext, D3D_PRIMITIVE_TOPOLOGY top = D3D11_PRIMITIVE_TOPOLOGY_12_CONTROL_POINT_PATCHLIST);
+	int GetVisibleTileCount() const { return (int)visibleTiles.size(); }
+	void SendTileData(ID3D11DeviceContext* deviceContext, int visibleTile);
+	int GetTileIndexCount() const { return TerrainTiles::kTileSize * TerrainTiles::kTileSize * TerrainTiles::kNeighbourIndicesPerPatch; }
+
+	// Height of the procedural terrain at a world position (x = n, z = m)
+	static float SampleHeight(const StreamingTerrainSettings& settings, float x, float z);
+
+	int GetCachedTileCount() const { return (int)cache.size(); }
+	int GetPendingTileCount();
+	size_t GetMemoryUsage() const { return cache.size() * kTileBytes; }
+	size_t GetMemoryBudget() const { return memoryBudget; }
+	int GetGeneratedTileCount() const { return generatedTiles; }
+
+private:
+	static const size_t kTileBytes = sizeof(TerrainVertexType) * TerrainTiles::kTileVertices * TerrainTiles::kTileVertices;
+
+	// Vertices of a tile produced by a generation task
+	struct GeneratedTile
+	{
+		XMINT2 key;
+		int settingsVersion;
+		std::vector<TerrainVertexType> vertices;
+		float minHeight, maxHeight;
+	};
+
+	static long long GetKeyHash(XMINT2 key) { return ((long long)key.x << 32) ^ (unsigned int)key.y; }
+
+	// Start generation tasks for the pending jobs, up to workerCount at a time
+	void StartGenerations();
+	// Generate the most urgent pending tile. The task submits the next one while there are pending jobs,
+	// each task is a single tile so the other work of the scheduler is not kept waiting
+	void GenerateNext();
+	static void GenerateTile(const StreamingTerrainSettings& settings, GeneratedTile& tile);
+
+	// Mark as used the cached tiles in radius around the centre (in tile coordinates) and add them to residentTiles (if any).
+	// The rest are added to the requests with their distance plus priorityOffset as priority
+	void RequestTilesAround(XMFLOAT2 centre, float radius, float priorityOffset, std::vector<ID3D11Buffer*>* residentTiles, std::vector<std::pair<float, XMINT2>>& requests);
+	void UploadGeneratedTiles(ID3D11DeviceContext* deviceContext);
+	void EvictTiles();
+	void ClearCache();
+
+	ID3D11Device* device;
+	ID3D11Buffer* indexBuffer;
+
+	StreamingTerrainSettings settings;
+	int settingsVersion; // generated tiles of an older version are discarded
+	float viewDistance;
+	float prefetchTime;
+	size_t memoryBudget;
+
+	// Cache of uploaded tiles, the front of the LRU list is the most recently used
+	std::unordered_map<long long, StreamedTile> cache;
+	std::list<long long> lru;
+	std::vector<ID3D11Buffer*> freeBuffers; // vertex buffers of evicted tiles, reused by the next uploads
+	std::vector<ID3D11Buffer*> visibleTiles;
+	int frame;
+
+	// Camera motion for the prefetch
+	XMFLOAT3 lastCameraPosition;
+	XMFLOAT3 cameraVelocity;
+	bool hasLastCameraPosition;
+
+	// Shared with the generation tasks
+	std::mutex jobsMutex;
+	std::condition_variable generationsFinished;
+	std::vector<XMINT2> pendingJobs; // sorted so the most urgent one is at the back
+	std::unordered_set<long long> requestedTiles; // pending or being generated
+	std::vector<GeneratedTile> generated;
+	StreamingTerrainSettings workerSettings;
+	int workerSettingsVersion;
+	bool stopWorkers;
+	int maxGenerations;
+	int generationsInFlight; // tasks submitted and not finished
+	std::atomic<int> generatedTiles;
+};
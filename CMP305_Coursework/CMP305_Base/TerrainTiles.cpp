@@ -0,0 +1,494 @@
+#include "TerrainTiles.h"
+
+#include <cfloat>
+#include <cmath>
+
+#include "Parallel.h"
+
+const int TerrainTiles::kTileSize;
+const int TerrainTiles::kTileVertices;
+const int TerrainTiles::kIndicesPerPatch;
+const int TerrainTiles::kNeighbourIndicesPerPatch;
+const int TerrainTiles::kUploadBatch;
+
+// a tile has to be a whole power of two of quadtree leaves, so the Morton order covers it exactly
+static_assert(TerrainTiles::kTileSize % HeightQuadtree::kLeafSize == 0 && ((TerrainTiles::kTileSize / HeightQuadtree::kLeafSize) & (TerrainTiles::kTileSize / HeightQuadtree::kLeafSize - 1)) == 0,
+	"The tile size must be a power of two multiple of the quadtree leaf size");
+
+
+TerrainTiles::TerrainTiles()
+	: resolution(0, 0), tileGrid(0, 0), indexBuffer(nullptr), quadtreeBuilt(false), uploadedBytes(0)
+{
+}
+
+TerrainTiles::~TerrainTiles()
+{
+	ReleaseTiles();
+
+	if (indexBuffer)
+	{
+		indexBuffer->Release();
+		indexBuffer = nullptr;
+	}
+}
+
+void TerrainTiles::Resize(ID3D11Device* device, XMINT2 newResolution)
+{
+	ReleaseTiles();
+
+	if (indexBuffer == nullptr)
+	{
+		indexBuffer = CreateIndexBuffer(device, kIndicesPerPatch);
+	}
+
+	resolution = newResolution;
+	quadtreeBuilt = false;
+	tileGrid = XMINT2((resolution.x + kTileSize - 1) / kTileSize, (resolution.y + kTileSize - 1) / kTileSize);
+	tiles.resize(tileGrid.x * tileGrid.y);
+
+	// The static stream is only written here. The dynamic one is written with UpdateSubresource only when the tile is dirty,
+	// so the buffers are not dynamic
+	D3D11_BUFFER_DESC staticBufferDesc;
+	D3D11_SUBRESOURCE_DATA staticData;
+	staticBufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	staticBufferDesc.ByteWidth = sizeof(TerrainStaticVertexType) * kTileVertices * kTileVertices;
+	staticBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	staticBufferDesc.CPUAccessFlags = 0;
+	staticBufferDesc.MiscFlags = 0;
+	staticBufferDesc.StructureByteStride = 0;
+	staticData.SysMemPitch = 0;
+	staticData.SysMemSlicePitch = 0;
+
+	D3D11_BUFFER_DESC dynamicBufferDesc;
+	dynamicBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+	dynamicBufferDesc.ByteWidth = sizeof(TerrainDynamicVertexType) * kTileVertices * kTileVertices;
+	dynamicBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	dynamicBufferDesc.CPUAccessFlags = 0;
+	dynamicBufferDesc.MiscFlags = 0;
+	dynamicBufferDesc.StructureByteStride = 0;
+
+	std::vector<TerrainStaticVertexType> staticVertices(kTileVertices * kTileVertices);
+	for (int tm = 0; tm < tileGrid.x; tm++)
+	{
+		for (int tn = 0; tn < tileGrid.y; tn++)
+		{
+			TerrainTile& tile = tiles[tn + tm * tileGrid.y];
+			tile.origin = XMINT2(tm * kTileSize, tn * kTileSize);
+			tile.size = XMINT2((std::min)(kTileSize, resolution.x - tile.origin.x), (std::min)(kTileSize, resolution.y - tile.origin.y));
+			tile.staticBuffer = nullptr;
+			tile.dynamicBuffer = nullptr;
+			tile.dirty = true;
+			tile.dirtyPoints = GetTileReadRect(tile);
+
+			BuildTileStaticVertices(tile, staticVertices.data());
+			staticData.pSysMem = staticVertices.data();
+			device->CreateBuffer(&staticBufferDesc, &staticData, &tile.staticBuffer);
+			device->CreateBuffer(&dynamicBufferDesc, NULL, &tile.dynamicBuffer);
+		}
+	}
+}
+
+void TerrainTiles::MarkAllDirty()
+{
+	for (TerrainTile& tile : tiles)
+	{
+		tile.dirty = true;
+		tile.dirtyPoints = GetTileReadRect(tile);
+	}
+}
+
+void TerrainTiles::MarkDirty(const HeightFieldRect& rect)
+{
+	if (rect.IsEmpty() || tiles.empty())
+	{
+		return;
+	}
+
+	// The tile tm reads the rows [m0 - 1, m0 + kTileSize + 2]: its points, the apron and the next row for the normals.
+	// Same for the columns
+	auto firstTile = [](int pointMin) { const int a = pointMin - kTileSize - 2; return a <= 0 ? 0 : (a + kTileSize - 1) / kTileSize; };
+	auto lastTile = [](int pointMax, int tileCount) { return (std::min)((std::max)(pointMax + 1, 0) / kTileSize, tileCount - 1); };
+
+	const int tmMin = firstTile(rect.mMin);
+	const int tmMax = lastTile(rect.mMax, tileGrid.x);
+	const int tnMin = firstTile(rect.nMin);
+	const int tnMax = lastTile(rect.nMax, tileGrid.y);
+
+	for (int tm = tmMin; tm <= tmMax; tm++)
+	{
+		for (int tn = tnMin; tn <= tnMax; tn++)
+		{
+			// the part of rect the tile reads, added to what has changed under it before
+			TerrainTile& tile = tiles[tn + tm * tileGrid.y];
+			const HeightFieldRect readRect = GetTileReadRect(tile);
+			const HeightFieldRect points((std::max)(rect.mMin, readRect.mMin), (std::max)(rect.nMin, readRect.nMin),
+				(std::min)(rect.mMax, readRect.mMax), (std::min)(rect.nMax, readRect.nMax));
+			if (points.IsEmpty())
+			{
+				continue;
+			}
+			if (!tile.dirty)
+			{
+				tile.dirtyPoints = points;
+			}
+			else
+			{
+				tile.dirtyPoints = HeightFieldRect((std::min)(tile.dirtyPoints.mMin, points.mMin), (std::min)(tile.dirtyPoints.nMin, points.nMin),
+					(std::max)(tile.dirtyPoints.mMax, points.mMax), (std::max)(tile.dirtyPoints.nMax, points.nMax));
+			}
+			tile.dirty = true;
+		}
+	}
+}
+
+int TerrainTiles::Update(ID3D11DeviceContext* deviceContext, const HeightField& heightField)
+{
+	std::vector<int> dirtyTiles;
+	for (int tile = 0; tile < (int)tiles.size(); tile++)
+	{
+		if (tiles[tile].dirty)
+		{
+			dirtyTiles.push_back(tile);
+		}
+	}
+
+	if (dirtyTiles.empty())
+	{
+		return 0;
+	}
+
+	// Bounds of the quadtree under the dirty tiles, or all of them
+	if (!quadtreeBuilt || dirtyTiles.size() == tiles.size())
+	{
+		quadtree.Build(heightField);
+		quadtreeBuilt = true;
+	}
+	else
+	{
+		// the changed points of the tile, the ones of the apron belong to the neighbour tiles
+		for (int tile : dirtyTiles)
+		{
+			const TerrainTile& dirtyTile = tiles[tile];
+			const HeightFieldRect& points = dirtyTile.dirtyPoints;
+			quadtree.Update(heightField, HeightFieldRect((std::max)(points.mMin, dirtyTile.origin.x), (std::max)(points.nMin, dirtyTile.origin.y),
+				(std::min)(points.mMax, dirtyTile.origin.x + dirtyTile.size.x), (std::min)(points.nMax, dirtyTile.origin.y + dirtyTile.size.y)));
+		}
+	}
+
+	// The tiles are built and uploaded kUploadBatch at a time, so the staging vertices stay the size of a batch
+	// however many tiles a full rebuild has
+	const int tileVertexCount = kTileVertices * kTileVertices;
+	const int batchSize = (std::min)((int)dirtyTiles.size(), kUploadBatch);
+	if (stagingVertices.size() < (size_t)batchSize * tileVertexCount)
+	{
+		stagingVertices.resize((size_t)batchSize * tileVertexCount);
+	}
+
+	uploadedBytes = 0;
+	for (int batchBegin = 0; batchBegin < (int)dirtyTiles.size(); batchBegin += kUploadBatch)
+	{
+		const int batchEnd = (std::min)(batchBegin + kUploadBatch, (int)dirtyTiles.size());
+
+		// Build the vertices of the tiles of the batch in parallel
+		Parallel::For(batchBegin, batchEnd, [&](int i)
+		{
+			const TerrainTile& tile = tiles[dirtyTiles[i]];
+			int rowMin, rowMax;
+			GetDirtyRows(tile, rowMin, rowMax);
+			BuildTileVertices(tile, heightField, rowMin, rowMax, &stagingVertices[(i - batchBegin) * tileVertexCount]);
+		});
+
+		// The device context is not thread safe, so the uploads are done here.
+		// The rows of a tile are contiguous in its buffer, so the dirty ones are a single box of bytes
+		for (int i = batchBegin; i < batchEnd; i++)
+		{
+			TerrainTile& tile = tiles[dirtyTiles[i]];
+			int rowMin, rowMax;
+			GetDirtyRows(tile, rowMin, rowMax);
+			const UINT rowBytes = sizeof(TerrainDynamicVertexType) * kTileVertices;
+
+			D3D11_BOX box;
+			box.left = rowMin * rowBytes;
+			box.right = (rowMax + 1) * rowBytes;
+			box.top = 0;
+			box.bottom = 1;
+			box.front = 0;
+			box.back = 1;
+			deviceContext->UpdateSubresource(tile.dynamicBuffer, 0, &box, &stagingVertices[(i - batchBegin) * tileVertexCount + rowMin * kTileVertices], 0, 0);
+			uploadedBytes += box.right - box.left;
+			tile.dirty = false;
+		}
+	}
+
+	return (int)dirtyTiles.size();
+}
+
+void TerrainTiles::SendIndexData(ID3D11DeviceContext* deviceContext, D3D_PRIMITIVE_TOPOLOGY top)
+{
+	deviceContext->IASetIndexBuffer(indexBuffer, DXGI_FORMAT_R16_UINT, 0);
+	deviceContext->IASetPrimitiveTopology(top);
+}
+
+void TerrainTiles::SendTileData(ID3D11DeviceContext* deviceContext, int tile)
+{
+	ID3D11Buffer* buffers[2] = { tiles[tile].staticBuffer, tiles[tile].dynamicBuffer };
+	unsigned int strides[2] = { sizeof(TerrainStaticVertexType), sizeof(TerrainDynamicVertexType) };
+	unsigned int offsets[2] = { 0, 0 };
+
+	deviceContext->IASetVertexBuffers(0, 2, buffers, strides, offsets);
+}
+
+ID3D11Buffer* TerrainTiles::CreateIndexBuffer(ID3D11Device* device, int indicesPerPatch)
+{
+	// Local vertex (i, j) of a tile is the point (origin.x + i - 1, origin.y + j - 1), less than 2^16 vertices per tile
+	auto vertexIndex = [](int i, int j) { return (unsigned short)(j + i * kTileVertices); };
+
+	// The patches are ordered by blocks (quadtree leaves) in Morton order, and row by row inside a block.
+	// The 4 corners first, then the neighbours if indicesPerPatch is 12, the same control points as a single mesh:
+	//			   6 -------- 7
+	//			   |		  |
+	//  8 -------- 0 -------- 3 -------- 5
+	//	|		   |		  |			 |
+	//  9 -------- 1 -------- 2 -------- 4
+	//			   |		  |
+	//			  10 -------- 11
+	// The apron replaces the clamping of the neighbours at the terrain borders
+	const int leafSize = HeightQuadtree::kLeafSize;
+	const int patchesPerBlock = leafSize * leafSize;
+	std::vector<unsigned short> indices(kTileSize * kTileSize * indicesPerPatch);
+	for (int qm = 0; qm < kTileSize; qm++)
+	{
+		for (int qn = 0; qn < kTileSize; qn++)
+		{
+			const int patch = GetBlockOrder(qm / leafSize, qn / leafSize) * patchesPerBlock + (qn % leafSize) + (qm % leafSize) * leafSize;
+			unsigned short* patchIndices = &indices[patch * indicesPerPatch];
+
+			const int i = qm + 1;
+			const int j = qn + 1;
+			patchIndices[0] = vertexIndex(i + 1, j + 0);
+			patchIndices[1] = vertexIndex(i + 0, j + 0);
+			patchIndices[2] = vertexIndex(i + 0, j + 1);
+			patchIndices[3] = vertexIndex(i + 1, j + 1);
+			if (indicesPerPatch < kNeighbourIndicesPerPatch)
+			{
+				continue;
+			}
+			patchIndices[4] = vertexIndex(i + 0, j + 2);
+			patchIndices[5] = vertexIndex(i + 1, j + 2);
+			patchIndices[6] = vertexIndex(i + 2, j + 0);
+			patchIndices[7] = vertexIndex(i + 2, j + 1);
+			patchIndices[8] = vertexIndex(i + 1, j - 1);
+			patchIndices[9] = vertexIndex(i + 0, j - 1);
+			patchIndices[10] = vertexIndex(i - 1, j + 0);
+			patchIndices[11] = vertexIndex(i - 1, j + 1);
+		}
+	}
+
+	D3D11_BUFFER_DESC indexBufferDesc;
+	D3D11_SUBRESOURCE_DATA indexData;
+
+	indexBufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	indexBufferDesc.ByteWidth = (UINT)(sizeof(unsigned short) * indices.size());
+	indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	indexBufferDesc.CPUAccessFlags = 0;
+	indexBufferDesc.MiscFlags = 0;
+	indexBufferDesc.StructureByteStride = 0;
+	indexData.pSysMem = indices.data();
+	indexData.SysMemPitch = 0;
+	indexData.SysMemSlicePitch = 0;
+
+	ID3D11Buffer* buffer = nullptr;
+	device->CreateBuffer(&indexBufferDesc, &indexData, &buffer);
+	return buffer;
+}
+
+void TerrainTiles::Cull(const Frustum* frustum, const HorizonOcclusion* occlusion, float heightFloor, std::vector<TerrainDrawRange>& ranges) const
+{
+	ranges.clear();
+	if (tiles.empty() || !quadtreeBuilt)
+	{
+		return;
+	}
+
+	const int root = quadtree.GetLevelCount() - 1;
+	CullNode(frustum, occlusion, heightFloor, root, 0, 0, frustum == nullptr, ranges);
+}
+
+void TerrainTiles::CullNode(const Frustum* frustum, const HorizonOcclusion* occlusion, float heightFloor, int level, int i, int j, bool inside, std::vector<TerrainDrawRange>& ranges) const
+{
+	const XMINT2 levelSize = quadtree.GetLevelSize(level);
+	if (i >= levelSize.x || j >= levelSize.y)
+	{
+		return;
+	}
+
+	const OcclusionState occlusionState = occlusion ? occlusion->GetState(level, i, j) : kOcclusionVisible;
+	if (occlusionState == kOcclusionHidden)
+	{
+		return;
+	}
+
+	// once a node is inside the frustum so are all its children
+	if (!inside)
+	{
+		const HeightFieldRect quads = quadtree.GetNodeQuads(level, i, j);
+		const XMFLOAT2 bounds = quadtree.GetBounds(level, i, j);
+		const XMFLOAT3 boxMin((float)quads.nMin, (std::max)(bounds.x, heightFloor), (float)quads.mMin);
+		const XMFLOAT3 boxMax((float)(quads.nMax + 1), (std::max)(bounds.y, heightFloor), (float)(quads.mMax + 1));
+
+		const FrustumTestResult result = frustum->TestBox(boxMin, boxMax);
+		if (result == kFrustumOutside)
+		{
+			return;
+		}
+		inside = (result == kFrustumInside);
+	}
+
+	// A node inside a tile is a single range if it is whole (the nodes at the far borders can miss some children).
+	// The leaves are always drawn whole, the quads beyond the end of the terrain are degenerate
+	const int leavesPerTile = kTileSize / HeightQuadtree::kLeafSize;
+	const XMINT2 leafGrid = quadtree.GetLevelSize(0);
+	const bool insideTile = (1 << level) <= leavesPerTile;
+	const bool whole = ((i + 1) << level) <= leafGrid.x && ((j + 1) << level) <= leafGrid.y;
+	if (level == 0 || (inside && occlusionState == kOcclusionVisible && insideTile && whole))
+	{
+		AddNodeRange(level, i, j, ranges);
+		return;
+	}
+
+	// children in Morton order, the same order as the index buffer
+	CullNode(frustum, occlusion, heightFloor, level - 1, 2 * i, 2 * j, inside, ranges);
+	CullNode(frustum, occlusion, heightFloor, level - 1, 2 * i, 2 * j + 1, inside, ranges);
+	CullNode(frustum, occlusion, heightFloor, level - 1, 2 * i + 1, 2 * j, inside, ranges);
+	CullNode(frustum, occlusion, heightFloor, level - 1, 2 * i + 1, 2 * j + 1, inside, ranges);
+}
+
+void TerrainTiles::AddNodeRange(int level, int i, int j, std::vector<TerrainDrawRange>& ranges) const
+{
+	const int leavesPerTile = kTileSize / HeightQuadtree::kLeafSize;
+	const int indicesPerBlock = HeightQuadtree::kLeafSize * HeightQuadtree::kLeafSize * kIndicesPerPatch;
+
+	// first leaf of the node, its tile and its block inside the tile
+	const int leafM = i << level;
+	const int leafN = j << level;
+	const int tile = (leafN / leavesPerTile) + (leafM / leavesPerTile) * tileGrid.y;
+
+	TerrainDrawRange range;
+	range.tile = tile;
+	range.startIndex = GetBlockOrder(leafM % leavesPerTile, leafN % leavesPerTile) * indicesPerBlock;
+	range.indexCount = (1 << (2 * level)) * indicesPerBlock;
+
+	if (!ranges.empty() && ranges.back().tile == tile && ranges.back().startIndex + ranges.back().indexCount == range.startIndex)
+	{
+		ranges.back().indexCount += range.indexCount;
+	}
+	else
+	{
+		ranges.push_back(range);
+	}
+}
+
+int TerrainTiles::GetBlockOrder(int bm, int bn)
+{
+	// interleave the bits, m in the odd ones
+	int order = 0;
+	for (int bit = 0; (1 << bit) <= (std::max)(bm, bn); bit++)
+	{
+		order |= ((bn >> bit) & 1) << (2 * bit);
+		order |= ((bm >> bit) & 1) << (2 * bit + 1);
+	}
+	return order;
+}
+
+void TerrainTiles::ReleaseTiles()
+{
+	for (TerrainTile& tile : tiles)
+	{
+		if (tile.staticBuffer)
+		{
+			tile.staticBuffer->Release();
+			tile.staticBuffer = nullptr;
+		}
+		if (tile.dynamicBuffer)
+		{
+			tile.dynamicBuffer->Release();
+			tile.dynamicBuffer = nullptr;
+		}
+	}
+	tiles.clear();
+}
+
+void TerrainTiles::BuildTileStaticVertices(const TerrainTile& tile, TerrainStaticVertexType* vertices) const
+{
+	const float fDepth = static_cast<float>(resolution.x);
+	const float fWidth = static_cast<float>(resolution.y);
+
+	for (int i = 0; i < kTileVertices; i++)
+	{
+		// the apron and the rows beyond the end of the terrain repeat the border points, as the clamped indices of a single mesh
+		const int m = (std::min)((std::max)(tile.origin.x + i - 1, 0), resolution.x);
+		const float v = static_cast<float>(m) / fDepth;
+
+		for (int j = 0; j < kTileVertices; j++)
+		{
+			const int n = (std::min)((std::max)(tile.origin.y + j - 1, 0), resolution.y);
+			const float u = static_cast<float>(n) / fWidth;
+
+			TerrainStaticVertexType& vertex = vertices[j + i * kTileVertices];
+			vertex.position = XMFLOAT2((float)n, (float)m);
+			vertex.texture = XMFLOAT2(v, u);
+		}
+	}
+}
+
+HeightFieldRect TerrainTiles::GetTileReadRect(const TerrainTile& tile) const
+{
+	// the vertex rows [m0 - 1, m0 + kTileSize + 1] and the next row for the normals, same for the columns
+	return HeightFieldRect(tile.origin.x - 1, tile.origin.y - 1, tile.origin.x + kTileVertices - 1, tile.origin.y + kTileVertices - 1);
+}
+
+void TerrainTiles::GetDirtyRows(const TerrainTile& tile, int& rowMin, int& rowMax) const
+{
+	// the vertex row i reads the points of the rows m0 + i - 1 and m0 + i (its normals), and the first one
+	// repeats the row 0 at the top of the terrain, so a changed row m is read by the vertex rows m - m0 and m - m0 + 1 at most
+	rowMin = (std::max)(tile.dirtyPoints.mMin - tile.origin.x - 1, 0);
+	rowMax = (std::min)(tile.dirtyPoints.mMax - tile.origin.x + 1, kTileVertices - 1);
+	// the rows past the end of the terrain repeat the last one
+	if (tile.dirtyPoints.mMax >= resolution.x)
+	{
+		rowMax = kTileVertices - 1;
+	}
+}
+
+void TerrainTiles::BuildTileVertices(const TerrainTile& tile, const HeightField& heightField, int rowMin, int rowMax, TerrainDynamicVertexType* vertices) const
+{
+	// the points of a row of the tile and their neighbours at (m, n + 1) and (m + 1, n) for the normals
+	float heights[kTileVertices], right[kTileVertices], below[kTileVertices];
+
+	// columns read by the tile: its points, the apron and the next column for the normals
+	const int nFirst = (std::max)(tile.origin.y - 1, 0);
+	const int nCount = (std::min)(tile.origin.y + kTileVertices - 1, resolution.y) - nFirst + 1;
+	// the buffers start at the column nFirst
+	float row[kTileVertices + 1], nextRow[kTileVertices + 1];
+
+	for (int i = rowMin; i <= rowMax; i++)
+	{
+		// the apron and the rows beyond the end of the terrain repeat the border points, as the clamped indices of a single mesh
+		const int m = (std::min)((std::max)(tile.origin.x + i - 1, 0), resolution.x);
+		heightField.ReadRow(m, nFirst, nCount, row);
+		heightField.ReadRow((std::min)(m + 1, resolution.x), nFirst, nCount, nextRow);
+
+		for (int j = 0; j < kTileVertices; j++)
+		{
+			const int n = (std::min)((std::max)(tile.origin.y + j - 1, 0), resolution.y);
+			heights[j] = row[n - nFirst];
+
+			// Normal of the quad (m, n), the last row and column have no quad and look up (+y)
+			const bool quad = m < resolution.x && n < resolution.y;
+			right[j] = quad ? row[n + 1 - nFirst] : heights[j];
+			below[j] = quad ? nextRow[n - nFirst] : heights[j];
+		}
+
+		TerrainVertexPacking::PackRow(heights, right, below, kTileVertices, &vertices[i * kTileVertices]);
+	}
+}
@@ -0,0 +1,120 @@
+#pragma once
+#include <d3d11.h>
+#include <vector>
+
+#include "HeightField.h"
+#include "HeightQuadtree.h"
+#include "Frustum.h"
+#include "HorizonOcclusion.h"
+#include "TerrainVertexPacking.h"
+
+// Same layout as BaseMesh::VertexType, which is what the tessellation shader input layout expects
+struct TerrainVertexType
+{
+	XMFLOAT3 position;
+	XMFLOAT2 texture;
+	XMFLOAT3 normal;
+};
+
+// Block of up to kTileSize x kTileSize quads of the terrain with its own vertex buffers
+struct TerrainTile
+{
+	XMINT2 origin; // first quad (m, n) of the tile in the height map
+	XMINT2 size; // number of quads (m, n), smaller than kTileSize in the last row/column of tiles
+	ID3D11Buffer* staticBuffer; // TerrainStaticVertexType, written once when the tile is created
+	ID3D11Buffer* dynamicBuffer; // TerrainDynamicVertexType, written when the tile is dirty
+	bool dirty; // the height map has changed under the tile since its vertices were uploaded
+	HeightFieldRect dirtyPoints; // the points changed, within the ones the tile reads: only the rows of vertices that read them are uploaded
+};
+
+// Contiguous part of the shared index buffer to draw with the vertex buffer of a tile
+struct TerrainDrawRange
+{
+	int tile;
+	int startIndex;
+	int indexCount;
+};
+
+// Chunked terrain: the height map is split in fixed-size tiles which are rebuilt independently.
+// Every tile stores its points plus a one point apron at each side (the border samples shared with
+// the neighbour tiles), so all the control points of every patch are inside the tile and all the tiles
+// can be drawn with the same index buffer. The terrain patches have 4 control points (PatchTessellation gives
+// the factors), the 12 control point patches of the hull shader that finds the neighbours are kept for the streamed terrain.
+// The patches of a tile are ordered by blocks of HeightQuadtree::kLeafSize^2 quads in Morton (Z) order, so every
+// quadtree node inside a tile is a contiguous range of indices and the visible parts are drawn with few ranges.
+// The vertices are split in two streams: the grid position and texture coordinates never change for a resolution,
+// so only the height and the packed normal (8 bytes instead of the 32 of TerrainVertexType) are uploaded after an edit
+class TerrainTiles
+{
+public:
+	static const int kTileSize = 64; // quads per side of a tile
+	static const int kTileVertices = kTileSize + 3; // vertices per side of a tile: kTileSize + 1 points and the apron
+	static const int kIndicesPerPatch = 4;
+	static const int kNeighbourIndicesPerPatch = 12; // the 4 corners and 2 points of each neighbour quad
+	static const int kUploadBatch = 64; // dirty tiles built and uploaded at a time by Update()
+
+	TerrainTiles();
+	~TerrainTiles();
+
+	// Create the tiles (and release the old ones) for a height map of the given resolution. Every tile starts dirty
+	void Resize(ID3D11Device* device, XMINT2 resolution);
+
+	// Flag the tiles to be rebuilt in the next Update()
+	void MarkAllDirty();
+	void MarkDirty(const HeightFieldRect& rect); // every tile whose vertices (or normals) read a point of rect
+
+	// Rebuild the vertices and the quadtree bounds of the dirty tiles in parallel and upload them. Return the number of tiles rebuilt.
+	// Only the rows of vertices of a tile that read a changed point are rebuilt and uploaded, a small edit writes a few rows
+	int Update(ID3D11DeviceContext* deviceContext, const HeightField& heightField);
+	// Bytes of vertices uploaded by the last Update() that rebuilt something
+	size_t GetUploadedBytes() const { return uploadedBytes; }
+
+	// Walk the quadtree and output the index ranges of the nodes inside the frustum, everything if frustum is null.
+	// Heights below heightFloor are drawn at heightFloor (fake water level).
+	// The nodes hidden by the terrain are skipped too if occlusion (computed from GetQuadtree()) is not null
+	void Cull(const Frustum* frustum, const HorizonOcclusion* occlusion, float heightFloor, std::vector<TerrainDrawRange>& ranges) const;
+
+	// Bind the shared index buffer and the primitive topology, once for all the tiles
+	void SendIndexData(ID3D11DeviceContext* deviceContext, D3D_PRIMITIVE_TOPOLOGY top);
+	// Bind the two vertex streams of a tile
+	void SendTileData(ID3D11DeviceContext* deviceContext, int tile);
+
+	int GetTileCount() const { return (int)tiles.size(); }
+	XMINT2 GetTileGrid() const { return tileGrid; }
+	const TerrainTile& GetTile(int tile) const { return tiles[tile]; }
+	int GetPatchCount() const { return resolution.x * resolution.y; }
+	const HeightQuadtree& GetQuadtree() const { return quadtree; }
+
+	// Create the index buffer of the patches of a tile with kIndicesPerPatch or kNeighbourIndicesPerPatch control points,
+	// it is the same for any grid of kTileVertices^2 vertices
+	static ID3D11Buffer* CreateIndexBuffer(ID3D11Device* device, int indicesPerPatch);
+
+private:
+	void ReleaseTiles();
+	// Fill the kTileVertices^2 static vertices of a tile
+	void BuildTileStaticVertices(const TerrainTile& tile, TerrainStaticVertexType* vertices) const;
+	// Fill the rows [rowMin, rowMax] of the kTileVertices^2 dynamic vertices of a tile from the height map
+	void BuildTileVertices(const TerrainTile& tile, const HeightField& heightField, int rowMin, int rowMax, TerrainDynamicVertexType* vertices) const;
+	// Points read by the vertices of a tile (and their normals), not clipped to the height map
+	HeightFieldRect GetTileReadRect(const TerrainTile& tile) const;
+	// Rows of vertices of a tile that read its dirty points
+	void GetDirtyRows(const TerrainTile& tile, int& rowMin, int& rowMax) const;
+
+	void CullNode(const Frustum* frustum, const HorizonOcclusion* occlusion, float heightFloor, int level, int i, int j, bool inside, std::vector<TerrainDrawRange>& ranges) const;
+	// Add the index range of a quadtree node that is inside a tile, merged with the previous range when they are contiguous
+	void AddNodeRange(int level, int i, int j, std::vector<TerrainDrawRange>& ranges) const;
+	// Position of the block of quads (bm, bn) of a tile in the Morton order
+	static int GetBlockOrder(int bm, int bn);
+
+	XMINT2 resolution;
+	XMINT2 tileGrid; // number of tiles along m and n
+	std::vector<TerrainTile> tiles; // tile (tm, tn) is at tn + tm * tileGrid.y
+	ID3D11Buffer* indexBuffer;
+
+	// Min/max heights over the whole height map, its leaves are the blocks of quads of the index buffer
+	HeightQuadtree quadtree;
+	bool quadtreeBuilt;
+
+	std::vector<TerrainDynamicVertexType> stagingVertices; // vertices of a batch of dirty tiles before the upload
+	size_t uploadedBytes;
+};
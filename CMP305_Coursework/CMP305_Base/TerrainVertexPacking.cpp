@@ -0,0 +1,85 @@
+#include "TerrainVertexPacking.h"
+
+#include <algorithm>
+#include <cmath>
+
+static const float kSnormScale = 32767.0f;
+
+static_assert(sizeof(TerrainDynamicVertexType) == 8, "The dynamic stream is a float and two snorm16");
+
+
+void TerrainVertexPacking::EncodeNormal(const XMFLOAT3& normal, short encoded[2])
+{
+	const float inverseSum = 1.0f / (fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z));
+	float x = normal.x * inverseSum;
+	float z = normal.z * inverseSum;
+	if (normal.y < 0.0f)
+	{
+		const float foldedX = (1.0f - fabsf(z)) * (x >= 0.0f ? 1.0f : -1.0f);
+		z = (1.0f - fabsf(x)) * (z >= 0.0f ? 1.0f : -1.0f);
+		x = foldedX;
+	}
+	encoded[0] = (short)lroundf((std::min)((std::max)(x, -1.0f), 1.0f) * kSnormScale);
+	encoded[1] = (short)lroundf((std::min)((std::max)(z, -1.0f), 1.0f) * kSnormScale);
+}
+
+XMFLOAT3 TerrainVertexPacking::DecodeNormal(const short encoded[2])
+{
+	// same as the input assembler reads R16G16_SNORM, -32768 is -1 too
+	float x = (std::max)(encoded[0] / kSnormScale, -1.0f);
+	float z = (std::max)(encoded[1] / kSnormScale, -1.0f);
+	const float y = 1.0f - fabsf(x) - fabsf(z);
+	if (y < 0.0f)
+	{
+		const float unfoldedX = (1.0f - fabsf(z)) * (x >= 0.0f ? 1.0f : -1.0f);
+		z = (1.0f - fabsf(x)) * (z >= 0.0f ? 1.0f : -1.0f);
+		x = unfoldedX;
+	}
+	const float inverseLength = 1.0f / sqrtf(x * x + y * y + z * z);
+	return XMFLOAT3(x * inverseLength, y * inverseLength, z * inverseLength);
+}
+
+// Pack 4 points, the arrays are read from the first one
+static void PackGroup(const float* heights, const float* right, const float* below, TerrainDynamicVertexType* vertices, int lanes)
+{
+	const XMVECTOR height = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(heights));
+	const XMVECTOR dhn = XMVectorSubtract(XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(right)), height);
+	const XMVECTOR dhm = XMVectorSubtract(XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(below)), height);
+
+	// The normal (-dhn, 1, -dhm) / length always points up, so it is on the upper half of the octahedron and it is not folded.
+	// Dividing by |x| + |y| + |z| makes the length cancel out: no square root
+	const XMVECTOR sum = XMVectorAdd(XMVectorAdd(XMVectorAbs(dhn), XMVectorAbs(dhm)), XMVectorReplicate(1.0f));
+	const XMVECTOR scale = XMVectorDivide(XMVectorReplicate(-kSnormScale), sum);
+	XMINT4 x, z;
+	XMStoreSInt4(&x, XMVectorRound(XMVectorMultiply(dhn, scale)));
+	XMStoreSInt4(&z, XMVectorRound(XMVectorMultiply(dhm, scale)));
+
+	const int32_t* xLanes = &x.x;
+	const int32_t* zLanes = &z.x;
+	for (int lane = 0; lane < lanes; lane++)
+	{
+		vertices[lane].height = heights[lane];
+		vertices[lane].normal[0] = (short)xLanes[lane];
+		vertices[lane].normal[1] = (short)zLanes[lane];
+	}
+}
+
+void TerrainVertexPacking::PackRow(const float* heights, const float* right, const float* below, int count, TerrainDynamicVertexType* vertices)
+{
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		PackGroup(&heights[i], &right[i], &below[i], &vertices[i], 4);
+	}
+
+	// the last points are copied to a group of 4 so nothing past count is read
+	const int lanes = count - i;
+	if (lanes > 0)
+	{
+		float groupHeights[4] = {}, groupRight[4] = {}, groupBelow[4] = {};
+		std::copy(&heights[i], &heights[count], groupHeights);
+		std::copy(&right[i], &right[count], groupRight);
+		std::copy(&below[i], &below[count], groupBelow);
+		PackGroup(groupHeights, groupRight, groupBelow, &vertices[i], lanes);
+	}
+}
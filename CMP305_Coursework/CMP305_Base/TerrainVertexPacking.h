@@ -0,0 +1,35 @@
+#pragma once
+#include <DirectXMath.h>
+
+using namespace DirectX;
+
+// Static stream of the compact terrain vertices: the grid point and its texture coordinates,
+// they only depend on the resolution so they are uploaded once per resize
+struct TerrainStaticVertexType
+{
+	XMFLOAT2 position; // (n, m)
+	XMFLOAT2 texture;
+};
+
+// Dynamic stream of the compact terrain vertices, the 8 bytes rewritten when the heights change
+struct TerrainDynamicVertexType
+{
+	float height;
+	short normal[2]; // octahedral encoding of the normal, read as R16G16_SNORM
+};
+
+// Packing of the height map points into TerrainDynamicVertexType.
+// The normals are stored with the octahedral encoding: the unit vector is projected on the octahedron |x| + |y| + |z| = 1
+// and (x, z) is kept, the lower half (y < 0) folded over the upper one. terrain_tile_vs.hlsl decodes it
+class TerrainVertexPacking
+{
+public:
+	// Reference encoding and decoding of any unit vector
+	static void EncodeNormal(const XMFLOAT3& normal, short encoded[2]);
+	static XMFLOAT3 DecodeNormal(const short encoded[2]);
+
+	// Pack count points of a row: heights[i] with the normal of the quad from the point to right[i] (next point along n)
+	// and below[i] (next point along m), which is (-dh/dn, 1, -dh/dm) normalised. Right and below equal to the height give (0, 1, 0).
+	// 4 points at a time with SIMD
+	static void PackRow(const float* heights, const float* right, const float* below, int count, TerrainDynamicVertexType* vertices);
+};
@@ -28,6 +28,41 @@ TessellationShader::~TessellationShader()
 		cameraBuffer->Release();
 		cameraBuffer = 0;
 	}
+	if (patchHullShader)
+	{
+		patchHullShader->Release();
+		patchHullShader = 0;
+	}
+	if (cdlodVertexShader)
+	{
+		cdlodVertexShader->Release();
+		cdlodVertexShader = 0;
+	}
+	if (cdlodBuffer)
+	{
+		cdlodBuffer->Release();
+		cdlodBuffer = 0;
+	}
+	if (clipmapVertexShader)
+	{
+		clipmapVertexShader->Release();
+		clipmapVertexShader = 0;
+	}
+	if (clipmapBuffer)
+	{
+		clipmapBuffer->Release();
+		clipmapBuffer = 0;
+	}
+	if (tileVertexShader)
+	{
+		tileVertexShader->Release();
+		tileVertexShader = 0;
+	}
+	if (tileLayout)
+	{
+		tileLayout->Release();
+		tileLayout = 0;
+	}
 	if (layout)
 	{
 		layout->Release();
@@ -51,13 +86,31 @@ void TessellationShader::initShader(const wchar_t* vsFilename, const wchar_t* ps
 	D3D11_BUFFER_DESC tessellationFactorBufferDesc;
 	D3D11_BUFFER_DESC cameraBufferDesc;
 	D3D11_BUFFER_DESC fakeWaterLvlBufferDesc;
+	D3D11_BUFFER_DESC cdlodBufferDesc;
+	D3D11_BUFFER_DESC clipmapBufferDesc;
 	D3D11_SAMPLER_DESC samplerDesc;
 	D3D11_BUFFER_DESC lightBufferDesc;
 	D3D11_BUFFER_DESC textureHeightBufferDesc;
 
 	// Load (+ compile) shader files
+	// BaseShader keeps a single vertex shader, so the CDLOD and clipmap ones are loaded first and kept apart. They have the same input layout
+	loadVertexShader(L"terrain_cdlod_vs.cso");
+	cdlodVertexShader = vertexShader;
+	if (layout)
+	{
+		layout->Release();
+		layout = 0;
+	}
+	loadVertexShader(L"terrain_clipmap_vs.cso");
+	clipmapVertexShader = vertexShader;
+	if (layout)
+	{
+		layout->Release();
+		layout = 0;
+	}
 	loadVertexShader(vsFilename);
 	loadPixelShader(psFilename);
+	loadTileVertexShader(L"terrain_tile_vs.cso");
 
 	// Setup the description of the dynamic matrix constant buffer that is in the vertex, hull, domain shader.
 	matrixBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
@@ -95,6 +148,24 @@ void TessellationShader::initShader(const wchar_t* vsFilename, const wchar_t* ps
 	fakeWaterLvlBufferDesc.StructureByteStride = 0;
 	renderer->CreateBuffer(&fakeWaterLvlBufferDesc, NULL, &fakeWaterLvlBuffer);
 
+	// Setup the description of the dynamic CDLOD buffer that is in the CDLOD vertex shader
+	cdlodBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	cdlodBufferDesc.ByteWidth = sizeof(CdlodBufferType);
+	cdlodBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	cdlodBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	cdlodBufferDesc.MiscFlags = 0;
+	cdlodBufferDesc.StructureByteStride = 0;
+	renderer->CreateBuffer(&cdlodBufferDesc, NULL, &cdlodBuffer);
+
+	// Setup the description of the dynamic clipmap buffer that is in the clipmap vertex shader
+	clipmapBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	clipmapBufferDesc.ByteWidth = sizeof(ClipmapBufferType);
+	clipmapBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	clipmapBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	clipmapBufferDesc.MiscFlags = 0;
+	clipmapBufferDesc.StructureByteStride = 0;
+	renderer->CreateBuffer(&clipmapBufferDesc, NULL, &clipmapBuffer);
+
 	// Create a texture sampler state description.
 	samplerDesc.Filter = D3D11_FILTER_ANISOTROPIC;
 	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
@@ -129,12 +200,42 @@ void TessellationShader::initShader(const wchar_t* vsFilename, const wchar_t* ps
 	renderer->CreateBuffer(&textureHeightBufferDesc, NULL, &textureHeightBuffer);
 }
 
+void TessellationShader::loadTileVertexShader(const wchar_t* filename)
+{
+	// Same as BaseShader::loadVertexShader() with the two vertex streams of TerrainTiles
+	ID3DBlob* vertexShaderBuffer = 0;
+	HRESULT result = D3DReadFileToBlob(filename, &vertexShaderBuffer);
+	if (result != S_OK)
+	{
+		MessageBox(NULL, filename, L"File ERROR", MB_OK);
+		exit(0);
+	}
+
+	renderer->CreateVertexShader(vertexShaderBuffer->GetBufferPointer(), vertexShaderBuffer->GetBufferSize(), NULL, &tileVertexShader);
+
+	// TerrainStaticVertexType in the slot 0 and TerrainDynamicVertexType in the slot 1
+	D3D11_INPUT_ELEMENT_DESC polygonLayout[] = {
+		{ "POSITION", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "HEIGHT", 0, DXGI_FORMAT_R32_FLOAT, 1, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 }
+	};
+	unsigned int numElements = sizeof(polygonLayout) / sizeof(polygonLayout[0]);
+	renderer->CreateInputLayout(polygonLayout, numElements, vertexShaderBuffer->GetBufferPointer(), vertexShaderBuffer->GetBufferSize(), &tileLayout);
+
+	vertexShaderBuffer->Release();
+	vertexShaderBuffer = 0;
+}
+
 void TessellationShader::initShader(const wchar_t* vsFilename, const wchar_t* hsFilename, const wchar_t* dsFilename, const wchar_t* psFilename)
 {
 	// InitShader must be overwritten and it will load both vertex and pixel shaders + setup buffers
 	initShader(vsFilename, psFilename);
 
 	// Load other required shaders.
+	// BaseShader keeps a single hull shader, so the one with the precomputed factors is loaded first and kept apart
+	loadHullShader(L"tessellation_patch_hs.cso");
+	patchHullShader = hullShader;
 	loadHullShader(hsFilename);
 	loadDomainShader(dsFilename);
 }
@@ -213,3 +314,111 @@ void TessellationShader::setShaderParameters(ID3D11DeviceContext* deviceContext,
 	deviceContext->PSSetShaderResources(0, 5, textures);
 	deviceContext->PSSetSamplers(0, 1, &sampleState);
 }
+
+void TessellationShader::setPipeline(ID3D11DeviceContext* deviceContext, ID3D11ShaderResourceView* patchTessFactors)
+{
+	// Same stages as BaseShader::render() without the draw, with the compact vertices of TerrainTiles
+	deviceContext->IASetInputLayout(tileLayout);
+	deviceContext->VSSetShader(tileVertexShader, NULL, 0);
+	if (patchTessFactors)
+	{
+		deviceContext->HSSetShader(patchHullShader, NULL, 0);
+		deviceContext->HSSetShaderResources(0, 1, &patchTessFactors);
+	}
+	else
+	{
+		deviceContext->HSSetShader(hullShader, NULL, 0);
+	}
+	deviceContext->DSSetShader(domainShader, NULL, 0);
+	deviceContext->GSSetShader(NULL, NULL, 0);
+	deviceContext->PSSetShader(pixelShader, NULL, 0);
+	deviceContext->CSSetShader(NULL, NULL, 0);
+}
+
+void TessellationShader::renderRange(ID3D11DeviceContext* deviceContext, int indexCount, int startIndex)
+{
+	deviceContext->DrawIndexed(indexCount, startIndex, 0);
+}
+
+void TessellationShader::setCdlodPipeline(ID3D11DeviceContext* deviceContext, ID3D11ShaderResourceView* heightTexture, ID3D11ShaderResourceView* instances,
+	const XMFLOAT3& eye, XMINT2 resolution, bool fakeWaterLevel)
+{
+	cdlodParameters.eyePosition = eye;
+	cdlodParameters.fakeWaterLvl = (float)fakeWaterLevel;
+	cdlodParameters.resolution = XMFLOAT2((float)resolution.y, (float)resolution.x);
+	cdlodParameters.instanceOffset = 0;
+	cdlodParameters.padding = 0.0f;
+
+	// the matrices of setShaderParameters() and the grid displaced by the heights, no tessellation
+	ID3D11ShaderResourceView* resources[2] = { heightTexture, instances };
+	deviceContext->IASetInputLayout(layout);
+	deviceContext->VSSetShader(cdlodVertexShader, NULL, 0);
+	deviceContext->VSSetConstantBuffers(0, 1, &matrixBuffer);
+	deviceContext->VSSetShaderResources(0, 2, resources);
+	deviceContext->HSSetShader(NULL, NULL, 0);
+	deviceContext->DSSetShader(NULL, NULL, 0);
+	deviceContext->GSSetShader(NULL, NULL, 0);
+	deviceContext->PSSetShader(pixelShader, NULL, 0);
+	deviceContext->CSSetShader(NULL, NULL, 0);
+}
+
+void TessellationShader::renderInstances(ID3D11DeviceContext* deviceContext, int indexCount, int instanceCount, int firstInstance)
+{
+	if (instanceCount <= 0)
+	{
+		return;
+	}
+
+	// SV_InstanceID starts at 0 in every draw, the shader adds the offset to read the instance buffer
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	cdlodParameters.instanceOffset = (unsigned int)firstInstance;
+	deviceContext->Map(cdlodBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	*(CdlodBufferType*)mappedResource.pData = cdlodParameters;
+	deviceContext->Unmap(cdlodBuffer, 0);
+	deviceContext->VSSetConstantBuffers(1, 1, &cdlodBuffer);
+
+	deviceContext->DrawIndexedInstanced(indexCount, instanceCount, 0, 0, 0);
+}
+
+void TessellationShader::setClipmapPipeline(ID3D11DeviceContext* deviceContext, ID3D11ShaderResourceView* heightTexture, ID3D11ShaderResourceView* instances,
+	const GeometryClipmap& clipmap, XMINT2 resolution, bool fakeWaterLevel)
+{
+	clipmapParameters.resolution = XMFLOAT2((float)resolution.y, (float)resolution.x);
+	clipmapParameters.instanceOffset = 0;
+	clipmapParameters.levelCount = (unsigned int)clipmap.GetLevelCount();
+	clipmapParameters.fakeWaterLvl = (float)fakeWaterLevel;
+	clipmapParameters.padding = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	for (int level = 0; level < GeometryClipmap::kMaxLevels; level++)
+	{
+		const XMINT2 origin = level < clipmap.GetLevelCount() ? clipmap.GetLevelOrigin(level) : XMINT2(0, 0);
+		clipmapParameters.levels[level] = XMFLOAT4((float)origin.y, (float)origin.x, (float)(1 << level), 0.0f);
+	}
+
+	ID3D11ShaderResourceView* resources[2] = { heightTexture, instances };
+	deviceContext->IASetInputLayout(layout);
+	deviceContext->VSSetShader(clipmapVertexShader, NULL, 0);
+	deviceContext->VSSetConstantBuffers(0, 1, &matrixBuffer);
+	deviceContext->VSSetShaderResources(0, 2, resources);
+	deviceContext->HSSetShader(NULL, NULL, 0);
+	deviceContext->DSSetShader(NULL, NULL, 0);
+	deviceContext->GSSetShader(NULL, NULL, 0);
+	deviceContext->PSSetShader(pixelShader, NULL, 0);
+	deviceContext->CSSetShader(NULL, NULL, 0);
+}
+
+void TessellationShader::renderClipmapInstances(ID3D11DeviceContext* deviceContext, int indexCount, int startIndex, int instanceCount, int firstInstance)
+{
+	if (instanceCount <= 0)
+	{
+		return;
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	clipmapParameters.instanceOffset = (unsigned int)firstInstance;
+	deviceContext->Map(clipmapBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	*(ClipmapBufferType*)mappedResource.pData = clipmapParameters;
+	deviceContext->Unmap(clipmapBuffer, 0);
+	deviceContext->VSSetConstantBuffers(1, 1, &clipmapBuffer);
+
+	deviceContext->DrawIndexedInstanced(indexCount, instanceCount, startIndex, 0, 0);
+}
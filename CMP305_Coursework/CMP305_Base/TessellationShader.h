@@ -3,6 +3,7 @@
 #pragma once
 
 #include "DXF.h"
+#include "GeometryClipmap.h"
 
 using namespace std;
 using namespace DirectX;
@@ -42,6 +43,23 @@ private:
 		XMFLOAT3 cameraPos;
 		float padding2;
 	};
+	struct CdlodBufferType
+	{
+		XMFLOAT3 eyePosition; // in the space of the height map
+		float fakeWaterLvl;
+		XMFLOAT2 resolution; // quads along n and m
+		unsigned int instanceOffset;
+		float padding;
+	};
+	struct ClipmapBufferType
+	{
+		XMFLOAT2 resolution; // quads along n and m
+		unsigned int instanceOffset;
+		unsigned int levelCount;
+		float fakeWaterLvl;
+		XMFLOAT3 padding;
+		XMFLOAT4 levels[GeometryClipmap::kMaxLevels]; // origin (n, m) of the window and 2^level
+	};
 
 public:
 
@@ -53,9 +71,31 @@ public:
 		Light* light,
 		float* dMinMax, float* lvlOfDetail, Camera* camera);
 
+	// Set the input layout and shader stages once, for several draws of parts of the bound index buffer of the tiles of TerrainTiles.
+	// With patchTessFactors the patches have 4 control points and the factors are read from it (PatchTessellation),
+	// without it they have 12 and the hull shader computes them
+	void setPipeline(ID3D11DeviceContext* deviceContext, ID3D11ShaderResourceView* patchTessFactors = nullptr);
+	// Draw indexCount indices from startIndex with the pipeline set by setPipeline()
+	void renderRange(ID3D11DeviceContext* deviceContext, int indexCount, int startIndex);
+
+	// Set the stages to draw the CDLOD nodes of CdlodTerrain (no tessellation, the vertex shader displaces the shared grid).
+	// The matrices, light and textures are the ones of setShaderParameters()
+	void setCdlodPipeline(ID3D11DeviceContext* deviceContext, ID3D11ShaderResourceView* heightTexture, ID3D11ShaderResourceView* instances,
+		const XMFLOAT3& eye, XMINT2 resolution, bool fakeWaterLevel);
+	// Draw instanceCount instances of indexCount indices of the grid, from the instance firstInstance of the buffer
+	void renderInstances(ID3D11DeviceContext* deviceContext, int indexCount, int instanceCount, int firstInstance);
+
+	// Set the stages to draw the footprints of ClipmapTerrain with the windows of clipmap, as setCdlodPipeline()
+	void setClipmapPipeline(ID3D11DeviceContext* deviceContext, ID3D11ShaderResourceView* heightTexture, ID3D11ShaderResourceView* instances,
+		const GeometryClipmap& clipmap, XMINT2 resolution, bool fakeWaterLevel);
+	// Draw instanceCount instances of the footprint at indexCount indices from startIndex, from the instance firstInstance of the buffer
+	void renderClipmapInstances(ID3D11DeviceContext* deviceContext, int indexCount, int startIndex, int instanceCount, int firstInstance);
+
 private:
 	void initShader(const wchar_t* vsFilename, const wchar_t* psFilename);
 	void initShader(const wchar_t* vsFilename, const wchar_t* hsFilename, const wchar_t* dsFilename, const wchar_t* psFilename);
+	// Load the vertex shader of the tiles of TerrainTiles and its input layout of two vertex streams
+	void loadTileVertexShader(const wchar_t* filename);
 
 private:
 	ID3D11Buffer* matrixBuffer;
@@ -64,4 +104,13 @@ private:
 	ID3D11Buffer* lightBuffer;
 	ID3D11Buffer* textureHeightBuffer;
 	ID3D11Buffer* fakeWaterLvlBuffer;
+	ID3D11HullShader* patchHullShader; // hull shader of the 4 control point patches
+	ID3D11VertexShader* cdlodVertexShader;
+	ID3D11Buffer* cdlodBuffer;
+	CdlodBufferType cdlodParameters; // of the current setCdlodPipeline(), only the instance offset changes per draw
+	ID3D11VertexShader* clipmapVertexShader;
+	ID3D11Buffer* clipmapBuffer;
+	ClipmapBufferType clipmapParameters;
+	ID3D11VertexShader* tileVertexShader;
+	ID3D11InputLayout* tileLayout; // static stream (position, texture) and dynamic stream (height, packed normal)
 };
\ No newline at end of file
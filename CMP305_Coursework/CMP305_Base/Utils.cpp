@@ -17,6 +17,23 @@ float Utils::GetRandom(Range range)
 	return Utils::GetRandom(range.min, range.max);
 }
 
+float Utils::GetPointRandom(unsigned int seed, int m, int n)
+{
+	// murmur3 finaliser of the coordinates mixed with the seed
+	unsigned int hash = seed * 0x9E3779B1u ^ (unsigned int)m * 0x85EBCA77u ^ (unsigned int)n * 0xC2B2AE3Du;
+	hash ^= hash >> 16;
+	hash *= 0x85EBCA6Bu;
+	hash ^= hash >> 13;
+	hash *= 0xC2B2AE35u;
+	hash ^= hash >> 16;
+	return (hash & 0xFFFFFF) / 16777216.0f;
+}
+
+float Utils::GetPointRandom(unsigned int seed, int m, int n, Range range)
+{
+	return range.min + GetPointRandom(seed, m, n) * (range.max - range.min);
+}
+
 float Utils::GetRandom(float from, float to)
 {
 	float min, max;
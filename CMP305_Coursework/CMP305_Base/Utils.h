@@ -25,4 +25,10 @@ public:
 	// Return a random float using two floats as parameters
 	// Function from: https://www.delftstack.com/howto/cpp/how-to-generate-random-float-number-in-cpp/
 	static float GetRandom(float from, float to);
+
+	// Random number in [0, 1) from a hash of the point (m, n) and the seed: always the same for the same point,
+	// so it does not depend on the order (or the thread) the points are computed in
+	static float GetPointRandom(unsigned int seed, int m, int n);
+	// Same, in the range
+	static float GetPointRandom(unsigned int seed, int m, int n, Range range);
 };
\ No newline at end of file
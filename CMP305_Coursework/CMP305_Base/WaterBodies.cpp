@@ -0,0 +1,177 @@
+#include "WaterBodies.h"
+
+#include <algorithm>
+
+#include "Parallel.h"
+
+const int WaterBodies::kDryLand;
+
+void WaterBodies::Label(const HeightField& heightField, float waterLevel, WaterBodyMaps& maps)
+{
+	const int rows = heightField.GetRows();
+	const int columns = heightField.GetColumns();
+	const int size = heightField.GetSize();
+
+	maps.resolution = heightField.GetResolution();
+	maps.waterLevel = waterLevel;
+	maps.bodies.clear();
+
+	// parent[i] == kDryLand for the points above the water level
+	std::vector<int>& parent = maps.label;
+	parent.assign(size, kDryLand);
+
+	// Local pass: label each band of rows on its own.
+	// A band only links points inside it, so the bands can run at the same time
+	std::vector<unsigned char> bandStart(rows, 0);
+	Parallel::ForBlocks(0, rows, 64, [&](int mBegin, int mEnd)
+	{
+		std::vector<float> row(columns);
+		bandStart[mBegin] = 1;
+		for (int m = mBegin; m < mEnd; m++)
+		{
+			heightField.ReadRow(m, row.data());
+			for (int n = 0; n < columns; n++)
+			{
+				if (row[n] >= waterLevel)
+				{
+					continue;
+				}
+
+				const int index = heightField.GetIndex(m, n);
+				parent[index] = index;
+
+				// join with the left and top neighbours if they are water too
+				if (n > 0 && parent[index - 1] != kDryLand)
+				{
+					Union(parent, index - 1, index);
+				}
+				if (m > mBegin && parent[index - columns] != kDryLand)
+				{
+					Union(parent, index - columns, index);
+				}
+			}
+		}
+	});
+
+	// Merge pass: join the regions across the first row of every band with the last row of the band above
+	for (int m = 1; m < rows; m++)
+	{
+		if (!bandStart[m])
+		{
+			continue;
+		}
+
+		for (int n = 0; n < columns; n++)
+		{
+			const int index = heightField.GetIndex(m, n);
+			if (parent[index] != kDryLand && parent[index - columns] != kDryLand)
+			{
+				Union(parent, index - columns, index);
+			}
+		}
+	}
+
+	// Flatten the trees and number the regions in scan order.
+	// Every point links to a lower index, so its parent has already been resolved to an id
+	for (int index = 0; index < size; index++)
+	{
+		if (parent[index] == kDryLand)
+		{
+			continue;
+		}
+
+		const int m = index / columns;
+		const int n = index % columns;
+		const float height = heightField.Get(m, n);
+		const bool border = (m == 0 || n == 0 || m == rows - 1 || n == columns - 1);
+
+		int id;
+		if (parent[index] == index)
+		{
+			// new region
+			id = (int)maps.bodies.size();
+
+			WaterBody body;
+			body.id = id;
+			body.type = kLake;
+			body.area = 0;
+			body.boundsMin = XMINT2(m, n);
+			body.boundsMax = XMINT2(m, n);
+			body.minHeight = height;
+			maps.bodies.push_back(body);
+		}
+		else
+		{
+			id = parent[parent[index]];
+		}
+		parent[index] = id;
+
+		// gather the information of the region
+		WaterBody& body = maps.bodies[id];
+		body.area++;
+		body.boundsMin = XMINT2(std::min(body.boundsMin.x, m), std::min(body.boundsMin.y, n));
+		body.boundsMax = XMINT2(std::max(body.boundsMax.x, m), std::max(body.boundsMax.y, n));
+		body.minHeight = std::min(body.minHeight, height);
+		if (border)
+		{
+			body.type = kSea;
+		}
+	}
+}
+
+int WaterBodies::Count(const WaterBodyMaps& maps, WaterBodyType type)
+{
+	int count = 0;
+	for (const WaterBody& body : maps.bodies)
+	{
+		if (body.type == type)
+		{
+			count++;
+		}
+	}
+	return count;
+}
+
+int WaterBodies::GetLargest(const WaterBodyMaps& maps, WaterBodyType type)
+{
+	int largest = kDryLand;
+	for (const WaterBody& body : maps.bodies)
+	{
+		if (body.type == type && (largest == kDryLand || body.area > maps.bodies[largest].area))
+		{
+			largest = body.id;
+		}
+	}
+	return largest;
+}
+
+int WaterBodies::FindRoot(std::vector<int>& parent, int index)
+{
+	// path halving: link every visited point to its grandparent
+	while (parent[index] != index)
+	{
+		parent[index] = parent[parent[index]];
+		index = parent[index];
+	}
+	return index;
+}
+
+void WaterBodies::Union(std::vector<int>& parent, int a, int b)
+{
+	a = FindRoot(parent, a);
+	b = FindRoot(parent, b);
+	if (a == b)
+	{
+		return;
+	}
+
+	// link the higher root to the lower one, so the parent of a point always has a lower index
+	if (a < b)
+	{
+		parent[b] = a;
+	}
+	else
+	{
+		parent[a] = b;
+	}
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <vector>
+
+#include "HeightField.h"
+
+enum WaterBodyType
+{
+	kSea = 0, // connected to the border of the map
+	kLake = 1 // enclosed by terrain above the water level
+};
+
+// Connected region of points below the water level
+struct WaterBody
+{
+	int id;
+	WaterBodyType type;
+	int area; // number of points
+	XMINT2 boundsMin; // (m, n) of the bounding box, inclusive
+	XMINT2 boundsMax;
+	float minHeight; // lowest point of the bed
+};
+
+struct WaterBodyMaps
+{
+	XMINT2 resolution = XMINT2(0, 0);
+	float waterLevel = 0.0f;
+	std::vector<int> label; // id of the water body of every point, or kDryLand
+	std::vector<WaterBody> bodies; // indexed by id
+};
+
+class WaterBodies
+{
+public:
+	static const int kDryLand = -1;
+
+	// Label the 4-connected regions of points below waterLevel.
+	// The rows are split in bands labelled in parallel with a union-find each, then the bands are merged along their shared rows
+	static void Label(const HeightField& heightField, float waterLevel, WaterBodyMaps& maps);
+
+	// Count the water bodies of each type
+	static int Count(const WaterBodyMaps& maps, WaterBodyType type);
+	// Return the id of the biggest water body of the type, or kDryLand if there is none
+	static int GetLargest(const WaterBodyMaps& maps, WaterBodyType type);
+
+private:
+	// Root of the set of index. Every point links to a lower index, so roots are the first point of their region
+	static int FindRoot(std::vector<int>& parent, int index);
+	static void Union(std::vector<int>& parent, int a, int b);
+};
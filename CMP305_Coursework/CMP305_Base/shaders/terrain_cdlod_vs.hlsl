@@ -0,0 +1,111 @@
+// CDLOD terrain vertex shader
+// Every instance is a node of the quadtree drawn with the shared grid: the grid is scaled and moved over the node,
+// displaced with the height map and morphed into the grid of the next level near the end of the range of its level.
+// The output is the same as the tessellation domain shader, so the same pixel shader is used
+
+cbuffer MatrixBuffer : register(b0)
+{
+    matrix worldMatrix;
+    matrix viewMatrix;
+    matrix projectionMatrix;
+};
+
+cbuffer CdlodBuffer : register(b1)
+{
+    float3 eyePosition; // camera in the space of the height map
+    float fakeWaterLevel;
+    float2 resolution; // quads along n (x) and m (y)
+    uint instanceOffset; // first instance of the draw, SV_InstanceID starts at 0 in every draw
+    float padding;
+};
+
+struct InstanceType
+{
+    float2 origin; // first point (n, m) of the node
+    float scale; // quads of the height map per quad of the grid
+    float lod;
+    float2 morphRange; // distances where the morph starts and ends
+};
+
+Texture2D<float> heightMap : register(t0);
+StructuredBuffer<InstanceType> instances : register(t1);
+
+struct InputType
+{
+    float3 position : POSITION; // point (n, 0, m) of the grid
+    float2 tex : TEXCOORD0;
+    float3 normal : NORMAL;
+};
+
+struct OutputType
+{
+    float4 position : SV_POSITION; // screen view position
+    float2 tex : TEXCOORD0;
+    float3 normal : NORMAL;
+    float4 pos : POSITION0; // position without applying world, view and projection matrices
+};
+
+// Height at the point p = (n, m) of the height map, bilinear interpolation between the 4 points around it
+float GetHeight(float2 p)
+{
+    p = clamp(p, 0.0f, resolution);
+    int2 p0 = min((int2) floor(p), (int2) resolution - 1);
+    float2 f = p - p0;
+    float h00 = heightMap.Load(int3(p0, 0));
+    float h10 = heightMap.Load(int3(p0 + int2(1, 0), 0));
+    float h01 = heightMap.Load(int3(p0 + int2(0, 1), 0));
+    float h11 = heightMap.Load(int3(p0 + int2(1, 1), 0));
+    return lerp(lerp(h00, h10, f.x), lerp(h01, h11, f.x), f.y);
+}
+
+OutputType main(InputType input, uint instanceID : SV_InstanceID)
+{
+    OutputType output;
+    InstanceType instance = instances[instanceOffset + instanceID];
+
+    // point of the height map under the vertex and its distance to the eye (with the height that is drawn)
+    float2 grid = input.position.xz;
+    float2 p = clamp(instance.origin + grid * instance.scale, 0.0f, resolution);
+    float height = GetHeight(p);
+    if (fakeWaterLevel == 1.0f)
+    {
+        height = max(height, 0.0f);
+    }
+    float eyeDistance = distance(float3(p.x, height, p.y), eyePosition);
+
+    // Morph: the odd vertices of the grid slide onto the even ones, which are the vertices of the next level
+    float morphK = saturate((eyeDistance - instance.morphRange.x) / (instance.morphRange.y - instance.morphRange.x));
+    grid -= frac(grid * 0.5f) * 2.0f * morphK;
+    p = clamp(instance.origin + grid * instance.scale, 0.0f, resolution);
+
+    float3 vertexPosition = float3(p.x, GetHeight(p), p.y);
+    // Normal from the central differences at the spacing of the level, (-dh/dn, 1, -dh/dm)
+    float spacing = instance.scale;
+    float hLeft = GetHeight(p - float2(spacing, 0.0f));
+    float hRight = GetHeight(p + float2(spacing, 0.0f));
+    float hDown = GetHeight(p - float2(0.0f, spacing));
+    float hUp = GetHeight(p + float2(0.0f, spacing));
+    float3 normalVal = normalize(float3(hLeft - hRight, 2.0f * spacing, hDown - hUp));
+
+    // ouput the position without applying world, view and projection matrices
+    output.pos = float4(vertexPosition, 1.0f);
+
+    // fake the water level by setting the height to 0 where it is lower
+    if (fakeWaterLevel == 1.0f && vertexPosition.y < 0.0f)
+    {
+        vertexPosition.y = 0.0f;
+        normalVal = float3(0.0f, 1.0f, 0.0f);
+    }
+
+    output.position = mul(float4(vertexPosition, 1.0f), worldMatrix);
+    output.position = mul(output.position, viewMatrix);
+    output.position = mul(output.position, projectionMatrix);
+
+    output.normal = mul(normalVal, (float3x3) worldMatrix);
+    output.normal = normalize(output.normal);
+
+    // same texture coordinates as the vertices of the tiles: (m, n) over the resolution
+    output.tex = float2(p.y / resolution.y, p.x / resolution.x);
+
+    return output;
+}
@@ -0,0 +1,118 @@
+// Geometry clipmap vertex shader
+// Every instance is a footprint of the ring of a level: its grid is moved into the window of the level and displaced with the
+// heights of the level, read from its slice of the toroidal texture array. Near the border of the window the vertices morph
+// into the points of the next level, so the rings meet without cracks.
+// The output is the same as the tessellation domain shader, so the same pixel shader is used
+
+#define MAX_LEVELS 10 // GeometryClipmap::kMaxLevels
+
+static const float kWindowQuads = 254.0f; // GeometryClipmap::kWindowSize - 1
+static const float kTransitionWidth = 25.0f; // quads of the morph into the next level, a tenth of the window
+static const int kTextureMask = 255; // GeometryClipmap::kTextureSize - 1
+
+cbuffer MatrixBuffer : register(b0)
+{
+    matrix worldMatrix;
+    matrix viewMatrix;
+    matrix projectionMatrix;
+};
+
+cbuffer ClipmapBuffer : register(b1)
+{
+    float2 resolution; // quads along n (x) and m (y)
+    uint instanceOffset; // first instance of the draw, SV_InstanceID starts at 0 in every draw
+    uint levelCount;
+    float fakeWaterLevel;
+    float3 padding;
+    float4 levels[MAX_LEVELS]; // first point (n, m) of the window of each level in its points, and 2^level
+};
+
+struct InstanceType
+{
+    float2 offset; // first quad (n, m) of the footprint inside the window
+    float level;
+    float padding;
+};
+
+Texture2DArray<float> clipmap : register(t0);
+StructuredBuffer<InstanceType> instances : register(t1);
+
+struct InputType
+{
+    float3 position : POSITION; // point (n, 0, m) of the footprint
+    float2 tex : TEXCOORD0;
+    float3 normal : NORMAL;
+};
+
+struct OutputType
+{
+    float4 position : SV_POSITION; // screen view position
+    float2 tex : TEXCOORD0;
+    float3 normal : NORMAL;
+    float4 pos : POSITION0; // position without applying world, view and projection matrices
+};
+
+// Height at the point g = (n, m) of a level, bilinear interpolation between the 4 texels around it (they wrap around)
+float GetHeight(float2 g, uint level)
+{
+    float2 g0 = floor(g);
+    float2 f = g - g0;
+    int2 t0 = (int2) g0 & kTextureMask;
+    int2 t1 = ((int2) g0 + 1) & kTextureMask;
+    float h00 = clipmap.Load(int4(t0.x, t0.y, level, 0));
+    float h10 = clipmap.Load(int4(t1.x, t0.y, level, 0));
+    float h01 = clipmap.Load(int4(t0.x, t1.y, level, 0));
+    float h11 = clipmap.Load(int4(t1.x, t1.y, level, 0));
+    return lerp(lerp(h00, h10, f.x), lerp(h01, h11, f.x), f.y);
+}
+
+OutputType main(InputType input, uint instanceID : SV_InstanceID)
+{
+    OutputType output;
+    InstanceType instance = instances[instanceOffset + instanceID];
+    uint level = (uint) instance.level;
+    float4 window = levels[level];
+
+    // Morph: near the border of the window the odd points slide onto the even ones, which are the points of the next level.
+    // The border itself is fully morphed, the coarsest level has no next level
+    float2 local = instance.offset + input.position.xz;
+    float2 g = window.xy + local;
+    float2 fromCentre = abs(local - kWindowQuads * 0.5f);
+    float alpha = saturate((max(fromCentre.x, fromCentre.y) - (kWindowQuads * 0.5f - kTransitionWidth - 1.0f)) / kTransitionWidth);
+    alpha = (level + 1 < levelCount) ? alpha : 0.0f;
+    g -= frac(g * 0.5f) * 2.0f * alpha;
+
+    // point of the height map, the footprints beyond its borders collapse onto them
+    float2 p = clamp(g * window.z, 0.0f, resolution);
+    float3 vertexPosition = float3(p.x, GetHeight(g, level), p.y);
+
+    // Normal from the central differences between the points of the level, (-dh/dn, 1, -dh/dm). The neighbours are kept inside the window
+    float2 windowEnd = window.xy + kWindowQuads;
+    float hLeft = GetHeight(max(g - float2(1.0f, 0.0f), window.xy), level);
+    float hRight = GetHeight(min(g + float2(1.0f, 0.0f), windowEnd), level);
+    float hDown = GetHeight(max(g - float2(0.0f, 1.0f), window.xy), level);
+    float hUp = GetHeight(min(g + float2(0.0f, 1.0f), windowEnd), level);
+    float3 normalVal = normalize(float3(hLeft - hRight, 2.0f * window.z, hDown - hUp));
+
+    // ouput the position without applying world, view and projection matrices
+    output.pos = float4(vertexPosition, 1.0f);
+
+    // fake the water level by setting the height to 0 where it is lower
+    if (fakeWaterLevel == 1.0f && vertexPosition.y < 0.0f)
+    {
+        vertexPosition.y = 0.0f;
+        normalVal = float3(0.0f, 1.0f, 0.0f);
+    }
+
+    output.position = mul(float4(vertexPosition, 1.0f), worldMatrix);
+    output.position = mul(output.position, viewMatrix);
+    output.position = mul(output.position, projectionMatrix);
+
+    output.normal = mul(normalVal, (float3x3) worldMatrix);
+    output.normal = normalize(output.normal);
+
+    // same texture coordinates as the vertices of the tiles: (m, n) over the resolution
+    output.tex = float2(p.y / resolution.y, p.x / resolution.x);
+
+    return output;
+}
@@ -0,0 +1,42 @@
+// Vertex shader of the tiles of TerrainTiles
+// The vertices come in two streams: the grid position and texture coordinates, which never change, and the height with
+// the octahedral encoded normal, which are rewritten when the terrain is edited. They are put back together as the control
+// points of tessellation_vs
+
+struct InputType
+{
+    float2 position : POSITION; // point (n, m), static stream
+    float2 tex : TEXCOORD0;
+    float height : HEIGHT; // dynamic stream
+    float2 normal : NORMAL; // (x, z) of the normal on the octahedron |x| + |y| + |z| = 1
+};
+
+struct OutputType
+{
+    float3 position : POSITION;
+    float2 tex : TEXCOORD0;
+    float3 normal : NORMAL;
+};
+
+// TerrainVertexPacking::DecodeNormal()
+float3 DecodeNormal(float2 encoded)
+{
+    float3 normal = float3(encoded.x, 1.0f - abs(encoded.x) - abs(encoded.y), encoded.y);
+    if (normal.y < 0.0f)
+    {
+        normal.xz = (1.0f - abs(normal.zx)) * (normal.xz >= 0.0f ? 1.0f : -1.0f);
+    }
+    return normalize(normal);
+}
+
+OutputType main(InputType input)
+{
+    OutputType output;
+
+    // Pass the control point into the hull shader.
+    output.position = float3(input.position.x, input.height, input.position.y);
+    output.tex = input.tex;
+    output.normal = DecodeNormal(input.normal);
+
+    return output;
+}
@@ -0,0 +1,83 @@
+// Tessellation Hull Shader with precomputed tessellation factors
+// The factors of every patch are computed on the CPU (PatchTessellation), so the patches only need their 4 corners
+
+Texture2D<uint> patchTessFactors : register(t0);
+
+struct InputType
+{
+    float3 position : POSITION;
+    float2 tex : TEXCOORD0;
+    float3 normal : NORMAL;
+};
+
+struct ConstantOutputType
+{
+    float edges[4] : SV_TessFactor;
+    float inside[2] : SV_InsideTessFactor;
+};
+
+struct OutputType
+{
+    float3 position : POSITION;
+    float2 tex : TEXCOORD0;
+    float3 normal : NORMAL;
+};
+
+// 6 bits per factor, storing the factor minus one
+float UnpackFactor(uint packed, uint factor)
+{
+    return (float)((packed >> (6 * factor)) & 63) + 1.0f;
+}
+
+ConstantOutputType PatchConstantFunction(InputPatch<InputType, 4> inputPatch, uint patchId : SV_PrimitiveID)
+{
+    ConstantOutputType output;
+    
+    // The control point 1 is the first corner (m, n) of the quad and its position is (n, height, m),
+    // the texel (n, m) has the factors of the quad
+    int2 quad = int2(inputPatch[1].position.xz);
+    uint packed = patchTessFactors.Load(int3(quad, 0));
+
+    // all ones: an edge factor is 0 and the patch is discarded
+    if (packed == 0xFFFFFFFF)
+    {
+        output.inside[0] = 0.0f;
+        output.inside[1] = 0.0f;
+        output.edges[0] = 0.0f;
+        output.edges[1] = 0.0f;
+        output.edges[2] = 0.0f;
+        output.edges[3] = 0.0f;
+        return output;
+    }
+
+    // Set the tessellation factor for tessallating inside the quad.
+    output.inside[0] = UnpackFactor(packed, 0); // u-axis (columns)
+    output.inside[1] = output.inside[0]; // v-axis (rows)
+
+    // Set the tessellation factors for the four edges of the quad, already the minimum with the neighbour quads.
+    output.edges[0] = UnpackFactor(packed, 1); // left edge
+    output.edges[1] = UnpackFactor(packed, 2); // top edge
+    output.edges[2] = UnpackFactor(packed, 3); // right edge
+    output.edges[3] = UnpackFactor(packed, 4); // bottom edge
+
+    return output;
+}
+
+
+[domain("quad")]
+[partitioning("integer")]
+[outputtopology("triangle_ccw")]
+[outputcontrolpoints(4)]
+[patchconstantfunc("PatchConstantFunction")]
+[maxtessfactor(64.0f)]
+OutputType main(InputPatch<InputType, 4> patch, uint pointId : SV_OutputControlPointID, uint patchId : SV_PrimitiveID)
+{
+    OutputType output;
+
+    // Set the position, texture coord and normal for this control point as the output
+    output.position = patch[pointId].position;
+    output.tex = patch[pointId].tex;
+    output.normal = patch[pointId].normal;
+
+    return output;
+}
@@ -0,0 +1,88 @@
+#include "TestFramework.h"
+#include "TestHeightMap.h"
+#include "DistanceTransform.h"
+
+#include <algorithm>
+#include <cfloat>
+
+// Distance from every point to the nearest point of the mask, trying all of them
+static void BruteForceDistance(XMINT2 resolution, const std::vector<unsigned char>& mask, std::vector<float>& distance)
+{
+	const int rows = resolution.x + 1;
+	const int columns = resolution.y + 1;
+	distance.assign(rows * columns, FLT_MAX);
+	for (int m = 0; m < rows; m++)
+	{
+		for (int n = 0; n < columns; n++)
+		{
+			for (int i = 0; i < rows * columns; i++)
+			{
+				if (mask[i])
+				{
+					const float dm = (float)(m - i / columns);
+					const float dn = (float)(n - i % columns);
+					distance[n + m * columns] = (std::min)(distance[n + m * columns], sqrtf(dm * dm + dn * dn));
+				}
+			}
+		}
+	}
+}
+
+TEST(DistanceTransformMatchesBruteForce)
+{
+	// not square and wider than a group of columns, so the rows and the column groups are both cut
+	const XMINT2 resolution(37, 52);
+	const int size = (resolution.x + 1) * (resolution.y + 1);
+	for (unsigned int seed = 1; seed <= 3; seed++)
+	{
+		// sparse masks, a single point for the first one
+		std::vector<unsigned char> mask(size, 0);
+		for (int i = 0; i < size; i++)
+		{
+			mask[i] = Utils::GetPointRandom(seed, i, 0) < (seed == 1 ? 0.0005f : 0.02f * seed) ? 1 : 0;
+		}
+		if (seed == 1)
+		{
+			mask[17 + 5 * (resolution.y + 1)] = 1;
+		}
+
+		std::vector<float> distance, expected;
+		DistanceTransform::Compute(resolution, mask, distance);
+		BruteForceDistance(resolution, mask, expected);
+
+		float maxError = 0.0f;
+		for (int i = 0; i < size; i++)
+		{
+			maxError = (std::max)(maxError, fabsf(distance[i] - expected[i]));
+		}
+		CHECK_NEAR(maxError, 0.0f, 1e-3f);
+	}
+}
+
+TEST(DistanceTransformEmptyMaskIsInfinite)
+{
+	const XMINT2 resolution(8, 8);
+	std::vector<unsigned char> mask((resolution.x + 1) * (resolution.y + 1), 0);
+	std::vector<float> distance;
+	DistanceTransform::Compute(resolution, mask, distance);
+
+	bool allInfinite = true;
+	for (float value : distance)
+	{
+		allInfinite = allInfinite && value > 1e9f;
+	}
+	CHECK(allInfinite);
+}
+
+TEST(DistanceToWaterFromTheCoast)
+{
+	// water on the first rows, the distance of the dry points grows a point per row
+	TestHeightMap heightMap(XMINT2(16, 16));
+	heightMap.Fill([](int m, int) { return m < 4 ? -1.0f : 1.0f; });
+
+	std::vector<float> distance;
+	DistanceTransform::DistanceToWater(heightMap.GetField(), 0.0f, distance);
+	CHECK_NEAR(distance[heightMap.GetField().GetIndex(2, 5)], 0.0f, 1e-6f);
+	CHECK_NEAR(distance[heightMap.GetField().GetIndex(4, 5)], 1.0f, 1e-5f);
+	CHECK_NEAR(distance[heightMap.GetField().GetIndex(16, 0)], 13.0f, 1e-4f);
+}
@@ -0,0 +1,74 @@
+#include "TestFramework.h"
+#include "Frustum.h"
+
+// The plane matches (a, b, c, d) up to the rounding of the extraction, which grows with the distance of the plane (the far plane is w - z)
+static void CheckPlane(const Frustum& frustum, int plane, float a, float b, float c, float d)
+{
+	const float tolerance = 1e-4f * (1.0f + fabsf(d));
+	const XMFLOAT4& extracted = frustum.GetPlane(plane);
+	CHECK_NEAR(extracted.x, a, tolerance);
+	CHECK_NEAR(extracted.y, b, tolerance);
+	CHECK_NEAR(extracted.z, c, tolerance);
+	CHECK_NEAR(extracted.w, d, tolerance);
+}
+
+// 90 degrees field of view and square aspect, looking down +z from the origin
+static Frustum BuildSquareFrustum()
+{
+	const XMMATRIX view = XMMatrixLookAtLH(XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f), XMVectorSet(0.0f, 0.0f, 1.0f, 1.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+	const XMMATRIX projection = XMMatrixPerspectiveFovLH(XM_PIDIV2, 1.0f, 1.0f, 100.0f);
+	Frustum frustum;
+	frustum.Build(XMMatrixMultiply(XMMatrixIdentity(), XMMatrixMultiply(view, projection)));
+	return frustum;
+}
+
+TEST(FrustumPlanesFromAKnownMatrix)
+{
+	// the side planes are the 45 degree planes through the eye, normals pointing inside
+	const Frustum frustum = BuildSquareFrustum();
+	const float diagonal = 1.0f / sqrtf(2.0f);
+	CheckPlane(frustum, Frustum::kPlaneLeft, diagonal, 0.0f, diagonal, 0.0f);
+	CheckPlane(frustum, Frustum::kPlaneRight, -diagonal, 0.0f, diagonal, 0.0f);
+	CheckPlane(frustum, Frustum::kPlaneBottom, 0.0f, diagonal, diagonal, 0.0f);
+	CheckPlane(frustum, Frustum::kPlaneTop, 0.0f, -diagonal, diagonal, 0.0f);
+	CheckPlane(frustum, Frustum::kPlaneNear, 0.0f, 0.0f, 1.0f, -1.0f);
+	CheckPlane(frustum, Frustum::kPlaneFar, 0.0f, 0.0f, -1.0f, 100.0f);
+}
+
+TEST(FrustumPlanesFromAMovedEye)
+{
+	// the same frustum with the eye at (10, 5, -20): every plane keeps its normal and passes through the moved points
+	const XMMATRIX view = XMMatrixLookAtLH(XMVectorSet(10.0f, 5.0f, -20.0f, 1.0f), XMVectorSet(10.0f, 5.0f, -19.0f, 1.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+	Frustum frustum;
+	frustum.Build(XMMatrixMultiply(view, XMMatrixPerspectiveFovLH(XM_PIDIV2, 1.0f, 1.0f, 100.0f)));
+	const float diagonal = 1.0f / sqrtf(2.0f);
+	CheckPlane(frustum, Frustum::kPlaneLeft, diagonal, 0.0f, diagonal, diagonal * (-10.0f + 20.0f));
+	CheckPlane(frustum, Frustum::kPlaneRight, -diagonal, 0.0f, diagonal, diagonal * (10.0f + 20.0f));
+	CheckPlane(frustum, Frustum::kPlaneBottom, 0.0f, diagonal, diagonal, diagonal * (-5.0f + 20.0f));
+	CheckPlane(frustum, Frustum::kPlaneTop, 0.0f, -diagonal, diagonal, diagonal * (5.0f + 20.0f));
+	CheckPlane(frustum, Frustum::kPlaneNear, 0.0f, 0.0f, 1.0f, 19.0f);
+	CheckPlane(frustum, Frustum::kPlaneFar, 0.0f, 0.0f, -1.0f, 80.0f);
+}
+
+TEST(FrustumTestBox)
+{
+	const Frustum frustum = BuildSquareFrustum();
+
+	// completely inside, well within the sides and the depth range
+	CHECK(frustum.TestBox(XMFLOAT3(-1.0f, -1.0f, 10.0f), XMFLOAT3(1.0f, 1.0f, 12.0f)) == kFrustumInside);
+
+	// crossing the near plane, the far plane and a side plane
+	CHECK(frustum.TestBox(XMFLOAT3(-0.25f, -0.25f, 0.5f), XMFLOAT3(0.25f, 0.25f, 2.0f)) == kFrustumIntersect);
+	CHECK(frustum.TestBox(XMFLOAT3(-1.0f, -1.0f, 90.0f), XMFLOAT3(1.0f, 1.0f, 110.0f)) == kFrustumIntersect);
+	CHECK(frustum.TestBox(XMFLOAT3(5.0f, -1.0f, 10.0f), XMFLOAT3(15.0f, 1.0f, 12.0f)) == kFrustumIntersect);
+	// containing the whole frustum
+	CHECK(frustum.TestBox(XMFLOAT3(-200.0f, -200.0f, -200.0f), XMFLOAT3(200.0f, 200.0f, 200.0f)) == kFrustumIntersect);
+
+	// behind the eye, beyond the far plane and beside each side plane
+	CHECK(frustum.TestBox(XMFLOAT3(-1.0f, -1.0f, -5.0f), XMFLOAT3(1.0f, 1.0f, -2.0f)) == kFrustumOutside);
+	CHECK(frustum.TestBox(XMFLOAT3(-1.0f, -1.0f, 101.0f), XMFLOAT3(1.0f, 1.0f, 105.0f)) == kFrustumOutside);
+	CHECK(frustum.TestBox(XMFLOAT3(-30.0f, -1.0f, 10.0f), XMFLOAT3(-20.0f, 1.0f, 12.0f)) == kFrustumOutside);
+	CHECK(frustum.TestBox(XMFLOAT3(20.0f, -1.0f, 10.0f), XMFLOAT3(30.0f, 1.0f, 12.0f)) == kFrustumOutside);
+	CHECK(frustum.TestBox(XMFLOAT3(-1.0f, -30.0f, 10.0f), XMFLOAT3(1.0f, -20.0f, 12.0f)) == kFrustumOutside);
+	CHECK(frustum.TestBox(XMFLOAT3(-1.0f, 20.0f, 10.0f), XMFLOAT3(1.0f, 30.0f, 12.0f)) == kFrustumOutside);
+}
@@ -0,0 +1,147 @@
+#include "TestFramework.h"
+#include "TestHeightMap.h"
+#include "GeometryClipmap.h"
+
+#include <algorithm>
+
+// Height of the point (m, n) of a level, the height map repeating its border beyond it
+static float GetLevelPoint(const HeightField& field, int level, int m, int n)
+{
+	const XMINT2 resolution = field.GetResolution();
+	return field.Get((std::min)((std::max)(m * (1 << level), 0), resolution.x), (std::min)((std::max)(n * (1 << level), 0), resolution.y));
+}
+
+// Window points of every level whose texel does not hold their height
+static int CountWrongTexels(const GeometryClipmap& clipmap, const HeightField& field)
+{
+	const int mask = GeometryClipmap::kTextureSize - 1;
+	int wrongTexels = 0;
+	for (int level = 0; level < clipmap.GetLevelCount(); level++)
+	{
+		const XMINT2 origin = clipmap.GetLevelOrigin(level);
+		const std::vector<float>& heights = clipmap.GetLevelHeights(level);
+		for (int m = origin.x; m < origin.x + GeometryClipmap::kWindowSize; m++)
+		{
+			for (int n = origin.y; n < origin.y + GeometryClipmap::kWindowSize; n++)
+			{
+				if (heights[(n & mask) + (m & mask) * GeometryClipmap::kTextureSize] != GetLevelPoint(field, level, m, n))
+				{
+					wrongTexels++;
+				}
+			}
+		}
+	}
+	return wrongTexels;
+}
+
+// Move the eye and check that the regions refreshed are exactly the texels of the points that have entered the windows
+// (all of them if the window was not valid) and the dirty points, without wrapping or overlapping
+static void CheckUpdate(GeometryClipmap& clipmap, const HeightField& field, const XMFLOAT3& eye, bool valid, const HeightFieldRect& dirtyRect)
+{
+	const int size = GeometryClipmap::kTextureSize;
+	const int mask = size - 1;
+	std::vector<XMINT2> oldOrigins;
+	for (int level = 0; level < clipmap.GetLevelCount(); level++)
+	{
+		oldOrigins.push_back(clipmap.GetLevelOrigin(level));
+	}
+
+	const int texels = clipmap.Update(field, eye);
+
+	std::vector<std::vector<unsigned char>> covered(clipmap.GetLevelCount(), std::vector<unsigned char>(size * size, 0));
+	int regionTexels = 0, wrappedRegions = 0, overlaps = 0;
+	for (const ClipmapRegion& region : clipmap.GetUpdatedRegions())
+	{
+		regionTexels += region.rows * region.columns;
+		if (region.texelM < 0 || region.texelN < 0 || region.texelM + region.rows > size || region.texelN + region.columns > size)
+		{
+			wrappedRegions++;
+			continue;
+		}
+		for (int m = region.texelM; m < region.texelM + region.rows; m++)
+		{
+			for (int n = region.texelN; n < region.texelN + region.columns; n++)
+			{
+				overlaps += covered[region.level][n + m * size]++ > 0 ? 1 : 0;
+			}
+		}
+	}
+	CHECK(texels == regionTexels);
+	CHECK(wrappedRegions == 0);
+	CHECK(overlaps == 0);
+
+	int missing = 0, extra = 0;
+	for (int level = 0; level < clipmap.GetLevelCount(); level++)
+	{
+		const XMINT2 origin = clipmap.GetLevelOrigin(level);
+		CHECK(origin.x == GeometryClipmap::GetWindowOrigin(eye, level).x && origin.y == GeometryClipmap::GetWindowOrigin(eye, level).y);
+		CHECK(origin.x % 2 == 0 && origin.y % 2 == 0);
+
+		std::vector<unsigned char> expected(size * size, 0);
+		for (int m = origin.x; m < origin.x + GeometryClipmap::kWindowSize; m++)
+		{
+			for (int n = origin.y; n < origin.y + GeometryClipmap::kWindowSize; n++)
+			{
+				const bool entered = !valid || m < oldOrigins[level].x || m >= oldOrigins[level].x + GeometryClipmap::kWindowSize
+					|| n < oldOrigins[level].y || n >= oldOrigins[level].y + GeometryClipmap::kWindowSize;
+				const int mapM = (std::min)((std::max)(m * (1 << level), 0), field.GetResolution().x);
+				const int mapN = (std::min)((std::max)(n * (1 << level), 0), field.GetResolution().y);
+				const bool dirty = mapM >= dirtyRect.mMin && mapM <= dirtyRect.mMax && mapN >= dirtyRect.nMin && mapN <= dirtyRect.nMax;
+				expected[(n & mask) + (m & mask) * size] = (entered || dirty) ? 1 : 0;
+			}
+		}
+		for (int texel = 0; texel < size * size; texel++)
+		{
+			missing += (expected[texel] && !covered[level][texel]) ? 1 : 0;
+			extra += (!expected[texel] && covered[level][texel]) ? 1 : 0;
+		}
+	}
+	CHECK(missing == 0);
+	CHECK(extra == 0);
+	CHECK(CountWrongTexels(clipmap, field) == 0);
+}
+
+TEST(GeometryClipmapRefreshesTheIncomingPoints)
+{
+	const XMINT2 resolution(600, 500);
+	TestHeightMap heightMap(resolution);
+	heightMap.FillRandom(31, Range());
+	HeightField& field = heightMap.GetField();
+
+	GeometryClipmap clipmap;
+	clipmap.Resize(resolution);
+	CHECK(clipmap.GetLevelCount() == 4);
+
+	// the first update fills every window
+	CheckUpdate(clipmap, field, XMFLOAT3(100.0f, 5.0f, 120.0f), false, HeightFieldRect());
+
+	// small steps along both axes and back, some of them within the same pair of points
+	const XMFLOAT3 smallSteps[] = { XMFLOAT3(103.0f, 5.0f, 121.0f), XMFLOAT3(98.0f, 5.0f, 128.5f), XMFLOAT3(98.5f, 5.0f, 129.0f), XMFLOAT3(90.0f, 5.0f, 110.0f) };
+	for (const XMFLOAT3& eye : smallSteps)
+	{
+		CheckUpdate(clipmap, field, eye, true, HeightFieldRect());
+	}
+
+	// a large jump leaves nothing in common with the finest windows, but the coarsest ones still shift
+	CheckUpdate(clipmap, field, XMFLOAT3(400.0f, 5.0f, 520.0f), true, HeightFieldRect());
+	// over the corner, the windows reach beyond the height map
+	CheckUpdate(clipmap, field, XMFLOAT3(-20.0f, 5.0f, 3.0f), true, HeightFieldRect());
+
+	// an edit refreshes its points in every level, also without moving
+	const HeightFieldRect edits[] = { HeightFieldRect(5, 10, 40, 33), HeightFieldRect(0, 0, 3, 3), HeightFieldRect(17, 17, 17, 17) };
+	for (const HeightFieldRect& rect : edits)
+	{
+		for (int m = rect.mMin; m <= rect.mMax; m++)
+		{
+			for (int n = rect.nMin; n <= rect.nMax; n++)
+			{
+				field.Set(m, n, 20.0f + m * 0.01f);
+			}
+		}
+		clipmap.MarkDirty(rect);
+		CheckUpdate(clipmap, field, XMFLOAT3(-18.0f, 5.0f, 3.0f), true, rect);
+	}
+
+	// nothing to do when the eye stays in the same points
+	CHECK(clipmap.Update(field, XMFLOAT3(-17.5f, 5.0f, 3.5f)) == 0);
+}
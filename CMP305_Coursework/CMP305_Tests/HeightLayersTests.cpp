@@ -0,0 +1,49 @@
+#include "TestFramework.h"
+#include "TestHeightMap.h"
+#include "HeightLayers.h"
+
+#include <algorithm>
+
+TEST(HeightLayersKeepTheEditsOfTheBase)
+{
+	// a base with an added layer painted over part of it, across the border of two tiles
+	const XMINT2 resolution(100, 80);
+	TestHeightMap heights(resolution);
+	heights.FillRandom(15, Range());
+	const TestHeightMap original(heights);
+	HeightLayerStack layers;
+	layers.Resize(resolution);
+	layers.SetBase(heights.GetField());
+	const int layer = layers.AddLayer("Hill", kLayerAdd);
+	layers.Paint(layer, 60.0f, 40.0f, 12.0f, 5.0f, 1.0f);
+	layers.Composite(heights.GetField());
+	const TestHeightMap painted(heights);
+
+	// an edit under the layer, as the terrain adds the change of a local edit to the base
+	const HeightFieldRect rect(55, 30, 70, 45);
+	std::vector<float> delta(rect.GetArea());
+	for (int i = 0; i < (int)delta.size(); i++)
+	{
+		delta[i] = 0.25f * (i % 7);
+	}
+	layers.AddToBase(rect, delta.data());
+	CHECK(layers.IsDirty());
+
+	// the composite of the tiles under the rect keeps the edit under the layer, and so does the base
+	layers.Composite(heights.GetField());
+	TestHeightMap base(resolution);
+	layers.ReadBase(base.GetField());
+	float compositeError = 0.0f, baseError = 0.0f;
+	for (int m = 0; m <= resolution.x; m++)
+	{
+		for (int n = 0; n <= resolution.y; n++)
+		{
+			const bool inside = m >= rect.mMin && m <= rect.mMax && n >= rect.nMin && n <= rect.nMax;
+			const float change = inside ? delta[(n - rect.nMin) + (m - rect.mMin) * (rect.nMax - rect.nMin + 1)] : 0.0f;
+			compositeError = (std::max)(compositeError, fabsf(heights.GetField().Get(m, n) - (painted.GetField().Get(m, n) + change)));
+			baseError = (std::max)(baseError, fabsf(base.GetField().Get(m, n) - (original.GetField().Get(m, n) + change)));
+		}
+	}
+	CHECK(compositeError < 1e-5f);
+	CHECK(baseError < 1e-5f);
+}
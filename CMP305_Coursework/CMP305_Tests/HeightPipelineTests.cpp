@@ -0,0 +1,156 @@
+#include "TestFramework.h"
+#include "TestHeightMap.h"
+#include "HeightPipeline.h"
+
+#include <algorithm>
+
+// Point passes as the terrain records them: a fault line, a scale and a clamp
+static void Fault(int m, int nBegin, int count, float* heights)
+{
+	for (int i = 0; i < count; i++)
+	{
+		heights[i] += (2 * m + 30 > 3 * (nBegin + i)) ? 1.5f : -1.5f;
+	}
+}
+
+static void Scale(int, int, int count, float* heights)
+{
+	for (int i = 0; i < count; i++)
+	{
+		heights[i] *= 1.25f;
+	}
+}
+
+static void Clamp(int, int, int count, float* heights)
+{
+	for (int i = 0; i < count; i++)
+	{
+		heights[i] = (std::min)((std::max)(heights[i], 0.0f), 9.0f);
+	}
+}
+
+static void Fill(int m, int nBegin, int count, float* heights)
+{
+	for (int i = 0; i < count; i++)
+	{
+		heights[i] = 0.01f * m + 0.02f * (nBegin + i);
+	}
+}
+
+// Map pass reading the neighbours: every point takes the height of the point above it (the first row is kept)
+static void ShiftDown(HeightField& field, TerrainJobProgress& progress)
+{
+	std::vector<float> above(field.GetColumns()), row(field.GetColumns());
+	field.ReadRow(0, above.data());
+	for (int m = 1; m < field.GetRows(); m++)
+	{
+		field.ReadRow(m, row.data());
+		field.WriteRow(m, above.data());
+		std::swap(above, row);
+	}
+	progress.Set(1.0f);
+}
+
+// Run every pass of passes on its own, as a pipeline of a single pass
+static void RunSeparately(const std::vector<HeightPipeline>& passes, HeightField& field)
+{
+	for (const HeightPipeline& pass : passes)
+	{
+		TerrainJobProgress progress;
+		pass.Run(field, progress);
+	}
+}
+
+static bool AreEqual(const HeightField& a, const HeightField& b)
+{
+	for (int m = 0; m < a.GetRows(); m++)
+	{
+		for (int n = 0; n < a.GetColumns(); n++)
+		{
+			if (a.Get(m, n) != b.Get(m, n))
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+TEST(HeightPipelineFusedEqualsSeparateRuns)
+{
+	// not a multiple of the tiles the fused passes run on
+	TestHeightMap fused(XMINT2(150, 100));
+	fused.FillRandom(61, Range());
+	TestHeightMap separate(fused);
+
+	HeightPipeline pipeline;
+	pipeline.AddPointPass("Fault", Fault);
+	pipeline.AddPointPass("Scale", Scale);
+	pipeline.AddMapPass("Shift", ShiftDown);
+	pipeline.AddPointPass("Clamp", Clamp);
+	pipeline.AddPointPass("Scale", Scale);
+	CHECK(pipeline.GetPassCount() == 5);
+	CHECK(pipeline.GetTraversalCount() == 3);
+	CHECK(pipeline.GetName() == "Fault + Scale + Shift + Clamp + Scale");
+
+	TerrainJobProgress progress;
+	pipeline.Run(fused.GetField(), progress);
+	CHECK_NEAR(progress.Get(), 1.0f, 1e-6f);
+
+	std::vector<HeightPipeline> passes(5);
+	passes[0].AddPointPass("Fault", Fault);
+	passes[1].AddPointPass("Scale", Scale);
+	passes[2].AddMapPass("Shift", ShiftDown);
+	passes[3].AddPointPass("Clamp", Clamp);
+	passes[4].AddPointPass("Scale", Scale);
+	RunSeparately(passes, separate.GetField());
+	CHECK(AreEqual(fused.GetField(), separate.GetField()));
+}
+
+TEST(HeightPipelineReplacingPassDropsThePreviousOnes)
+{
+	TestHeightMap heightMap(XMINT2(70, 70));
+	heightMap.FillRandom(62, Range());
+	TestHeightMap expected(heightMap);
+
+	// a fill replaces every height, nothing before it can change the result
+	HeightPipeline pipeline;
+	pipeline.AddPointPass("Fault", Fault);
+	pipeline.AddMapPass("Shift", ShiftDown);
+	pipeline.AddPointPass("Fill", Fill, true);
+	pipeline.AddPointPass("Scale", Scale);
+	CHECK(pipeline.GetPassCount() == 2);
+	CHECK(pipeline.GetName() == "Fill + Scale");
+	TerrainJobProgress progress;
+	pipeline.Run(heightMap.GetField(), progress);
+
+	std::vector<HeightPipeline> passes(2);
+	passes[0].AddPointPass("Fill", Fill);
+	passes[1].AddPointPass("Scale", Scale);
+	RunSeparately(passes, expected.GetField());
+	CHECK(AreEqual(heightMap.GetField(), expected.GetField()));
+
+	// a map pass can replace the heights too (the Diamond-Square)
+	pipeline.AddMapPass("Shift", ShiftDown, true);
+	CHECK(pipeline.GetPassCount() == 1);
+	CHECK(pipeline.GetTraversalCount() == 1);
+	CHECK(pipeline.GetName() == "Shift");
+}
+
+TEST(HeightPipelineCancelledLeavesTheMap)
+{
+	TestHeightMap heightMap(XMINT2(100, 100));
+	heightMap.FillRandom(63, Range());
+	const TestHeightMap original(heightMap);
+
+	HeightPipeline pipeline;
+	pipeline.AddPointPass("Fault", Fault);
+	pipeline.AddMapPass("Shift", ShiftDown);
+	TerrainJobProgress progress;
+	progress.Cancel();
+	pipeline.Run(heightMap.GetField(), progress);
+	CHECK(AreEqual(heightMap.GetField(), original.GetField()));
+
+	pipeline.Clear();
+	CHECK(pipeline.IsEmpty() && pipeline.GetTraversalCount() == 0);
+}
@@ -0,0 +1,95 @@
+#include "TestFramework.h"
+#include "TestHeightMap.h"
+#include "HeightQuadtree.h"
+
+#include <algorithm>
+#include <cfloat>
+
+// Every node holds the min/max of the points of its quads, border points included
+static int CountWrongNodes(const HeightQuadtree& quadtree, const HeightField& field)
+{
+	int wrongNodes = 0;
+	for (int level = 0; level < quadtree.GetLevelCount(); level++)
+	{
+		for (int i = 0; i < quadtree.GetLevelSize(level).x; i++)
+		{
+			for (int j = 0; j < quadtree.GetLevelSize(level).y; j++)
+			{
+				const HeightFieldRect quads = quadtree.GetNodeQuads(level, i, j);
+				XMFLOAT2 expected(FLT_MAX, -FLT_MAX);
+				for (int m = quads.mMin; m <= quads.mMax + 1; m++)
+				{
+					for (int n = quads.nMin; n <= quads.nMax + 1; n++)
+					{
+						expected.x = (std::min)(expected.x, field.Get(m, n));
+						expected.y = (std::max)(expected.y, field.Get(m, n));
+					}
+				}
+				const XMFLOAT2 bounds = quadtree.GetBounds(level, i, j);
+				if (bounds.x != expected.x || bounds.y != expected.y)
+				{
+					wrongNodes++;
+				}
+			}
+		}
+	}
+	return wrongNodes;
+}
+
+TEST(HeightQuadtreeBuildMatchesBruteForce)
+{
+	// not a multiple of the leaf size, so the last leaves are clipped
+	TestHeightMap heightMap(XMINT2(70, 45));
+	heightMap.FillRandom(7, Range());
+
+	HeightQuadtree quadtree;
+	quadtree.Build(heightMap.GetField());
+	CHECK(quadtree.GetLevelSize(0).x == 9 && quadtree.GetLevelSize(0).y == 6);
+	CHECK(quadtree.GetLevelSize(quadtree.GetLevelCount() - 1).x == 1 && quadtree.GetLevelSize(quadtree.GetLevelCount() - 1).y == 1);
+	CHECK(CountWrongNodes(quadtree, heightMap.GetField()) == 0);
+}
+
+TEST(HeightQuadtreeUpdateMatchesBuild)
+{
+	TestHeightMap heightMap(XMINT2(70, 45));
+	heightMap.FillRandom(8, Range());
+	HeightQuadtree quadtree;
+	quadtree.Build(heightMap.GetField());
+
+	// edits raising and lowering the extremes, on leaf borders, on the map border and on a single point
+	const HeightFieldRect edits[] = { HeightFieldRect(10, 5, 20, 17), HeightFieldRect(16, 24, 16, 24), HeightFieldRect(62, 40, 70, 45), HeightFieldRect(0, 0, 3, 8), HeightFieldRect(33, 11, 33, 11) };
+	const float heights[] = { 50.0f, -50.0f, 5.0f, 30.0f, -35.0f };
+	for (int edit = 0; edit < 5; edit++)
+	{
+		const HeightFieldRect& rect = edits[edit];
+		for (int m = rect.mMin; m <= rect.mMax; m++)
+		{
+			for (int n = rect.nMin; n <= rect.nMax; n++)
+			{
+				heightMap.GetField().Set(m, n, heights[edit]);
+			}
+		}
+		quadtree.Update(heightMap.GetField(), rect);
+
+		HeightQuadtree built;
+		built.Build(heightMap.GetField());
+		int differentNodes = 0;
+		for (int level = 0; level < built.GetLevelCount(); level++)
+		{
+			for (int i = 0; i < built.GetLevelSize(level).x; i++)
+			{
+				for (int j = 0; j < built.GetLevelSize(level).y; j++)
+				{
+					const XMFLOAT2 updated = quadtree.GetBounds(level, i, j);
+					const XMFLOAT2 expected = built.GetBounds(level, i, j);
+					if (updated.x != expected.x || updated.y != expected.y)
+					{
+						differentNodes++;
+					}
+				}
+			}
+		}
+		CHECK(differentNodes == 0);
+	}
+	CHECK(CountWrongNodes(quadtree, heightMap.GetField()) == 0);
+}
@@ -0,0 +1,120 @@
+#include "TestFramework.h"
+#include "TestHeightMap.h"
+#include "HeightResampler.h"
+
+#include <algorithm>
+
+// A plane over the height map
+static float GetPlaneHeight(float m, float n)
+{
+	return 0.75f * m - 0.5f * n + 3.0f;
+}
+
+// Largest difference from the plane of the destination points whose filter only reads points inside the source,
+// at margin source points or more from its edges
+static float GetPlaneError(const HeightField& destination, XMINT2 sourceResolution, float margin)
+{
+	const float stepM = (float)sourceResolution.x / (float)destination.GetResolution().x;
+	const float stepN = (float)sourceResolution.y / (float)destination.GetResolution().y;
+	float largest = 0.0f;
+	for (int m = 0; m < destination.GetRows(); m++)
+	{
+		for (int n = 0; n < destination.GetColumns(); n++)
+		{
+			const float sourceM = m * stepM, sourceN = n * stepN;
+			if (sourceM >= margin && sourceM <= sourceResolution.x - margin && sourceN >= margin && sourceN <= sourceResolution.y - margin)
+			{
+				largest = (std::max)(largest, fabsf(destination.Get(m, n) - GetPlaneHeight(sourceM, sourceN)));
+			}
+		}
+	}
+	return largest;
+}
+
+TEST(HeightResamplerIdentity)
+{
+	// the same resolution gives the same heights with both filters
+	const XMINT2 resolution(37, 50);
+	TestHeightMap source(resolution);
+	source.FillRandom(51, Range());
+	const ResampleFilter filters[] = { kResampleBilinear, kResampleBicubic };
+	for (ResampleFilter filter : filters)
+	{
+		TestHeightMap destination(resolution);
+		HeightResampler::Resample(source.GetField(), destination.GetField(), filter);
+		float largest = 0.0f;
+		for (int m = 0; m < source.GetField().GetRows(); m++)
+		{
+			for (int n = 0; n < source.GetField().GetColumns(); n++)
+			{
+				largest = (std::max)(largest, fabsf(destination.GetField().Get(m, n) - source.GetField().Get(m, n)));
+			}
+		}
+		CHECK_NEAR(largest, 0.0f, 1e-5f);
+	}
+}
+
+TEST(HeightResamplerReproducesAPlane)
+{
+	const XMINT2 resolution(20, 31);
+	TestHeightMap source(resolution);
+	source.Fill([](int m, int n) { return GetPlaneHeight((float)m, (float)n); });
+
+	// enlarged: the tent everywhere, Catmull-Rom where its 4 points are inside the map (the edge is repeated beyond it)
+	TestHeightMap enlarged(XMINT2(57, 83));
+	HeightResampler::Resample(source.GetField(), enlarged.GetField(), kResampleBilinear);
+	CHECK_NEAR(GetPlaneError(enlarged.GetField(), resolution, 0.0f), 0.0f, 1e-4f);
+	HeightResampler::Resample(source.GetField(), enlarged.GetField(), kResampleBicubic);
+	CHECK_NEAR(GetPlaneError(enlarged.GetField(), resolution, 1.0f), 0.0f, 1e-4f);
+
+	// halved: every output is on a source point and the stretched filters are symmetric around it
+	TestHeightMap plane(XMINT2(64, 48));
+	plane.Fill([](int m, int n) { return GetPlaneHeight((float)m, (float)n); });
+	const XMINT2 half = HeightResampler::GetHalfResolution(XMINT2(64, 48));
+	CHECK(half.x == 32 && half.y == 24);
+	TestHeightMap reduced(half);
+	HeightResampler::Resample(plane.GetField(), reduced.GetField(), kResampleBilinear);
+	CHECK_NEAR(GetPlaneError(reduced.GetField(), XMINT2(64, 48), 2.0f), 0.0f, 1e-4f);
+	HeightResampler::Resample(plane.GetField(), reduced.GetField(), kResampleBicubic);
+	CHECK_NEAR(GetPlaneError(reduced.GetField(), XMINT2(64, 48), 4.0f), 0.0f, 1e-4f);
+}
+
+TEST(HeightResamplerKeepsFlatMapsAndCorners)
+{
+	TestHeightMap source(XMINT2(45, 29));
+	source.FillRandom(52, Range());
+	const HeightField& field = source.GetField();
+	TestHeightMap flat(XMINT2(45, 29));
+	flat.Fill([](int, int) { return 4.5f; });
+
+	// larger, smaller and mixed resolutions, down to a single quad
+	const XMINT2 resolutions[] = { XMINT2(100, 64), XMINT2(11, 7), XMINT2(90, 10), XMINT2(1, 1) };
+	const ResampleFilter filters[] = { kResampleBilinear, kResampleBicubic };
+	for (const XMINT2& resolution : resolutions)
+	{
+		for (ResampleFilter filter : filters)
+		{
+			// the weights add up to 1, so a flat map stays flat
+			TestHeightMap destination(resolution);
+			HeightResampler::Resample(flat.GetField(), destination.GetField(), filter);
+			float largest = 0.0f;
+			for (int m = 0; m <= resolution.x; m++)
+			{
+				for (int n = 0; n <= resolution.y; n++)
+				{
+					largest = (std::max)(largest, fabsf(destination.GetField().Get(m, n) - 4.5f));
+				}
+			}
+			CHECK_NEAR(largest, 0.0f, 1e-5f);
+
+			// the corners of both maps are the same points, they only move by the filtering when the map is reduced
+			if (resolution.x >= 45 && resolution.y >= 29)
+			{
+				HeightResampler::Resample(field, destination.GetField(), filter);
+				CHECK_NEAR(destination.GetField().Get(0, 0), field.Get(0, 0), 1e-5f);
+				CHECK_NEAR(destination.GetField().Get(resolution.x, resolution.y), field.Get(45, 29), 1e-5f);
+				CHECK_NEAR(destination.GetField().Get(resolution.x, 0), field.Get(45, 0), 1e-5f);
+			}
+		}
+	}
+}
@@ -0,0 +1,123 @@
+#include "TestFramework.h"
+#include "TestHeightMap.h"
+#include "HorizonOcclusion.h"
+
+#include <algorithm>
+#include <cfloat>
+
+// Bilinear height of the map at (x, z), x along n and z along m
+static float SampleHeight(const HeightField& field, float x, float z)
+{
+	const int m = (std::min)((int)z, field.GetResolution().x - 1);
+	const int n = (std::min)((int)x, field.GetResolution().y - 1);
+	const float u = x - n, v = z - m;
+	const float top = field.Get(m, n) + (field.Get(m, n + 1) - field.Get(m, n)) * u;
+	const float bottom = field.Get(m + 1, n) + (field.Get(m + 1, n + 1) - field.Get(m + 1, n)) * u;
+	return top + (bottom - top) * v;
+}
+
+// A point is visible when the segment from the eye to it stays above the terrain, marched in small steps
+static bool IsPointVisible(const HeightField& field, const XMFLOAT3& eye, int m, int n)
+{
+	const XMFLOAT3 point((float)n, field.Get(m, n), (float)m);
+	const float distance = sqrtf((point.x - eye.x) * (point.x - eye.x) + (point.z - eye.z) * (point.z - eye.z));
+	const int steps = (int)(distance * 4.0f);
+	// the last quad before the point can not hide it
+	for (int step = 1; step < steps - 4; step++)
+	{
+		const float t = (float)step / steps;
+		const float height = eye.y + (point.y - eye.y) * t;
+		if (height < SampleHeight(field, eye.x + (point.x - eye.x) * t, eye.z + (point.z - eye.z) * t))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// A leaf is visible when any of its points is, border points included
+static bool IsLeafVisible(const HeightQuadtree& quadtree, const HeightField& field, const XMFLOAT3& eye, int i, int j)
+{
+	const HeightFieldRect quads = quadtree.GetNodeQuads(0, i, j);
+	for (int m = quads.mMin; m <= quads.mMax + 1; m++)
+	{
+		for (int n = quads.nMin; n <= quads.nMax + 1; n++)
+		{
+			if (IsPointVisible(field, eye, m, n))
+			{
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+TEST(HorizonOcclusionHidesTheValleyBehindARidge)
+{
+	// a wall across the map at rows 24 to 32, a low bumpy valley behind it and the eye just over the ground in front of it
+	TestHeightMap heightMap(XMINT2(128, 128));
+	heightMap.Fill([](int m, int n) { return (m >= 24 && m <= 32) ? 40.0f : Utils::GetPointRandom(4, m, n) * 2.0f; });
+	const HeightField& field = heightMap.GetField();
+	HeightQuadtree quadtree;
+	quadtree.Build(field);
+
+	// the eye is in the middle of a leaf column: a bin is only raised by a wall leaf covering all of it, so the bin
+	// straight ahead would stay open if two wall leaves met exactly on the line of sight
+	const XMFLOAT3 eye(60.0f, 3.0f, 4.0f);
+	HorizonOcclusion occlusion;
+	occlusion.Compute(quadtree, eye, -FLT_MAX);
+
+	// never hides a leaf that can be seen, and the whole valley behind the wall is hidden
+	int wronglyHidden = 0, valleyHidden = 0, valleyLeaves = 0;
+	for (int i = 0; i < quadtree.GetLevelSize(0).x; i++)
+	{
+		for (int j = 0; j < quadtree.GetLevelSize(0).y; j++)
+		{
+			const bool hidden = occlusion.GetState(0, i, j) == kOcclusionHidden;
+			if (hidden && IsLeafVisible(quadtree, field, eye, i, j))
+			{
+				wronglyHidden++;
+			}
+			if (i >= 5)
+			{
+				CHECK(!IsLeafVisible(quadtree, field, eye, i, j));
+				valleyLeaves++;
+				valleyHidden += hidden ? 1 : 0;
+			}
+		}
+	}
+	CHECK(wronglyHidden == 0);
+	CHECK(valleyHidden == valleyLeaves);
+	CHECK(occlusion.GetHiddenLeafCount() > 0);
+	// the wall itself and the ground in front of it are in view
+	CHECK(occlusion.GetState(0, 3, 8) == kOcclusionVisible);
+	CHECK(occlusion.GetState(0, 0, 8) == kOcclusionVisible);
+}
+
+TEST(HorizonOcclusionHidesNothingOnAnOpenPlane)
+{
+	TestHeightMap heightMap(XMINT2(128, 96));
+	const HeightField& field = heightMap.GetField();
+	HeightQuadtree quadtree;
+	quadtree.Build(field);
+
+	// from the middle and from a corner, just over the ground
+	const XMFLOAT3 eyes[] = { XMFLOAT3(48.0f, 2.0f, 64.0f), XMFLOAT3(0.5f, 0.5f, 0.5f) };
+	for (const XMFLOAT3& eye : eyes)
+	{
+		HorizonOcclusion occlusion;
+		occlusion.Compute(quadtree, eye, -FLT_MAX);
+		CHECK(occlusion.GetHiddenLeafCount() == 0);
+
+		int leavesInView = 0;
+		for (int i = 0; i < quadtree.GetLevelSize(0).x; i++)
+		{
+			for (int j = 0; j < quadtree.GetLevelSize(0).y; j++)
+			{
+				leavesInView += IsLeafVisible(quadtree, field, eye, i, j) ? 1 : 0;
+			}
+		}
+		CHECK(leavesInView == occlusion.GetLeafCount());
+		CHECK(occlusion.GetState(quadtree.GetLevelCount() - 1, 0, 0) == kOcclusionVisible);
+	}
+}
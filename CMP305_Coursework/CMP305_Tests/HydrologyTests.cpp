@@ -0,0 +1,142 @@
+#include "TestFramework.h"
+#include "TestHeightMap.h"
+#include "Hydrology.h"
+
+#include <algorithm>
+
+// Next point downstream of index, -1 at an outlet
+static int GetDownstream(XMINT2 resolution, const std::vector<unsigned char>& flowDirection, int index)
+{
+	const int columns = resolution.y + 1;
+	const int direction = flowDirection[index];
+	if (direction == kFlowOutlet)
+	{
+		return -1;
+	}
+	const int m = index / columns + Hydrology::kNeighbourOffsetM[direction];
+	const int n = index % columns + Hydrology::kNeighbourOffsetN[direction];
+	return n + m * columns;
+}
+
+TEST(HydrologyFilledMapDrainsToTheBorder)
+{
+	const XMINT2 resolution(48, 40);
+	TestHeightMap heightMap(resolution);
+	heightMap.FillRandom(11, Range());
+
+	HydrologyMaps maps;
+	Hydrology::Analyse(heightMap.GetField(), maps);
+
+	// the quantisation of the bucket queue is the only slack allowed on the way down
+	const float tolerance = 10.0f / Hydrology::kNumBuckets * 2.0f;
+	const int size = heightMap.GetField().GetSize();
+	const int columns = resolution.y + 1;
+	int raisedBelow = 0, outletsInside = 0, uphill = 0, undrained = 0;
+	for (int index = 0; index < size; index++)
+	{
+		const int m = index / columns;
+		const int n = index % columns;
+		if (maps.filledHeight[index] < heightMap.GetField().Get(m, n))
+		{
+			raisedBelow++;
+		}
+		if (maps.flowDirection[index] == kFlowOutlet && m > 0 && n > 0 && m < resolution.x && n < resolution.y)
+		{
+			outletsInside++;
+		}
+
+		// every path reaches an outlet without going up
+		int point = index, steps = 0;
+		while (point >= 0 && steps <= size)
+		{
+			const int next = GetDownstream(resolution, maps.flowDirection, point);
+			if (next >= 0 && maps.filledHeight[next] > maps.filledHeight[point] + tolerance)
+			{
+				uphill++;
+			}
+			point = next;
+			steps++;
+		}
+		if (point >= 0)
+		{
+			undrained++;
+		}
+	}
+	CHECK(raisedBelow == 0);
+	CHECK(outletsInside == 0);
+	CHECK(uphill == 0);
+	CHECK(undrained == 0);
+}
+
+TEST(HydrologyFillsAPitToItsRim)
+{
+	// a bowl with its rim at 5 and a pit at the centre, the outside at 0
+	TestHeightMap heightMap(XMINT2(20, 20));
+	heightMap.Fill([](int m, int n)
+	{
+		const int ring = (std::max)(abs(m - 10), abs(n - 10));
+		return ring == 4 ? 5.0f : (ring < 4 ? 1.0f : 0.0f);
+	});
+
+	std::vector<float> filledHeight;
+	std::vector<unsigned char> floodDirection;
+	Hydrology::FillDepressions(heightMap.GetField(), filledHeight, floodDirection);
+	const float tolerance = 5.0f / Hydrology::kNumBuckets * 2.0f;
+	CHECK_NEAR(filledHeight[heightMap.GetField().GetIndex(10, 10)], 5.0f, tolerance);
+	CHECK_NEAR(filledHeight[heightMap.GetField().GetIndex(2, 2)], 0.0f, tolerance);
+}
+
+TEST(HydrologyAccumulationMatchesTheFlowPaths)
+{
+	const XMINT2 resolution(33, 29);
+	TestHeightMap heightMap(resolution);
+	heightMap.FillRandom(5, Range());
+
+	HydrologyMaps maps;
+	Hydrology::Analyse(heightMap.GetField(), maps);
+
+	// every point adds one to itself and to all the points downstream of it
+	const int size = heightMap.GetField().GetSize();
+	std::vector<float> expected(size, 0.0f);
+	for (int index = 0; index < size; index++)
+	{
+		for (int point = index; point >= 0; point = GetDownstream(resolution, maps.flowDirection, point))
+		{
+			expected[point] += 1.0f;
+		}
+	}
+
+	int mismatches = 0;
+	for (int index = 0; index < size; index++)
+	{
+		if (maps.flowAccumulation[index] != expected[index])
+		{
+			mismatches++;
+		}
+	}
+	CHECK(mismatches == 0);
+}
+
+TEST(HydrologyStopsWhenCancelled)
+{
+	TestHeightMap heightMap(XMINT2(32, 32));
+	heightMap.FillRandom(12, Range());
+	TestHeightMap before(heightMap);
+
+	// a cancelled analysis reports it, and a cancelled carve leaves the heights alone
+	std::atomic<bool> cancel(true);
+	HydrologyMaps maps;
+	CHECK(!Hydrology::Analyse(heightMap.GetField(), maps, &cancel));
+
+	cancel = false;
+	CHECK(Hydrology::Analyse(heightMap.GetField(), maps, &cancel));
+	cancel = true;
+	CHECK(Hydrology::CarveRivers(heightMap.GetField(), maps, 1.0f, 2.0f, &cancel) == 0);
+	int changed = 0;
+	for (int index = 0; index < heightMap.GetField().GetSize(); index++)
+	{
+		const int m = index / 33, n = index % 33;
+		changed += heightMap.GetField().Get(m, n) != before.GetField().Get(m, n) ? 1 : 0;
+	}
+	CHECK(changed == 0);
+}
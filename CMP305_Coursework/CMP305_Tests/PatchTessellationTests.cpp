@@ -0,0 +1,160 @@
+#include "TestFramework.h"
+#include "TestHeightMap.h"
+#include "PatchTessellation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Quads whose factors differ from the packed PatchFactors() of the hull shader port
+static int CountWrongPatches(const PatchTessellation& tessellation, const HeightField& field, const XMFLOAT3& eye, const TessellationSettings& settings)
+{
+	int wrongPatches = 0;
+	for (int m = 0; m < field.GetResolution().x; m++)
+	{
+		for (int n = 0; n < field.GetResolution().y; n++)
+		{
+			float inside, edges[PatchTessellation::kEdgeCount];
+			PatchTessellation::ComputePatchFactors(field, m, n, eye, settings, inside, edges);
+			if (tessellation.GetPackedFactors(m, n) != PatchTessellation::PackFactors(inside, edges))
+			{
+				wrongPatches++;
+			}
+		}
+	}
+	return wrongPatches;
+}
+
+TEST(PatchTessellationBlocksMatchThePatchFactors)
+{
+	// not a multiple of the block size, and big enough to have blocks beyond dMax filled with a single value
+	const XMINT2 resolution(150, 133);
+	TestHeightMap heightMap(resolution);
+	heightMap.FillRandom(21, Range());
+	HeightField& field = heightMap.GetField();
+
+	PatchTessellation tessellation;
+	tessellation.Resize(nullptr, resolution);
+	const TessellationSettings settings = { 5.0f, 40.0f, 1.0f, 64.0f };
+
+	// near the corner, in the middle and over the far side of the map
+	const XMFLOAT3 eyes[] = { XMFLOAT3(10.0f, 12.0f, 6.0f), XMFLOAT3(66.5f, 3.0f, 75.25f), XMFLOAT3(140.0f, 20.0f, 160.0f) };
+	for (const XMFLOAT3& eye : eyes)
+	{
+		CHECK(tessellation.Update(nullptr, field, eye, settings) > 0);
+		CHECK(CountWrongPatches(tessellation, field, eye, settings) == 0);
+	}
+	// the far corner of the map is further than dMax
+	float inside, edges[PatchTessellation::kEdgeCount];
+	PatchTessellation::UnpackFactors(tessellation.GetPackedFactors(0, 0), inside, edges);
+	CHECK(inside == settings.lodMin && edges[PatchTessellation::kEdgeLeft] == settings.lodMin && edges[PatchTessellation::kEdgeTop] == settings.lodMin);
+
+	// nothing changes without moving or editing
+	CHECK(tessellation.Update(nullptr, field, eyes[2], settings) == 0);
+
+	// an edit only recomputes the blocks around it, which must still match
+	const HeightFieldRect rect(120, 100, 131, 117);
+	for (int m = rect.mMin; m <= rect.mMax; m++)
+	{
+		for (int n = rect.nMin; n <= rect.nMax; n++)
+		{
+			field.Set(m, n, 25.0f);
+		}
+	}
+	tessellation.MarkDirty(rect);
+	CHECK(tessellation.Update(nullptr, field, eyes[2], settings) > 0);
+	CHECK(CountWrongPatches(tessellation, field, eyes[2], settings) == 0);
+}
+
+TEST(PatchTessellationCullsTheFarBlocks)
+{
+	// lodMin of 0 culls every patch beyond dMax, the far blocks are filled with the sentinel
+	const XMINT2 resolution(100, 90);
+	TestHeightMap heightMap(resolution);
+	heightMap.FillRandom(22, Range());
+
+	PatchTessellation tessellation;
+	tessellation.Resize(nullptr, resolution);
+	const TessellationSettings settings = { 10.0f, 30.0f, 0.0f, 16.0f };
+	const XMFLOAT3 eye(20.0f, 8.0f, 30.0f);
+	tessellation.Update(nullptr, heightMap.GetField(), eye, settings);
+	CHECK(CountWrongPatches(tessellation, heightMap.GetField(), eye, settings) == 0);
+	CHECK(tessellation.GetPackedFactors(99, 89) == PatchTessellation::kCulledPatch);
+	CHECK(tessellation.GetPackedFactors(30, 20) != PatchTessellation::kCulledPatch);
+}
+
+TEST(PatchTessellationPackRoundTrip)
+{
+	// every packed value of 6 bit factors unpacks to factors that pack back to it
+	int wrongValues = 0;
+	for (unsigned int seed = 0; seed < 4096; seed++)
+	{
+		const unsigned int packed = (unsigned int)(Utils::GetPointRandom(seed, 0, 0) * (1 << 15)) | ((unsigned int)(Utils::GetPointRandom(seed, 1, 1) * (1 << 15)) << 15);
+		float inside, edges[PatchTessellation::kEdgeCount];
+		PatchTessellation::UnpackFactors(packed, inside, edges);
+		if (PatchTessellation::PackFactors(inside, edges) != packed)
+		{
+			wrongValues++;
+		}
+	}
+	CHECK(wrongValues == 0);
+
+	// the factors are rounded up as the integer partitioning does, and clamped to [1, 64]
+	const float factors[] = { 0.25f, 1.0f, 1.5f, 7.0f, 7.01f, 63.2f, 64.0f, 100.0f };
+	const float rounded[] = { 1.0f, 1.0f, 2.0f, 7.0f, 8.0f, 64.0f, 64.0f, 64.0f };
+	for (int factor = 0; factor < 8; factor++)
+	{
+		const float edges[PatchTessellation::kEdgeCount] = { factors[factor], 2.0f, factors[factor], 3.0f };
+		float inside, unpacked[PatchTessellation::kEdgeCount];
+		PatchTessellation::UnpackFactors(PatchTessellation::PackFactors(factors[factor], edges), inside, unpacked);
+		CHECK(inside == rounded[factor]);
+		CHECK(unpacked[PatchTessellation::kEdgeLeft] == rounded[factor] && unpacked[PatchTessellation::kEdgeRight] == rounded[factor]);
+		CHECK(unpacked[PatchTessellation::kEdgeTop] == 2.0f && unpacked[PatchTessellation::kEdgeBottom] == 3.0f);
+	}
+
+	// an edge of 0 or NaN culls the patch, which unpacks to all zeros
+	const float culledEdges[][PatchTessellation::kEdgeCount] = { { 4.0f, 0.0f, 4.0f, 4.0f }, { 4.0f, 4.0f, 4.0f, std::numeric_limits<float>::quiet_NaN() } };
+	for (const auto& edges : culledEdges)
+	{
+		CHECK(PatchTessellation::PackFactors(4.0f, edges) == PatchTessellation::kCulledPatch);
+	}
+	float inside, edges[PatchTessellation::kEdgeCount];
+	PatchTessellation::UnpackFactors(PatchTessellation::kCulledPatch, inside, edges);
+	CHECK(inside == 0.0f && edges[0] == 0.0f && edges[1] == 0.0f && edges[2] == 0.0f && edges[3] == 0.0f);
+	// no factors pack to the sentinel
+	const float maxEdges[PatchTessellation::kEdgeCount] = { 64.0f, 64.0f, 64.0f, 64.0f };
+	CHECK(PatchTessellation::PackFactors(64.0f, maxEdges) != PatchTessellation::kCulledPatch);
+}
+
+TEST(PatchTessellationSharedEdgesMatch)
+{
+	// every edge is the minimum of the two patches sharing it, so both sides agree and no edge is over the inside factor
+	const XMINT2 resolution(40, 40);
+	TestHeightMap heightMap(resolution);
+	heightMap.FillRandom(23, Range());
+	const TessellationSettings settings = { 2.0f, 30.0f, 1.0f, 64.0f };
+	const XMFLOAT3 eye(12.5f, 6.0f, 20.0f);
+
+	int mismatches = 0;
+	for (int m = 0; m < resolution.x; m++)
+	{
+		for (int n = 0; n < resolution.y; n++)
+		{
+			float inside, edges[PatchTessellation::kEdgeCount];
+			PatchTessellation::ComputePatchFactors(heightMap.GetField(), m, n, eye, settings, inside, edges);
+			for (int edge = 0; edge < PatchTessellation::kEdgeCount; edge++)
+			{
+				mismatches += edges[edge] > inside ? 1 : 0;
+			}
+
+			float rightInside, right[PatchTessellation::kEdgeCount], topInside, top[PatchTessellation::kEdgeCount];
+			PatchTessellation::ComputePatchFactors(heightMap.GetField(), m, n + 1, eye, settings, rightInside, right);
+			PatchTessellation::ComputePatchFactors(heightMap.GetField(), m + 1, n, eye, settings, topInside, top);
+			mismatches += edges[PatchTessellation::kEdgeRight] != right[PatchTessellation::kEdgeLeft] ? 1 : 0;
+			mismatches += edges[PatchTessellation::kEdgeTop] != top[PatchTessellation::kEdgeBottom] ? 1 : 0;
+			mismatches += edges[PatchTessellation::kEdgeRight] != (std::min)(inside, rightInside) ? 1 : 0;
+			mismatches += edges[PatchTessellation::kEdgeTop] != (std::min)(inside, topInside) ? 1 : 0;
+		}
+	}
+	CHECK(mismatches == 0);
+}
@@ -0,0 +1,216 @@
+#include "TestFramework.h"
+#include "QuantisedHeightMap.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <vector>
+
+// Rounding of offset + step * code in floats, at the magnitude of the offsets of the tests (up to 65)
+static const float kDecodeRounding = 2e-5f;
+
+// Height written at (m, n) by the tests
+static float GetWrittenHeight(unsigned int seed, int m, int n, float range)
+{
+	return Utils::GetPointRandom(seed, m, n) * range - range * 0.5f;
+}
+
+// Write every row of the map with WriteRow
+static void WriteMap(QuantisedHeightMap& heightMap, unsigned int seed, float range)
+{
+	const XMINT2 resolution = heightMap.GetResolution();
+	std::vector<float> row(resolution.y + 1);
+	for (int m = 0; m <= resolution.x; m++)
+	{
+		for (int n = 0; n <= resolution.y; n++)
+		{
+			row[n] = GetWrittenHeight(seed, m, n, range);
+		}
+		heightMap.WriteRow(m, 0, resolution.y + 1, row.data());
+	}
+}
+
+// Largest difference between the heights read and the ones written, both with Get() and ReadRow()
+static float GetLargestError(const QuantisedHeightMap& heightMap, unsigned int seed, float range)
+{
+	const XMINT2 resolution = heightMap.GetResolution();
+	std::vector<float> row(resolution.y + 1);
+	float largest = 0.0f;
+	for (int m = 0; m <= resolution.x; m++)
+	{
+		heightMap.ReadRow(m, 0, resolution.y + 1, row.data());
+		for (int n = 0; n <= resolution.y; n++)
+		{
+			const float written = GetWrittenHeight(seed, m, n, range);
+			largest = (std::max)(largest, (std::max)(fabsf(heightMap.Get(m, n) - written), fabsf(row[n] - written)));
+		}
+	}
+	return largest;
+}
+
+TEST(QuantisedHeightMapWithinTheMaxError)
+{
+	// the last row and column of tiles are partial
+	const float maxError = 0.001f;
+	QuantisedHeightMap heightMap;
+	heightMap.Resize(XMINT2(150, 100), maxError);
+	CHECK(heightMap.GetTileCount() == 3 * 2);
+
+	// a row read back just after it is written is within the error, whatever the refits of its tiles
+	const XMINT2 resolution = heightMap.GetResolution();
+	std::vector<float> row(resolution.y + 1), readBack(resolution.y + 1);
+	float rowError = 0.0f;
+	for (int m = 0; m <= resolution.x; m++)
+	{
+		for (int n = 0; n <= resolution.y; n++)
+		{
+			row[n] = GetWrittenHeight(1, m, n, 20.0f);
+		}
+		heightMap.WriteRow(m, 0, resolution.y + 1, row.data());
+		heightMap.ReadRow(m, 0, resolution.y + 1, readBack.data());
+		for (int n = 0; n <= resolution.y; n++)
+		{
+			rowError = (std::max)(rowError, fabsf(readBack[n] - row[n]));
+		}
+	}
+	CHECK(rowError <= maxError);
+	CHECK(heightMap.GetExactTileCount() == 0);
+	CHECK(heightMap.GetLargestStep() <= maxError);
+
+	// once the ranges hold the heights nothing is refitted, so a second write leaves all of them within the error
+	WriteMap(heightMap, 2, 20.0f);
+	CHECK(GetLargestError(heightMap, 2, 20.0f) <= maxError);
+
+	// and writing the decoded heights back gives the same heights
+	int changed = 0;
+	for (int m = 0; m <= resolution.x; m++)
+	{
+		heightMap.ReadRow(m, 0, resolution.y + 1, row.data());
+		heightMap.WriteRow(m, 0, resolution.y + 1, row.data());
+		heightMap.ReadRow(m, 0, resolution.y + 1, readBack.data());
+		for (int n = 0; n <= resolution.y; n++)
+		{
+			changed += fabsf(readBack[n] - row[n]) > heightMap.GetLargestStep() * 1e-3f ? 1 : 0;
+		}
+	}
+	CHECK(changed == 0);
+}
+
+TEST(QuantisedHeightMapReadsPartsOfRows)
+{
+	QuantisedHeightMap heightMap;
+	heightMap.Resize(XMINT2(140, 140), 0.01f);
+	WriteMap(heightMap, 3, 10.0f);
+
+	// starts and counts that are not aligned, crossing the borders of the tiles
+	int mismatches = 0;
+	float row[141];
+	const int starts[] = { 0, 1, 3, 62, 63, 64, 65, 127, 130 };
+	for (int nMin : starts)
+	{
+		for (int count = 1; nMin + count <= 141; count += 7)
+		{
+			heightMap.ReadRow(77, nMin, count, row);
+			for (int i = 0; i < count; i++)
+			{
+				mismatches += row[i] != heightMap.Get(77, nMin + i) ? 1 : 0;
+			}
+		}
+	}
+	CHECK(mismatches == 0);
+
+	// writing part of a row leaves the rest of it
+	const float heights[5] = { 1.0f, 2.0f, 3.0f, 4.0f, 5.0f };
+	const float before = heightMap.Get(20, 61), after = heightMap.Get(20, 67);
+	heightMap.WriteRow(20, 62, 5, heights);
+	for (int i = 0; i < 5; i++)
+	{
+		CHECK_NEAR(heightMap.Get(20, 62 + i), heights[i], 0.01f);
+	}
+	CHECK_NEAR(heightMap.Get(20, 61), before, 0.01f);
+	CHECK_NEAR(heightMap.Get(20, 67), after, 0.01f);
+}
+
+TEST(QuantisedHeightMapKeepsWideTilesExact)
+{
+	// a range of 20 needs a step over twice the error: every tile fails the check and keeps the floats
+	QuantisedHeightMap heightMap;
+	heightMap.Resize(XMINT2(100, 70), 1e-5f);
+	WriteMap(heightMap, 4, 20.0f);
+	CHECK(heightMap.GetExactTileCount() == heightMap.GetTileCount());
+	CHECK(GetLargestError(heightMap, 4, 20.0f) == 0.0f);
+
+	// with a larger error they are quantised again, within it
+	heightMap.SetMaxError(0.002f);
+	CHECK(heightMap.GetExactTileCount() == 0);
+	CHECK(GetLargestError(heightMap, 4, 20.0f) <= 0.002f);
+}
+
+TEST(QuantisedHeightMapCompactNarrowsTheRanges)
+{
+	const float maxError = 0.001f;
+	QuantisedHeightMap heightMap;
+	heightMap.Resize(XMINT2(63, 63), maxError);
+	WriteMap(heightMap, 5, 50.0f);
+	const float wideStep = heightMap.GetLargestStep();
+
+	// flatten the single tile to small bumps, its range is now much wider than the heights
+	for (int m = 0; m <= 63; m++)
+	{
+		for (int n = 0; n <= 63; n++)
+		{
+			heightMap.Set(m, n, GetWrittenHeight(6, m, n, 1.0f));
+		}
+	}
+	CHECK(GetLargestError(heightMap, 6, 1.0f) <= maxError + kDecodeRounding);
+
+	// the finer step of the refit holds the heights exactly
+	heightMap.Compact();
+	CHECK(heightMap.GetLargestStep() < wideStep * 0.25f);
+	CHECK(GetLargestError(heightMap, 6, 1.0f) <= maxError + kDecodeRounding);
+}
+
+TEST(QuantisedHeightMapRefitsKeepTheMaxError)
+{
+	// a single tile, widened by a spike on one point and narrowed back by Compact() over and over
+	const float maxError = 0.001f;
+	QuantisedHeightMap heightMap;
+	heightMap.Resize(XMINT2(63, 63), maxError);
+	std::vector<float> exact(64 * 64);
+	for (int m = 0; m <= 63; m++)
+	{
+		for (int n = 0; n <= 63; n++)
+		{
+			exact[n + m * 64] = GetWrittenHeight(7, m, n, 2.0f);
+			heightMap.Set(m, n, exact[n + m * 64]);
+		}
+	}
+
+	float largestError = 0.0f;
+	int refits = 0;
+	for (int i = 0; i < 200; i++)
+	{
+		// spikes of different heights and signs, so the steps go up and down the powers of two
+		const int m = (i * 37) % 64, n = (i * 11) % 64;
+		const float step = heightMap.GetLargestStep();
+		heightMap.Set(m, n, (i % 2 ? 1.0f : -1.0f) * (1.0f + (i % 7) * 4.0f));
+		refits += heightMap.GetLargestStep() != step ? 1 : 0;
+
+		// a few points are written again before the spike goes
+		for (int j = 0; j < 5; j++)
+		{
+			const int point = (i * 131 + j * 977) % (64 * 64);
+			exact[point] = GetWrittenHeight(8 + i, point / 64, point % 64, 2.0f);
+			heightMap.Set(point / 64, point % 64, exact[point]);
+		}
+		heightMap.Set(m, n, exact[n + m * 64]);
+		heightMap.Compact();
+
+		for (int point = 0; point < 64 * 64; point++)
+		{
+			largestError = (std::max)(largestError, fabsf(heightMap.Get(point / 64, point % 64) - exact[point]));
+		}
+	}
+	CHECK(refits > 100);
+	CHECK(heightMap.GetExactTileCount() == 0);
+	CHECK(largestError <= maxError);
+}
@@ -0,0 +1,203 @@
+#include "TestFramework.h"
+#include "TestHeightMap.h"
+#include "Stencil.h"
+
+#include <algorithm>
+
+// The kernel on every point with the neighbours resolved one by one, the loop Stencil::Apply replaces
+template <class Kernel, class Border>
+static void ApplyReference(const HeightField& source, TestHeightMap& destination)
+{
+	for (int m = 0; m < source.GetRows(); m++)
+	{
+		for (int n = 0; n < source.GetColumns(); n++)
+		{
+			float p[3][3];
+			for (int i = 0; i < 3; i++)
+			{
+				for (int j = 0; j < 3; j++)
+				{
+					p[i][j] = source.Get(Border::Resolve(m - 1 + i, source.GetRows()), Border::Resolve(n - 1 + j, source.GetColumns()));
+				}
+			}
+			destination.GetField().Set(m, n, Kernel::Apply(p));
+		}
+	}
+}
+
+// Largest difference between two maps of the same resolution
+static float GetLargestDifference(const HeightField& a, const HeightField& b)
+{
+	float largest = 0.0f;
+	for (int m = 0; m < a.GetRows(); m++)
+	{
+		for (int n = 0; n < a.GetColumns(); n++)
+		{
+			largest = (std::max)(largest, fabsf(a.Get(m, n) - b.Get(m, n)));
+		}
+	}
+	return largest;
+}
+
+// Out of place and in place against the reference, for every width modulo 4 and several bands of rows
+template <class Kernel, class Border>
+static void CheckStencil()
+{
+	const float tolerance = 1e-5f;
+	for (int width = 36; width < 40; width++)
+	{
+		const XMINT2 resolution(150, width);
+		TestHeightMap source(resolution);
+		source.FillRandom(width, Range());
+		TestHeightMap expected(resolution);
+		ApplyReference<Kernel, Border>(source.GetField(), expected);
+
+		TestHeightMap destination(resolution);
+		Stencil::Apply<Kernel, Border>(source.GetField(), destination.GetField());
+		CHECK_NEAR(GetLargestDifference(destination.GetField(), expected.GetField()), 0.0f, tolerance);
+
+		Stencil::Apply<Kernel, Border>(source.GetField(), source.GetField());
+		CHECK_NEAR(GetLargestDifference(source.GetField(), expected.GetField()), 0.0f, tolerance);
+	}
+
+	// a map of a single band and one of two rows, the smallest the mirror can reflect
+	const XMINT2 smallResolutions[] = { XMINT2(5, 6), XMINT2(1, 9) };
+	for (const XMINT2& resolution : smallResolutions)
+	{
+		TestHeightMap source(resolution);
+		source.FillRandom(1, Range());
+		TestHeightMap expected(resolution);
+		ApplyReference<Kernel, Border>(source.GetField(), expected);
+		Stencil::Apply<Kernel, Border>(source.GetField(), source.GetField());
+		CHECK_NEAR(GetLargestDifference(source.GetField(), expected.GetField()), 0.0f, tolerance);
+	}
+}
+
+TEST(StencilBorderPolicies)
+{
+	CHECK(StencilClamp::Resolve(-1, 10) == 0 && StencilClamp::Resolve(10, 10) == 9 && StencilClamp::Resolve(4, 10) == 4);
+	CHECK(StencilMirror::Resolve(-1, 10) == 1 && StencilMirror::Resolve(-9, 10) == 9 && StencilMirror::Resolve(10, 10) == 8 && StencilMirror::Resolve(18, 10) == 0);
+	CHECK(StencilWrap::Resolve(-1, 10) == 9 && StencilWrap::Resolve(-9, 10) == 1 && StencilWrap::Resolve(10, 10) == 0 && StencilWrap::Resolve(19, 10) == 9);
+}
+
+TEST(StencilBoxMatchesTheReference)
+{
+	CheckStencil<StencilBoxKernel, StencilClamp>();
+	CheckStencil<StencilBoxKernel, StencilMirror>();
+	CheckStencil<StencilBoxKernel, StencilWrap>();
+}
+
+TEST(StencilGaussianMatchesTheReference)
+{
+	CheckStencil<StencilGaussianKernel, StencilClamp>();
+	CheckStencil<StencilGaussianKernel, StencilMirror>();
+	CheckStencil<StencilGaussianKernel, StencilWrap>();
+}
+
+TEST(StencilSharpenMatchesTheReference)
+{
+	CheckStencil<StencilSharpenKernel, StencilClamp>();
+	CheckStencil<StencilSharpenKernel, StencilMirror>();
+	CheckStencil<StencilSharpenKernel, StencilWrap>();
+}
+
+TEST(StencilOverAQuantisedMap)
+{
+	// in place over the 16 bit storage, the bands are aligned to its tiles
+	const XMINT2 resolution(200, 70);
+	const float maxError = 0.001f;
+	QuantisedHeightMap quantised;
+	quantised.Resize(resolution, maxError);
+	HeightField field(&quantised);
+	TestHeightMap source(resolution);
+	source.FillRandom(2, Range());
+	for (int m = 0; m < field.GetRows(); m++)
+	{
+		for (int n = 0; n < field.GetColumns(); n++)
+		{
+			field.Set(m, n, source.GetField().Get(m, n));
+		}
+	}
+
+	// the reference reads the same quantised heights
+	TestHeightMap expected(resolution);
+	ApplyReference<StencilGaussianKernel, StencilClamp>(field, expected);
+	Stencil::Apply<StencilGaussianKernel, StencilClamp>(field, field);
+	CHECK_NEAR(GetLargestDifference(field, expected.GetField()), 0.0f, 2.0f * maxError);
+}
+
+TEST(StencilGatherMatchesTheReference)
+{
+	TestHeightMap heightMap(XMINT2(12, 9));
+	heightMap.FillRandom(3, Range());
+	const HeightField& field = heightMap.GetField();
+
+	int mismatches = 0;
+	for (int m = 0; m < field.GetRows(); m++)
+	{
+		for (int n = 0; n < field.GetColumns(); n++)
+		{
+			float clamped[3][3], mirrored[3][3];
+			Stencil::Gather<StencilClamp>(field, m, n, clamped);
+			Stencil::Gather<StencilMirror>(field, m, n, mirrored);
+			for (int i = 0; i < 3; i++)
+			{
+				for (int j = 0; j < 3; j++)
+				{
+					const int neighbourM = m - 1 + i, neighbourN = n - 1 + j;
+					mismatches += clamped[i][j] != field.Get(StencilClamp::Resolve(neighbourM, field.GetRows()), StencilClamp::Resolve(neighbourN, field.GetColumns())) ? 1 : 0;
+					mismatches += mirrored[i][j] != field.Get(StencilMirror::Resolve(neighbourM, field.GetRows()), StencilMirror::Resolve(neighbourN, field.GetColumns())) ? 1 : 0;
+				}
+			}
+		}
+	}
+	CHECK(mismatches == 0);
+}
+
+// The same heights in another layout give the same results, what HeightMapLayoutBenchmark relies on
+template <class Layout>
+static void CheckLayout()
+{
+	const XMINT2 resolution(70, 45);
+	TestHeightMap heightMap(resolution);
+	heightMap.FillRandom(4, Range());
+	std::vector<float> data(BasicHeightField<Layout>::GetStorageSize(resolution));
+	BasicHeightField<Layout> field(data.data(), resolution);
+	std::vector<float> row(field.GetColumns());
+	for (int m = 0; m < field.GetRows(); m++)
+	{
+		heightMap.GetField().ReadRow(m, row.data());
+		field.WriteRow(m, row.data());
+	}
+
+	int mismatches = 0;
+	for (int m = 0; m < field.GetRows(); m++)
+	{
+		for (int n = 0; n < field.GetColumns(); n++)
+		{
+			const XMINT2 expected = Stencil::FindNeighbour<StencilClamp>(heightMap.GetField(), m, n, false);
+			const XMINT2 lowest = Stencil::FindNeighbour<StencilClamp>(field, m, n, false);
+			mismatches += lowest.x != expected.x || lowest.y != expected.y ? 1 : 0;
+		}
+	}
+	CHECK(mismatches == 0);
+
+	Stencil::Apply<StencilGaussianKernel, StencilMirror>(heightMap.GetField(), heightMap.GetField());
+	Stencil::Apply<StencilGaussianKernel, StencilMirror>(field, field);
+	float largest = 0.0f;
+	for (int m = 0; m < field.GetRows(); m++)
+	{
+		for (int n = 0; n < field.GetColumns(); n++)
+		{
+			largest = (std::max)(largest, fabsf(field.Get(m, n) - heightMap.GetField().Get(m, n)));
+		}
+	}
+	CHECK(largest == 0.0f);
+}
+
+TEST(StencilIsTheSameInEveryLayout)
+{
+	CheckLayout<RowMajorLayout>();
+	CheckLayout<TiledLayout>();
+	CheckLayout<MortonLayout>();
+}
@@ -0,0 +1,83 @@
+#include "TestFramework.h"
+#include "TestHeightMap.h"
+#include "TerrainBrush.h"
+
+TEST(TerrainBrushPicksAFlatMap)
+{
+	// the whole map is its highest point, a ray straight down and a slanted one both hit it
+	TestHeightMap heightMap(XMINT2(40, 30));
+	heightMap.Fill([](int, int) { return 3.0f; });
+	HeightQuadtree quadtree;
+	quadtree.Build(heightMap.GetField());
+
+	XMFLOAT3 point;
+	CHECK(TerrainBrush::Pick(heightMap.GetField(), quadtree, XMFLOAT3(12.5f, 20.0f, 7.25f), XMFLOAT3(0.0f, -1.0f, 0.0f), point));
+	CHECK_NEAR(point.x, 12.5f, 1e-3f);
+	CHECK_NEAR(point.y, 3.0f, 1e-3f);
+	CHECK_NEAR(point.z, 7.25f, 1e-3f);
+
+	CHECK(TerrainBrush::Pick(heightMap.GetField(), quadtree, XMFLOAT3(0.0f, 13.0f, 0.0f), XMFLOAT3(0.6f, -0.6f, 0.52915f), point));
+	CHECK_NEAR(point.x, 10.0f, 1e-2f);
+	CHECK_NEAR(point.y, 3.0f, 1e-2f);
+	CHECK_NEAR(point.z, 8.8192f, 1e-2f);
+}
+
+TEST(TerrainBrushPicksThePeak)
+{
+	// a single point higher than the rest, hit from straight above
+	TestHeightMap heightMap(XMINT2(20, 20));
+	heightMap.Fill([](int m, int n) { return (m == 10 && n == 10) ? 8.0f : 0.0f; });
+	HeightQuadtree quadtree;
+	quadtree.Build(heightMap.GetField());
+
+	XMFLOAT3 point;
+	CHECK(TerrainBrush::Pick(heightMap.GetField(), quadtree, XMFLOAT3(10.0f, 50.0f, 10.0f), XMFLOAT3(0.0f, -1.0f, 0.0f), point));
+	CHECK_NEAR(point.y, 8.0f, 1e-3f);
+}
+
+TEST(TerrainBrushPickHitsTheSurface)
+{
+	TestHeightMap heightMap(XMINT2(64, 64));
+	// hills a few points wide, the ray is marched half a point at a time so it can not jump over them
+	heightMap.Fill([](int m, int n) { return 5.0f + sinf(m * 0.3f) * cosf(n * 0.25f) * 5.0f; });
+	const HeightField& field = heightMap.GetField();
+	HeightQuadtree quadtree;
+	quadtree.Build(field);
+
+	// slanted rays from above the map: the hit is on the surface and the ray is above it until there
+	int misses = 0, offSurface = 0, crossedBefore = 0;
+	for (int ray = 0; ray < 100; ray++)
+	{
+		const XMFLOAT3 origin(Utils::GetPointRandom(82, ray, 0) * 64.0f, 30.0f, Utils::GetPointRandom(82, ray, 1) * 64.0f);
+		const XMFLOAT3 target(Utils::GetPointRandom(82, ray, 2) * 64.0f, 0.0f, Utils::GetPointRandom(82, ray, 3) * 64.0f);
+		XMFLOAT3 direction(target.x - origin.x, target.y - origin.y, target.z - origin.z);
+		const float length = sqrtf(direction.x * direction.x + direction.y * direction.y + direction.z * direction.z);
+		direction = XMFLOAT3(direction.x / length, direction.y / length, direction.z / length);
+
+		XMFLOAT3 point;
+		if (!TerrainBrush::Pick(field, quadtree, origin, direction, point))
+		{
+			misses++;
+			continue;
+		}
+		offSurface += fabsf(point.y - TerrainBrush::SampleHeight(field, point.z, point.x)) > 1e-2f ? 1 : 0;
+		const float t = (point.x - origin.x) * direction.x + (point.y - origin.y) * direction.y + (point.z - origin.z) * direction.z;
+		for (float s = 0.0f; s < t - 0.05f; s += 0.05f)
+		{
+			const float x = origin.x + direction.x * s, y = origin.y + direction.y * s, z = origin.z + direction.z * s;
+			if (x >= 0.0f && z >= 0.0f && x <= 64.0f && z <= 64.0f && y < TerrainBrush::SampleHeight(field, z, x))
+			{
+				crossedBefore++;
+				break;
+			}
+		}
+	}
+	// every ray ends at the height of the lowest point, inside the map, so it hits
+	CHECK(misses == 0);
+	CHECK(offSurface == 0);
+	CHECK(crossedBefore == 0);
+
+	// a ray going up misses
+	XMFLOAT3 point;
+	CHECK(!TerrainBrush::Pick(field, quadtree, XMFLOAT3(32.0f, 30.0f, 32.0f), XMFLOAT3(0.0f, 1.0f, 0.0f), point));
+}
@@ -0,0 +1,65 @@
+#include "TestFramework.h"
+#include "TerrainGraphCache.h"
+
+static std::shared_ptr<std::vector<float>> MakeHeights(int count, float height)
+{
+	return std::make_shared<std::vector<float>>(count, height);
+}
+
+TEST(TerrainGraphCacheFindsWhatWasAdded)
+{
+	TerrainGraphCache cache(1024 * sizeof(float));
+	std::shared_ptr<std::vector<float>> heights = MakeHeights(256, 3.0f);
+	cache.Add(7, heights);
+
+	CHECK(cache.Find(7) == heights);
+	CHECK(!cache.Find(8));
+	CHECK(cache.GetEntryCount() == 1);
+	CHECK(cache.GetBytes() == 256 * sizeof(float));
+
+	// the same hash again keeps the first one
+	cache.Add(7, MakeHeights(256, 4.0f));
+	CHECK(cache.Find(7) == heights);
+	CHECK(cache.GetEntryCount() == 1);
+}
+
+TEST(TerrainGraphCacheDropsTheLeastRecentlyUsedOverTheBudget)
+{
+	TerrainGraphCache cache(3 * 256 * sizeof(float));
+	cache.Add(1, MakeHeights(256, 1.0f));
+	cache.Add(2, MakeHeights(256, 2.0f));
+	cache.Add(3, MakeHeights(256, 3.0f));
+	CHECK(cache.Find(1)); // 2 is now the least recently used
+
+	cache.Add(4, MakeHeights(256, 4.0f));
+	CHECK(cache.GetEntryCount() == 3);
+	CHECK(cache.GetBytes() <= cache.GetBudget());
+	CHECK(cache.Find(1));
+	CHECK(!cache.Find(2));
+	CHECK(cache.Find(3));
+	CHECK(cache.Find(4));
+}
+
+TEST(TerrainGraphCacheKeepsTheBudgetWhenItShrinks)
+{
+	TerrainGraphCache cache(8 * 256 * sizeof(float));
+	for (unsigned long long hash = 0; hash < 8; hash++)
+	{
+		cache.Add(hash, MakeHeights(256, (float)hash));
+	}
+	CHECK(cache.GetEntryCount() == 8);
+
+	// a result held by an evaluation stays valid after the cache drops it
+	std::shared_ptr<std::vector<float>> held = cache.Find(0);
+	cache.SetBudget(2 * 256 * sizeof(float));
+	CHECK(cache.GetEntryCount() == 2);
+	CHECK(cache.GetBytes() <= cache.GetBudget());
+	CHECK(cache.Find(0));
+	CHECK(cache.Find(7));
+	CHECK(held->size() == 256 && (*held)[0] == 0.0f);
+
+	// smaller than one result, nothing is kept
+	cache.SetBudget(16);
+	CHECK(cache.GetEntryCount() == 0);
+	CHECK(cache.GetBytes() == 0);
+}
@@ -0,0 +1,254 @@
+#include "TestFramework.h"
+#include "TestHeightMap.h"
+#include "TerrainHistory.h"
+
+#include <algorithm>
+
+// Largest difference between two maps of the same resolution
+static float GetLargestDifference(const HeightField& a, const HeightField& b)
+{
+	float largest = 0.0f;
+	for (int m = 0; m < a.GetRows(); m++)
+	{
+		for (int n = 0; n < a.GetColumns(); n++)
+		{
+			largest = (std::max)(largest, fabsf(a.Get(m, n) - b.Get(m, n)));
+		}
+	}
+	return largest;
+}
+
+// A local edit as the brush makes it: kept by the history around the writes
+static void Edit(TerrainHistory& history, HeightField& field, const std::string& name, const HeightFieldRect& rect, float delta, bool merge = false)
+{
+	history.BeginEdit(name, field, rect, merge);
+	for (int m = rect.mMin; m <= rect.mMax; m++)
+	{
+		for (int n = rect.nMin; n <= rect.nMax; n++)
+		{
+			field.Set(m, n, field.Get(m, n) + delta * (1.0f + 0.01f * (m - n)));
+		}
+	}
+	history.EndEdit(field);
+}
+
+TEST(TerrainHistoryUndoRedo)
+{
+	// 3 x 3 tiles, the last row and column of them partial
+	const XMINT2 resolution(130, 140);
+	TestHeightMap heightMap(resolution);
+	heightMap.FillRandom(71, Range());
+	HeightField& field = heightMap.GetField();
+	TerrainHistory history;
+	history.Resize(resolution);
+	history.SetCompression(false, 0.001f);
+
+	std::vector<TestHeightMap> states(1, heightMap);
+	const HeightFieldRect edits[] = { HeightFieldRect(10, 10, 20, 20), HeightFieldRect(60, 60, 70, 70), HeightFieldRect(120, 0, 130, 140), HeightFieldRect(5, 100, 6, 101) };
+	for (int edit = 0; edit < 4; edit++)
+	{
+		Edit(history, field, "Raise", edits[edit], 1.0f + edit);
+		states.push_back(heightMap);
+	}
+	CHECK(history.GetEntryCount() == 4 && history.GetPosition() == 4);
+	CHECK(history.GetUndoName() == "Raise");
+
+	// only the tiles under the edit are written: the one across the corner of 4 tiles has all of them
+	std::vector<HeightFieldRect> rects;
+	history.GetUndoRects(rects);
+	CHECK(rects.size() == 1 && rects[0].mMin == 0 && rects[0].nMin == 64);
+
+	// back to every state and forward again, exactly
+	for (int state = 3; state >= 0; state--)
+	{
+		CHECK(history.Undo(field));
+		CHECK(GetLargestDifference(field, states[state].GetField()) == 0.0f);
+	}
+	CHECK(!history.CanUndo() && !history.Undo(field));
+	for (int state = 1; state <= 4; state++)
+	{
+		CHECK(history.Redo(field));
+		CHECK(GetLargestDifference(field, states[state].GetField()) == 0.0f);
+	}
+	CHECK(!history.CanRedo() && !history.Redo(field));
+
+	// an edit after undoing drops the redo entries
+	history.Undo(field);
+	history.Undo(field);
+	Edit(history, field, "Lower", edits[0], -2.0f);
+	CHECK(history.GetEntryCount() == 3 && !history.CanRedo());
+	const TestHeightMap lowered(heightMap);
+	history.Undo(field);
+	CHECK(GetLargestDifference(field, states[2].GetField()) == 0.0f);
+	history.Redo(field);
+	CHECK(GetLargestDifference(field, lowered.GetField()) == 0.0f);
+
+	// an edit that changes nothing adds no entry
+	history.BeginEdit("Nothing", field, edits[1]);
+	history.EndEdit(field);
+	CHECK(history.GetEntryCount() == 3);
+}
+
+TEST(TerrainHistoryMergesTheSameOperation)
+{
+	const XMINT2 resolution(200, 200);
+	TestHeightMap heightMap(resolution);
+	heightMap.FillRandom(72, Range());
+	HeightField& field = heightMap.GetField();
+	TerrainHistory history;
+	history.Resize(resolution);
+	const TestHeightMap original(heightMap);
+
+	// the strokes of a drag, moving over new tiles, are a single entry
+	Edit(history, field, "Raise", HeightFieldRect(10, 10, 20, 20), 1.0f, true);
+	Edit(history, field, "Raise", HeightFieldRect(15, 15, 30, 30), 1.0f, true);
+	Edit(history, field, "Raise", HeightFieldRect(60, 60, 70, 70), 1.0f, true);
+	CHECK(history.GetEntryCount() == 1);
+	std::vector<HeightFieldRect> rects;
+	history.GetUndoRects(rects);
+	CHECK(rects.size() == 4);
+	const TestHeightMap raised(heightMap);
+
+	history.Undo(field);
+	CHECK(GetLargestDifference(field, original.GetField()) == 0.0f);
+	history.Redo(field);
+	CHECK(GetLargestDifference(field, raised.GetField()) == 0.0f);
+
+	// another operation, or the same one after an undo, starts a new entry
+	Edit(history, field, "Lower", HeightFieldRect(10, 10, 20, 20), -1.0f, true);
+	CHECK(history.GetEntryCount() == 2);
+	history.Undo(field);
+	Edit(history, field, "Raise", HeightFieldRect(100, 100, 110, 110), 1.0f, true);
+	CHECK(history.GetEntryCount() == 2 && history.GetPosition() == 2);
+	history.Undo(field);
+	CHECK(GetLargestDifference(field, raised.GetField()) == 0.0f);
+	history.Undo(field);
+	CHECK(GetLargestDifference(field, original.GetField()) == 0.0f);
+}
+
+TEST(TerrainHistorySharesTheTilesOfConsecutiveEntries)
+{
+	const XMINT2 resolution(63, 63);
+	TestHeightMap heightMap(resolution);
+	heightMap.FillRandom(73, Range());
+	HeightField& field = heightMap.GetField();
+	TerrainHistory history;
+	history.Resize(resolution);
+	history.SetCompression(false, 0.001f);
+
+	// the after of an entry is the before of the next: three tiles for two entries of the single tile
+	const size_t tileBytes = TerrainHistory::kTilePoints * sizeof(float);
+	Edit(history, field, "Raise", HeightFieldRect(0, 0, 10, 10), 1.0f);
+	Edit(history, field, "Raise", HeightFieldRect(0, 0, 10, 10), 1.0f);
+	CHECK(history.GetBytes() == 3 * tileBytes);
+
+	// a flat tile is a single float
+	history.BeginEdit("Flatten", field, field.GetBounds());
+	for (int m = 0; m <= 63; m++)
+	{
+		for (int n = 0; n <= 63; n++)
+		{
+			field.Set(m, n, 2.0f);
+		}
+	}
+	history.EndEdit(field);
+	CHECK(history.GetBytes() == 3 * tileBytes + sizeof(float));
+}
+
+TEST(TerrainHistoryTrimsToTheBudget)
+{
+	const XMINT2 resolution(63, 63);
+	TestHeightMap heightMap(resolution);
+	heightMap.FillRandom(74, Range());
+	HeightField& field = heightMap.GetField();
+	TerrainHistory history;
+	history.Resize(resolution);
+	history.SetCompression(false, 0.001f);
+
+	// 10 edits of the tile keep 11 tiles, the budget holds 5 of them: 4 entries
+	const size_t tileBytes = TerrainHistory::kTilePoints * sizeof(float);
+	history.SetBudget(5 * tileBytes);
+	std::vector<TestHeightMap> states(1, heightMap);
+	for (int edit = 0; edit < 10; edit++)
+	{
+		Edit(history, field, "Raise", HeightFieldRect(0, 0, 20, 20), 0.5f);
+		states.push_back(heightMap);
+	}
+	CHECK(history.GetBytes() <= history.GetBudget());
+	CHECK(history.GetEntryCount() == 4);
+
+	// the newest entries are kept and still undo exactly
+	for (int state = 9; state >= 6; state--)
+	{
+		CHECK(history.Undo(field));
+		CHECK(GetLargestDifference(field, states[state].GetField()) == 0.0f);
+	}
+	CHECK(!history.CanUndo());
+
+	// with no undo left the furthest redo entries go first
+	history.SetBudget(3 * tileBytes);
+	CHECK(history.GetEntryCount() == 2 && history.GetPosition() == 0);
+	history.Redo(field);
+	history.Redo(field);
+	CHECK(GetLargestDifference(field, states[8].GetField()) == 0.0f);
+}
+
+TEST(TerrainHistoryCompressesTheOldEntries)
+{
+	const XMINT2 resolution(63, 63);
+	TestHeightMap heightMap(resolution);
+	heightMap.FillRandom(75, Range());
+	HeightField& field = heightMap.GetField();
+	TerrainHistory history;
+	history.Resize(resolution);
+	const float maxError = 0.001f;
+	history.SetCompression(true, maxError);
+
+	std::vector<TestHeightMap> states(1, heightMap);
+	const int edits = TerrainHistory::kExactEntries + 4;
+	for (int edit = 0; edit < edits; edit++)
+	{
+		Edit(history, field, "Raise", HeightFieldRect(0, 0, 30, 30), 0.5f);
+		states.push_back(heightMap);
+	}
+
+	// the old tiles take 16 bits per point
+	const size_t tileBytes = TerrainHistory::kTilePoints * sizeof(float);
+	CHECK(history.GetBytes() < (edits + 1) * tileBytes);
+
+	// the newest entries undo exactly, the older ones within the error
+	for (int state = edits - 1; state >= 0; state--)
+	{
+		CHECK(history.Undo(field));
+		const float tolerance = state >= edits - TerrainHistory::kExactEntries ? 0.0f : maxError + 1e-5f;
+		CHECK_NEAR(GetLargestDifference(field, states[state].GetField()), 0.0f, tolerance);
+	}
+}
+
+TEST(TerrainHistoryRecordsAJob)
+{
+	// a job writes the back height map, only the tiles that differ are kept
+	const XMINT2 resolution(200, 130);
+	TestHeightMap before(resolution);
+	before.FillRandom(76, Range());
+	TestHeightMap after(before);
+	after.GetField().Set(70, 70, 50.0f);
+	after.GetField().Set(199, 129, -5.0f);
+
+	TerrainHistory history;
+	history.Resize(resolution);
+	history.Record("Job", before.GetField(), after.GetField());
+	std::vector<HeightFieldRect> rects;
+	history.GetUndoRects(rects);
+	CHECK(rects.size() == 2);
+
+	TestHeightMap field(after);
+	history.Undo(field.GetField());
+	CHECK(GetLargestDifference(field.GetField(), before.GetField()) == 0.0f);
+	history.Redo(field.GetField());
+	CHECK(GetLargestDifference(field.GetField(), after.GetField()) == 0.0f);
+
+	// a job that changed nothing adds no entry
+	history.Record("Nothing", after.GetField(), after.GetField());
+	CHECK(history.GetEntryCount() == 1);
+}
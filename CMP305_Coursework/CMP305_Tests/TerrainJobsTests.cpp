@@ -0,0 +1,119 @@
+#include "TestFramework.h"
+#include "TestHeightMap.h"
+#include "TerrainJobs.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+// Job that doubles every height once release is set, so the test can edit the front map while it runs
+static TerrainJobFunction GetDoubleJob(const std::atomic<bool>& release)
+{
+	return [&release](HeightField& field, TerrainJobProgress& progress)
+	{
+		while (!release && !progress.IsCancelled())
+		{
+			std::this_thread::yield();
+		}
+		std::vector<float> row(field.GetColumns());
+		for (int m = 0; m < field.GetRows(); m++)
+		{
+			field.ReadRow(m, row.data());
+			for (float& height : row)
+			{
+				height *= 2.0f;
+			}
+			field.WriteRow(m, row.data());
+		}
+	};
+}
+
+// Raise the points of rect of field by height, as a local edit whose change is kept
+static TerrainEdit RaiseRect(HeightField& field, const HeightFieldRect& rect, float height)
+{
+	TerrainEdit edit;
+	edit.Begin(field, rect);
+	for (int m = rect.mMin; m <= rect.mMax; m++)
+	{
+		for (int n = rect.nMin; n <= rect.nMax; n++)
+		{
+			field.Set(m, n, field.Get(m, n) + height);
+		}
+	}
+	edit.End(field);
+	return edit;
+}
+
+TEST(TerrainJobsKeepTheEditsMadeWhileRunning)
+{
+	TestHeightMap front(XMINT2(40, 30));
+	front.FillRandom(13, Range());
+	const TestHeightMap original(front);
+	TestHeightMap back(front);
+
+	std::atomic<bool> release(false);
+	TerrainJobQueue jobs;
+	jobs.Push("Double", GetDoubleJob(release));
+	CHECK(jobs.StartNext(back.GetField()));
+
+	// two overlapping edits of the front map while the job waits
+	const HeightFieldRect first(5, 7, 12, 20), second(10, 0, 30, 9);
+	jobs.AddEdit(RaiseRect(front.GetField(), first, 3.0f));
+	jobs.AddEdit(RaiseRect(front.GetField(), second, -1.5f));
+	CHECK(jobs.IsRunning());
+
+	// the job has completed and its result has the edits on top
+	release = true;
+	CHECK(jobs.Collect());
+	float largestError = 0.0f;
+	for (int m = 0; m <= 40; m++)
+	{
+		for (int n = 0; n <= 30; n++)
+		{
+			float expected = original.GetField().Get(m, n) * 2.0f;
+			expected += (m >= first.mMin && m <= first.mMax && n >= first.nMin && n <= first.nMax) ? 3.0f : 0.0f;
+			expected += (m >= second.mMin && m <= second.mMax && n >= second.nMin && n <= second.nMax) ? -1.5f : 0.0f;
+			largestError = (std::max)(largestError, fabsf(back.GetField().Get(m, n) - expected));
+		}
+	}
+	CHECK(largestError < 1e-5f);
+}
+
+TEST(TerrainJobsDropTheEditsOfACancelledJob)
+{
+	TestHeightMap front(XMINT2(20, 20));
+	front.FillRandom(14, Range());
+
+	std::atomic<bool> release(false);
+	TerrainJobQueue jobs;
+	jobs.Push("Double", GetDoubleJob(release));
+	jobs.Push("Double", GetDoubleJob(release));
+	TestHeightMap back(front);
+	CHECK(jobs.StartNext(back.GetField()));
+	jobs.AddEdit(RaiseRect(front.GetField(), HeightFieldRect(0, 0, 20, 20), 1.0f));
+	jobs.Cancel();
+	CHECK(!jobs.Collect());
+
+	// the next job starts from the edited map and gets no edit of the cancelled one
+	TestHeightMap nextBack(front);
+	release = true;
+	CHECK(jobs.StartNext(nextBack.GetField()));
+	CHECK(jobs.Collect());
+	float largestError = 0.0f;
+	for (int m = 0; m <= 20; m++)
+	{
+		for (int n = 0; n <= 20; n++)
+		{
+			largestError = (std::max)(largestError, fabsf(nextBack.GetField().Get(m, n) - front.GetField().Get(m, n) * 2.0f));
+		}
+	}
+	CHECK(largestError == 0.0f);
+
+	// and an edit made with no job running is not kept
+	jobs.AddEdit(RaiseRect(front.GetField(), HeightFieldRect(0, 0, 5, 5), 1.0f));
+	TestHeightMap lastBack(front);
+	jobs.Push("Double", GetDoubleJob(release));
+	CHECK(jobs.StartNext(lastBack.GetField()));
+	CHECK(jobs.Collect());
+	CHECK_NEAR(lastBack.GetField().Get(2, 2), front.GetField().Get(2, 2) * 2.0f, 1e-6f);
+}
@@ -0,0 +1,106 @@
+#include "TestFramework.h"
+#include "TerrainVertexPacking.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+// Largest angular error of the octahedral normals after the snorm16 rounding, in degrees
+static const float kMaxAngularError = 0.04f;
+
+// Angle between two unit vectors in degrees
+static float GetAngle(const XMFLOAT3& a, const XMFLOAT3& b)
+{
+	const float dot = a.x * b.x + a.y * b.y + a.z * b.z;
+	return XMConvertToDegrees(acosf((std::min)((std::max)(dot, -1.0f), 1.0f)));
+}
+
+static XMFLOAT3 Normalise(float x, float y, float z)
+{
+	const float inverseLength = 1.0f / sqrtf(x * x + y * y + z * z);
+	return XMFLOAT3(x * inverseLength, y * inverseLength, z * inverseLength);
+}
+
+TEST(TerrainVertexPackingRowMatchesTheReference)
+{
+	// every count up to 4 groups, so the tails of 1 to 3 points are covered
+	int wrongHeights = 0, wrongNormals = 0, overwritten = 0;
+	float maxError = 0.0f;
+	for (int count = 1; count <= 16; count++)
+	{
+		std::vector<float> heights(count), right(count), below(count);
+		for (int i = 0; i < count; i++)
+		{
+			// gentle slopes and cliffs
+			const float steepness = (i % 3 == 0) ? 40.0f : 2.0f;
+			heights[i] = Utils::GetPointRandom(count, i, 0) * 20.0f - 10.0f;
+			right[i] = heights[i] + (Utils::GetPointRandom(count, i, 1) * 2.0f - 1.0f) * steepness;
+			below[i] = heights[i] + (Utils::GetPointRandom(count, i, 2) * 2.0f - 1.0f) * steepness;
+		}
+
+		// one vertex past the row to catch writes beyond count
+		std::vector<TerrainDynamicVertexType> vertices(count + 1);
+		vertices[count].height = -1.0f;
+		vertices[count].normal[0] = vertices[count].normal[1] = 12345;
+		TerrainVertexPacking::PackRow(heights.data(), right.data(), below.data(), count, vertices.data());
+		overwritten += (vertices[count].height != -1.0f || vertices[count].normal[0] != 12345 || vertices[count].normal[1] != 12345) ? 1 : 0;
+
+		for (int i = 0; i < count; i++)
+		{
+			wrongHeights += vertices[i].height != heights[i] ? 1 : 0;
+
+			// the same encoding as the reference up to the last bit of rounding
+			const XMFLOAT3 normal = Normalise(heights[i] - right[i], 1.0f, heights[i] - below[i]);
+			short encoded[2];
+			TerrainVertexPacking::EncodeNormal(normal, encoded);
+			wrongNormals += (abs(vertices[i].normal[0] - encoded[0]) > 1 || abs(vertices[i].normal[1] - encoded[1]) > 1) ? 1 : 0;
+			maxError = (std::max)(maxError, GetAngle(TerrainVertexPacking::DecodeNormal(vertices[i].normal), normal));
+		}
+	}
+	CHECK(wrongHeights == 0);
+	CHECK(wrongNormals == 0);
+	CHECK(overwritten == 0);
+	CHECK(maxError <= kMaxAngularError);
+}
+
+TEST(TerrainVertexPackingFlatNormal)
+{
+	// right and below equal to the height give (0, 1, 0), in the packed rows and in the reference
+	const float heights[5] = { 0.0f, 3.5f, -2.0f, 100.0f, 7.25f };
+	TerrainDynamicVertexType vertices[5];
+	TerrainVertexPacking::PackRow(heights, heights, heights, 5, vertices);
+	for (const TerrainDynamicVertexType& vertex : vertices)
+	{
+		CHECK(vertex.normal[0] == 0 && vertex.normal[1] == 0);
+	}
+
+	short encoded[2];
+	TerrainVertexPacking::EncodeNormal(XMFLOAT3(0.0f, 1.0f, 0.0f), encoded);
+	CHECK(encoded[0] == 0 && encoded[1] == 0);
+	const XMFLOAT3 decoded = TerrainVertexPacking::DecodeNormal(encoded);
+	CHECK(decoded.x == 0.0f && decoded.y == 1.0f && decoded.z == 0.0f);
+}
+
+TEST(TerrainVertexPackingRoundTripOfAnyNormal)
+{
+	// the reference also folds the lower half, every direction comes back within the bound
+	float maxError = 0.0f;
+	for (int i = 0; i < 10000; i++)
+	{
+		const XMFLOAT3 normal = Normalise(Utils::GetPointRandom(41, i, 0) * 2.0f - 1.0f, Utils::GetPointRandom(41, i, 1) * 2.0f - 1.0f, Utils::GetPointRandom(41, i, 2) * 2.0f - 1.0f);
+		short encoded[2];
+		TerrainVertexPacking::EncodeNormal(normal, encoded);
+		maxError = (std::max)(maxError, GetAngle(TerrainVertexPacking::DecodeNormal(encoded), normal));
+	}
+	CHECK(maxError <= kMaxAngularError);
+
+	// the axes are exact
+	const XMFLOAT3 axes[] = { XMFLOAT3(1.0f, 0.0f, 0.0f), XMFLOAT3(-1.0f, 0.0f, 0.0f), XMFLOAT3(0.0f, -1.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, 1.0f), XMFLOAT3(0.0f, 0.0f, -1.0f) };
+	for (const XMFLOAT3& axis : axes)
+	{
+		short encoded[2];
+		TerrainVertexPacking::EncodeNormal(axis, encoded);
+		CHECK_NEAR(GetAngle(TerrainVertexPacking::DecodeNormal(encoded), axis), 0.0f, 1e-3f);
+	}
+}
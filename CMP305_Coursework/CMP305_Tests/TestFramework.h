@@ -0,0 +1,63 @@
+#pragma once
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+// Headless tests of the terrain code, no window or device needed.
+// Every TEST() registers itself and TestMain.cpp runs all of them: the process returns 1 if a check has failed,
+// so the post-build step of the project fails too
+struct TestCase
+{
+	const char* name;
+	void (*function)();
+};
+
+class TestRegistry
+{
+public:
+	static std::vector<TestCase>& GetTests()
+	{
+		static std::vector<TestCase> tests;
+		return tests;
+	}
+
+	// Checks failed so far, by all the tests
+	static int& GetFailures()
+	{
+		static int failures = 0;
+		return failures;
+	}
+
+	static void Fail(const char* file, int line, const char* expression)
+	{
+		printf("    FAILED %s(%d): %s\n", file, line, expression);
+		GetFailures()++;
+	}
+
+	static void FailNear(const char* file, int line, const char* expression, double value, double expected, double tolerance)
+	{
+		printf("    FAILED %s(%d): %s (%g, expected %g within %g)\n", file, line, expression, value, expected, tolerance);
+		GetFailures()++;
+	}
+
+	struct Registrar
+	{
+		Registrar(const char* name, void (*function)())
+		{
+			TestCase test = { name, function };
+			GetTests().push_back(test);
+		}
+	};
+};
+
+#define TEST(name) \
+	static void name(); \
+	static TestRegistry::Registrar name##Registrar(#name, name); \
+	static void name()
+
+#define CHECK(condition) \
+	do { if (!(condition)) { TestRegistry::Fail(__FILE__, __LINE__, #condition); } } while (0)
+
+#define CHECK_NEAR(value, expected, tolerance) \
+	do { const double checkValue = (double)(value), checkExpected = (double)(expected); \
+		if (!(fabs(checkValue - checkExpected) <= (double)(tolerance))) { TestRegistry::FailNear(__FILE__, __LINE__, #value, checkValue, checkExpected, (double)(tolerance)); } } while (0)
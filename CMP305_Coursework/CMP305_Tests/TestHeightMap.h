@@ -0,0 +1,46 @@
+#pragma once
+#include <vector>
+
+#include "HeightField.h"
+#include "Utils.h"
+
+// Float height map of a resolution owning its storage, for the tests
+class TestHeightMap
+{
+public:
+	explicit TestHeightMap(XMINT2 resolution)
+		: data(HeightField::GetStorageSize(resolution), 0.0f), field(data.data(), resolution)
+	{
+	}
+	TestHeightMap(const TestHeightMap& other)
+		: data(other.data), field(data.data(), other.field.GetResolution())
+	{
+	}
+	TestHeightMap& operator=(const TestHeightMap&) = delete;
+
+	HeightField& GetField() { return field; }
+	const HeightField& GetField() const { return field; }
+
+	// Every point from function(m, n)
+	template<typename Function>
+	void Fill(const Function& function)
+	{
+		for (int m = 0; m < field.GetRows(); m++)
+		{
+			for (int n = 0; n < field.GetColumns(); n++)
+			{
+				field.Set(m, n, function(m, n));
+			}
+		}
+	}
+
+	// Random heights in the range, always the same for the seed
+	void FillRandom(unsigned int seed, Range range)
+	{
+		Fill([seed, range](int m, int n) { return Utils::GetPointRandom(seed, m, n, range); });
+	}
+
+private:
+	std::vector<float> data;
+	HeightField field;
+};
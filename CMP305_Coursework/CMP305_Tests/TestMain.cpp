@@ -0,0 +1,19 @@
+#include "TestFramework.h"
+
+int main()
+{
+	int failedTests = 0;
+	for (const TestCase& test : TestRegistry::GetTests())
+	{
+		printf("%s\n", test.name);
+		const int failures = TestRegistry::GetFailures();
+		test.function();
+		if (TestRegistry::GetFailures() > failures)
+		{
+			failedTests++;
+		}
+	}
+
+	printf("%d tests, %d failed\n", (int)TestRegistry::GetTests().size(), failedTests);
+	return failedTests > 0 ? 1 : 0;
+}
@@ -0,0 +1,98 @@
+#include "TestFramework.h"
+#include "TestHeightMap.h"
+#include "WaterBodies.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+TEST(WaterBodiesMatchAFloodFill)
+{
+	// tall enough to be split in several bands of rows, with regions crossing them
+	const XMINT2 resolution(300, 120);
+	TestHeightMap heightMap(resolution);
+	heightMap.Fill([](int m, int n) { return sinf(m * 0.11f) * cosf(n * 0.13f) * 5.0f + Utils::GetPointRandom(3, m, n) * 2.0f - 1.0f; });
+	const HeightField& field = heightMap.GetField();
+
+	WaterBodyMaps maps;
+	WaterBodies::Label(field, 0.0f, maps);
+
+	// 4-connected flood fill of every region below the water level from its first point
+	const int rows = resolution.x + 1;
+	const int columns = resolution.y + 1;
+	std::vector<int> region(rows * columns, -1);
+	int regionCount = 0, mismatches = 0;
+	for (int start = 0; start < rows * columns; start++)
+	{
+		if (region[start] >= 0 || field.Get(start / columns, start % columns) >= 0.0f)
+		{
+			continue;
+		}
+
+		std::vector<int> stack(1, start);
+		region[start] = regionCount;
+		int area = 0;
+		bool border = false;
+		float minHeight = FLT_MAX;
+		XMINT2 boundsMin(rows, columns), boundsMax(-1, -1);
+		while (!stack.empty())
+		{
+			const int point = stack.back();
+			stack.pop_back();
+			const int m = point / columns;
+			const int n = point % columns;
+			area++;
+			border = border || m == 0 || n == 0 || m == rows - 1 || n == columns - 1;
+			minHeight = (std::min)(minHeight, field.Get(m, n));
+			boundsMin = XMINT2((std::min)(boundsMin.x, m), (std::min)(boundsMin.y, n));
+			boundsMax = XMINT2((std::max)(boundsMax.x, m), (std::max)(boundsMax.y, n));
+
+			// the whole region has the label of its first point
+			if (maps.label[point] != maps.label[start])
+			{
+				mismatches++;
+			}
+
+			const int neighbours[4][2] = { { m - 1, n }, { m + 1, n }, { m, n - 1 }, { m, n + 1 } };
+			for (const auto& neighbour : neighbours)
+			{
+				if (field.InBounds(neighbour[0], neighbour[1]) && field.Get(neighbour[0], neighbour[1]) < 0.0f)
+				{
+					const int next = neighbour[1] + neighbour[0] * columns;
+					if (region[next] < 0)
+					{
+						region[next] = regionCount;
+						stack.push_back(next);
+					}
+				}
+			}
+		}
+
+		CHECK(maps.label[start] != WaterBodies::kDryLand);
+		if (maps.label[start] == WaterBodies::kDryLand)
+		{
+			return;
+		}
+		const WaterBody& body = maps.bodies[maps.label[start]];
+		CHECK(body.area == area);
+		CHECK(body.type == (border ? kSea : kLake));
+		CHECK(body.boundsMin.x == boundsMin.x && body.boundsMin.y == boundsMin.y);
+		CHECK(body.boundsMax.x == boundsMax.x && body.boundsMax.y == boundsMax.y);
+		CHECK_NEAR(body.minHeight, minHeight, 0.0f);
+		regionCount++;
+	}
+
+	// one body per region, and the dry land is not labelled
+	CHECK(mismatches == 0);
+	CHECK((int)maps.bodies.size() == regionCount);
+	CHECK(WaterBodies::Count(maps, kSea) + WaterBodies::Count(maps, kLake) == regionCount);
+	int dryLabelled = 0;
+	for (int point = 0; point < rows * columns; point++)
+	{
+		if (region[point] < 0 && maps.label[point] != WaterBodies::kDryLand)
+		{
+			dryLabelled++;
+		}
+	}
+	CHECK(dryLabelled == 0);
+}